@@ -0,0 +1,207 @@
+#include "ExportIndex.h"
+#include "ProcessMemory.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+namespace blackbone
+{
+
+ExportIndex::ExportIndex()
+{
+}
+
+ExportIndex::~ExportIndex()
+{
+}
+
+/// <summary>
+/// Read export table of the module
+/// </summary>
+/// <param name="memory">Target process memory</param>
+/// <param name="mod">Module</param>
+/// <returns>Status code</returns>
+NTSTATUS ExportIndex::Build( ProcessMemory& memory, const ModuleData& mod )
+{
+    IMAGE_DOS_HEADER hdrDos = { 0 };
+    uint8_t hdrNt32[sizeof(IMAGE_NT_HEADERS64)] = { 0 };
+    auto phdrNt32 = reinterpret_cast<PIMAGE_NT_HEADERS32>(hdrNt32);
+    auto phdrNt64 = reinterpret_cast<PIMAGE_NT_HEADERS64>(hdrNt32);
+    IMAGE_DATA_DIRECTORY expDir = { 0 };
+
+    _base = mod.baseAddress;
+    _size = mod.size;
+    _type = mod.type;
+
+    NTSTATUS status = memory.Read( _base, sizeof(hdrDos), &hdrDos );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    if (hdrDos.e_magic != IMAGE_DOS_SIGNATURE)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    status = memory.Read( _base + hdrDos.e_lfanew, sizeof(hdrNt32), hdrNt32 );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    if (phdrNt32->Signature != IMAGE_NT_SIGNATURE)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    if (phdrNt32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+    {
+        _imageType = mt_mod32;
+        expDir = phdrNt32->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    }
+    else
+    {
+        _imageType = mt_mod64;
+        expDir = phdrNt64->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    }
+
+    // No exports
+    if (expDir.VirtualAddress == 0 || expDir.Size < sizeof(IMAGE_EXPORT_DIRECTORY))
+        return STATUS_SUCCESS;
+
+    std::vector<uint8_t> dir( expDir.Size );
+    status = memory.Read( _base + expDir.VirtualAddress, dir.size(), dir.data() );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    auto pExpData = reinterpret_cast<const IMAGE_EXPORT_DIRECTORY*>(dir.data());
+    if (pExpData->NumberOfFunctions > 0x10000 || pExpData->NumberOfNames > 0x10000)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    auto inDir = [&expDir]( DWORD rva, size_t size )
+    {
+        return rva >= expDir.VirtualAddress && rva - expDir.VirtualAddress + size <= expDir.Size;
+    };
+
+    // Tables are normally located inside export directory
+    auto readTable = [&]( DWORD rva, size_t size, void* dst ) -> NTSTATUS
+    {
+        if (size == 0)
+            return STATUS_SUCCESS;
+
+        if (!inDir( rva, size ))
+            return memory.Read( _base + rva, size, dst );
+
+        memcpy( dst, dir.data() + rva - expDir.VirtualAddress, size );
+        return STATUS_SUCCESS;
+    };
+
+    std::vector<DWORD> funcs( pExpData->NumberOfFunctions );
+    std::vector<DWORD> names( pExpData->NumberOfNames );
+    std::vector<WORD>  ords( pExpData->NumberOfNames );
+
+    if (!NT_SUCCESS( status = readTable( pExpData->AddressOfFunctions, funcs.size() * sizeof(DWORD), funcs.data() ) ) ||
+        !NT_SUCCESS( status = readTable( pExpData->AddressOfNames, names.size() * sizeof(DWORD), names.data() ) ) ||
+        !NT_SUCCESS( status = readTable( pExpData->AddressOfNameOrdinals, ords.size() * sizeof(WORD), ords.data() ) ))
+    {
+        return status;
+    }
+
+    _ordinalBase = pExpData->Base;
+    _functions.resize( funcs.size() );
+
+    for (size_t i = 0; i < funcs.size(); i++)
+    {
+        _functions[i].rva = funcs[i];
+
+        // Forwarded export points to 'module.function' string inside export directory
+        if (funcs[i] != 0 && inDir( funcs[i], 1 ))
+        {
+            const char* pStr = reinterpret_cast<const char*>(dir.data() + funcs[i] - expDir.VirtualAddress);
+            std::string chainExp( pStr, strnlen( pStr, expDir.VirtualAddress + expDir.Size - funcs[i] ) );
+
+            Forward fwd;
+            std::string strName = chainExp.substr( chainExp.find( "." ) + 1, std::string::npos );
+
+            fwd.module = Utils::AnsiToWstring( chainExp.substr( 0, chainExp.find( "." ) ) + ".dll" );
+            fwd.byOrdinal = (strName.find( "#" ) == 0);
+
+            if (fwd.byOrdinal)
+                fwd.ordinal = static_cast<WORD>(atoi( strName.c_str() + 1 ));
+            else
+                fwd.name = strName;
+
+            _functions[i].forward = static_cast<int32_t>(_forwards.size());
+            _forwards.emplace_back( fwd );
+        }
+    }
+
+    for (size_t i = 0; i < names.size(); i++)
+    {
+        if (ords[i] >= funcs.size())
+            continue;
+
+        Name name = { static_cast<uint32_t>(_namePool.size()), ords[i] };
+
+        if (inDir( names[i], 1 ))
+        {
+            const char* pName = reinterpret_cast<const char*>(dir.data() + names[i] - expDir.VirtualAddress);
+            _namePool.insert( _namePool.end(), pName, pName + strnlen( pName, expDir.VirtualAddress + expDir.Size - names[i] ) );
+        }
+        else
+        {
+            char buf[256] = { 0 };
+            if (!NT_SUCCESS( memory.Read( _base + names[i], sizeof(buf) - 1, buf ) ))
+                continue;
+
+            _namePool.insert( _namePool.end(), buf, buf + strlen( buf ) );
+        }
+
+        _namePool.emplace_back( '\0' );
+        _names.emplace_back( name );
+    }
+
+    std::sort( _names.begin(), _names.end(), [this]( const Name& l, const Name& r )
+    {
+        return strcmp( &_namePool[l.offset], &_namePool[r.offset] ) < 0;
+    } );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Find export by name
+/// </summary>
+/// <param name="name">Function name</param>
+/// <returns>Export entry, nullptr if not found</returns>
+const ExportIndex::Entry* ExportIndex::Find( const char* name ) const
+{
+    size_t lo = 0, hi = _names.size();
+
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp( &_namePool[_names[mid].offset], name );
+
+        if (cmp == 0)
+        {
+            auto& entry = _functions[_names[mid].index];
+            return entry.rva != 0 ? &entry : nullptr;
+        }
+        else if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return nullptr;
+}
+
+/// <summary>
+/// Find export by ordinal
+/// </summary>
+/// <param name="ordinal">Function ordinal, including ordinal base</param>
+/// <returns>Export entry, nullptr if not found</returns>
+const ExportIndex::Entry* ExportIndex::Find( WORD ordinal ) const
+{
+    if (ordinal < _ordinalBase || ordinal - _ordinalBase >= _functions.size())
+        return nullptr;
+
+    auto& entry = _functions[ordinal - _ordinalBase];
+    return entry.rva != 0 ? &entry : nullptr;
+}
+
+}
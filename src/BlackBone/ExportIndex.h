@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+
+#include <string>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Immutable export table of a loaded module.
+/// Export directory is read from target once, names are sorted for binary search,
+/// ordinals are looked up directly and forwarders are parsed in advance.
+/// </summary>
+class ExportIndex
+{
+public:
+    // Exported function
+    struct Entry
+    {
+        uint32_t rva = 0;           // Function RVA
+        int32_t forward = -1;       // Index of forwarder, -1 if export isn't forwarded
+    };
+
+    // Parsed forwarder string, e.g. "NTDLL.RtlAllocateHeap" or "NTDLL.#12"
+    struct Forward
+    {
+        std::wstring module;        // Forward module name, with .dll extension
+        std::string name;           // Forwarded function name
+        WORD ordinal = 0;           // Forwarded function ordinal
+        bool byOrdinal = false;     // Forward is done by ordinal
+    };
+
+public:
+    ExportIndex();
+    ~ExportIndex();
+
+    /// <summary>
+    /// Read export table of the module
+    /// </summary>
+    /// <param name="memory">Target process memory</param>
+    /// <param name="mod">Module</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Build( class ProcessMemory& memory, const ModuleData& mod );
+
+    /// <summary>
+    /// Find export by name
+    /// </summary>
+    /// <param name="name">Function name</param>
+    /// <returns>Export entry, nullptr if not found</returns>
+    const Entry* Find( const char* name ) const;
+
+    /// <summary>
+    /// Find export by ordinal
+    /// </summary>
+    /// <param name="ordinal">Function ordinal, including ordinal base</param>
+    /// <returns>Export entry, nullptr if not found</returns>
+    const Entry* Find( WORD ordinal ) const;
+
+    /// <summary>
+    /// Get forwarder of export
+    /// </summary>
+    /// <param name="entry">Forwarded export</param>
+    /// <returns>Forwarder info</returns>
+    inline const Forward& forward( const Entry& entry ) const { return _forwards[entry.forward]; }
+
+    /// <summary>
+    /// Check if index was built for this module
+    /// </summary>
+    /// <param name="mod">Module</param>
+    /// <returns>true if index is still valid for module</returns>
+    inline bool valid( const ModuleData& mod ) const
+    {
+        return _base == mod.baseAddress && _size == mod.size && _type == mod.type;
+    }
+
+    inline eModType imageType() const { return _imageType; }
+    inline size_t size() const { return _functions.size(); }
+
+private:
+    // Export name
+    struct Name
+    {
+        uint32_t offset;            // Offset in name pool
+        WORD index;                 // Function index
+    };
+
+    ptr_t _base = 0;                // Module base
+    size_t _size = 0;               // Module size
+    eModType _type = mt_default;    // Module type
+    eModType _imageType = mt_mod32; // Image bitness from PE header
+    DWORD _ordinalBase = 0;         // Ordinal of the first function
+
+    std::vector<Entry> _functions;  // Functions, indexed by ordinal - ordinal base
+    std::vector<Name> _names;       // Names, sorted
+    std::vector<char> _namePool;    // Null-terminated names
+    std::vector<Forward> _forwards; // Forwarders
+};
+
+}
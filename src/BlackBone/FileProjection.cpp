@@ -1,5 +1,17 @@
 #include "FileProjection.h"
 
+#ifndef _WIN32
+#include "PEView.h"
+#include "Macro.h"
+#include "Utils.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 namespace blackbone
 {
 
@@ -28,25 +40,8 @@ void* FileProjection::Project( const std::wstring& path )
 {
     Release();
 
-    // Prepare activation context
-    ACTCTX act = { 0 };
-    act.cbSize = sizeof(act);
-    act.dwFlags = ACTCTX_FLAG_RESOURCE_NAME_VALID;
-    act.lpSource = path.c_str();
-    act.lpResourceName = MAKEINTRESOURCEW( 2 );
-
-    _hctx = CreateActCtx( &act );
-
-    // Retry with another resource id
-    if (_hctx == INVALID_HANDLE_VALUE)
-    {
-        act.lpResourceName = MAKEINTRESOURCEW( 1 );
-
-        if ((_hctx = CreateActCtx( &act )) != INVALID_HANDLE_VALUE)
-            _manifestIdx = 1;
-    }
-    else
-        _manifestIdx = 2;
+#ifdef _WIN32
+    PrepareActx( path );
 
     _hFile = CreateFileW( path.c_str(), FILE_GENERIC_READ, 
                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
@@ -60,6 +55,14 @@ void* FileProjection::Project( const std::wstring& path )
         if (_hMapping && _hMapping != INVALID_HANDLE_VALUE)
         {
             _pData = MapViewOfFile( _hMapping, FILE_MAP_READ, 0, 0, 0 );
+
+            // Headers were validated by loader, SizeOfImage is at the same offset for PE32 and PE32+
+            if (_pData)
+            {
+                auto pDosHdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(_pData);
+                auto pNtHdr = reinterpret_cast<const IMAGE_NT_HEADERS32*>(reinterpret_cast<const uint8_t*>(_pData) + pDosHdr->e_lfanew);
+                _size = pNtHdr->OptionalHeader.SizeOfImage;
+            }
         }
         // Map as simple datafile
         else
@@ -67,19 +70,176 @@ void* FileProjection::Project( const std::wstring& path )
             _plainData = true;
             _hMapping  = CreateFileMappingW( _hFile, NULL, PAGE_READONLY, 0, 0, NULL );
 
-            if (_hMapping && _hMapping != INVALID_HANDLE_VALUE)
+            LARGE_INTEGER fileSize = { 0 };
+            if (_hMapping && _hMapping != INVALID_HANDLE_VALUE && GetFileSizeEx( _hFile, &fileSize ))
+            {
                 _pData = MapViewOfFile( _hMapping, FILE_MAP_READ, 0, 0, 0 );
+                _size = static_cast<size_t>(fileSize.QuadPart);
+            }
         }
     }
+#else
+    _fd = open( Utils::WstringToUTF8( path ).c_str(), O_RDONLY | O_CLOEXEC );
+
+    struct stat st = { 0 };
+    if (_fd < 0 || fstat( _fd, &st ) != 0 || st.st_size <= 0)
+    {
+        Release();
+        return nullptr;
+    }
+
+    _fileSize = static_cast<size_t>(st.st_size);
+    _pFile = mmap( nullptr, _fileSize, PROT_READ, MAP_PRIVATE, _fd, 0 );
+    if (_pFile == MAP_FAILED)
+    {
+        _pFile = nullptr;
+        Release();
+        return nullptr;
+    }
+
+    // Same fallback as SEC_IMAGE failure - expose raw file
+    if (LayoutImage())
+    {
+        _pData = _pImage;
+        _size = _imageSize;
+    }
+    else
+    {
+        _plainData = true;
+        _pData = _pFile;
+        _size = _fileSize;
+    }
+#endif
 
     return _pData;
 }
 
+#ifndef _WIN32
+/// <summary>
+/// Place headers and sections of mapped file at their RVAs.
+/// Whole pages of page-aligned sections are mapped directly from file,
+/// the rest is copied. Uninitialized data is backed by anonymous zero pages
+/// </summary>
+/// <returns>true on success, false if file isn't a valid image</returns>
+bool FileProjection::LayoutImage()
+{
+    pe::PEView view;
+    if (view.Attach( _pFile, _fileSize ) != STATUS_SUCCESS || view.imageSize() == 0)
+        return false;
+
+    const size_t page = static_cast<size_t>(sysconf( _SC_PAGESIZE ));
+    _imageSize = Align( view.imageSize(), page );
+
+    _pImage = mmap( nullptr, _imageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if (_pImage == MAP_FAILED)
+    {
+        _pImage = nullptr;
+        return false;
+    }
+
+    auto pImage = reinterpret_cast<uint8_t*>(_pImage);
+    auto pFile = reinterpret_cast<const uint8_t*>(_pFile);
+
+    size_t hdrSize = std::min<size_t>( std::min<size_t>( view.headersSize(), _fileSize ), _imageSize );
+    memcpy( pImage, pFile, hdrSize );
+
+    // Sections must be sorted and must not overlap, like loader requires
+    bool valid = true;
+    size_t prevEnd = hdrSize;
+    for (auto& secRef : view.sections())
+    {
+        IMAGE_SECTION_HEADER sec;
+        memcpy( &sec, &secRef, sizeof(sec) );
+
+        size_t rva = sec.VirtualAddress;
+        size_t raw = sec.PointerToRawData;
+        size_t size = sec.SizeOfRawData;
+        if (sec.Misc.VirtualSize != 0)
+            size = std::min<size_t>( size, sec.Misc.VirtualSize );
+
+        if (rva < prevEnd || rva >= _imageSize)
+        {
+            valid = false;
+            break;
+        }
+
+        prevEnd = rva + std::max<size_t>( sec.Misc.VirtualSize, sec.SizeOfRawData );
+
+        if (size == 0 || raw >= _fileSize)
+            continue;
+
+        size = std::min<size_t>( std::min<size_t>( size, _fileSize - raw ), _imageSize - rva );
+
+        // Remap whole pages, no copy
+        size_t mapped = 0;
+        if (rva % page == 0 && raw % page == 0 && size >= page)
+        {
+            size_t length = size - size % page;
+            if (mmap( pImage + rva, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, _fd, raw ) != MAP_FAILED)
+                mapped = length;
+        }
+
+        memcpy( pImage + rva + mapped, pFile + raw + mapped, size - mapped );
+    }
+
+    if (!valid || mprotect( _pImage, _imageSize, PROT_READ ) != 0)
+    {
+        munmap( _pImage, _imageSize );
+        _pImage = nullptr;
+        _imageSize = 0;
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+/// <summary>
+/// Create activation context from image manifest, without mapping the file
+/// </summary>
+/// <param name="path">Image path</param>
+/// <returns>Activation context handle, INVALID_HANDLE_VALUE if image has no manifest</returns>
+#ifdef _WIN32
+HANDLE FileProjection::PrepareActx( const std::wstring& path )
+{
+    if (_hctx != INVALID_HANDLE_VALUE)
+    {
+        ReleaseActCtx( _hctx );
+        _hctx = INVALID_HANDLE_VALUE;
+    }
+
+    _manifestIdx = 0;
+
+    // Prepare activation context
+    ACTCTX act = { 0 };
+    act.cbSize = sizeof(act);
+    act.dwFlags = ACTCTX_FLAG_RESOURCE_NAME_VALID;
+    act.lpSource = path.c_str();
+    act.lpResourceName = MAKEINTRESOURCEW( 2 );
+
+    _hctx = CreateActCtx( &act );
+
+    // Retry with another resource id
+    if (_hctx == INVALID_HANDLE_VALUE)
+    {
+        act.lpResourceName = MAKEINTRESOURCEW( 1 );
+
+        if ((_hctx = CreateActCtx( &act )) != INVALID_HANDLE_VALUE)
+            _manifestIdx = 1;
+    }
+    else
+        _manifestIdx = 2;
+
+    return _hctx;
+}
+#endif
+
 /// <summary>
 /// Release mapping, if any
 /// </summary>
 void FileProjection::Release()
 {
+#ifdef _WIN32
     if (_hctx != INVALID_HANDLE_VALUE)
     {
         ReleaseActCtx( _hctx );
@@ -103,6 +263,32 @@ void FileProjection::Release()
         CloseHandle( _hFile );
         _hFile = INVALID_HANDLE_VALUE;
     }
+#else
+    if (_pImage)
+    {
+        munmap( _pImage, _imageSize );
+        _pImage = nullptr;
+        _imageSize = 0;
+    }
+
+    if (_pFile)
+    {
+        munmap( _pFile, _fileSize );
+        _pFile = nullptr;
+        _fileSize = 0;
+    }
+
+    if (_fd >= 0)
+    {
+        close( _fd );
+        _fd = -1;
+    }
+
+    _pData = nullptr;
+#endif
+
+    _size = 0;
+    _plainData = false;
 }
 
 };
\ No newline at end of file
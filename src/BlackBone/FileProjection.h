@@ -7,7 +7,9 @@ namespace blackbone
 {
 
 /// <summary>
-/// Load file as PE image
+/// Load file as PE image.
+/// On Windows image layout is provided by SEC_IMAGE section, elsewhere
+/// sections are placed at their RVAs in software on top of read-only file mapping
 /// </summary>
 class FileProjection
 {
@@ -23,6 +25,15 @@ public:
     /// <returns>File address in memory, nullptr if failed</returns>
     void* Project( const std::wstring& path );
 
+#ifdef _WIN32
+    /// <summary>
+    /// Create activation context from image manifest, without mapping the file
+    /// </summary>
+    /// <param name="path">Image path</param>
+    /// <returns>Activation context handle, INVALID_HANDLE_VALUE if image has no manifest</returns>
+    HANDLE PrepareActx( const std::wstring& path );
+#endif
+
     /// <summary>
     /// Release mapping, if any
     /// </summary>
@@ -34,11 +45,19 @@ public:
     /// <returns></returns>
     inline void* base() const { return _pData; }
 
+    /// <summary>
+    /// Size of mapped view, image size if file is mapped as image
+    /// </summary>
+    /// <returns></returns>
+    inline size_t size() const { return _size; }
+
+#ifdef _WIN32
     /// <summary>
     /// Get activation context handle
     /// </summary>
     /// <returns></returns>
     inline HANDLE actx() const { return _hctx; }
+#endif
 
     /// <summary>
     /// true if image is mapped as plain data file
@@ -59,11 +78,29 @@ public:
     inline operator void*() const { return _pData; }
 
 private:
+#ifndef _WIN32
+    /// <summary>
+    /// Place headers and sections of mapped file at their RVAs
+    /// </summary>
+    /// <returns>true on success, false if file isn't a valid image</returns>
+    bool LayoutImage();
+#endif
+
+private:
+#ifdef _WIN32
     HANDLE  _hFile = INVALID_HANDLE_VALUE;  // Target file HANDLE
     HANDLE  _hMapping = NULL;               // Memory mapping object
+    HANDLE  _hctx = INVALID_HANDLE_VALUE;   // Activation context
+#else
+    int     _fd = -1;                       // Target file descriptor
+    void*   _pFile = nullptr;               // Read-only file mapping
+    size_t  _fileSize = 0;                  // Size of file mapping
+    void*   _pImage = nullptr;              // Software image layout
+    size_t  _imageSize = 0;                 // Size of image layout
+#endif
     void*   _pData = nullptr;               // Mapping base
+    size_t  _size = 0;                      // Mapping size
     bool    _plainData = false;             // File mapped as plain data file
-    HANDLE  _hctx = INVALID_HANDLE_VALUE;   // Activation context
     int     _manifestIdx = 0;               // Manifest resource ID
 };
 
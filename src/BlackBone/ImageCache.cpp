@@ -0,0 +1,600 @@
+#include "ImageCache.h"
+#include "Macro.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <cstddef>
+#include <cstring>
+
+namespace blackbone
+{
+
+namespace
+{
+
+const uint32_t CacheMagic   = 0x43494242;   // 'BBIC'
+const uint32_t CacheVersion = 3;
+
+// Image file is hashed by blocks of this size
+const size_t HashBlockSize = 1024 * 1024;
+
+// FNV-1a offset basis
+const uint64_t HashBasis = 0xCBF29CE484222325ull;
+
+// Cache entry flags
+const uint32_t CacheRelocatable = 0x01;     // Image has relocation directory
+
+// Table location inside cache file
+struct CacheTable
+{
+    uint32_t offset;        // Offset from file start
+    uint32_t count;         // Number of records
+};
+
+// Cache file header
+struct CacheHeader
+{
+    uint32_t magic;         // CacheMagic
+    uint32_t version;       // CacheVersion
+    uint64_t fileSize;      // Image file size
+    uint64_t fileTime;      // Image file last write time
+    uint64_t fileHash;      // Image file content hash
+    uint32_t flags;         // Entry flags
+    uint32_t checksum;      // Image header checksum
+    CacheTable path;        // Lower case image path, UTF-8
+    CacheTable layout;      // Image layout, bytes
+    CacheTable regions;     // CacheRegion records
+    CacheTable relocs;      // pe::RelocationPlan::Record records
+    CacheTable imports;     // CacheImport records
+    CacheTable tls;         // TLS callback RVAs
+    CacheTable strings;     // Null-terminated UTF-8 import names
+};
+
+// Part of layout to write into target
+struct CacheRegion
+{
+    uint32_t offset;        // Offset in layout
+    uint32_t size;          // Region size
+};
+
+// Imported function
+struct CacheImport
+{
+    uint32_t module;        // Module name offset in string table
+    uint32_t name;          // Function name offset in string table
+    uint32_t ptrRVA;        // IAT slot RVA
+    uint16_t ordinal;       // Function ordinal
+    uint8_t  byOrdinal;     // Function is imported by ordinal
+    uint8_t  delayed;       // Delayed import
+};
+
+// Image file identity
+struct FileKey
+{
+    uint64_t size = 0;
+    uint64_t time = 0;
+    uint64_t hash = 0;
+    uint32_t checksum = 0;
+};
+
+// Content hash of file version seen by this process.
+// Change time and file ID can't be restored by copying tools, unlike last write time
+struct HashMemo
+{
+    uint64_t size;
+    uint64_t time;
+    uint64_t change;
+    uint64_t id;
+    uint64_t hash;
+    uint32_t checksum;
+};
+
+std::mutex g_memoGuard;                                 // Guards g_memo
+std::unordered_map<std::wstring, HashMemo> g_memo;      // Hashes by lower case path
+
+/// <summary>
+/// FNV-1a hash
+/// </summary>
+/// <param name="data">Data</param>
+/// <param name="size">Data size</param>
+/// <param name="hash">Hash of preceding data</param>
+/// <returns>Hash value</returns>
+uint64_t Hash( const void* data, size_t size, uint64_t hash = HashBasis )
+{
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(data);
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= ptr[i];
+        hash *= 0x100000001B3ull;
+    }
+
+    return hash;
+}
+
+/// <summary>
+/// Read part of file
+/// </summary>
+/// <param name="file">Opened file</param>
+/// <param name="offset">Offset from file start</param>
+/// <param name="size">Number of bytes to read</param>
+/// <param name="data">Read bytes</param>
+/// <returns>true on success</returns>
+bool ReadRange( std::ifstream& file, uint64_t offset, size_t size, std::vector<uint8_t>& data )
+{
+    data.resize( size );
+    if (size == 0)
+        return true;
+
+    file.seekg( static_cast<std::streamoff>(offset), std::ios::beg );
+    return file.read( reinterpret_cast<char*>(data.data()), size ).good();
+}
+
+/// <summary>
+/// Get image checksum from the start of file
+/// </summary>
+/// <param name="data">File data</param>
+/// <param name="size">Data size</param>
+/// <param name="checksum">Header checksum</param>
+/// <returns>true if data starts with PE headers</returns>
+bool GetChecksum( const uint8_t* data, size_t size, uint32_t& checksum )
+{
+    // CheckSum is at the same offset for PE32 and PE32+
+    const size_t checksumOfst = offsetof( IMAGE_NT_HEADERS32, OptionalHeader.CheckSum );
+    IMAGE_DOS_HEADER hdrDos = { 0 };
+
+    if (size < sizeof(hdrDos))
+        return false;
+
+    memcpy( &hdrDos, data, sizeof(hdrDos) );
+    if (hdrDos.e_magic != IMAGE_DOS_SIGNATURE || hdrDos.e_lfanew < 0 ||
+         size - sizeof(checksum) < static_cast<size_t>(hdrDos.e_lfanew) + checksumOfst)
+    {
+        return false;
+    }
+
+    memcpy( &checksum, data + hdrDos.e_lfanew + checksumOfst, sizeof(checksum) );
+    return true;
+}
+
+/// <summary>
+/// Get image file identity.
+/// Whole file is hashed once per process for each version of the file
+/// </summary>
+/// <param name="path">Image path</param>
+/// <param name="key">File identity</param>
+/// <returns>Status code</returns>
+NTSTATUS GetFileKey( const std::wstring& path, FileKey& key )
+{
+    HANDLE hFile = CreateFileW( path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+
+    if (hFile == INVALID_HANDLE_VALUE)
+        return LastNtStatus();
+
+    BY_HANDLE_FILE_INFORMATION info = { 0 };
+    FILE_BASIC_INFO basic = { 0 };
+
+    if (!GetFileInformationByHandle( hFile, &info ) || !GetFileInformationByHandleEx( hFile, FileBasicInfo, &basic, sizeof(basic) ))
+    {
+        NTSTATUS status = LastNtStatus();
+        CloseHandle( hFile );
+        return status;
+    }
+
+    HashMemo memo = { 0 };
+    memo.size   = (static_cast<uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    memo.time   = (static_cast<uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+    memo.change = static_cast<uint64_t>(basic.ChangeTime.QuadPart);
+    memo.id     = (static_cast<uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+
+    key.size = memo.size;
+    key.time = memo.time;
+
+    auto lowerPath = Utils::ToLower( path );
+
+    // Same file version was already hashed
+    {
+        std::lock_guard<std::mutex> lg( g_memoGuard );
+
+        auto iter = g_memo.find( lowerPath );
+        if (iter != g_memo.end() && iter->second.size == memo.size && iter->second.time == memo.time &&
+             iter->second.change == memo.change && iter->second.id == memo.id)
+        {
+            key.hash = iter->second.hash;
+            key.checksum = iter->second.checksum;
+
+            CloseHandle( hFile );
+            return STATUS_SUCCESS;
+        }
+    }
+
+    std::vector<uint8_t> buf( HashBlockSize );
+    uint64_t total = 0;
+    bool valid = true;
+
+    memo.hash = HashBasis;
+
+    for (DWORD bytes = 0; ReadFile( hFile, buf.data(), static_cast<DWORD>(buf.size()), &bytes, NULL ) && bytes != 0; total += bytes)
+    {
+        if (total == 0)
+            valid = GetChecksum( buf.data(), bytes, memo.checksum );
+
+        memo.hash = Hash( buf.data(), bytes, memo.hash );
+    }
+
+    CloseHandle( hFile );
+
+    if (!valid)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    // File was modified while it was hashed
+    if (total != memo.size)
+        return STATUS_NOT_FOUND;
+
+    key.hash = memo.hash;
+    key.checksum = memo.checksum;
+
+    {
+        std::lock_guard<std::mutex> lg( g_memoGuard );
+        g_memo[lowerPath] = memo;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Check that layout starts with headers of an image of the same size
+/// </summary>
+/// <param name="layout">Image layout</param>
+/// <param name="size">Layout size</param>
+/// <returns>true if layout is valid</returns>
+bool ValidLayout( const uint8_t* layout, size_t size )
+{
+    IMAGE_DOS_HEADER hdrDos = { 0 };
+    IMAGE_NT_HEADERS64 hdrNt64 = { 0 };
+    auto phdrNt32 = reinterpret_cast<const IMAGE_NT_HEADERS32*>(&hdrNt64);
+
+    if (size < sizeof(hdrDos) + sizeof(hdrNt64))
+        return false;
+
+    memcpy( &hdrDos, layout, sizeof(hdrDos) );
+    if (hdrDos.e_magic != IMAGE_DOS_SIGNATURE || hdrDos.e_lfanew < 0 || size - sizeof(hdrNt64) < static_cast<size_t>(hdrDos.e_lfanew))
+        return false;
+
+    memcpy( &hdrNt64, layout + hdrDos.e_lfanew, sizeof(hdrNt64) );
+    if (hdrNt64.Signature != IMAGE_NT_SIGNATURE)
+        return false;
+
+    size_t sections = hdrDos.e_lfanew + hdrNt64.FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER);
+
+    if (hdrNt64.OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+        return hdrNt64.OptionalHeader.SizeOfImage == size && sections + sizeof(IMAGE_NT_HEADERS64) <= size;
+    else
+        return phdrNt32->OptionalHeader.SizeOfImage == size && sections + sizeof(IMAGE_NT_HEADERS32) <= size;
+}
+
+}
+
+CachedImage::CachedImage()
+{
+}
+
+CachedImage::~CachedImage()
+{
+}
+
+ImageCache::ImageCache()
+{
+}
+
+ImageCache::~ImageCache()
+{
+}
+
+/// <summary>
+/// Set folder for cache files
+/// </summary>
+/// <param name="dir">Cache folder, empty string disables cache</param>
+void ImageCache::SetDirectory( const std::wstring& dir )
+{
+    _dir = dir;
+
+    while (!_dir.empty() && (_dir.back() == L'\\' || _dir.back() == L'/'))
+        _dir.pop_back();
+
+    if (!_dir.empty())
+        CreateDirectoryW( _dir.c_str(), NULL );
+}
+
+/// <summary>
+/// Load prepared image for file
+/// </summary>
+/// <param name="path">Image path</param>
+/// <returns>Cached image, nullptr if there is no valid entry for file</returns>
+std::shared_ptr<const CachedImage> ImageCache::Lookup( const std::wstring& path ) const
+{
+    if (!enabled())
+        return nullptr;
+
+    std::ifstream file( EntryPath( path ).c_str(), std::ios::binary );
+    if (!file)
+        return nullptr;
+
+    file.seekg( 0, std::ios::end );
+    std::streamoff fileSize = file.tellg();
+
+    std::vector<uint8_t> buf;
+    if (fileSize < static_cast<std::streamoff>(sizeof(CacheHeader)) || !ReadRange( file, 0, sizeof(CacheHeader), buf ))
+        return nullptr;
+
+    CacheHeader hdr;
+    memcpy( &hdr, buf.data(), sizeof(hdr) );
+
+    if (hdr.magic != CacheMagic || hdr.version != CacheVersion)
+        return nullptr;
+
+    // Only tables are read, entry file is never read as a whole
+    auto table = [&file, fileSize]( const CacheTable& tbl, size_t recSize, std::vector<uint8_t>& out ) -> bool
+    {
+        if (static_cast<uint64_t>(tbl.offset) + static_cast<uint64_t>(tbl.count) * recSize > static_cast<uint64_t>(fileSize))
+            return false;
+
+        return ReadRange( file, tbl.offset, tbl.count * recSize, out );
+    };
+
+    // Entry belongs to another file
+    auto strPath = Utils::WstringToUTF8( Utils::ToLower( path ) );
+    if (strPath.size() != hdr.path.count || !table( hdr.path, sizeof(char), buf ) || memcmp( strPath.data(), buf.data(), strPath.size() ) != 0)
+        return nullptr;
+
+    // File was changed since entry was created
+    FileKey key;
+    if (!NT_SUCCESS( GetFileKey( path, key ) ) || key.size != hdr.fileSize || key.time != hdr.fileTime ||
+         key.hash != hdr.fileHash || key.checksum != hdr.checksum)
+    {
+        return nullptr;
+    }
+
+    std::shared_ptr<CachedImage> image( new CachedImage() );
+    std::vector<uint8_t> regions, relocs, imports, tls, strings;
+
+    if (!table( hdr.regions, sizeof(CacheRegion), regions ) ||
+         !table( hdr.relocs, sizeof(pe::RelocationPlan::Record), relocs ) ||
+         !table( hdr.imports, sizeof(CacheImport), imports ) ||
+         !table( hdr.tls, sizeof(uint32_t), tls ) ||
+         !table( hdr.strings, sizeof(char), strings ) ||
+         hdr.layout.count == 0 || !table( hdr.layout, sizeof(uint8_t), image->_data ))
+    {
+        return nullptr;
+    }
+
+    auto pLayout  = image->_data.data();
+    auto pRegions = regions.data();
+    auto pTls     = tls.data();
+    auto pImports = imports.data();
+    auto pStrings = strings.data();
+
+    if (!ValidLayout( pLayout, hdr.layout.count ))
+        return nullptr;
+
+    image->_layout = pLayout;
+    image->_layoutSize = hdr.layout.count;
+    image->_relocatable = (hdr.flags & CacheRelocatable) != 0;
+
+    for (uint32_t i = 0; i < hdr.regions.count; i++)
+    {
+        CacheRegion region;
+        memcpy( &region, pRegions + i * sizeof(region), sizeof(region) );
+
+        if (region.offset > image->_layoutSize || image->_layoutSize - region.offset < region.size)
+            return nullptr;
+
+        image->_regions.emplace_back( region.offset, region.size );
+    }
+
+    std::vector<pe::RelocationPlan::Record> records( hdr.relocs.count );
+    if (!records.empty())
+        memcpy( records.data(), relocs.data(), records.size() * sizeof(records[0]) );
+
+    if (!NT_SUCCESS( image->_relocs.Assign( records ) ))
+        return nullptr;
+
+    for (uint32_t i = 0; i < hdr.tls.count; i++)
+    {
+        uint32_t rva = 0;
+        memcpy( &rva, pTls + i * sizeof(rva), sizeof(rva) );
+
+        if (rva >= image->_layoutSize)
+            return nullptr;
+
+        image->_tlsCallbacks.emplace_back( rva );
+    }
+
+    // String must be null-terminated inside string table
+    auto getString = [pStrings, &hdr]( uint32_t offset ) -> const char*
+    {
+        if (offset >= hdr.strings.count || memchr( pStrings + offset, 0, hdr.strings.count - offset ) == nullptr)
+            return nullptr;
+
+        return reinterpret_cast<const char*>(pStrings + offset);
+    };
+
+    for (uint32_t i = 0; i < hdr.imports.count; i++)
+    {
+        CacheImport rec;
+        memcpy( &rec, pImports + i * sizeof(rec), sizeof(rec) );
+
+        const char* modName = getString( rec.module );
+        const char* fnName = rec.byOrdinal ? "" : getString( rec.name );
+        if (modName == nullptr || fnName == nullptr)
+            return nullptr;
+
+        pe::ImportData data;
+        data.importName = fnName;
+        data.ptrRVA = rec.ptrRVA;
+        data.importOrdinal = rec.ordinal;
+        data.importByOrd = rec.byOrdinal != 0;
+
+        auto& imports = rec.delayed ? image->_delayImports : image->_imports;
+        imports[Utils::UTF8ToWstring( modName )].emplace_back( data );
+    }
+
+    return image;
+}
+
+/// <summary>
+/// Save prepared image for file
+/// </summary>
+/// <param name="path">Image path</param>
+/// <param name="image">Image parsed from file</param>
+/// <param name="layout">Image laid out by RVA, not relocated</param>
+/// <param name="regions">Parts of layout that must be written into target</param>
+/// <returns>Status code</returns>
+NTSTATUS ImageCache::Store( const std::wstring& path, pe::PEParser& image, const std::vector<uint8_t>& layout, const vecRegions& regions ) const
+{
+    if (!enabled() || layout.empty() || layout.size() > 0xFFFFFFFF)
+        return STATUS_INVALID_PARAMETER;
+
+    CacheHeader hdr = { 0 };
+    FileKey key;
+
+    NTSTATUS status = GetFileKey( path, key );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    hdr.magic = CacheMagic;
+    hdr.version = CacheVersion;
+    hdr.fileSize = key.size;
+    hdr.fileTime = key.time;
+    hdr.fileHash = key.hash;
+    hdr.checksum = key.checksum;
+
+    // Relocations
+    pe::RelocationPlan plan;
+    status = plan.Build( image );
+    if (NT_SUCCESS( status ))
+        hdr.flags |= CacheRelocatable;
+    else if (status != STATUS_NOT_FOUND)
+        return status;
+
+    // TLS callbacks
+    std::vector<ptr_t> callbacks;
+    std::vector<uint32_t> tls;
+
+    image.GetTLSCallbacks( image.imageBase(), callbacks );
+    for (auto& callback : callbacks)
+    {
+        if (callback >= image.imageBase() && callback - image.imageBase() < layout.size())
+            tls.emplace_back( static_cast<uint32_t>(callback - image.imageBase()) );
+    }
+
+    // Import names are stored once per module
+    std::vector<CacheImport> imports;
+    std::vector<char> strings;
+
+    auto addString = [&strings]( const std::string& str ) -> uint32_t
+    {
+        uint32_t offset = static_cast<uint32_t>(strings.size());
+        strings.insert( strings.end(), str.begin(), str.end() );
+        strings.emplace_back( '\0' );
+        return offset;
+    };
+
+    for (int delayed = 0; delayed < 2; delayed++)
+    {
+        for (auto& importMod : image.ProcessImports( delayed != 0 ))
+        {
+            uint32_t modName = addString( Utils::WstringToUTF8( importMod.first ) );
+
+            for (auto& importFn : importMod.second)
+            {
+                CacheImport rec = { 0 };
+                rec.module = modName;
+                rec.name = importFn.importByOrd ? 0 : addString( importFn.importName );
+                rec.ptrRVA = static_cast<uint32_t>(importFn.ptrRVA);
+                rec.ordinal = importFn.importOrdinal;
+                rec.byOrdinal = importFn.importByOrd;
+                rec.delayed = static_cast<uint8_t>(delayed);
+
+                imports.emplace_back( rec );
+            }
+        }
+    }
+
+    std::vector<CacheRegion> cacheRegions;
+    for (auto& region : regions)
+    {
+        CacheRegion rec = { static_cast<uint32_t>(region.first), static_cast<uint32_t>(region.second) };
+        cacheRegions.emplace_back( rec );
+    }
+
+    // Tables follow header, layout is page aligned
+    std::vector<uint8_t> data( sizeof(hdr) );
+
+    auto append = [&data]( const void* ptr, size_t count, size_t recSize, size_t alignment ) -> CacheTable
+    {
+        data.resize( Align( data.size(), alignment ) );
+
+        CacheTable tbl = { static_cast<uint32_t>(data.size()), static_cast<uint32_t>(count) };
+        if (count != 0)
+            data.insert( data.end(), reinterpret_cast<const uint8_t*>(ptr), reinterpret_cast<const uint8_t*>(ptr) + count * recSize );
+
+        return tbl;
+    };
+
+    auto strPath = Utils::WstringToUTF8( Utils::ToLower( path ) );
+
+    hdr.path    = append( strPath.data(), strPath.size(), sizeof(char), sizeof(uint64_t) );
+    hdr.regions = append( cacheRegions.data(), cacheRegions.size(), sizeof(CacheRegion), sizeof(uint64_t) );
+    hdr.relocs  = append( plan.records().data(), plan.size(), sizeof(pe::RelocationPlan::Record), sizeof(uint64_t) );
+    hdr.imports = append( imports.data(), imports.size(), sizeof(CacheImport), sizeof(uint64_t) );
+    hdr.tls     = append( tls.data(), tls.size(), sizeof(uint32_t), sizeof(uint64_t) );
+    hdr.strings = append( strings.data(), strings.size(), sizeof(char), sizeof(uint64_t) );
+    hdr.layout  = append( layout.data(), layout.size(), sizeof(uint8_t), 0x1000 );
+
+    memcpy( data.data(), &hdr, sizeof(hdr) );
+
+    // Write into temporary file first, so readers never see partial entry
+    auto entryPath = EntryPath( path );
+    auto tmpPath = entryPath + L"." + std::to_wstring( GetCurrentThreadId() ) + L".tmp";
+
+    {
+        std::ofstream file( tmpPath.c_str(), std::ios::binary | std::ios::trunc );
+        if (!file || !file.write( reinterpret_cast<const char*>(data.data()), data.size() ))
+        {
+            file.close();
+            DeleteFileW( tmpPath.c_str() );
+            return STATUS_UNSUCCESSFUL;
+        }
+    }
+
+    if (!MoveFileExW( tmpPath.c_str(), entryPath.c_str(), MOVEFILE_REPLACE_EXISTING ))
+    {
+        status = LastNtStatus();
+        DeleteFileW( tmpPath.c_str() );
+        return status;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Get cache file path for image
+/// </summary>
+/// <param name="path">Image path</param>
+/// <returns>Cache file path</returns>
+std::wstring ImageCache::EntryPath( const std::wstring& path ) const
+{
+    auto strPath = Utils::WstringToUTF8( Utils::ToLower( path ) );
+    wchar_t name[32] = { 0 };
+
+    swprintf_s( name, L"%016llx.bbic", Hash( strPath.data(), strPath.size() ) );
+
+    return _dir + L"\\" + name;
+}
+
+}
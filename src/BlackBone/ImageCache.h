@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+#include "PEParser.h"
+#include "RelocationPlan.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Image prepared for mapping, loaded from image cache
+/// </summary>
+class CachedImage
+{
+public:
+    typedef std::vector<std::pair<size_t, size_t>> vecRegions;
+
+public:
+    CachedImage();
+    ~CachedImage();
+
+    /// <summary>
+    /// Get image laid out by RVA, not relocated
+    /// </summary>
+    /// <returns>Image layout</returns>
+    inline const uint8_t* layout() const { return _layout; }
+
+    /// <summary>
+    /// Get image layout size
+    /// </summary>
+    /// <returns>Layout size, equals image size</returns>
+    inline size_t layoutSize() const { return _layoutSize; }
+
+    /// <summary>
+    /// Get parts of layout that must be written into target (offset, size)
+    /// </summary>
+    /// <returns>Image regions</returns>
+    inline const vecRegions& regions() const { return _regions; }
+
+    /// <summary>
+    /// Check if image has relocation directory
+    /// </summary>
+    /// <returns>true if image can be relocated</returns>
+    inline bool relocatable() const { return _relocatable; }
+
+    /// <summary>
+    /// Get image relocations
+    /// </summary>
+    /// <returns>Relocation plan</returns>
+    inline const pe::RelocationPlan& relocs() const { return _relocs; }
+
+    /// <summary>
+    /// Get image imports
+    /// </summary>
+    /// <param name="useDelayed">Get delayed import instead</param>
+    /// <returns>Import data</returns>
+    inline const pe::mapImports& imports( bool useDelayed = false ) const { return useDelayed ? _delayImports : _imports; }
+
+    /// <summary>
+    /// Get TLS callback RVAs
+    /// </summary>
+    /// <returns>TLS callbacks</returns>
+    inline const std::vector<uint32_t>& tlsCallbacks() const { return _tlsCallbacks; }
+
+private:
+    friend class ImageCache;
+
+    std::vector<uint8_t> _data;             // Image layout read from cache file
+    const uint8_t* _layout = nullptr;       // Image layout, points into _data
+    size_t _layoutSize = 0;                 // Image layout size
+    bool _relocatable = false;              // Image has relocation directory
+    vecRegions _regions;                    // Layout parts to write
+    pe::RelocationPlan _relocs;             // Relocations
+    pe::mapImports _imports;                // Import functions
+    pe::mapImports _delayImports;           // Delayed import functions
+    std::vector<uint32_t> _tlsCallbacks;    // TLS callback RVAs
+};
+
+/// <summary>
+/// On-disk cache of images prepared for manual mapping.
+/// Entry is keyed by file path, size, last write time, header checksum and content hash.
+/// Content hash is computed once per process for each version of the file.
+/// Cache file is a flat set of tables at fixed offsets, lookup reads the header first
+/// and the tables only if entry matches the file.
+/// </summary>
+class ImageCache
+{
+public:
+    typedef CachedImage::vecRegions vecRegions;
+
+public:
+    ImageCache();
+    ~ImageCache();
+
+    /// <summary>
+    /// Set folder for cache files
+    /// </summary>
+    /// <param name="dir">Cache folder, empty string disables cache</param>
+    void SetDirectory( const std::wstring& dir );
+
+    /// <summary>
+    /// Get cache folder
+    /// </summary>
+    /// <returns>Cache folder</returns>
+    inline const std::wstring& directory() const { return _dir; }
+
+    /// <summary>
+    /// Check if cache is used
+    /// </summary>
+    /// <returns>true if cache folder is set</returns>
+    inline bool enabled() const { return !_dir.empty(); }
+
+    /// <summary>
+    /// Load prepared image for file
+    /// </summary>
+    /// <param name="path">Image path</param>
+    /// <returns>Cached image, nullptr if there is no valid entry for file</returns>
+    std::shared_ptr<const CachedImage> Lookup( const std::wstring& path ) const;
+
+    /// <summary>
+    /// Save prepared image for file
+    /// </summary>
+    /// <param name="path">Image path</param>
+    /// <param name="image">Image parsed from file</param>
+    /// <param name="layout">Image laid out by RVA, not relocated</param>
+    /// <param name="regions">Parts of layout that must be written into target</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Store( const std::wstring& path, pe::PEParser& image, const std::vector<uint8_t>& layout, const vecRegions& regions ) const;
+
+private:
+    /// <summary>
+    /// Get cache file path for image
+    /// </summary>
+    /// <param name="path">Image path</param>
+    /// <returns>Cache file path</returns>
+    std::wstring EntryPath( const std::wstring& path ) const;
+
+private:
+    std::wstring _dir;      // Cache folder
+};
+
+}
@@ -1,66 +1,182 @@
 #include "ImageNET.h"
+#include "PEView.h"
+#include "Utils.h"
 
+#ifndef BLACKBONE_PORTABLE
 #include <mscoree.h>
 #include <metahost.h>
+#include <atlbase.h>
+#endif
 
-#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
 
 namespace blackbone
 {
 
+namespace
+{
+
+// Metadata tables used by parser
+enum eMetaTable
+{
+    tbl_Module      = 0x00,
+    tbl_TypeRef     = 0x01,
+    tbl_TypeDef     = 0x02,
+    tbl_FieldPtr    = 0x03,
+    tbl_Field       = 0x04,
+    tbl_MethodPtr   = 0x05,
+    tbl_MethodDef   = 0x06,
+    tbl_Param       = 0x08,
+    tbl_ModuleRef   = 0x1A,
+    tbl_TypeSpec    = 0x1B,
+    tbl_AssemblyRef = 0x23,
+};
+
+// Metadata root signature, 'BSJB'
+const uint32_t MetadataSignature = 0x424A5342;
+
+// #~ stream HeapSizes flags
+const uint8_t HeapStringsWide = 0x01;
+const uint8_t HeapGuidWide    = 0x02;
+const uint8_t HeapBlobWide    = 0x04;
+const uint8_t HeapExtraData   = 0x40;
+
+/// <summary>
+/// Read 2 or 4 byte table column
+/// </summary>
+/// <param name="ptr">Column address</param>
+/// <param name="size">Column size</param>
+/// <returns>Column value</returns>
+inline uint32_t ReadColumn( const uint8_t* ptr, uint32_t size )
+{
+    if (size == 2)
+    {
+        uint16_t value = 0;
+        memcpy( &value, ptr, sizeof(value) );
+        return value;
+    }
+
+    uint32_t value = 0;
+    memcpy( &value, ptr, sizeof(value) );
+    return value;
+}
+
+/// <summary>
+/// Get size of coded index column
+/// </summary>
+/// <param name="rows">Table row counts</param>
+/// <param name="tables">Tables referenced by index</param>
+/// <param name="tagBits">Number of bits used for table tag</param>
+/// <returns>Column size</returns>
+inline uint32_t CodedIndexSize( const uint32_t* rows, std::initializer_list<int> tables, int tagBits )
+{
+    uint32_t maxRows = 0;
+    for (auto table : tables)
+        maxRows = std::max<uint32_t>( maxRows, rows[table] );
+
+    return maxRows < (1u << (16 - tagBits)) ? 2 : 4;
+}
+
+}
+
 ImageNET::ImageNET( void )
 {
 }
 
 ImageNET::~ImageNET(void)
 {
-    if (!_path.empty())
-        CoUninitialize();
 }
 
 /// <summary>
-/// Initialize COM classes
+/// Map image file and locate metadata streams
 /// </summary>
 /// <param name="path">Image file path</param>
 /// <returns>true on success</returns>
 bool ImageNET::Init( const std::wstring& path )
 {
-    HRESULT hr;
-    VARIANT value;
+    if (!_file.Project( path ))
+        return false;
 
-    _path = path;
+    return Init( _file.base(), _file.size(), _file.isPlainData() );
+}
 
-    if (FAILED( CoInitialize( 0 ) ))
-         return false;
+/// <summary>
+/// Locate metadata streams in image already loaded into memory
+/// </summary>
+/// <param name="data">Image data</param>
+/// <param name="size">Image data size</param>
+/// <param name="isPlainData">Image is in file layout</param>
+/// <returns>true on success</returns>
+bool ImageNET::Init( const void* data, size_t size, bool isPlainData )
+{
+    _tables = _strings = _blob = _guid = Stream();
 
-    hr = CoCreateInstance( CLSID_CorMetaDataDispenser, NULL, CLSCTX_INPROC_SERVER, 
-                           IID_IMetaDataDispenserEx, reinterpret_cast<void**>(&_pMetaDisp) );
-    if (FAILED( hr ))
+    pe::PEView view;
+    if (view.Attach( data, size, isPlainData ) != STATUS_SUCCESS)
         return false;
 
-    //
-    // query required interfaces
-    //
-    hr = _pMetaDisp->OpenScope( _path.c_str(), 0, IID_IMetaDataImport, reinterpret_cast<IUnknown**>(&_pMetaImport) );
-    if (hr == CLDB_E_BADUPDATEMODE)
-    {
-        V_VT(&value)  = VT_UI4;
-        V_UI4(&value) = MDUpdateIncremental;
+    // CLI header
+    IMAGE_COR20_HEADER corHdr = { 0 };
+    auto dir = view.Directory( IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR );
+    if (dir.VirtualAddress == 0 || !view.Read( dir.VirtualAddress, corHdr ))
+        return false;
 
-        if (FAILED( hr = _pMetaDisp->SetOption( MetaDataSetUpdate, &value ) ))
-            return false;
+    const uint32_t metaSize = corHdr.MetaData.Size;
+    auto pMeta = view.ResolveRVA( corHdr.MetaData.VirtualAddress, metaSize );
+    if (pMeta == nullptr || metaSize < 16)
+        return false;
 
-        hr = _pMetaDisp->OpenScope( _path.c_str(), 0, IID_IMetaDataImport, reinterpret_cast<IUnknown**>(&_pMetaImport) );
-    }
+    // Metadata root: signature, version string, stream headers
+    uint32_t signature = 0, verLength = 0;
+    memcpy( &signature, pMeta, sizeof(signature) );
+    memcpy( &verLength, pMeta + 12, sizeof(verLength) );
 
-    if (FAILED( hr ))
+    if (signature != MetadataSignature || verLength > metaSize - 16)
         return false;
 
-    hr = _pMetaImport->QueryInterface( IID_IMetaDataAssemblyImport, reinterpret_cast<void**>(&_pAssemblyImport) );
-    if (FAILED( hr ))
+    uint64_t offset = 16 + ((static_cast<uint64_t>(verLength) + 3) & ~3ull);
+    if (offset + 4 > metaSize)
         return false;
 
-    return true;
+    uint16_t streamCount = 0;
+    memcpy( &streamCount, pMeta + offset + 2, sizeof(streamCount) );
+    offset += 4;
+
+    for (uint16_t i = 0; i < streamCount; i++)
+    {
+        if (offset + 8 > metaSize)
+            return false;
+
+        uint32_t streamOfs = 0, streamSize = 0;
+        memcpy( &streamOfs, pMeta + offset, sizeof(streamOfs) );
+        memcpy( &streamSize, pMeta + offset + 4, sizeof(streamSize) );
+
+        // Stream name is null-terminated and padded to 4 bytes, at most 32 bytes long
+        auto pName = reinterpret_cast<const char*>(pMeta + offset + 8);
+        auto pNameEnd = static_cast<const char*>(memchr( pName, 0, std::min<size_t>( 32, metaSize - static_cast<size_t>(offset) - 8 ) ));
+        if (pNameEnd == nullptr || streamOfs > metaSize || streamSize > metaSize - streamOfs)
+            return false;
+
+        Stream stream;
+        stream.data = pMeta + streamOfs;
+        stream.size = streamSize;
+
+        std::string name( pName );
+        if (name == "#~" || name == "#-")
+            _tables = stream;
+        else if (name == "#Strings")
+            _strings = stream;
+        else if (name == "#Blob")
+            _blob = stream;
+        else if (name == "#GUID")
+            _guid = stream;
+
+        offset += 8 + ((pNameEnd - pName + 1 + 3) & ~3);
+    }
+
+    return _tables.data != nullptr && _strings.data != nullptr;
 }
 
 /// <summary>
@@ -70,47 +186,102 @@ bool ImageNET::Init( const std::wstring& path )
 /// <returns>true on success</returns>
 bool ImageNET::Parse( mapMethodRVA& methods )
 {
-    DWORD dwcTypeDefs, dwTypeDefFlags, dwcTokens, dwSigBlobSize;
+    _methods.clear();
+
+    // #~ header: reserved, version, heap sizes, reserved, valid and sorted table masks
+    const uint8_t* pTables = _tables.data;
+    if (pTables == nullptr || _tables.size < 24)
+        return false;
 
-    HCORENUM  hceTypeDefs    = 0;
-    mdToken   tExtends       = 0;
-    HCORENUM  hceMethods     = 0;
-    mdTypeRef rTypeDefs[10]  = { 0 };
-    WCHAR     wcName[1024]   = { 0 };
-    mdToken   rTokens[10]    = { 0 };
+    uint8_t heapSizes = pTables[6];
+    uint64_t valid = 0;
+    memcpy( &valid, pTables + 8, sizeof(valid) );
 
-    while (SUCCEEDED( _pMetaImport->EnumTypeDefs( &hceTypeDefs, rTypeDefs, ARRAYSIZE( rTypeDefs ), &dwcTypeDefs ))
-            && dwcTypeDefs > 0)
+    // Row counts of present tables
+    uint32_t rows[64] = { 0 };
+    uint64_t offset = 24;
+    for (int i = 0; i < 64; i++)
     {
-        for (UINT i = 0; i < dwcTypeDefs; i++)
-        {
-            HRESULT hr = _pMetaImport->GetTypeDefProps( rTypeDefs[i], wcName, ARRAYSIZE( wcName ), NULL, &dwTypeDefFlags, &tExtends );
-            if ( FAILED(hr) )
-                continue;
+        if (!(valid & (1ull << i)))
+            continue;
 
-            while (SUCCEEDED( _pMetaImport->EnumMethods( &hceMethods, rTypeDefs[i], rTokens, ARRAYSIZE( rTokens ), &dwcTokens ) )
-                && dwcTokens > 0)
-            {
-                DWORD            dwCodeRVA, dwAttr;
-                WCHAR            wmName[1024] = { 0 };
-                PCCOR_SIGNATURE  pbySigBlob = nullptr;
+        if (offset + 4 > _tables.size)
+            return false;
 
-                for (UINT j = 0; j < dwcTokens; j++)
-                {
-                    // get method information
-                    HRESULT hr = _pMetaImport->GetMemberProps(
-                        rTokens[j], NULL, wmName, 
-                        ARRAYSIZE( wmName ), NULL,
-                        &dwAttr, &pbySigBlob, &dwSigBlobSize,
-                        &dwCodeRVA, NULL, NULL, NULL, NULL );
+        memcpy( &rows[i], pTables + offset, sizeof(rows[i]) );
+        offset += 4;
+    }
 
-                    if (FAILED( hr ))
-                        continue;
+    if (heapSizes & HeapExtraData)
+        offset += 4;
+
+    // Column sizes
+    const uint32_t strIdx = (heapSizes & HeapStringsWide) ? 4 : 2;
+    const uint32_t guidIdx = (heapSizes & HeapGuidWide) ? 4 : 2;
+    const uint32_t blobIdx = (heapSizes & HeapBlobWide) ? 4 : 2;
+    const uint32_t fieldIdx = rows[tbl_Field] < 0x10000 ? 2 : 4;
+    const uint32_t methodIdx = rows[tbl_MethodDef] < 0x10000 ? 2 : 4;
+    const uint32_t paramIdx = rows[tbl_Param] < 0x10000 ? 2 : 4;
+    const uint32_t typeDefOrRef = CodedIndexSize( rows, { tbl_TypeDef, tbl_TypeRef, tbl_TypeSpec }, 2 );
+    const uint32_t resolutionScope = CodedIndexSize( rows, { tbl_Module, tbl_ModuleRef, tbl_TypeRef, tbl_AssemblyRef }, 2 );
+
+    // Tables are stored back to back, only the ones preceding MethodDef are needed
+    const uint32_t rowSize[tbl_MethodDef + 1] =
+    {
+        2 + strIdx + 3 * guidIdx,                                   // Module
+        resolutionScope + 2 * strIdx,                               // TypeRef
+        4 + 2 * strIdx + typeDefOrRef + fieldIdx + methodIdx,       // TypeDef
+        fieldIdx,                                                   // FieldPtr
+        2 + strIdx + blobIdx,                                       // Field
+        methodIdx,                                                  // MethodPtr
+        4 + 2 + 2 + strIdx + blobIdx + paramIdx,                    // MethodDef
+    };
+
+    const uint8_t* pTable[tbl_MethodDef + 1] = { 0 };
+    for (int i = 0; i <= tbl_MethodDef; i++)
+    {
+        pTable[i] = pTables + offset;
+        offset += static_cast<uint64_t>(rows[i]) * rowSize[i];
+    }
 
-                    _methods.emplace( std::make_pair( wcName, wmName ), dwCodeRVA );
-                }
-            }
+    if (offset > _tables.size)
+        return false;
+
+    // Uncompressed stream may reference methods through MethodPtr table
+    const bool indirect = rows[tbl_MethodPtr] != 0;
+    const uint32_t methodCount = indirect ? rows[tbl_MethodPtr] : rows[tbl_MethodDef];
+    const uint32_t methodListOfs = 4 + 2 * strIdx + typeDefOrRef + fieldIdx;
+
+    // Method list of a type ends where list of the next type starts.
+    // First row is <Module> pseudo type, skipped like IMetaDataImport::EnumTypeDefs does
+    uint32_t first = rows[tbl_TypeDef] > 1 ? ReadColumn( pTable[tbl_TypeDef] + rowSize[tbl_TypeDef] + methodListOfs, methodIdx ) : 0;
+    for (uint32_t type = 1; type < rows[tbl_TypeDef]; type++)
+    {
+        auto pType = pTable[tbl_TypeDef] + type * rowSize[tbl_TypeDef];
+        uint32_t last = methodCount + 1;
+        if (type + 1 < rows[tbl_TypeDef])
+            last = ReadColumn( pType + rowSize[tbl_TypeDef] + methodListOfs, methodIdx );
+
+        auto name = GetString( ReadColumn( pType + 4, strIdx ) );
+        auto nameSpace = GetString( ReadColumn( pType + 4 + strIdx, strIdx ) );
+        auto typeName = Utils::AnsiToWstring( nameSpace.empty() ? name : nameSpace + "." + name, CP_UTF8 );
+
+        for (uint32_t method = std::max<uint32_t>( first, 1 ); method < std::min<uint32_t>( last, methodCount + 1 ); method++)
+        {
+            uint32_t rid = method;
+            if (indirect)
+                rid = ReadColumn( pTable[tbl_MethodPtr] + (method - 1) * rowSize[tbl_MethodPtr], methodIdx );
+
+            if (rid == 0 || rid > rows[tbl_MethodDef])
+                continue;
+
+            auto pMethod = pTable[tbl_MethodDef] + (rid - 1) * rowSize[tbl_MethodDef];
+            auto methodName = GetString( ReadColumn( pMethod + 8, strIdx ) );
+
+            _methods.emplace( std::make_pair( typeName, Utils::AnsiToWstring( methodName, CP_UTF8 ) ), ReadColumn( pMethod, 4 ) );
         }
+
+        first = last;
     }
 
     methods = _methods;
@@ -118,6 +289,24 @@ bool ImageNET::Parse( mapMethodRVA& methods )
     return true;
 }
 
+/// <summary>
+/// Get string from #Strings heap
+/// </summary>
+/// <param name="index">String offset</param>
+/// <returns>String, empty if index is invalid</returns>
+std::string ImageNET::GetString( uint32_t index ) const
+{
+    if (index >= _strings.size)
+        return std::string();
+
+    auto pStr = reinterpret_cast<const char*>(_strings.data + index);
+    auto pEnd = static_cast<const char*>(memchr( pStr, 0, _strings.size - index ));
+
+    return pEnd ? std::string( pStr, pEnd ) : std::string();
+}
+
+#ifndef BLACKBONE_PORTABLE
+
 typedef decltype(&GetRequestedRuntimeVersion) fnGetRequestedRuntimeVersion;
 typedef decltype(&CLRCreateInstance) fnCLRCreateInstancen;
 
@@ -201,4 +390,6 @@ std::wstring ImageNET::GetImageRuntimeVer( const wchar_t* ImagePath )
     
 }
 
-}
\ No newline at end of file
+#endif
+
+}
@@ -1,17 +1,17 @@
 #pragma once
 
 #include "Winheaders.h"
-#include <cor.h>
-#include <CorError.h>
+#include "FileProjection.h"
 
 #include <map>
-#include <atlbase.h>
+#include <string>
 
 namespace blackbone
 {
 
 /// <summary>
-/// .NET metadata parser
+/// .NET metadata parser.
+/// Reads CLI header and metadata tables directly from image, without COM
 /// </summary>
 class ImageNET
 {
@@ -23,12 +23,21 @@ public:
     ~ImageNET(void);
 
     /// <summary>
-    /// Initialize COM classes
+    /// Map image file and locate metadata streams
     /// </summary>
     /// <param name="path">Image file path</param>
     /// <returns>true on success</returns>
     bool Init( const std::wstring& path );
 
+    /// <summary>
+    /// Locate metadata streams in image already loaded into memory
+    /// </summary>
+    /// <param name="data">Image data</param>
+    /// <param name="size">Image data size</param>
+    /// <param name="isPlainData">Image is in file layout</param>
+    /// <returns>true on success</returns>
+    bool Init( const void* data, size_t size, bool isPlainData );
+
     /// <summary>
     /// Extract methods from image
     /// </summary>
@@ -36,19 +45,36 @@ public:
     /// <returns>true on success</returns>
     bool Parse( mapMethodRVA& methods );
 
+#ifndef BLACKBONE_PORTABLE
     /// <summary>
     /// Get image .NET runtime version
     /// </summary>
     /// <returns>runtime version, "n/a" if nothing found</returns>
     static std::wstring GetImageRuntimeVer( const wchar_t* ImagePath );
+#endif
+
 private:
-    std::wstring _path;         // Image path
-    mapMethodRVA _methods;      // Image methods
+    // Metadata stream
+    struct Stream
+    {
+        const uint8_t* data = nullptr;
+        uint32_t size = 0;
+    };
 
-    // COM helpers
-    CComPtr<IMetaDataDispenserEx>    _pMetaDisp;
-    CComPtr<IMetaDataImport>         _pMetaImport;
-    CComPtr<IMetaDataAssemblyImport> _pAssemblyImport;
+    /// <summary>
+    /// Get string from #Strings heap
+    /// </summary>
+    /// <param name="index">String offset</param>
+    /// <returns>String, empty if index is invalid</returns>
+    std::string GetString( uint32_t index ) const;
+
+private:
+    FileProjection _file;       // Image file mapping
+    Stream _tables;             // #~ stream
+    Stream _strings;            // #Strings heap
+    Stream _blob;               // #Blob heap
+    Stream _guid;               // #GUID heap
+    mapMethodRVA _methods;      // Image methods
 };
 
-}
\ No newline at end of file
+}
@@ -4,12 +4,17 @@
 #include <stdint.h>
 #include <string.h>
 
-#ifdef _M_AMD64
+#if defined(_M_AMD64) || defined(__x86_64__)
     #define is_x64 1
 #else
     #define is_x64 0
 #endif//_M_AMD64
 
+// Calling convention is MSVC specific, other compilers use default one
+#if !defined(_MSC_VER) && !defined(__fastcall)
+    #define __fastcall
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -3,11 +3,15 @@
 #include "NameResolve.h"
 #include "Utils.h"
 #include "DynImport.h"
+#include "RelocationPlan.h"
 #include "Trace.hpp"
 
 #include "VADPurgeDef.h"
 
 #include <random>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <VersionHelpers.h>
 
 namespace blackbone
@@ -50,8 +54,16 @@ const ModuleData* MMap::MapImage( const std::wstring& path, int flags /*= NoFlag
 
     BLACBONE_TRACE( L"ManualMap: Mapping image '%ls' with flags 0x%x", path.c_str(), flags );
 
+    // Load and parse all manually mapped dependencies at once
+    if (flags & ManualImports)
+        PrepareDependencies( path, flags );
+
     // Map module and all dependencies
     auto mod = FindOrMapModule( path, flags );
+
+    // Images that weren't needed, e.g. already loaded by the time they were reached
+    _prepared.clear();
+
     if (mod == nullptr)
         return nullptr;
 
@@ -93,16 +105,28 @@ const ModuleData* MMap::MapImage( const std::wstring& path, int flags /*= NoFlag
 /// <returns>Module info</returns>
 const ModuleData* MMap::FindOrMapModule( const std::wstring& path, int flags /*= NoFlags*/ )
 {
-    std::unique_ptr<ImageContext> pImage( new ImageContext() );
+    std::unique_ptr<ImageContext> pImage;
+
+    // Image may already be prepared together with other dependencies
+    auto iter = _prepared.find( Utils::ToLower( path ) );
+    if (iter != _prepared.end())
+    {
+        pImage = std::move( iter->second );
+        _prepared.erase( iter );
+    }
+    else
+    {
+        pImage.reset( new ImageContext() );
+        pImage->FilePath = path;
+
+        if (!PrepareImage( pImage.get() ))
+            return nullptr;
+    }
 
     pImage->FilePath = path;
     pImage->FileName = Utils::StripPath( pImage->FilePath );
     pImage->flags = static_cast<eLoadFlags>(flags);
 
-    // Load and parse image
-    if (!pImage->FileImage.Project( path ) || !pImage->PEImage.Parse( pImage->FileImage, pImage->FileImage.isPlainData() ))
-        return nullptr;
-
     // Check if already loaded
     if (auto hMod = _process.modules().GetModule( path, LdrList, pImage->PEImage.mType() ))
         return hMod;
@@ -144,7 +168,9 @@ const ModuleData* MMap::FindOrMapModule( const std::wstring& path, int flags /*=
     }*/
 
     // Core image mapping operations
-    if (!CopyImage( pImage.get() ) || !RelocateImage( pImage.get() ))
+    // Image is built locally by PrepareImage, relocated and written into target at once.
+    // It must be present in target before imports are resolved, circular dependencies read its exports.
+    if (!RelocateImage( pImage.get() ) || !CommitImage( pImage.get() ))
         return nullptr;
 
     auto mt = pImage->PEImage.mType();
@@ -159,6 +185,16 @@ const ModuleData* MMap::FindOrMapModule( const std::wstring& path, int flags /*=
         return nullptr;
     }
 
+    // Write filled IAT
+    if (!CommitImage( pImage.get() ))
+    {
+        _process.modules().RemoveManualModule( pImage->FileName, mt );
+        return nullptr;
+    }
+
+    // Local copy is no longer needed
+    std::vector<uint8_t>().swap( pImage->localImage );
+
     // Apply proper memory protection for sections
     ProtectImageMemory( pImage.get() );
 
@@ -193,13 +229,20 @@ const ModuleData* MMap::FindOrMapModule( const std::wstring& path, int flags /*=
     }
     
     // Fill TLS callbacks
-    pImage->PEImage.GetTLSCallbacks( pImage->imgMem.ptr<ptr_t>(), pImage->tlsCallbacks );
+    if (pImage->cached)
+    {
+        for (auto rva : pImage->cached->tlsCallbacks())
+            pImage->tlsCallbacks.emplace_back( pImage->imgMem.ptr<ptr_t>() + rva );
+    }
+    else
+        pImage->PEImage.GetTLSCallbacks( pImage->imgMem.ptr<ptr_t>(), pImage->tlsCallbacks );
 
     // Get entry point
     pImage->EntryPoint = pImage->PEImage.entryPoint( pImage->imgMem.ptr<ptr_t>() );
 
     // Unload local copy
     pImage->FileImage.Release();
+    pImage->cached.reset();
 
     // Release image
     pImage->imgMem.Release();
@@ -209,6 +252,153 @@ const ModuleData* MMap::FindOrMapModule( const std::wstring& path, int flags /*=
     return pMod;
 }
 
+/// <summary>
+/// Load, parse and lay out image locally. Doesn't access target process
+/// </summary>
+/// <param name="pImage">Image data, FilePath must be set</param>
+/// <returns>true on success</returns>
+bool MMap::PrepareImage( ImageContext* pImage )
+{
+    auto& path = pImage->FilePath;
+
+    // Use prepared image if file wasn't changed since it was cached
+    pImage->cached = _cache.Lookup( path );
+    if (pImage->cached)
+    {
+        BLACBONE_TRACE( L"ManualMap: Using cached image for '%ls'", path.c_str() );
+
+        pImage->FileImage.PrepareActx( path );
+        if (!pImage->PEImage.Parse( pImage->cached->layout() ))
+            return false;
+
+        pImage->relocStatus = pImage->cached->relocatable() ? STATUS_SUCCESS : STATUS_NOT_FOUND;
+    }
+    // Load and parse image
+    else if (!pImage->FileImage.Project( path ) || !pImage->PEImage.Parse( pImage->FileImage, pImage->FileImage.isPlainData() ))
+        return false;
+    else
+        pImage->relocStatus = pImage->relocs.Build( pImage->PEImage );
+
+    if (!CopyImage( pImage ))
+        return false;
+
+    // Save prepared image for the next time
+    if (_cache.enabled() && !pImage->cached)
+    {
+        NTSTATUS status = _cache.Store( path, pImage->PEImage, pImage->localImage, pImage->dirtyRegions );
+        if (!NT_SUCCESS( status ))
+            BLACBONE_TRACE( L"ManualMap: Failed to cache image '%ls'. Status = 0x%x", path.c_str(), status );
+    }
+
+    return true;
+}
+
+/// <summary>
+/// Prepare image and all of its manually mapped dependencies ahead of mapping.
+/// Import graph is walked level by level, images of each level are prepared in parallel.
+/// </summary>
+/// <param name="path">Image path</param>
+/// <param name="flags">Mapping flags</param>
+void MMap::PrepareDependencies( const std::wstring& path, int flags )
+{
+    std::vector<ImageContext*> level;
+
+    auto schedule = [this, &level]( const std::wstring& modPath, int modFlags )
+    {
+        auto key = Utils::ToLower( modPath );
+        if (_prepared.count( key ))
+            return;
+
+        std::unique_ptr<ImageContext> pImage( new ImageContext() );
+        pImage->FilePath = modPath;
+        pImage->FileName = Utils::StripPath( modPath );
+        pImage->flags = static_cast<eLoadFlags>(modFlags);
+
+        level.emplace_back( pImage.get() );
+        _prepared.emplace( key, std::move( pImage ) );
+    };
+
+    schedule( path, flags );
+
+    while (!level.empty())
+    {
+        std::vector<ImageContext*> current;
+        current.swap( level );
+
+        // Images don't depend on each other until they are mapped
+        std::vector<uint8_t> results( current.size(), 0 );
+        std::atomic<size_t> next( 0 );
+
+        auto worker = [&]()
+        {
+            for (size_t i = next++; i < current.size(); i = next++)
+                results[i] = PrepareImage( current[i] );
+        };
+
+        size_t threads = std::min<size_t>( std::max<unsigned int>( std::thread::hardware_concurrency(), 1 ), current.size() );
+
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < threads; i++)
+            pool.emplace_back( worker );
+
+        worker();
+
+        for (auto& thd : pool)
+            thd.join();
+
+        // Collect next level. Failed images are left for FindOrMapModule to report
+        for (size_t i = 0; i < current.size(); i++)
+        {
+            auto pImage = current[i];
+
+            if (!results[i])
+            {
+                _prepared.erase( Utils::ToLower( pImage->FilePath ) );
+                continue;
+            }
+
+            for (int useDelayed = 0; useDelayed < 2; useDelayed++)
+            {
+                if (useDelayed && (pImage->flags & NoDelayLoad))
+                    break;
+
+                auto& imports = pImage->cached ? pImage->cached->imports( useDelayed != 0 ) : pImage->PEImage.ProcessImports( useDelayed != 0 );
+
+                for (auto& importMod : imports)
+                {
+                    std::wstring depPath = importMod.first;
+                    if (_process.modules().GetModule( depPath, LdrList, pImage->PEImage.mType(), pImage->FileName.c_str() ))
+                        continue;
+
+                    NameResolve::Instance().ResolvePath( depPath, pImage->FileName,
+                                                         Utils::GetParent( pImage->FilePath ),
+                                                         NameResolve::EnsureFullPath,
+                                                         _process.pid(),
+                                                         pImage->FileImage.actx() );
+
+                    schedule( depPath, DependencyFlags( pImage->flags ) );
+                }
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Get mapping flags of image dependencies
+/// </summary>
+/// <param name="flags">Image mapping flags</param>
+/// <returns>Dependency mapping flags</returns>
+int MMap::DependencyFlags( int flags ) const
+{
+    // For win32 one exception handler is enough
+    // For amd64 each image must have it's own handler to resolve C++ exceptions properly
+#ifdef _M_AMD64
+    return flags | NoSxS | NoDelayLoad;
+#else
+    return flags | NoSxS | NoDelayLoad | PartialExcept;
+#endif
+}
+
 /// <summary>
 /// Map pure IL image
 /// Not supported yet
@@ -269,7 +459,7 @@ bool MMap::UnmapAllModules()
 }
 
 /// <summary>
-/// Copies image into target process
+/// Copies image headers and sections into local image buffer
 /// </summary>
 /// <param name="pImage">Image data</param>
 /// <returns>true on success</returns>
@@ -277,22 +467,25 @@ bool MMap::CopyImage( ImageContext* pImage )
 {
     BLACBONE_TRACE( L"ManualMap: Performing image copy" );
 
-    // offset to first section equals to header size
-    size_t dwHeaderSize = pImage->PEImage.headersSize();
-
-    // Copy header
-    if (pImage->imgMem.Write( 0, dwHeaderSize, pImage->FileImage.base() ) != STATUS_SUCCESS)
+    // Prepared image is already laid out
+    if (pImage->cached)
     {
-        BLACBONE_TRACE( L"ManualMap: Failed to copy image headers. Status = 0x%x", LastNtStatus() );
-        return false;
+        pImage->localImage.assign( pImage->cached->layout(), pImage->cached->layout() + pImage->cached->layoutSize() );
+        pImage->dirtyRegions = pImage->cached->regions();
+        return true;
     }
 
-    // Set header protection
-    if (pImage->imgMem.Protect( PAGE_READONLY, 0, dwHeaderSize ) != STATUS_SUCCESS)
-    {
-        BLACBONE_TRACE( L"ManualMap: Failed to set header memory protection. Status = 0x%x", LastNtStatus() );
-        return false;
-    }
+    size_t imageSize = pImage->PEImage.imageSize();
+
+    // offset to first section equals to header size
+    size_t dwHeaderSize = std::min<size_t>( pImage->PEImage.headersSize(), imageSize );
+
+    pImage->localImage.assign( imageSize, 0 );
+    pImage->dirtyRegions.clear();
+
+    // Copy header
+    memcpy( pImage->localImage.data(), pImage->PEImage.fileBase(), dwHeaderSize );
+    pImage->dirtyRegions.emplace_back( 0, dwHeaderSize );
 
     auto& sections = pImage->PEImage.sections();
 
@@ -303,20 +496,58 @@ bool MMap::CopyImage( ImageContext* pImage )
         if (section.Characteristics & (IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE | IMAGE_SCN_MEM_EXECUTE) &&
              !(section.Characteristics & IMAGE_SCN_MEM_DISCARDABLE))
         {
-            uint8_t* pSource = reinterpret_cast<uint8_t*>(pImage->PEImage.ResolveRVAToVA( section.VirtualAddress ));
-
-            if (pImage->imgMem.Write( section.VirtualAddress, section.Misc.VirtualSize, pSource ) != STATUS_SUCCESS)
+            if (section.VirtualAddress >= imageSize)
             {
-                BLACBONE_TRACE( L"ManualMap: Failed to copy image section at offset 0x%x. Status = 0x%x", 
-                                section.VirtualAddress, LastNtStatus() );
+                BLACBONE_TRACE( L"ManualMap: Image section at offset 0x%x is out of image bounds", section.VirtualAddress );
+                LastNtStatus( STATUS_INVALID_IMAGE_FORMAT );
                 return false;
             }
+
+            size_t size = std::min<size_t>( section.Misc.VirtualSize, imageSize - section.VirtualAddress );
+            if (pImage->PEImage.isPlainData())
+                size = std::min<size_t>( size, section.SizeOfRawData );
+
+            uint8_t* pSource = reinterpret_cast<uint8_t*>(pImage->PEImage.ResolveRVAToVA( section.VirtualAddress ));
+
+            memcpy( pImage->localImage.data() + section.VirtualAddress, pSource, size );
+            pImage->dirtyRegions.emplace_back( section.VirtualAddress, size );
         } 
     }
 
     return true;
 }
 
+/// <summary>
+/// Write modified parts of local image into target process.
+/// Adjacent regions are merged, so each contiguous range takes a single write.
+/// </summary>
+/// <param name="pImage">Image data</param>
+/// <returns>true on success</returns>
+bool MMap::CommitImage( ImageContext* pImage )
+{
+    auto& regions = pImage->dirtyRegions;
+    std::sort( regions.begin(), regions.end() );
+
+    for (size_t i = 0; i < regions.size(); )
+    {
+        size_t start = regions[i].first;
+        size_t end = start + regions[i].second;
+
+        // Local image mirrors target memory, so small gaps between regions can be written too
+        for (++i; i < regions.size() && regions[i].first <= Align( end, 0x1000 ); ++i)
+            end = std::max<size_t>( end, regions[i].first + regions[i].second );
+
+        if (pImage->imgMem.Write( start, end - start, pImage->localImage.data() + start ) != STATUS_SUCCESS)
+        {
+            BLACBONE_TRACE( L"ManualMap: Failed to write image region at offset 0x%x. Status = 0x%x", start, LastNtStatus() );
+            return false;
+        }
+    }
+
+    regions.clear();
+    return true;
+}
+
 /// <summary>
 /// Adjust image memory protection
 /// </summary>
@@ -324,6 +555,13 @@ bool MMap::CopyImage( ImageContext* pImage )
 /// <returns>true on success</returns>
 bool MMap::ProtectImageMemory( ImageContext* pImage )
 {
+    // Set header protection
+    if (pImage->imgMem.Protect( PAGE_READONLY, 0, pImage->PEImage.headersSize() ) != STATUS_SUCCESS)
+    {
+        BLACBONE_TRACE( L"ManualMap: Failed to set header memory protection. Status = 0x%x", LastNtStatus() );
+        return false;
+    }
+
     // Set section memory protection
     for (auto& section : pImage->PEImage.sections())
     {
@@ -348,7 +586,7 @@ bool MMap::ProtectImageMemory( ImageContext* pImage )
 }
 
 /// <summary>
-///  Fix relocations if image wasn't loaded at base address
+///  Fix relocations in local image if image wasn't loaded at base address
 /// </summary>
 /// <param name="pImage">image data</param>
 /// <returns>true on success</returns>
@@ -357,67 +595,36 @@ bool MMap::RelocateImage( ImageContext* pImage )
     BLACBONE_TRACE( L"ManualMap: Relocating image '%ls'", pImage->FilePath.c_str() );
 
     // Reloc delta
-    size_t Delta = pImage->imgMem.ptr<size_t>() - static_cast<size_t>(pImage->PEImage.imageBase());
+    uint64_t delta = pImage->imgMem.ptr<uint64_t>() - static_cast<uint64_t>(pImage->PEImage.imageBase());
 
     // No need to relocate
-    if (Delta == 0)
+    if (delta == 0)
     {
         BLACBONE_TRACE( L"ManualMap: No need for relocation" );
         LastNtStatus( STATUS_SUCCESS );
         return true;
     }
 
-    auto start = pImage->PEImage.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_BASERELOC );
-    auto end = start + pImage->PEImage.DirectorySize( IMAGE_DIRECTORY_ENTRY_BASERELOC );
+    // Relocations were parsed by PrepareImage
+    const pe::RelocationPlan* plan = pImage->cached ? &pImage->cached->relocs() : &pImage->relocs;
+    NTSTATUS status = pImage->relocStatus;
 
-    pe::RelocData* fixrec = reinterpret_cast<pe::RelocData*>(start);
-    if (fixrec == nullptr)
+    if (status == STATUS_NOT_FOUND)
     {
-        // TODO: return proper error code
         BLACBONE_TRACE( L"ManualMap: Can't relocate image, no relocation data" );
         LastNtStatus( STATUS_IMAGE_NOT_AT_BASE );
         return false;
     }
 
-    while ((size_t)fixrec < end && fixrec->BlockSize)
-    {
-        DWORD count = (fixrec->BlockSize - 8) >> 1;             // records count
-
-        for (DWORD i = 0; i < count; ++i)
-        {
-            WORD fixtype = (fixrec->Item[i].Type);              // fixup type
-            WORD fixoffset = (fixrec->Item[i].Offset) % 4096;   // offset in 4K block
-
-            // no fixup required
-            if (fixtype == IMAGE_REL_BASED_ABSOLUTE)
-                continue;
-
-            // add delta 
-            if (fixtype == IMAGE_REL_BASED_HIGHLOW || fixtype == IMAGE_REL_BASED_DIR64)
-            {
-                size_t fixRVA = static_cast<ULONG>(fixoffset) + fixrec->PageRVA;
-                size_t val = *reinterpret_cast<size_t*>(
-                    reinterpret_cast<size_t>(pImage->FileImage.base()) + fixoffset + fixrec->PageRVA) 
-                    + Delta;
-
-                // Apply relocation
-                if (pImage->imgMem.Write( fixRVA, val ) != STATUS_SUCCESS)
-                {
-                    BLACBONE_TRACE( L"ManualMap: Failed to apply relocation at offset 0x%x. Status = 0x%x", fixRVA, LastNtStatus() );
-                    return false;
-                }
-            }
-            else
-            {
-                // TODO: support for all remaining relocations
-                BLACBONE_TRACE( L"ManualMap: Abnormal relocation type %d. Aborting", fixtype );
-                LastNtStatus( STATUS_INVALID_IMAGE_FORMAT );
-                return false;
-            }
-        }
+    // Apply relocations to local image
+    if (NT_SUCCESS( status ))
+        status = plan->Apply( pImage->localImage.data(), pImage->localImage.size(), delta );
 
-        // next reloc entry
-        fixrec = reinterpret_cast<pe::RelocData*>(reinterpret_cast<size_t>(fixrec) + fixrec->BlockSize);
+    if (!NT_SUCCESS( status ))
+    {
+        BLACBONE_TRACE( L"ManualMap: Failed to relocate image, status 0x%x", status );
+        LastNtStatus( status );
+        return false;
     }
 
     return true;
@@ -431,13 +638,7 @@ bool MMap::RelocateImage( ImageContext* pImage )
 /// <returns></returns>
 const ModuleData* MMap::FindOrMapDependency( ImageContext* pImage, std::wstring& path )
 {
-    // For win32 one exception handler is enough
-    // For amd64 each image must have it's own handler to resolve C++ exceptions properly
-#ifdef _M_AMD64
-    eLoadFlags newFlags = static_cast<eLoadFlags>(pImage->flags | NoSxS | NoDelayLoad);
-#else
-    eLoadFlags newFlags = static_cast<eLoadFlags>(pImage->flags | NoSxS | NoDelayLoad | PartialExcept);
-#endif
+    eLoadFlags newFlags = static_cast<eLoadFlags>(DependencyFlags( pImage->flags ));
 
     // Already loaded
     auto hMod = _process.modules().GetModule( path, LdrList, pImage->PEImage.mType(), pImage->FileName.c_str() );
@@ -469,7 +670,7 @@ const ModuleData* MMap::FindOrMapDependency( ImageContext* pImage, std::wstring&
 /// <returns>true on success</returns>
 bool MMap::ResolveImport( ImageContext* pImage, bool useDelayed /*= false */ )
 {
-    auto imports = pImage->PEImage.ProcessImports( useDelayed );
+    auto& imports = pImage->cached ? pImage->cached->imports( useDelayed ) : pImage->PEImage.ProcessImports( useDelayed );
     if (imports.empty())
         return true;
 
@@ -531,13 +732,22 @@ bool MMap::ResolveImport( ImageContext* pImage, bool useDelayed /*= false */ )
                 return false;
             }
 
-            // Write function address
-            if (pImage->imgMem.Write( importFn.ptrRVA, static_cast<size_t>(expData.procAddress) ) != STATUS_SUCCESS)
+            // Write function address into local image, IAT is written into target in bulk
+            size_t slotSize = (pImage->PEImage.mType() == mt_mod64) ? sizeof(uint64_t) : sizeof(uint32_t);
+            if (importFn.ptrRVA + slotSize > pImage->localImage.size())
             {
-                BLACBONE_TRACE( L"ManualMap: Failed to write import function address at offset 0x%x. Status = 0x%x",
-                                importFn.ptrRVA, LastNtStatus() );
+                BLACBONE_TRACE( L"ManualMap: Import function address at offset 0x%x is out of image bounds", importFn.ptrRVA );
+                LastNtStatus( STATUS_INVALID_IMAGE_FORMAT );
                 return false;
             }
+
+            uint8_t* pSlot = pImage->localImage.data() + importFn.ptrRVA;
+            if (slotSize == sizeof(uint64_t))
+                *reinterpret_cast<uint64_t*>(pSlot) = expData.procAddress;
+            else
+                *reinterpret_cast<uint32_t*>(pSlot) = static_cast<uint32_t>(expData.procAddress);
+
+            pImage->dirtyRegions.emplace_back( importFn.ptrRVA, slotSize );
         }
     }
 
@@ -564,7 +774,7 @@ bool MMap::EnableExceptions( ImageContext* pImage )
         AsmJitHelper ah(a);
         uint64_t result = 0;
 
-        pImage->pExpTableAddr = REBASE( pExpTable, pImage->FileImage.base(), pImage->imgMem.ptr<ptr_t>() );
+        pImage->pExpTableAddr = REBASE( pExpTable, pImage->PEImage.fileBase(), pImage->imgMem.ptr<ptr_t>() );
         auto pAddTable = _process.modules().GetExport( _process.modules().GetModule( L"ntdll.dll", LdrList, pImage->PEImage.mType() ),
                                                        "RtlAddFunctionTable" );
 
@@ -649,7 +859,7 @@ bool MMap::DisableExceptions( ImageContext* pImage )
 bool MMap::InitStaticTLS( ImageContext* pImage )
 {
     IMAGE_TLS_DIRECTORY *pTls = reinterpret_cast<decltype(pTls)>(pImage->PEImage.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_TLS ));
-    auto pRebasedTls = reinterpret_cast<IMAGE_TLS_DIRECTORY*>(REBASE( pTls, pImage->FileImage.base(), pImage->imgMem.ptr<ptr_t>() ));
+    auto pRebasedTls = reinterpret_cast<IMAGE_TLS_DIRECTORY*>(REBASE( pTls, pImage->PEImage.fileBase(), pImage->imgMem.ptr<ptr_t>() ));
 
     // Use native TLS initialization
     if (pTls && pTls->AddressOfIndex)
@@ -3,6 +3,7 @@
 #include "Winheaders.h"
 #include "FileProjection.h"
 #include "PEParser.h"
+#include "ImageCache.h"
 #include "ImageNET.h"
 #include "MemBlock.h"
 #include "MExcept.h"
@@ -38,10 +39,16 @@ enum eLoadFlags
 struct ImageContext
 {
     typedef std::vector<ptr_t> vecPtr;
+    typedef std::vector<std::pair<size_t, size_t>> vecRegions;
 
     FileProjection FileImage;           // Image file mapping
     pe::PEParser   PEImage;             // PE data
+    std::shared_ptr<const CachedImage> cached;  // Prepared image from image cache, if any
+    pe::RelocationPlan relocs;          // Image relocations, unless image is cached
+    NTSTATUS       relocStatus = STATUS_NOT_FOUND;  // Relocation parsing status, STATUS_NOT_FOUND if image has no relocations
     MemBlock       imgMem;              // Target image memory region
+    std::vector<uint8_t> localImage;    // Image built locally before it is written into target
+    vecRegions     dirtyRegions;        // Parts of local image not yet written into target (offset, size)
     std::wstring   FilePath;            // path to image being mapped
     std::wstring   FileName;            // File name string
     vecPtr         tlsCallbacks;        // TLS callback routines
@@ -52,6 +59,7 @@ struct ImageContext
 };
 
 typedef std::vector<std::unique_ptr<ImageContext>> vecImageCtx;
+typedef std::map<std::wstring, std::unique_ptr<ImageContext>> mapImageCtx;
 
 
 /// <summary>
@@ -81,7 +89,13 @@ public:
     /// <summary>
     /// Reset local data
     /// </summary>
-    inline void reset() { _images.clear(); _pAContext.Reset(); _usedBlocks.clear(); }
+    inline void reset() { _images.clear(); _prepared.clear(); _pAContext.Reset(); _usedBlocks.clear(); }
+
+    /// <summary>
+    /// Get cache of prepared images. Disabled until cache folder is set
+    /// </summary>
+    /// <returns>Image cache</returns>
+    inline ImageCache& imageCache() { return _cache; }
 
 private:
 
@@ -93,6 +107,28 @@ private:
     /// <returns>Module info</returns>
     const ModuleData* FindOrMapModule( const std::wstring& path, int flags = NoFlags );
 
+    /// <summary>
+    /// Load, parse and lay out image locally. Doesn't access target process
+    /// </summary>
+    /// <param name="pImage">Image data, FilePath must be set</param>
+    /// <returns>true on success</returns>
+    bool PrepareImage( ImageContext* pImage );
+
+    /// <summary>
+    /// Prepare image and all of its manually mapped dependencies ahead of mapping.
+    /// Import graph is walked level by level, images of each level are prepared in parallel.
+    /// </summary>
+    /// <param name="path">Image path</param>
+    /// <param name="flags">Mapping flags</param>
+    void PrepareDependencies( const std::wstring& path, int flags );
+
+    /// <summary>
+    /// Get mapping flags of image dependencies
+    /// </summary>
+    /// <param name="flags">Image mapping flags</param>
+    /// <returns>Dependency mapping flags</returns>
+    int DependencyFlags( int flags ) const;
+
     /// <summary>
     /// Run module initializers(TLS and entry point).
     /// </summary>
@@ -107,12 +143,20 @@ private:
     bool RunModuleInitializers( ImageContext* pImage, DWORD dwReason );
 
     /// <summary>
-    /// Copies image into target process
+    /// Copies image headers and sections into local image buffer
     /// </summary>
     /// <param name="pImage">Image data</param>
     /// <returns>true on success</returns>
     bool CopyImage( ImageContext* pImage );
 
+    /// <summary>
+    /// Write modified parts of local image into target process.
+    /// Adjacent regions are merged, so each contiguous range takes a single write.
+    /// </summary>
+    /// <param name="pImage">Image data</param>
+    /// <returns>true on success</returns>
+    bool CommitImage( ImageContext* pImage );
+
     /// <summary>
     /// Adjust image memory protection
     /// </summary>
@@ -121,7 +165,7 @@ private:
     bool ProtectImageMemory( ImageContext* pImage );
 
     /// <summary>
-    ///  Fix relocations if image wasn't loaded at base address
+    ///  Fix relocations in local image if image wasn't loaded at base address
     /// </summary>
     /// <param name="pImage">image data</param>
     /// <returns>true on success</returns>
@@ -220,8 +264,10 @@ private:
 
 private:
     vecImageCtx     _images;        // Mapped images
+    mapImageCtx     _prepared;      // Images prepared ahead of mapping, by lower case path
     class Process&  _process;       // Target process manager
     MemBlock        _pAContext;     // SxS activation context memory address
+    ImageCache      _cache;         // Prepared images
 
     std::vector<std::pair<ptr_t, size_t>> _usedBlocks;   // Used memory blocks 
 };
@@ -62,6 +62,8 @@ inline size_t Align( size_t val, size_t alignment )
     return (val % alignment == 0) ? val : (val / alignment + 1) * alignment;
 }
 
+#ifdef _WIN32
+
 // Offset of 'LastStatus' field in TEB
 #define LAST_STATUS_OFS (0x598 + 0x197 * WordSize)
 
@@ -84,6 +86,8 @@ inline NTSTATUS LastNtStatus( NTSTATUS status )
     return *(NTSTATUS*)((unsigned char*)NtCurrentTeb() + LAST_STATUS_OFS) = status;
 }
 
+#endif
+
 #define EMIT(a) __asm __emit (a)
 
 // Switch processor to long mode
@@ -0,0 +1,616 @@
+#include "Minidump.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace blackbone
+{
+
+namespace
+{
+
+#pragma pack(push, 4)
+
+// MINIDUMP_HEADER
+struct DumpHeader
+{
+    uint32_t signature;
+    uint32_t version;
+    uint32_t streamCount;
+    uint32_t streamRva;
+    uint32_t checksum;
+    uint32_t timestamp;
+    uint64_t flags;
+};
+
+// MINIDUMP_DIRECTORY
+struct DumpDirectory
+{
+    uint32_t type;
+    uint32_t dataSize;
+    uint32_t rva;
+};
+
+// MINIDUMP_MEMORY_DESCRIPTOR
+struct DumpMemoryDescriptor
+{
+    uint64_t start;
+    uint32_t dataSize;
+    uint32_t rva;
+};
+
+// MINIDUMP_MEMORY_DESCRIPTOR64
+struct DumpMemoryDescriptor64
+{
+    uint64_t start;
+    uint64_t dataSize;
+};
+
+// MINIDUMP_MEMORY64_LIST without descriptors
+struct DumpMemory64List
+{
+    uint64_t count;
+    uint64_t baseRva;
+};
+
+// MINIDUMP_MEMORY_INFO_LIST
+struct DumpMemoryInfoList
+{
+    uint32_t headerSize;
+    uint32_t entrySize;
+    uint64_t count;
+};
+
+// MINIDUMP_MODULE
+struct DumpModule
+{
+    uint64_t base;
+    uint32_t size;
+    uint32_t checksum;
+    uint32_t timestamp;
+    uint32_t nameRva;
+    uint8_t  versionInfo[52];
+    uint32_t cvSize;
+    uint32_t cvRva;
+    uint32_t miscSize;
+    uint32_t miscRva;
+    uint64_t reserved0;
+    uint64_t reserved1;
+};
+
+// MINIDUMP_THREAD
+struct DumpThread
+{
+    uint32_t id;
+    uint32_t suspendCount;
+    uint32_t priorityClass;
+    uint32_t priority;
+    uint64_t teb;
+    DumpMemoryDescriptor stack;
+    uint32_t contextSize;
+    uint32_t contextRva;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(DumpHeader) == 32, "DumpHeader size mismatch");
+static_assert(sizeof(DumpModule) == 108, "DumpModule size mismatch");
+static_assert(sizeof(DumpThread) == 48, "DumpThread size mismatch");
+static_assert(sizeof(MEMORY_BASIC_INFORMATION64) == 48, "MINIDUMP_MEMORY_INFO size mismatch");
+
+const uint32_t DumpSignature = 0x504D444D;      // MDMP
+const uint32_t DumpVersion = 0xA793;
+
+// MINIDUMP_STREAM_TYPE
+enum eStreamType
+{
+    ThreadListStream = 3,
+    ModuleListStream = 4,
+    MemoryListStream = 5,
+    SystemInfoStream = 7,
+    Memory64ListStream = 9,
+    MemoryInfoListStream = 16,
+};
+
+// MINIDUMP_SYSTEM_INFO::ProcessorArchitecture
+const uint16_t ArchAMD64 = 9;
+const uint16_t ArchIA64 = 6;
+const uint16_t ArchARM64 = 12;
+
+const ptr_t PageMask = 0xFFF;
+
+}
+
+Minidump::Minidump()
+{
+}
+
+Minidump::~Minidump()
+{
+    Close();
+}
+
+/// <summary>
+/// Map dump file and index its streams
+/// </summary>
+/// <param name="path">Dump file path</param>
+/// <returns>Status code</returns>
+NTSTATUS Minidump::Open( const std::wstring& path )
+{
+    Close();
+
+    if (_file.Project( path ) == nullptr)
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+
+    _data = reinterpret_cast<const uint8_t*>(_file.base());
+    _size = _file.size();
+
+    NTSTATUS status = Parse();
+    if (status != STATUS_SUCCESS)
+        Close();
+
+    return status;
+}
+
+/// <summary>
+/// Index dump already loaded into memory. Data must stay valid until Close
+/// </summary>
+/// <param name="data">Dump data</param>
+/// <param name="size">Dump size</param>
+/// <returns>Status code</returns>
+NTSTATUS Minidump::Open( const void* data, size_t size )
+{
+    Close();
+
+    _data = reinterpret_cast<const uint8_t*>(data);
+    _size = size;
+
+    NTSTATUS status = Parse();
+    if (status != STATUS_SUCCESS)
+        Close();
+
+    return status;
+}
+
+/// <summary>
+/// Drop dump mapping and indexes
+/// </summary>
+void Minidump::Close()
+{
+    _file.Release();
+    _data = nullptr;
+    _size = 0;
+    _is64 = false;
+    _ranges.clear();
+    _info.clear();
+    _modules.clear();
+    _threads.clear();
+}
+
+/// <summary>
+/// Get pointer to dumped memory
+/// </summary>
+/// <param name="address">Target address</param>
+/// <param name="available">Number of bytes available at returned pointer</param>
+/// <returns>Pointer into dump data, nullptr if address wasn't captured</returns>
+const uint8_t* Minidump::Translate( ptr_t address, size_t& available ) const
+{
+    auto iter = std::upper_bound( _ranges.begin(), _ranges.end(), address,
+        []( ptr_t value, const Range& range ) { return value < range.address; } );
+
+    available = 0;
+    if (iter == _ranges.begin())
+        return nullptr;
+
+    --iter;
+    if (address - iter->address >= iter->size)
+        return nullptr;
+
+    ptr_t delta = address - iter->address;
+    available = static_cast<size_t>(iter->size - delta);
+    return _data + iter->offset + delta;
+}
+
+/// <summary>
+/// Read dumped memory
+/// </summary>
+/// <param name="address">Target address</param>
+/// <param name="buffer">Output buffer</param>
+/// <param name="size">Number of bytes to read</param>
+/// <param name="pRead">Number of bytes read</param>
+/// <returns>STATUS_SUCCESS if whole range was captured, STATUS_PARTIAL_COPY otherwise</returns>
+NTSTATUS Minidump::Read( ptr_t address, void* buffer, size_t size, size_t* pRead /*= nullptr*/ ) const
+{
+    auto pOut = reinterpret_cast<uint8_t*>(buffer);
+    size_t done = 0;
+
+    // Range may be split between adjacent descriptors
+    while (done < size)
+    {
+        size_t available = 0;
+        auto pData = Translate( address + done, available );
+        if (pData == nullptr)
+            break;
+
+        size_t chunk = std::min<size_t>( available, size - done );
+        memcpy( pOut + done, pData, chunk );
+        done += chunk;
+    }
+
+    if (pRead)
+        *pRead = done;
+
+    return (done == size) ? STATUS_SUCCESS : STATUS_PARTIAL_COPY;
+}
+
+/// <summary>
+/// Get memory region info.
+/// Without MemoryInfoList stream captured ranges are reported as committed read-only memory
+/// </summary>
+/// <param name="address">Target address</param>
+/// <param name="mbi">Region info, BaseAddress is page containing address</param>
+/// <returns>Status code, STATUS_INVALID_PARAMETER past the last region</returns>
+NTSTATUS Minidump::Query( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi ) const
+{
+    ptr_t page = address & ~PageMask;
+    ptr_t prevEnd = 0, nextBase = 0;
+
+    if (!_info.empty())
+    {
+        auto iter = std::upper_bound( _info.begin(), _info.end(), address,
+            []( ptr_t value, const MEMORY_BASIC_INFORMATION64& region ) { return value < region.BaseAddress; } );
+
+        if (iter != _info.begin() && address - (iter - 1)->BaseAddress < (iter - 1)->RegionSize)
+        {
+            --iter;
+            ptr_t start = std::max<ptr_t>( page, iter->BaseAddress );
+
+            mbi = *iter;
+            mbi.RegionSize -= start - iter->BaseAddress;
+            mbi.BaseAddress = start;
+            return STATUS_SUCCESS;
+        }
+
+        if (iter == _info.end())
+            return STATUS_INVALID_PARAMETER;
+
+        if (iter != _info.begin())
+            prevEnd = (iter - 1)->BaseAddress + (iter - 1)->RegionSize;
+
+        nextBase = iter->BaseAddress;
+    }
+    else
+    {
+        auto iter = std::upper_bound( _ranges.begin(), _ranges.end(), address,
+            []( ptr_t value, const Range& range ) { return value < range.address; } );
+
+        if (iter != _ranges.begin() && address - (iter - 1)->address < (iter - 1)->size)
+        {
+            --iter;
+            ptr_t start = std::max<ptr_t>( page, iter->address );
+
+            memset( &mbi, 0, sizeof(mbi) );
+            mbi.BaseAddress = start;
+            mbi.AllocationBase = iter->address;
+            mbi.AllocationProtect = PAGE_READONLY;
+            mbi.RegionSize = iter->address + iter->size - start;
+            mbi.State = MEM_COMMIT;
+            mbi.Protect = PAGE_READONLY;
+            mbi.Type = MEM_PRIVATE;
+            return STATUS_SUCCESS;
+        }
+
+        if (iter == _ranges.end())
+            return STATUS_INVALID_PARAMETER;
+
+        if (iter != _ranges.begin())
+            prevEnd = (iter - 1)->address + (iter - 1)->size;
+
+        nextBase = iter->address;
+    }
+
+    // Gap between known regions, they aren't always page aligned
+    ptr_t start = std::max<ptr_t>( page, prevEnd );
+    memset( &mbi, 0, sizeof(mbi) );
+    mbi.BaseAddress = start;
+    mbi.RegionSize = nextBase - start;
+    mbi.State = MEM_FREE;
+    mbi.Protect = PAGE_NOACCESS;
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Find module containing address
+/// </summary>
+/// <param name="address">Target address</param>
+/// <returns>Module, nullptr if not found</returns>
+const Minidump::Module* Minidump::FindModule( ptr_t address ) const
+{
+    for (auto& mod : _modules)
+        if (address >= mod.base && address - mod.base < mod.size)
+            return &mod;
+
+    return nullptr;
+}
+
+/// <summary>
+/// Find thread by ID
+/// </summary>
+/// <param name="id">Thread ID</param>
+/// <returns>Thread, nullptr if not found</returns>
+const Minidump::Thread* Minidump::FindThread( uint32_t id ) const
+{
+    for (auto& thread : _threads)
+        if (thread.id == id)
+            return &thread;
+
+    return nullptr;
+}
+
+/// <summary>
+/// Get dump data at offset
+/// </summary>
+/// <param name="offset">Offset in dump</param>
+/// <param name="size">Required data size</param>
+/// <returns>Pointer to data, nullptr if range is outside the dump</returns>
+const uint8_t* Minidump::At( uint64_t offset, uint64_t size ) const
+{
+    if (offset > _size || size > _size - offset)
+        return nullptr;
+
+    return _data + offset;
+}
+
+/// <summary>
+/// Read MINIDUMP_STRING
+/// </summary>
+/// <param name="offset">String offset in dump</param>
+/// <returns>String, empty if offset is invalid</returns>
+std::wstring Minidump::ReadString( uint64_t offset ) const
+{
+    uint32_t length = 0;
+    auto pLength = At( offset, sizeof(length) );
+    if (pLength == nullptr)
+        return std::wstring();
+
+    memcpy( &length, pLength, sizeof(length) );
+
+    auto pChars = At( offset + sizeof(length), length );
+    if (pChars == nullptr)
+        return std::wstring();
+
+    // UTF-16, surrogate pairs are combined where wchar_t is 32 bit
+    std::wstring result;
+    result.reserve( length / 2 );
+
+    for (uint32_t i = 0; i + 1 < length; i += 2)
+    {
+        uint32_t ch = pChars[i] | (pChars[i + 1] << 8);
+
+        if (sizeof(wchar_t) == 4 && ch >= 0xD800 && ch < 0xDC00 && i + 3 < length)
+        {
+            uint32_t low = pChars[i + 2] | (pChars[i + 3] << 8);
+            if (low >= 0xDC00 && low < 0xE000)
+            {
+                ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+        }
+
+        result.push_back( static_cast<wchar_t>(ch) );
+    }
+
+    return result;
+}
+
+/// <summary>
+/// Index streams
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS Minidump::Parse()
+{
+    DumpHeader header = { 0 };
+    auto pHeader = At( 0, sizeof(header) );
+    if (pHeader == nullptr)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    memcpy( &header, pHeader, sizeof(header) );
+    if (header.signature != DumpSignature || (header.version & 0xFFFF) != DumpVersion)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    auto pDirectory = At( header.streamRva, static_cast<uint64_t>(header.streamCount) * sizeof(DumpDirectory) );
+    if (pDirectory == nullptr)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    for (uint32_t i = 0; i < header.streamCount; i++)
+    {
+        DumpDirectory dir = { 0 };
+        memcpy( &dir, pDirectory + i * sizeof(dir), sizeof(dir) );
+
+        // Damaged streams are skipped, the rest of dump is still usable
+        auto pStream = At( dir.rva, dir.dataSize );
+        if (pStream == nullptr)
+            continue;
+
+        switch (dir.type)
+        {
+            case ThreadListStream:
+                ParseThreadList( pStream, dir.dataSize );
+                break;
+
+            case ModuleListStream:
+                ParseModuleList( pStream, dir.dataSize );
+                break;
+
+            case MemoryListStream:
+                ParseMemoryList( pStream, dir.dataSize );
+                break;
+
+            case Memory64ListStream:
+                ParseMemory64List( pStream, dir.dataSize );
+                break;
+
+            case MemoryInfoListStream:
+                ParseMemoryInfoList( pStream, dir.dataSize );
+                break;
+
+            case SystemInfoStream:
+                if (dir.dataSize >= sizeof(uint16_t))
+                {
+                    uint16_t arch = pStream[0] | (pStream[1] << 8);
+                    _is64 = (arch == ArchAMD64 || arch == ArchIA64 || arch == ArchARM64);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    std::sort( _ranges.begin(), _ranges.end(), []( const Range& l, const Range& r ) { return l.address < r.address; } );
+    std::sort( _info.begin(), _info.end(), []( const MEMORY_BASIC_INFORMATION64& l, const MEMORY_BASIC_INFORMATION64& r )
+    {
+        return l.BaseAddress < r.BaseAddress;
+    } );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Index MemoryListStream, used by dumps without full memory
+/// </summary>
+/// <param name="pStream">Stream data</param>
+/// <param name="size">Stream size</param>
+void Minidump::ParseMemoryList( const uint8_t* pStream, uint32_t size )
+{
+    uint32_t count = 0;
+    if (size < sizeof(count))
+        return;
+
+    memcpy( &count, pStream, sizeof(count) );
+    count = std::min<uint32_t>( count, static_cast<uint32_t>((size - sizeof(count)) / sizeof(DumpMemoryDescriptor)) );
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        DumpMemoryDescriptor desc = { 0 };
+        memcpy( &desc, pStream + sizeof(count) + i * sizeof(desc), sizeof(desc) );
+
+        if (desc.dataSize != 0 && At( desc.rva, desc.dataSize ) != nullptr)
+        {
+            Range range = { desc.start, desc.dataSize, desc.rva };
+            _ranges.emplace_back( range );
+        }
+    }
+}
+
+/// <summary>
+/// Index Memory64ListStream. Data of all ranges is stored contiguously after BaseRva
+/// </summary>
+/// <param name="pStream">Stream data</param>
+/// <param name="size">Stream size</param>
+void Minidump::ParseMemory64List( const uint8_t* pStream, uint32_t size )
+{
+    DumpMemory64List list = { 0 };
+    if (size < sizeof(list))
+        return;
+
+    memcpy( &list, pStream, sizeof(list) );
+    list.count = std::min<uint64_t>( list.count, (size - sizeof(list)) / sizeof(DumpMemoryDescriptor64) );
+
+    // Truncated dump keeps ranges that were written completely
+    uint64_t offset = list.baseRva;
+    for (uint64_t i = 0; i < list.count; i++)
+    {
+        DumpMemoryDescriptor64 desc = { 0 };
+        memcpy( &desc, pStream + sizeof(list) + i * sizeof(desc), sizeof(desc) );
+
+        if (At( offset, desc.dataSize ) == nullptr)
+            break;
+
+        if (desc.dataSize != 0)
+        {
+            Range range = { desc.start, desc.dataSize, offset };
+            _ranges.emplace_back( range );
+        }
+
+        offset += desc.dataSize;
+    }
+}
+
+/// <summary>
+/// Index MemoryInfoListStream, MINIDUMP_MEMORY_INFO matches MEMORY_BASIC_INFORMATION64 layout
+/// </summary>
+/// <param name="pStream">Stream data</param>
+/// <param name="size">Stream size</param>
+void Minidump::ParseMemoryInfoList( const uint8_t* pStream, uint32_t size )
+{
+    DumpMemoryInfoList list = { 0 };
+    if (size < sizeof(list))
+        return;
+
+    memcpy( &list, pStream, sizeof(list) );
+    if (list.headerSize < sizeof(list) || list.headerSize > size || list.entrySize < sizeof(MEMORY_BASIC_INFORMATION64))
+        return;
+
+    list.count = std::min<uint64_t>( list.count, (size - list.headerSize) / list.entrySize );
+    _info.reserve( static_cast<size_t>(list.count) );
+
+    for (uint64_t i = 0; i < list.count; i++)
+    {
+        MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+        memcpy( &mbi, pStream + list.headerSize + i * list.entrySize, sizeof(mbi) );
+
+        if (mbi.RegionSize != 0)
+            _info.emplace_back( mbi );
+    }
+}
+
+/// <summary>
+/// Index ModuleListStream
+/// </summary>
+/// <param name="pStream">Stream data</param>
+/// <param name="size">Stream size</param>
+void Minidump::ParseModuleList( const uint8_t* pStream, uint32_t size )
+{
+    uint32_t count = 0;
+    if (size < sizeof(count))
+        return;
+
+    memcpy( &count, pStream, sizeof(count) );
+    count = std::min<uint32_t>( count, static_cast<uint32_t>((size - sizeof(count)) / sizeof(DumpModule)) );
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        DumpModule mod;
+        memcpy( &mod, pStream + sizeof(count) + i * sizeof(mod), sizeof(mod) );
+
+        Module data = { mod.base, mod.size, ReadString( mod.nameRva ) };
+        _modules.emplace_back( data );
+    }
+}
+
+/// <summary>
+/// Index ThreadListStream
+/// </summary>
+/// <param name="pStream">Stream data</param>
+/// <param name="size">Stream size</param>
+void Minidump::ParseThreadList( const uint8_t* pStream, uint32_t size )
+{
+    uint32_t count = 0;
+    if (size < sizeof(count))
+        return;
+
+    memcpy( &count, pStream, sizeof(count) );
+    count = std::min<uint32_t>( count, static_cast<uint32_t>((size - sizeof(count)) / sizeof(DumpThread)) );
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        DumpThread thd;
+        memcpy( &thd, pStream + sizeof(count) + i * sizeof(thd), sizeof(thd) );
+
+        Thread data = { thd.id, thd.teb, thd.stack.start, thd.stack.dataSize };
+        _threads.emplace_back( data );
+    }
+}
+
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+#include "FileProjection.h"
+
+#include <string>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Read-only view of user-mode minidump.
+/// Memory, memory info, module and thread streams are indexed once,
+/// memory contents are served directly from file mapping
+/// </summary>
+class Minidump
+{
+public:
+    // Module from ModuleList stream
+    struct Module
+    {
+        ptr_t base;             // Image base
+        uint32_t size;          // Image size
+        std::wstring path;      // Full image path
+    };
+
+    // Thread from ThreadList stream
+    struct Thread
+    {
+        uint32_t id;            // Thread ID
+        ptr_t teb;              // TEB address
+        ptr_t stack;            // Lowest address of captured stack
+        ptr_t stackSize;        // Captured stack size
+    };
+
+public:
+    Minidump();
+    ~Minidump();
+
+    /// <summary>
+    /// Map dump file and index its streams
+    /// </summary>
+    /// <param name="path">Dump file path</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Open( const std::wstring& path );
+
+    /// <summary>
+    /// Index dump already loaded into memory. Data must stay valid until Close
+    /// </summary>
+    /// <param name="data">Dump data</param>
+    /// <param name="size">Dump size</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Open( const void* data, size_t size );
+
+    /// <summary>
+    /// Drop dump mapping and indexes
+    /// </summary>
+    void Close();
+
+    /// <summary>
+    /// Get pointer to dumped memory
+    /// </summary>
+    /// <param name="address">Target address</param>
+    /// <param name="available">Number of bytes available at returned pointer</param>
+    /// <returns>Pointer into dump data, nullptr if address wasn't captured</returns>
+    const uint8_t* Translate( ptr_t address, size_t& available ) const;
+
+    /// <summary>
+    /// Read dumped memory
+    /// </summary>
+    /// <param name="address">Target address</param>
+    /// <param name="buffer">Output buffer</param>
+    /// <param name="size">Number of bytes to read</param>
+    /// <param name="pRead">Number of bytes read</param>
+    /// <returns>STATUS_SUCCESS if whole range was captured, STATUS_PARTIAL_COPY otherwise</returns>
+    NTSTATUS Read( ptr_t address, void* buffer, size_t size, size_t* pRead = nullptr ) const;
+
+    /// <summary>
+    /// Get memory region info.
+    /// Without MemoryInfoList stream captured ranges are reported as committed read-only memory
+    /// </summary>
+    /// <param name="address">Target address</param>
+    /// <param name="mbi">Region info, BaseAddress is page containing address</param>
+    /// <returns>Status code, STATUS_INVALID_PARAMETER past the last region</returns>
+    NTSTATUS Query( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi ) const;
+
+    /// <summary>
+    /// Find module containing address
+    /// </summary>
+    /// <param name="address">Target address</param>
+    /// <returns>Module, nullptr if not found</returns>
+    const Module* FindModule( ptr_t address ) const;
+
+    /// <summary>
+    /// Find thread by ID
+    /// </summary>
+    /// <param name="id">Thread ID</param>
+    /// <returns>Thread, nullptr if not found</returns>
+    const Thread* FindThread( uint32_t id ) const;
+
+    inline const std::vector<Module>& modules() const { return _modules; }
+    inline const std::vector<Thread>& threads() const { return _threads; }
+    inline bool is64() const { return _is64; }
+    inline bool valid() const { return _data != nullptr; }
+
+private:
+    // Captured memory range
+    struct Range
+    {
+        ptr_t address;          // Range start
+        ptr_t size;             // Range size
+        uint64_t offset;        // Offset of range data in dump
+    };
+
+    /// <summary>
+    /// Get dump data at offset
+    /// </summary>
+    /// <param name="offset">Offset in dump</param>
+    /// <param name="size">Required data size</param>
+    /// <returns>Pointer to data, nullptr if range is outside the dump</returns>
+    const uint8_t* At( uint64_t offset, uint64_t size ) const;
+
+    /// <summary>
+    /// Read MINIDUMP_STRING
+    /// </summary>
+    /// <param name="offset">String offset in dump</param>
+    /// <returns>String, empty if offset is invalid</returns>
+    std::wstring ReadString( uint64_t offset ) const;
+
+    /// <summary>
+    /// Index streams
+    /// </summary>
+    /// <returns>Status code</returns>
+    NTSTATUS Parse();
+
+    /// <summary>
+    /// Index MemoryListStream, used by dumps without full memory
+    /// </summary>
+    /// <param name="pStream">Stream data</param>
+    /// <param name="size">Stream size</param>
+    void ParseMemoryList( const uint8_t* pStream, uint32_t size );
+
+    /// <summary>
+    /// Index Memory64ListStream. Data of all ranges is stored contiguously after BaseRva
+    /// </summary>
+    /// <param name="pStream">Stream data</param>
+    /// <param name="size">Stream size</param>
+    void ParseMemory64List( const uint8_t* pStream, uint32_t size );
+
+    /// <summary>
+    /// Index MemoryInfoListStream, MINIDUMP_MEMORY_INFO matches MEMORY_BASIC_INFORMATION64 layout
+    /// </summary>
+    /// <param name="pStream">Stream data</param>
+    /// <param name="size">Stream size</param>
+    void ParseMemoryInfoList( const uint8_t* pStream, uint32_t size );
+
+    /// <summary>
+    /// Index ModuleListStream
+    /// </summary>
+    /// <param name="pStream">Stream data</param>
+    /// <param name="size">Stream size</param>
+    void ParseModuleList( const uint8_t* pStream, uint32_t size );
+
+    /// <summary>
+    /// Index ThreadListStream
+    /// </summary>
+    /// <param name="pStream">Stream data</param>
+    /// <param name="size">Stream size</param>
+    void ParseThreadList( const uint8_t* pStream, uint32_t size );
+
+private:
+    Minidump( const Minidump& ) = delete;
+    Minidump& operator =(const Minidump&) = delete;
+
+private:
+    FileProjection _file;                       // Dump file mapping
+    const uint8_t* _data = nullptr;             // Dump data
+    size_t _size = 0;                           // Dump size
+    bool _is64 = false;                         // Dumped process is 64 bit
+    std::vector<Range> _ranges;                 // Captured memory, sorted by address
+    std::vector<MEMORY_BASIC_INFORMATION64> _info;  // Memory regions, sorted by address
+    std::vector<Module> _modules;               // Loaded modules
+    std::vector<Thread> _threads;               // Threads
+};
+
+}
@@ -0,0 +1,120 @@
+#include "MinidumpNative.h"
+#include "Macro.h"
+
+namespace blackbone
+{
+
+MinidumpNative::MinidumpNative()
+    : OfflineNative(
+        [this]( ptr_t address, std::wstring& path )
+        {
+            auto pMod = _dump.FindModule( address );
+            if (pMod != nullptr)
+                path = pMod->path;
+
+            return pMod != nullptr;
+        },
+        [this]( uint32_t id )
+        {
+            auto pThread = _dump.FindThread( id );
+            return pThread != nullptr ? pThread->teb : 0;
+        } )
+{
+}
+
+MinidumpNative::~MinidumpNative()
+{
+}
+
+/// <summary>
+/// Map dump file
+/// </summary>
+/// <param name="path">Dump file path</param>
+/// <returns>Status code</returns>
+NTSTATUS MinidumpNative::Open( const std::wstring& path )
+{
+    NTSTATUS status = _dump.Open( path );
+    _regions.Reset();
+
+    if (status != STATUS_SUCCESS)
+        return status;
+
+    // Barrier is defined by dumped process bitness
+    SetTargetBitness( _dump.is64() );
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Read dumped memory
+/// </summary>
+/// <param name="lpBaseAddress">Memory address</param>
+/// <param name="lpBuffer">Output buffer</param>
+/// <param name="nSize">Number of bytes to read</param>
+/// <param name="lpBytes">Mumber of bytes read</param>
+/// <returns>Status code</returns>
+NTSTATUS MinidumpNative::ReadProcessMemoryT( ptr_t lpBaseAddress, LPVOID lpBuffer, size_t nSize, DWORD64 *lpBytes /*= nullptr */ )
+{
+    size_t read = 0;
+    NTSTATUS status = _dump.Read( lpBaseAddress, lpBuffer, nSize, &read );
+
+    if (lpBytes)
+        *lpBytes = read;
+
+    return LastNtStatus( status );
+}
+
+/// <summary>
+/// Query dumped memory regions
+/// </summary>
+/// <param name="lpAddress">Address to query</param>
+/// <param name="lpBuffer">Retrieved memory info</param>
+/// <returns>Status code</returns>
+NTSTATUS MinidumpNative::VirtualQueryExT( ptr_t lpAddress, PMEMORY_BASIC_INFORMATION64 lpBuffer )
+{
+    return LastNtStatus( _dump.Query( lpAddress, *lpBuffer ) );
+}
+
+/// <summary>
+/// Get PEB of 32 bit process
+/// </summary>
+/// <param name="ppeb">Retrieved PEB</param>
+/// <returns>PEB pointer</returns>
+ptr_t MinidumpNative::getPEB( _PEB32* ppeb )
+{
+    return _dump.is64() ? 0 : getPEBT<DWORD>( ppeb );
+}
+
+/// <summary>
+/// Get PEB of 64 bit process
+/// </summary>
+/// <param name="ppeb">Retrieved PEB</param>
+/// <returns>PEB pointer</returns>
+ptr_t MinidumpNative::getPEB( _PEB64* ppeb )
+{
+    return _dump.is64() ? getPEBT<DWORD64>( ppeb ) : 0;
+}
+
+/// <summary>
+/// Read PEB pointer from TEB of the first dumped thread
+/// </summary>
+/// <returns>PEB pointer, 0 if not found</returns>
+template<typename T>
+ptr_t MinidumpNative::getPEBT( typename _PEB_T2<T>::type* ppeb )
+{
+    T peb = 0;
+
+    for (auto& thread : _dump.threads())
+    {
+        if (_dump.Read( thread.teb + FIELD_OFFSET( _TEB_T<T>, ProcessEnvironmentBlock ), &peb, sizeof(peb) ) != STATUS_SUCCESS || peb == 0)
+            continue;
+
+        if (ppeb)
+            _dump.Read( peb, ppeb, sizeof(*ppeb) );
+
+        return peb;
+    }
+
+    return 0;
+}
+
+}
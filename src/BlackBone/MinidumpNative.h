@@ -0,0 +1,72 @@
+#pragma once
+
+#include "OfflineNative.h"
+#include "Minidump.h"
+
+namespace blackbone
+{
+
+/// <summary>
+/// Crash dump subsystem. Serves memory and module queries from minidump
+/// </summary>
+class MinidumpNative : public OfflineNative
+{
+public:
+    MinidumpNative();
+    ~MinidumpNative();
+
+    /// <summary>
+    /// Map dump file
+    /// </summary>
+    /// <param name="path">Dump file path</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Open( const std::wstring& path );
+
+    /// <summary>
+    /// Read dumped memory
+    /// </summary>
+    /// <param name="lpBaseAddress">Memory address</param>
+    /// <param name="lpBuffer">Output buffer</param>
+    /// <param name="nSize">Number of bytes to read</param>
+    /// <param name="lpBytes">Mumber of bytes read</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS ReadProcessMemoryT( ptr_t lpBaseAddress, LPVOID lpBuffer, size_t nSize, DWORD64 *lpBytes = nullptr );
+
+    /// <summary>
+    /// Query dumped memory regions
+    /// </summary>
+    /// <param name="lpAddress">Address to query</param>
+    /// <param name="lpBuffer">Retrieved memory info</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS VirtualQueryExT( ptr_t lpAddress, PMEMORY_BASIC_INFORMATION64 lpBuffer );
+    using OfflineNative::VirtualQueryExT;
+
+    /// <summary>
+    /// Get PEB of 32 bit process
+    /// </summary>
+    /// <param name="ppeb">Retrieved PEB</param>
+    /// <returns>PEB pointer</returns>
+    virtual ptr_t getPEB( _PEB32* ppeb );
+
+    /// <summary>
+    /// Get PEB of 64 bit process
+    /// </summary>
+    /// <param name="ppeb">Retrieved PEB</param>
+    /// <returns>PEB pointer</returns>
+    virtual ptr_t getPEB( _PEB64* ppeb );
+
+    inline Minidump& dump() { return _dump; }
+
+private:
+    /// <summary>
+    /// Read PEB pointer from TEB of the first dumped thread
+    /// </summary>
+    /// <returns>PEB pointer, 0 if not found</returns>
+    template<typename T>
+    ptr_t getPEBT( typename _PEB_T2<T>::type* ppeb );
+
+private:
+    Minidump _dump;     // Dump file
+};
+
+}
@@ -11,6 +11,7 @@ namespace blackbone
 
 Native::Native( HANDLE hProcess, bool x86OS /*= false*/ )
     : _hProcess( hProcess )
+    , _regions( minAddr(), maxAddr(), [this]( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi ) { return VirtualQueryExT( address, &mbi ); } )
 {
     SYSTEM_INFO info = { 0 };
     GetNativeSystemInfo( &info );
@@ -73,6 +74,9 @@ NTSTATUS Native::VirualAllocExT( ptr_t& lpAddress, size_t dwSize, DWORD flAlloca
     lpAddress = reinterpret_cast<ptr_t>
         (VirtualAllocEx( _hProcess, reinterpret_cast<LPVOID>(lpAddress), dwSize, flAllocationType, flProtect ));
 
+    if (lpAddress != 0)
+        _regions.Invalidate( lpAddress, dwSize );
+
     return LastNtStatus();
 }
 
@@ -88,6 +92,8 @@ NTSTATUS Native::VirualFreeExT( ptr_t lpAddress, size_t dwSize, DWORD dwFreeType
 {
     LastNtStatus( STATUS_SUCCESS );
     VirtualFreeEx( _hProcess, reinterpret_cast<LPVOID>(lpAddress), dwSize, dwFreeType );
+    _regions.Invalidate( lpAddress, dwSize );
+
     return LastNtStatus();
 }
 
@@ -140,6 +146,7 @@ NTSTATUS Native::VirtualProtectExT( ptr_t lpAddress, DWORD64 dwSize, DWORD flPro
     LastNtStatus( STATUS_SUCCESS );
 
     VirtualProtectEx( _hProcess, reinterpret_cast<LPVOID>(lpAddress), static_cast<SIZE_T>(dwSize), flProtect, flOld );
+    _regions.Invalidate( lpAddress, static_cast<size_t>(dwSize) );
 
     return LastNtStatus();
 }
@@ -401,26 +408,22 @@ size_t Native::EnumModulesT( Native::listModules& result )
 }
 
 /// <summary>
-/// Enum process section objects
+/// Enum process section objects.
+/// Address space is swept again, images mapped by target since last walk are found
 /// </summary>
 /// <param name="result">Found modules</param>
 /// <returns>Sections count</returns>
 size_t Native::EnumSections( listModules& result )
 {
-    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+    RegionMap::vecRegions regions;
     ptr_t lastBase = 0;
 
     result.clear( );
+    _regions.Reset();
+    _regions.Enum( minAddr(), maxAddr(), regions );
 
-    for (ptr_t memptr = minAddr(); memptr < maxAddr(); memptr = mbi.BaseAddress + mbi.RegionSize)
+    for (auto& mbi : regions)
     {
-        auto status = VirtualQueryExT( memptr, &mbi );
-
-        if (status == STATUS_INVALID_PARAMETER)
-            break;
-        else if (status != STATUS_SUCCESS)
-            continue;
-
         // Filter non-section regions
         if (mbi.State != MEM_COMMIT || mbi.Type != SEC_IMAGE || lastBase == mbi.AllocationBase)
             continue;
@@ -428,7 +431,7 @@ size_t Native::EnumSections( listModules& result )
         uint8_t buf[0x1000] = { 0 };
         _UNICODE_STRING_T<DWORD64>* ustr = (decltype(ustr))(buf + 0x800);
 
-        status = VirtualQueryExT( mbi.AllocationBase, MemorySectionName, ustr, sizeof(buf) / 2 );
+        auto status = VirtualQueryExT( mbi.AllocationBase, MemorySectionName, ustr, sizeof(buf) / 2 );
 
         // Get additional 
         if (status == STATUS_SUCCESS)
@@ -484,27 +487,23 @@ size_t Native::EnumSections( listModules& result )
 }
 
 /// <summary>
-/// Enum pages containing valid PE headers
+/// Enum pages containing valid PE headers.
+/// Address space is swept again, images mapped by target since last walk are found
 /// </summary>
 /// <param name="result">Found modules</param>
 /// <returns>Sections count</returns>
 size_t Native::EnumPEHeaders( listModules& result )
 {
-    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+    RegionMap::vecRegions regions;
     uint8_t buf[0x1000];
     ptr_t lastBase = 0;
 
     result.clear();
+    _regions.Reset();
+    _regions.Enum( minAddr(), maxAddr(), regions );
 
-    for (ptr_t memptr = minAddr(); memptr < maxAddr(); memptr = mbi.BaseAddress + mbi.RegionSize)
+    for (auto& mbi : regions)
     {
-        auto status = VirtualQueryExT( memptr, &mbi );
-
-        if (status == STATUS_INVALID_PARAMETER)
-            break;
-        else if (status != STATUS_SUCCESS)
-            continue;
-
         // Filter regions
         if (mbi.State != MEM_COMMIT || 
              mbi.AllocationProtect == PAGE_NOACCESS || 
@@ -547,7 +546,7 @@ size_t Native::EnumPEHeaders( listModules& result )
 
         // Try to get section name
         _UNICODE_STRING_T<DWORD64>* ustr = (decltype(ustr))buf;
-        status = VirtualQueryExT( mbi.AllocationBase, MemorySectionName, ustr, sizeof(buf) );
+        auto status = VirtualQueryExT( mbi.AllocationBase, MemorySectionName, ustr, sizeof(buf) );
 
         if (status == STATUS_SUCCESS)
         {
@@ -2,6 +2,7 @@
 
 #include "Winheaders.h"
 #include "Types.h"
+#include "RegionMap.h"
 
 #include <string>
 #include <list>
@@ -20,7 +21,7 @@ public:
 
 public:
     Native( HANDLE hProcess, bool x86OS = false );
-    ~Native();
+    virtual ~Native();
 
     inline const Wow64Barrier& GetWow64Barrier() const { return _wowBarrier; }
 
@@ -184,6 +185,14 @@ public:
     /// </summary>
     /// <returns>Address value</returns>
     inline uint32_t pageSize() const { return _pageSize; }
+
+    /// <summary>
+    /// Address space layout shared by region walkers.
+    /// Own allocations, frees and protection changes update affected ranges only,
+    /// changes made by target itself require RegionMap::Reset
+    /// </summary>
+    /// <returns>Region map</returns>
+    inline RegionMap& regions() { return _regions; }
 private:
 
     /// <summary>
@@ -212,6 +221,7 @@ protected:
     HANDLE _hProcess;           // Process handle
     Wow64Barrier _wowBarrier;   // WOW64 barrier info
     uint32_t _pageSize;
+    RegionMap _regions;         // Cached address space layout
 };
 
 }
\ No newline at end of file
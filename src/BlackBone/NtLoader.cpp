@@ -732,7 +732,8 @@ bool NtLdr::FindLdrpModuleBase()
 /// <returns>true on success</returns>
 bool NtLdr::ScanPatterns( )
 {
-    std::vector<ptr_t> foundData;
+    std::vector<PatternSet::Match> foundData;
+    PatternSet patterns;
     pe::PEParser ntdll;
     void* pStart  = nullptr;
     size_t scanSize = 0;
@@ -762,43 +763,41 @@ bool NtLdr::ScanPatterns( )
     #ifdef _M_AMD64
         // RtlInsertInvertedFunctionTable
         // 48 83 EC 20 8B F2 4C 8D 4C 24
-        PatternSearch ps1( "\x48\x83\xec\x20\x8b\xf2\x4c\x8d\x4c\x24" );
-        ps1.Search( pStart, scanSize, foundData );
-
-        if (!foundData.empty())
-        {
-            _RtlInsertInvertedFunctionTable = static_cast<size_t>(foundData.front() - 0xE);
-            _LdrpInvertedFunctionTable = (size_t)hNtdll + 0x129C50;//*reinterpret_cast<size_t*>(foundData.front() + 0x4A);
-            foundData.clear();
-        }
+        auto ps1 = patterns.Add( "\x48\x83\xec\x20\x8b\xf2\x4c\x8d\x4c\x24" );
 
         // LdrpHandleTlsData
         // 44 8D 43 09 4C 8D 4C 24 38
-        PatternSearch ps2( "\x44\x8d\x43\x09\x4c\x8d\x4c\x24\x38" );
-        ps2.Search( pStart, scanSize, foundData );
+        auto ps2 = patterns.Add( "\x44\x8d\x43\x09\x4c\x8d\x4c\x24\x38" );
 
-        if (!foundData.empty())
-            _LdrpHandleTlsData = static_cast<size_t>(foundData.front() - 0x43);
-    #else
-        // RtlInsertInvertedFunctionTable
-        // 8D 45 F4 89 55 F8 50 8D
-        PatternSearch ps1( "\x8d\x45\xf4\x89\x55\xf8\x50\x8d\x55\xfc" );
-        ps1.Search( pStart, scanSize, foundData );
+        patterns.Search( pStart, scanSize, foundData );
 
-        if (!foundData.empty())
+        if (auto found = PatternSet::First( foundData, ps1 ))
         {
-            _RtlInsertInvertedFunctionTable = static_cast<size_t>(foundData.front() - 0xB);
-            _LdrpInvertedFunctionTable = *reinterpret_cast<size_t*>(foundData.front( ) + 0x1D);
-            foundData.clear();
+            _RtlInsertInvertedFunctionTable = static_cast<size_t>(found - 0xE);
+            _LdrpInvertedFunctionTable = (size_t)hNtdll + 0x129C50;//*reinterpret_cast<size_t*>(found + 0x4A);
         }
 
+        if (auto found = PatternSet::First( foundData, ps2 ))
+            _LdrpHandleTlsData = static_cast<size_t>(found - 0x43);
+    #else
+        // RtlInsertInvertedFunctionTable
+        // 8D 45 F4 89 55 F8 50 8D
+        auto ps1 = patterns.Add( "\x8d\x45\xf4\x89\x55\xf8\x50\x8d\x55\xfc" );
+
         // LdrpHandleTlsData
         // 8D 45 A8 50 6A 09
-        PatternSearch ps2( "\x8d\x45\xa8\x50\x6a\x09" );
-        ps2.Search( pStart, scanSize, foundData );
+        auto ps2 = patterns.Add( "\x8d\x45\xa8\x50\x6a\x09" );
+
+        patterns.Search( pStart, scanSize, foundData );
 
-        if (!foundData.empty())
-            _LdrpHandleTlsData = static_cast<size_t>(foundData.front() - 0x18);
+        if (auto found = PatternSet::First( foundData, ps1 ))
+        {
+            _RtlInsertInvertedFunctionTable = static_cast<size_t>(found - 0xB);
+            _LdrpInvertedFunctionTable = *reinterpret_cast<size_t*>(found + 0x1D);
+        }
+
+        if (auto found = PatternSet::First( foundData, ps2 ))
+            _LdrpHandleTlsData = static_cast<size_t>(found - 0x18);
     #endif
     }
     // Win 8
@@ -807,31 +806,30 @@ bool NtLdr::ScanPatterns( )
     #ifdef _M_AMD64
         // LdrpHandleTlsData
         // 48 8B 79 30 45 8D 66 01
-        PatternSearch ps( "\x48\x8b\x79\x30\x45\x8d\x66\x01" );
-        ps.Search( pStart, scanSize, foundData );
+        auto ps = patterns.Add( "\x48\x8b\x79\x30\x45\x8d\x66\x01" );
+        patterns.Search( pStart, scanSize, foundData );
 
-        if (!foundData.empty())
-            _LdrpHandleTlsData = static_cast<size_t>(foundData.front() - 0x49);
+        if (auto found = PatternSet::First( foundData, ps ))
+            _LdrpHandleTlsData = static_cast<size_t>(found - 0x49);
     #else
         // RtlInsertInvertedFunctionTable
         // 8B FF 55 8B EC 51 51 53 57 8B 7D 08 8D
-        PatternSearch ps1( "\x8b\xff\x55\x8b\xec\x51\x51\x53\x57\x8b\x7d\x08\x8d" );
-        ps1.Search(pStart, scanSize, foundData );
+        auto ps1 = patterns.Add( "\x8b\xff\x55\x8b\xec\x51\x51\x53\x57\x8b\x7d\x08\x8d" );
+
+        // LdrpHandleTlsData
+        // 8B 45 08 89 45 A0
+        auto ps2 = patterns.Add( "\x8b\x45\x08\x89\x45\xa0" );
+
+        patterns.Search( pStart, scanSize, foundData );
 
-        if(!foundData.empty())
+        if (auto found = PatternSet::First( foundData, ps1 ))
         {
-            _RtlInsertInvertedFunctionTable = static_cast<size_t>(foundData.front());
+            _RtlInsertInvertedFunctionTable = static_cast<size_t>(found);
             _LdrpInvertedFunctionTable = *reinterpret_cast<size_t*>(_RtlInsertInvertedFunctionTable + 0x26);
-            foundData.clear();
         }
 
-        // LdrpHandleTlsData
-        // 8B 45 08 89 45 A0
-        PatternSearch ps2( "\x8b\x45\x08\x89\x45\xa0" );
-        ps2.Search( pStart, scanSize, foundData );
-
-        if(!foundData.empty())
-            _LdrpHandleTlsData = static_cast<size_t>(foundData.front() - 0xC);
+        if (auto found = PatternSet::First( foundData, ps2 ))
+            _LdrpHandleTlsData = static_cast<size_t>(found - 0xC);
                  
     #endif
 
@@ -842,66 +840,49 @@ bool NtLdr::ScanPatterns( )
     #ifdef _M_AMD64
         // LdrpHandleTlsData
         // 41 B8 09 00 00 00 48 8D 44 24 38
-        PatternSearch ps1( "\x41\xb8\x09\x00\x00\x00\x48\x8d\x44\x24\x38", 11 );
-        ps1.Search( pStart, scanSize, foundData );
-
-        if (!foundData.empty())
-        {
-            _LdrpHandleTlsData = static_cast<size_t>(foundData.front() - 0x27);
-            foundData.clear();            
-        }
+        auto ps1 = patterns.Add( "\x41\xb8\x09\x00\x00\x00\x48\x8d\x44\x24\x38", 11 );
 
         // LdrpFindOrMapDll patch address
         // 48 8D 8C 24 98 00 00 00 41 b0 01
-        PatternSearch ps2( "\x48\x8D\x8C\x24\x98\x00\x00\x00\x41\xb0\x01", 11 );
-        ps2.Search( pStart, scanSize, foundData );
-
-        if (!foundData.empty())
-        {
-            _LdrKernel32PatchAddress = static_cast<size_t>(foundData.front() + 0x12);
-            foundData.clear();            
-        }
+        auto ps2 = patterns.Add( "\x48\x8D\x8C\x24\x98\x00\x00\x00\x41\xb0\x01", 11 );
 
         // KiUserApcDispatcher patch address
         // 48 8B 4C 24 18 48 8B C1 4C
-        PatternSearch ps3( "\x48\x8b\x4c\x24\x18\x48\x8b\xc1\x4c");
-        ps3.Search( pStart, scanSize, foundData );
+        auto ps3 = patterns.Add( "\x48\x8b\x4c\x24\x18\x48\x8b\xc1\x4c" );
 
-        if (!foundData.empty())
-        {
-            _APC64PatchAddress = static_cast<size_t>(foundData.front());
-            foundData.clear();            
-        }
+        patterns.Search( pStart, scanSize, foundData );
+
+        if (auto found = PatternSet::First( foundData, ps1 ))
+            _LdrpHandleTlsData = static_cast<size_t>(found - 0x27);
+
+        if (auto found = PatternSet::First( foundData, ps2 ))
+            _LdrKernel32PatchAddress = static_cast<size_t>(found + 0x12);
+
+        if (auto found = PatternSet::First( foundData, ps3 ))
+            _APC64PatchAddress = static_cast<size_t>(found);
     #else
         // RtlInsertInvertedFunctionTable
         // 8B FF 55 8B EC 56 68
-        PatternSearch ps1( "\x8b\xff\x55\x8b\xec\x56\x68" );
-        ps1.Search( pStart, scanSize, foundData);
-
-        if(!foundData.empty())
-        {
-            _RtlInsertInvertedFunctionTable = static_cast<size_t>(foundData.front( ));
-            foundData.clear();
-        }
+        auto ps1 = patterns.Add( "\x8b\xff\x55\x8b\xec\x56\x68" );
 
         // RtlLookupFunctionTable + 0x11
         // 89 5D E0 38
-        PatternSearch ps2( "\x89\x5D\xE0\x38" );
-        ps2.Search( pStart, scanSize, foundData );
-                
-        if(!foundData.empty())
-        {
-            _LdrpInvertedFunctionTable = *reinterpret_cast<size_t*>(foundData.front() + 0x1B);
-            foundData.clear();
-        }
+        auto ps2 = patterns.Add( "\x89\x5D\xE0\x38" );
 
         // LdrpHandleTlsData
         // 74 20 8D 45 D4 50 6A 09 
-        PatternSearch ps3( "\x74\x20\x8d\x45\xd4\x50\x6a\x09" );
-        ps3.Search( pStart, scanSize, foundData );
+        auto ps3 = patterns.Add( "\x74\x20\x8d\x45\xd4\x50\x6a\x09" );
+
+        patterns.Search( pStart, scanSize, foundData );
+
+        if (auto found = PatternSet::First( foundData, ps1 ))
+            _RtlInsertInvertedFunctionTable = static_cast<size_t>(found);
+                
+        if (auto found = PatternSet::First( foundData, ps2 ))
+            _LdrpInvertedFunctionTable = *reinterpret_cast<size_t*>(found + 0x1B);
 
-        if(!foundData.empty())
-            _LdrpHandleTlsData = static_cast<size_t>(foundData.front() - 0x14);
+        if (auto found = PatternSet::First( foundData, ps3 ))
+            _LdrpHandleTlsData = static_cast<size_t>(found - 0x14);
 
     #endif
     }
@@ -0,0 +1,217 @@
+#include "OfflineNative.h"
+#include "Macro.h"
+
+namespace blackbone
+{
+
+OfflineNative::OfflineNative( fnFindModule findModule, fnFindThread findThread )
+    : Native( NULL )
+    , _findModule( findModule )
+    , _findThread( findThread )
+{
+}
+
+OfflineNative::~OfflineNative()
+{
+}
+
+/// <summary>
+/// Set WOW64 barrier by target bitness
+/// </summary>
+/// <param name="is64">Target is 64 bit process</param>
+void OfflineNative::SetTargetBitness( bool is64 )
+{
+    _wowBarrier.targetWow64 = !is64;
+    _wowBarrier.x86OS = false;
+
+    if (is64)
+        _wowBarrier.type = _wowBarrier.sourceWow64 ? wow_32_64 : wow_64_64;
+    else
+        _wowBarrier.type = _wowBarrier.sourceWow64 ? wow_32_32 : wow_64_32;
+}
+
+/// <summary>
+/// Allocate virtual memory
+/// </summary>
+/// <param name="lpAddress">Allocation address</param>
+/// <param name="dwSize">Region size</param>
+/// <param name="flAllocationType">Allocation type</param>
+/// <param name="flProtect">Memory protection</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::VirualAllocExT( ptr_t& /*lpAddress*/, size_t /*dwSize*/, DWORD /*flAllocationType*/, DWORD /*flProtect*/ )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+/// <summary>
+/// Free virtual memory
+/// </summary>
+/// <param name="lpAddress">Memory address</param>
+/// <param name="dwSize">Region size</param>
+/// <param name="dwFreeType">Memory release type.</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::VirualFreeExT( ptr_t /*lpAddress*/, size_t /*dwSize*/, DWORD /*dwFreeType*/ )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+/// <summary>
+/// Change memory protection
+/// </summary>
+/// <param name="lpAddress">Memory address.</param>
+/// <param name="dwSize">Region size</param>
+/// <param name="flProtect">New protection.</param>
+/// <param name="flOld">Old protection</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::VirtualProtectExT( ptr_t /*lpAddress*/, DWORD64 /*dwSize*/, DWORD /*flProtect*/, DWORD* /*flOld*/ )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+/// <summary>
+/// Write virtual memory
+/// </summary>
+/// <param name="lpBaseAddress">Memory address</param>
+/// <param name="lpBuffer">Buffer to write</param>
+/// <param name="nSize">Number of bytes to read</param>
+/// <param name="lpBytes">Mumber of bytes read</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::WriteProcessMemoryT( ptr_t /*lpBaseAddress*/, LPCVOID /*lpBuffer*/, size_t /*nSize*/, DWORD64 *lpBytes /*= nullptr */ )
+{
+    if (lpBytes)
+        *lpBytes = 0;
+
+    return LastNtStatus( STATUS_NOT_SUPPORTED );
+}
+
+/// <summary>
+/// Query virtual memory. Only MemorySectionName of known images is supported
+/// </summary>
+/// <param name="lpAddress">Address to query</param>
+/// <param name="lpBuffer">Retrieved memory info</param>
+/// <returns>Status code</returns>
+NTSTATUS OfflineNative::VirtualQueryExT( ptr_t lpAddress, MEMORY_INFORMATION_CLASS infoClass, LPVOID lpBuffer, size_t bufSize )
+{
+    if (infoClass != MemorySectionName)
+        return STATUS_NOT_SUPPORTED;
+
+    std::wstring path;
+    if (!_findModule( lpAddress, path ))
+        return STATUS_INVALID_ADDRESS;
+
+    // String data follows UNICODE_STRING, same as NtQueryVirtualMemory output
+    auto ustr = reinterpret_cast<_UNICODE_STRING_T<DWORD64>*>(lpBuffer);
+    size_t bytes = path.length() * sizeof(wchar_t);
+    if (bufSize < sizeof(*ustr) + bytes + sizeof(wchar_t))
+        return STATUS_BUFFER_OVERFLOW;
+
+    auto pStr = reinterpret_cast<wchar_t*>(ustr + 1);
+    memcpy( pStr, path.c_str(), bytes + sizeof(wchar_t) );
+
+    ustr->Length = static_cast<WORD>(bytes);
+    ustr->MaximumLength = static_cast<WORD>(bytes + sizeof(wchar_t));
+    ustr->Buffer = reinterpret_cast<DWORD64>(pStr);
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Creates new thread in the remote process
+/// </summary>
+/// <param name="hThread">Created thread handle</param>
+/// <param name="entry">Thread entry point</param>
+/// <param name="arg">Thread argument</param>
+/// <param name="flags">Creation flags</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::CreateRemoteThreadT( HANDLE& hThread, ptr_t /*entry*/, ptr_t /*arg*/, DWORD /*flags*/ )
+{
+    hThread = NULL;
+    return STATUS_NOT_SUPPORTED;
+}
+
+/// <summary>
+/// Get native thread context
+/// </summary>
+/// <param name="hThread">Thread handle.</param>
+/// <param name="ctx">Thread context</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::GetThreadContextT( HANDLE /*hThread*/, _CONTEXT64& /*ctx*/ )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+/// <summary>
+/// Get WOW64 thread context
+/// </summary>
+/// <param name="hThread">Thread handle.</param>
+/// <param name="ctx">Thread context</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::GetThreadContextT( HANDLE /*hThread*/, _CONTEXT32& /*ctx*/ )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+/// <summary>
+/// Set native thread context
+/// </summary>
+/// <param name="hThread">Thread handle.</param>
+/// <param name="ctx">Thread context</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::SetThreadContextT( HANDLE /*hThread*/, _CONTEXT64& /*ctx*/ )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+/// <summary>
+/// Set WOW64 thread context
+/// </summary>
+/// <param name="hThread">Thread handle.</param>
+/// <param name="ctx">Thread context</param>
+/// <returns>STATUS_NOT_SUPPORTED</returns>
+NTSTATUS OfflineNative::SetThreadContextT( HANDLE /*hThread*/, _CONTEXT32& /*ctx*/ )
+{
+    return STATUS_NOT_SUPPORTED;
+}
+
+/// <summary>
+/// Get TEB of 32 bit process thread
+/// </summary>
+/// <param name="hThread">Thread ID</param>
+/// <param name="ppeb">Retrieved TEB</param>
+/// <returns>TEB pointer, 0 if not found</returns>
+ptr_t OfflineNative::getTEB( HANDLE hThread, _TEB32* pteb )
+{
+    return _wowBarrier.targetWow64 ? getTEBT<DWORD>( hThread, pteb ) : 0;
+}
+
+/// <summary>
+/// Get TEB of 64 bit process thread
+/// </summary>
+/// <param name="hThread">Thread ID</param>
+/// <param name="ppeb">Retrieved TEB</param>
+/// <returns>TEB pointer, 0 if not found</returns>
+ptr_t OfflineNative::getTEB( HANDLE hThread, _TEB64* pteb )
+{
+    return _wowBarrier.targetWow64 ? 0 : getTEBT<DWORD64>( hThread, pteb );
+}
+
+/// <summary>
+/// Get TEB of target thread
+/// </summary>
+/// <param name="hThread">Thread ID</param>
+/// <param name="pteb">Retrieved TEB</param>
+/// <returns>TEB pointer, 0 if not found</returns>
+template<typename T>
+ptr_t OfflineNative::getTEBT( HANDLE hThread, _TEB_T<T>* pteb )
+{
+    ptr_t teb = _findThread( static_cast<uint32_t>(reinterpret_cast<uintptr_t>(hThread)) );
+    if (teb == 0)
+        return 0;
+
+    if (pteb)
+        ReadProcessMemoryT( teb, pteb, sizeof(*pteb) );
+
+    return teb;
+}
+
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "NativeSubsystem.h"
+
+#include <functional>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Base of subsystems without live target, e.g. crash dump or simulated process.
+/// Operations that modify target, execute code or access thread context fail with STATUS_NOT_SUPPORTED.
+/// There are no thread handles, thread ID cast to HANDLE is accepted by getTEB instead.
+/// Process has no thread list, so ProcessThreads is empty for such targets
+/// </summary>
+class OfflineNative : public Native
+{
+public:
+    // Get full path of image containing address. Returns false if address doesn't belong to image
+    typedef std::function<bool( ptr_t address, std::wstring& path )> fnFindModule;
+
+    // Get TEB address of thread by ID. Returns 0 if thread is unknown
+    typedef std::function<ptr_t( uint32_t id )> fnFindThread;
+
+public:
+    /// <summary>
+    /// Offline subsystem
+    /// </summary>
+    /// <param name="findModule">Image lookup</param>
+    /// <param name="findThread">Thread lookup</param>
+    OfflineNative( fnFindModule findModule, fnFindThread findThread );
+    ~OfflineNative();
+
+    /// <summary>
+    /// Allocate virtual memory
+    /// </summary>
+    /// <param name="lpAddress">Allocation address</param>
+    /// <param name="dwSize">Region size</param>
+    /// <param name="flAllocationType">Allocation type</param>
+    /// <param name="flProtect">Memory protection</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS VirualAllocExT( ptr_t& lpAddress, size_t dwSize, DWORD flAllocationType, DWORD flProtect );
+
+    /// <summary>
+    /// Free virtual memory
+    /// </summary>
+    /// <param name="lpAddress">Memory address</param>
+    /// <param name="dwSize">Region size</param>
+    /// <param name="dwFreeType">Memory release type.</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS VirualFreeExT( ptr_t lpAddress, size_t dwSize, DWORD dwFreeType );
+
+    /// <summary>
+    /// Change memory protection
+    /// </summary>
+    /// <param name="lpAddress">Memory address.</param>
+    /// <param name="dwSize">Region size</param>
+    /// <param name="flProtect">New protection.</param>
+    /// <param name="flOld">Old protection</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS VirtualProtectExT( ptr_t lpAddress, DWORD64 dwSize, DWORD flProtect, DWORD* flOld );
+
+    /// <summary>
+    /// Write virtual memory
+    /// </summary>
+    /// <param name="lpBaseAddress">Memory address</param>
+    /// <param name="lpBuffer">Buffer to write</param>
+    /// <param name="nSize">Number of bytes to read</param>
+    /// <param name="lpBytes">Mumber of bytes read</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS WriteProcessMemoryT( ptr_t lpBaseAddress, LPCVOID lpBuffer, size_t nSize, DWORD64 *lpBytes = nullptr );
+
+    /// <summary>
+    /// Query virtual memory. Only MemorySectionName of known images is supported
+    /// </summary>
+    /// <param name="lpAddress">Address to query</param>
+    /// <param name="lpBuffer">Retrieved memory info</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS VirtualQueryExT( ptr_t lpAddress, MEMORY_INFORMATION_CLASS infoClass, LPVOID lpBuffer, size_t bufSize );
+
+    /// <summary>
+    /// Creates new thread in the remote process
+    /// </summary>
+    /// <param name="hThread">Created thread handle</param>
+    /// <param name="entry">Thread entry point</param>
+    /// <param name="arg">Thread argument</param>
+    /// <param name="flags">Creation flags</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS CreateRemoteThreadT( HANDLE& hThread, ptr_t entry, ptr_t arg, DWORD flags );
+
+    /// <summary>
+    /// Get native thread context
+    /// </summary>
+    /// <param name="hThread">Thread handle.</param>
+    /// <param name="ctx">Thread context</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS GetThreadContextT( HANDLE hThread, _CONTEXT64& ctx );
+
+    /// <summary>
+    /// Get WOW64 thread context
+    /// </summary>
+    /// <param name="hThread">Thread handle.</param>
+    /// <param name="ctx">Thread context</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS GetThreadContextT( HANDLE hThread, _CONTEXT32& ctx );
+
+    /// <summary>
+    /// Set native thread context
+    /// </summary>
+    /// <param name="hThread">Thread handle.</param>
+    /// <param name="ctx">Thread context</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS SetThreadContextT( HANDLE hThread, _CONTEXT64& ctx );
+
+    /// <summary>
+    /// Set WOW64 thread context
+    /// </summary>
+    /// <param name="hThread">Thread handle.</param>
+    /// <param name="ctx">Thread context</param>
+    /// <returns>STATUS_NOT_SUPPORTED</returns>
+    virtual NTSTATUS SetThreadContextT( HANDLE hThread, _CONTEXT32& ctx );
+
+    /// <summary>
+    /// Get TEB of 32 bit process thread
+    /// </summary>
+    /// <param name="hThread">Thread ID</param>
+    /// <param name="ppeb">Retrieved TEB</param>
+    /// <returns>TEB pointer, 0 if not found</returns>
+    virtual ptr_t getTEB( HANDLE hThread, _TEB32* pteb );
+
+    /// <summary>
+    /// Get TEB of 64 bit process thread
+    /// </summary>
+    /// <param name="hThread">Thread ID</param>
+    /// <param name="ppeb">Retrieved TEB</param>
+    /// <returns>TEB pointer, 0 if not found</returns>
+    virtual ptr_t getTEB( HANDLE hThread, _TEB64* pteb );
+
+protected:
+    /// <summary>
+    /// Set WOW64 barrier by target bitness
+    /// </summary>
+    /// <param name="is64">Target is 64 bit process</param>
+    void SetTargetBitness( bool is64 );
+
+private:
+    /// <summary>
+    /// Get TEB of target thread
+    /// </summary>
+    /// <param name="hThread">Thread ID</param>
+    /// <param name="pteb">Retrieved TEB</param>
+    /// <returns>TEB pointer, 0 if not found</returns>
+    template<typename T>
+    ptr_t getTEBT( HANDLE hThread, _TEB_T<T>* pteb );
+
+private:
+    fnFindModule _findModule;   // Image lookup
+    fnFindThread _findThread;   // Thread lookup
+};
+
+}
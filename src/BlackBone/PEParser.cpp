@@ -2,6 +2,8 @@
 #include "Macro.h"
 #include "Utils.h"
 
+#include <algorithm>
+
 #define TLS32(ptr) ((const IMAGE_TLS_DIRECTORY32*)ptr)  // TLS directory
 #define TLS64(ptr) ((const IMAGE_TLS_DIRECTORY64*)ptr)  // TLS directory
 #define THK32(ptr) ((const IMAGE_THUNK_DATA32*)ptr)     // Import thunk data
@@ -14,6 +16,7 @@ namespace pe
 {
 
 PEParser::PEParser( void )
+    : _lastSection( 0 )
 {
 }
 
@@ -39,6 +42,10 @@ bool PEParser::Parse( const void* pFileBase, bool isPlainData /*= false*/ )
     }
 
     _isPlainData = isPlainData;
+    _sections.clear();
+    _sectionIndex.clear();
+    _imports.clear();
+    _delayImports.clear();
 
     // Get DOS header
     _pFileBase = pFileBase;
@@ -89,6 +96,12 @@ bool PEParser::Parse( const void* pFileBase, bool isPlainData /*= false*/ )
     // Exe file
     _isExe = !(_pImageHdr32->FileHeader.Characteristics & IMAGE_FILE_DLL);
 
+    // Sections
+    for (int i = 0; i < _pImageHdr32->FileHeader.NumberOfSections; ++i, pSection++)
+        _sections.push_back( *pSection );
+
+    BuildSectionIndex();
+
     // Pure IL image
     auto pCorHdr = reinterpret_cast<PIMAGE_COR20_HEADER>(DirectoryAddress( IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR ));
 
@@ -97,13 +110,90 @@ bool PEParser::Parse( const void* pFileBase, bool isPlainData /*= false*/ )
     else
         _isPureIL = false;
 
-    // Sections
-    for (int i = 0; i < _pImageHdr32->FileHeader.NumberOfSections; ++i, pSection++)
-        _sections.push_back( *pSection );
-
     return true;
 }
 
+/// <summary>
+/// Build section lookup index for plain data files
+/// </summary>
+void PEParser::BuildSectionIndex()
+{
+    _lastSection.store( 0, std::memory_order_relaxed );
+    _sectionsSorted = false;
+
+    // Last byte at VirtualAddress + VirtualSize is resolved to section too
+    for (auto& sec : _sections)
+    {
+        SectionRange range = { sec.VirtualAddress, 0, sec.PointerToRawData };
+        range.end = range.start + sec.Misc.VirtualSize + 1;
+        _sectionIndex.push_back( range );
+    }
+
+    std::vector<SectionRange> sorted( _sectionIndex );
+    std::stable_sort( sorted.begin(), sorted.end(), []( const SectionRange& l, const SectionRange& r ) { return l.start < r.start; } );
+
+    // Overlapping sections are resolved in table order, like before
+    for (size_t i = 1; i < sorted.size(); i++)
+    {
+        if (sorted[i].start + 1 < sorted[i - 1].end)
+            return;
+
+        // Section that starts at the end of previous one owns its first byte
+        sorted[i - 1].end = std::min<uint64_t>( sorted[i - 1].end, sorted[i].start );
+    }
+
+    _sectionIndex.swap( sorted );
+    _sectionsSorted = true;
+}
+
+/// <summary>
+/// Find section containing RVA
+/// </summary>
+/// <param name="rva">Memory address</param>
+/// <returns>Section entry, nullptr if not found</returns>
+const PEParser::SectionRange* PEParser::FindSection( size_t rva ) const
+{
+    if (_sectionIndex.empty())
+        return nullptr;
+
+    // Consecutive lookups usually hit the same section
+    auto pLast = &_sectionIndex[_lastSection.load( std::memory_order_relaxed )];
+    if (rva >= pLast->start && rva < pLast->end)
+        return pLast;
+
+    const SectionRange* pFound = nullptr;
+    if (_sectionsSorted)
+    {
+        // Last section starting at or below rva
+        auto pBase = _sectionIndex.data();
+        for (size_t count = _sectionIndex.size(); count > 1;)
+        {
+            size_t half = count / 2;
+            pBase = (pBase[half].start <= rva) ? pBase + half : pBase;
+            count -= half;
+        }
+
+        if (rva >= pBase->start && rva < pBase->end)
+            pFound = pBase;
+    }
+    else
+    {
+        for (auto& range : _sectionIndex)
+        {
+            if (rva >= range.start && rva < range.end)
+            {
+                pFound = &range;
+                break;
+            }
+        }
+    }
+
+    if (pFound != nullptr)
+        _lastSection.store( static_cast<uint32_t>(pFound - _sectionIndex.data()), std::memory_order_relaxed );
+
+    return pFound;
+}
+
 /// <summary>
 /// Processes image imports
 /// </summary>
@@ -117,24 +207,31 @@ mapImports& PEParser::ProcessImports( bool useDelayed /*= false*/ )
         if (!pImportTbl)
             return _delayImports;
 
+        _delayImports.clear();
+
         // Delayed Imports
         for (; pImportTbl->DllNameRVA; ++pImportTbl)
         {
             uint8_t* pRVA = nullptr;
             DWORD IAT_Index = 0;
-            char *pDllName = MAKE_PTR( char*, pImportTbl->DllNameRVA, _pFileBase );
-            auto dllStr = Utils::AnsiToWstring( pDllName );
+            char *pDllName = reinterpret_cast<char*>(ResolveRVAToVA( pImportTbl->DllNameRVA ));
+            pRVA = reinterpret_cast<uint8_t*>(ResolveRVAToVA( pImportTbl->ImportNameTableRVA ));
+            if (pDllName == nullptr || pRVA == nullptr)
+                continue;
 
-            pRVA = MAKE_PTR( uint8_t*, pImportTbl->ImportNameTableRVA, _pFileBase );
+            auto dllStr = Utils::AnsiToWstring( pDllName );
 
             while (_is64 ? THK64( pRVA )->u1.AddressOfData : THK32( pRVA )->u1.AddressOfData)
             {
                 uint64_t AddressOfData = _is64 ? THK64( pRVA )->u1.AddressOfData : THK32( pRVA )->u1.AddressOfData;
-                IMAGE_IMPORT_BY_NAME* pAddressTable = MAKE_PTR( IMAGE_IMPORT_BY_NAME*, AddressOfData, _pFileBase );
+                IMAGE_IMPORT_BY_NAME* pAddressTable = nullptr;
                 ImportData data;
 
+                if (AddressOfData < (_is64 ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32))
+                    pAddressTable = reinterpret_cast<IMAGE_IMPORT_BY_NAME*>(ResolveRVAToVA( static_cast<size_t>(AddressOfData) ));
+
                 // import by name
-                if (AddressOfData < (_is64 ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32) && pAddressTable->Name[0])
+                if (pAddressTable != nullptr && pAddressTable->Name[0])
                 {
                     data.importByOrd = false;
                     data.importName = pAddressTable->Name;
@@ -165,27 +262,36 @@ mapImports& PEParser::ProcessImports( bool useDelayed /*= false*/ )
         if (!pImportTbl)
             return _imports;
 
+        _imports.clear();
+
         // Imports
         for (; pImportTbl->Name; ++pImportTbl)
         {
             uint8_t* pRVA = nullptr;
             DWORD IAT_Index = 0;
-            char *pDllName = MAKE_PTR( char*, pImportTbl->Name, _pFileBase );
-            auto dllStr = Utils::AnsiToWstring( pDllName );
+            char *pDllName = reinterpret_cast<char*>(ResolveRVAToVA( pImportTbl->Name ));
 
             if (pImportTbl->OriginalFirstThunk)
-                pRVA = MAKE_PTR( uint8_t*, pImportTbl->OriginalFirstThunk, _pFileBase );
+                pRVA = reinterpret_cast<uint8_t*>(ResolveRVAToVA( pImportTbl->OriginalFirstThunk ));
             else
-                pRVA = MAKE_PTR( uint8_t*, pImportTbl->FirstThunk, _pFileBase );
+                pRVA = reinterpret_cast<uint8_t*>(ResolveRVAToVA( pImportTbl->FirstThunk ));
+
+            if (pDllName == nullptr || pRVA == nullptr)
+                continue;
+
+            auto dllStr = Utils::AnsiToWstring( pDllName );
 
             while (_is64 ? THK64( pRVA )->u1.AddressOfData : THK32( pRVA )->u1.AddressOfData)
             {
                 uint64_t AddressOfData = _is64 ? THK64( pRVA )->u1.AddressOfData : THK32( pRVA )->u1.AddressOfData;
-                IMAGE_IMPORT_BY_NAME* pAddressTable = MAKE_PTR( IMAGE_IMPORT_BY_NAME*, AddressOfData, _pFileBase );
+                IMAGE_IMPORT_BY_NAME* pAddressTable = nullptr;
                 ImportData data;
 
+                if (AddressOfData < (_is64 ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32))
+                    pAddressTable = reinterpret_cast<IMAGE_IMPORT_BY_NAME*>(ResolveRVAToVA( static_cast<size_t>(AddressOfData) ));
+
                 // import by name
-                if (AddressOfData < (_is64 ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32) && pAddressTable->Name[0])
+                if (pAddressTable != nullptr && pAddressTable->Name[0])
                 {
                     data.importByOrd   = false;
                     data.importName    = pAddressTable->Name;
@@ -230,10 +336,16 @@ void PEParser::GetExportNames( std::list<std::string>& names )
     if (pExport == 0)
         return;
 
-    DWORD *pAddressOfNames = reinterpret_cast<DWORD*>(pExport->AddressOfNames + reinterpret_cast<size_t>(_pFileBase));
+    DWORD *pAddressOfNames = reinterpret_cast<DWORD*>(ResolveRVAToVA( pExport->AddressOfNames ));
+    if (pAddressOfNames == nullptr)
+        return;
 
     for (DWORD i = 0; i < pExport->NumberOfNames; ++i)
-        names.push_back( reinterpret_cast<const char*>(_pFileBase) + pAddressOfNames[i] );
+    {
+        auto pName = reinterpret_cast<const char*>(ResolveRVAToVA( pAddressOfNames[i] ));
+        if (pName != nullptr)
+            names.push_back( pName );
+    }
 
     return;
 }
@@ -269,18 +381,12 @@ size_t PEParser::ResolveRVAToVA( size_t Rva, bool keepRelative /*= false*/ ) con
 {
     if (_isPlainData)
     {
-        for (auto& sec : _sections)
-        {
-            if (Rva >= sec.VirtualAddress && Rva <= sec.VirtualAddress + sec.Misc.VirtualSize)
-            {
-                if (keepRelative)
-                    return  (Rva - sec.VirtualAddress + sec.PointerToRawData);
-                else
-                    return reinterpret_cast<size_t>(_pFileBase)+(Rva - sec.VirtualAddress + sec.PointerToRawData);
-            }
-        }
+        auto pSection = FindSection( Rva );
+        if (pSection == nullptr)
+            return 0;
 
-        return 0;
+        size_t offset = static_cast<size_t>(Rva - pSection->start + pSection->rawOffset);
+        return keepRelative ? offset : reinterpret_cast<size_t>(_pFileBase) + offset;
     }
     else
         return (keepRelative ? Rva : (reinterpret_cast<size_t>(_pFileBase) + Rva));
@@ -5,8 +5,10 @@
 #include "ImageNET.h"
 
 #include <string>
+#include <atomic>
 #include <memory>
 #include <vector>
+#include <list>
 #include <map>
 #include <unordered_map>
 #include <set>
@@ -133,6 +135,18 @@ public:
     /// <returns>New entry point address</returns>
     inline ptr_t entryPoint( module_t base ) const { return ((_epRVA != 0) ? (_epRVA + base) : 0); };
 
+    /// <summary>
+    /// Get parsed image memory location
+    /// </summary>
+    /// <returns>Image memory location</returns>
+    inline const void* fileBase() const { return _pFileBase; }
+
+    /// <summary>
+    /// Check if image was parsed as plain data file
+    /// </summary>
+    /// <returns>true if section data is located by raw offsets</returns>
+    inline bool isPlainData() const { return _isPlainData; }
+
     /// <summary>
     /// Get image sections
     /// </summary>
@@ -164,6 +178,27 @@ public:
     /// <returns>.NET image parser</returns>
     ImageNET& net() { return _netImage; }
 
+private:
+    // Section lookup entry
+    struct SectionRange
+    {
+        uint64_t start;     // Section RVA
+        uint64_t end;       // RVA past the section end
+        uint64_t rawOffset; // Section file offset
+    };
+
+    /// <summary>
+    /// Build section lookup index for plain data files
+    /// </summary>
+    void BuildSectionIndex();
+
+    /// <summary>
+    /// Find section containing RVA
+    /// </summary>
+    /// <param name="rva">Memory address</param>
+    /// <returns>Section entry, nullptr if not found</returns>
+    const SectionRange* FindSection( size_t rva ) const;
+
 private:
     bool        _isPlainData = false;       // File mapped as plain data file
     bool        _is64 = false;              // Image is 64 bit
@@ -178,6 +213,9 @@ private:
     size_t      _hdrSize = 0;               // Size of headers
 
     vecSections _sections;                  // Section info
+    std::vector<SectionRange> _sectionIndex;    // Sections sorted by RVA, or in table order if they overlap
+    bool        _sectionsSorted = false;    // Section index can be binary searched
+    mutable std::atomic<uint32_t> _lastSection; // Index of last found section
     mapImports  _imports;                   // Import functions
     mapImports  _delayImports;              // Import functions
     ImageNET    _netImage;                  // .net image info
@@ -0,0 +1,432 @@
+#pragma once
+
+//
+// Portable definitions of Win32 base types and PE structures.
+// Used instead of Windows SDK headers when library is built for other platforms.
+// Layouts match winnt.h, packing is explicit and sizes are checked at compile time.
+//
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef uint8_t     BYTE, UCHAR, BOOLEAN;
+typedef char        CHAR;
+typedef uint16_t    WORD, USHORT;
+typedef int16_t     SHORT;
+typedef uint32_t    DWORD, ULONG;
+typedef int32_t     LONG, BOOL;
+typedef uint64_t    ULONGLONG, DWORD64;
+typedef int64_t     LONGLONG;
+typedef intptr_t    LONG_PTR;
+typedef uintptr_t   ULONG_PTR, SIZE_T;
+typedef void*       PVOID;
+typedef void*       HANDLE;
+typedef LONG        NTSTATUS;
+
+#ifndef FALSE
+#define FALSE 0
+#define TRUE  1
+#endif
+
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
+
+#define STATUS_SUCCESS                  ((NTSTATUS)0x00000000L)
+#define STATUS_PARTIAL_COPY             ((NTSTATUS)0x8000000DL)
+#define STATUS_UNSUCCESSFUL             ((NTSTATUS)0xC0000001L)
+#define STATUS_NOT_IMPLEMENTED          ((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_PARAMETER        ((NTSTATUS)0xC000000DL)
+#define STATUS_NO_MEMORY                ((NTSTATUS)0xC0000017L)
+#define STATUS_CONFLICTING_ADDRESSES    ((NTSTATUS)0xC0000018L)
+#define STATUS_NOT_COMMITTED            ((NTSTATUS)0xC000002DL)
+#define STATUS_OBJECT_NAME_NOT_FOUND    ((NTSTATUS)0xC0000034L)
+#define STATUS_INVALID_IMAGE_FORMAT     ((NTSTATUS)0xC000007BL)
+#define STATUS_FREE_VM_NOT_AT_BASE      ((NTSTATUS)0xC000009FL)
+#define STATUS_NOT_SUPPORTED            ((NTSTATUS)0xC00000BBL)
+#define STATUS_INVALID_ADDRESS          ((NTSTATUS)0xC0000141L)
+#define STATUS_NOT_FOUND                ((NTSTATUS)0xC0000225L)
+
+#define CP_ACP  0
+#define CP_UTF8 65001
+
+#ifndef FIELD_OFFSET
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#endif
+
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+#define IMAGE_DOS_SIGNATURE                 0x5A4D      // MZ
+#define IMAGE_NT_SIGNATURE                  0x00004550  // PE00
+
+#define IMAGE_NT_OPTIONAL_HDR32_MAGIC       0x10b
+#define IMAGE_NT_OPTIONAL_HDR64_MAGIC       0x20b
+
+#define IMAGE_FILE_MACHINE_I386             0x014c
+#define IMAGE_FILE_MACHINE_ARMNT            0x01c4
+#define IMAGE_FILE_MACHINE_AMD64            0x8664
+
+#define IMAGE_FILE_RELOCS_STRIPPED          0x0001
+#define IMAGE_FILE_EXECUTABLE_IMAGE         0x0002
+#define IMAGE_FILE_LARGE_ADDRESS_AWARE      0x0020
+#define IMAGE_FILE_32BIT_MACHINE            0x0100
+#define IMAGE_FILE_DLL                      0x2000
+
+#define IMAGE_NUMBEROF_DIRECTORY_ENTRIES    16
+#define IMAGE_SIZEOF_SHORT_NAME             8
+
+#define IMAGE_DIRECTORY_ENTRY_EXPORT            0
+#define IMAGE_DIRECTORY_ENTRY_IMPORT            1
+#define IMAGE_DIRECTORY_ENTRY_RESOURCE          2
+#define IMAGE_DIRECTORY_ENTRY_EXCEPTION         3
+#define IMAGE_DIRECTORY_ENTRY_SECURITY          4
+#define IMAGE_DIRECTORY_ENTRY_BASERELOC         5
+#define IMAGE_DIRECTORY_ENTRY_DEBUG             6
+#define IMAGE_DIRECTORY_ENTRY_ARCHITECTURE      7
+#define IMAGE_DIRECTORY_ENTRY_GLOBALPTR         8
+#define IMAGE_DIRECTORY_ENTRY_TLS               9
+#define IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG       10
+#define IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT      11
+#define IMAGE_DIRECTORY_ENTRY_IAT               12
+#define IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT      13
+#define IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR    14
+
+#define IMAGE_SCN_CNT_CODE                  0x00000020
+#define IMAGE_SCN_CNT_INITIALIZED_DATA      0x00000040
+#define IMAGE_SCN_CNT_UNINITIALIZED_DATA    0x00000080
+#define IMAGE_SCN_MEM_DISCARDABLE           0x02000000
+#define IMAGE_SCN_MEM_NOT_CACHED            0x04000000
+#define IMAGE_SCN_MEM_NOT_PAGED             0x08000000
+#define IMAGE_SCN_MEM_SHARED                0x10000000
+#define IMAGE_SCN_MEM_EXECUTE               0x20000000
+#define IMAGE_SCN_MEM_READ                  0x40000000
+#define IMAGE_SCN_MEM_WRITE                 0x80000000
+
+#define PAGE_NOACCESS                       0x01
+#define PAGE_READONLY                       0x02
+#define PAGE_READWRITE                      0x04
+#define PAGE_WRITECOPY                      0x08
+#define PAGE_EXECUTE                        0x10
+#define PAGE_EXECUTE_READ                   0x20
+#define PAGE_EXECUTE_READWRITE              0x40
+#define PAGE_EXECUTE_WRITECOPY              0x80
+#define PAGE_GUARD                          0x100
+
+#define MEM_COMMIT                          0x1000
+#define MEM_RESERVE                         0x2000
+#define MEM_DECOMMIT                        0x4000
+#define MEM_RELEASE                         0x8000
+#define MEM_FREE                            0x10000
+#define MEM_PRIVATE                         0x20000
+#define MEM_MAPPED                          0x40000
+#define MEM_IMAGE                           0x1000000
+#define SEC_IMAGE                           0x1000000
+
+#define IMAGE_REL_BASED_ABSOLUTE            0
+#define IMAGE_REL_BASED_HIGH                1
+#define IMAGE_REL_BASED_LOW                 2
+#define IMAGE_REL_BASED_HIGHLOW             3
+#define IMAGE_REL_BASED_HIGHADJ             4
+#define IMAGE_REL_BASED_ARM_MOV32           5
+#define IMAGE_REL_BASED_THUMB_MOV32         7
+#define IMAGE_REL_BASED_DIR64               10
+
+#define IMAGE_ORDINAL_FLAG64                0x8000000000000000ull
+#define IMAGE_ORDINAL_FLAG32                0x80000000
+
+#define COMIMAGE_FLAGS_ILONLY               0x00000001
+
+#pragma pack(push, 2)
+
+typedef struct _IMAGE_DOS_HEADER
+{
+    WORD   e_magic;
+    WORD   e_cblp;
+    WORD   e_cp;
+    WORD   e_crlc;
+    WORD   e_cparhdr;
+    WORD   e_minalloc;
+    WORD   e_maxalloc;
+    WORD   e_ss;
+    WORD   e_sp;
+    WORD   e_csum;
+    WORD   e_ip;
+    WORD   e_cs;
+    WORD   e_lfarlc;
+    WORD   e_ovno;
+    WORD   e_res[4];
+    WORD   e_oemid;
+    WORD   e_oeminfo;
+    WORD   e_res2[10];
+    LONG   e_lfanew;
+} IMAGE_DOS_HEADER, *PIMAGE_DOS_HEADER;
+
+typedef struct _IMAGE_IMPORT_BY_NAME
+{
+    WORD    Hint;
+    CHAR    Name[1];
+} IMAGE_IMPORT_BY_NAME, *PIMAGE_IMPORT_BY_NAME;
+
+#pragma pack(pop)
+
+#pragma pack(push, 4)
+
+typedef struct _IMAGE_FILE_HEADER
+{
+    WORD    Machine;
+    WORD    NumberOfSections;
+    DWORD   TimeDateStamp;
+    DWORD   PointerToSymbolTable;
+    DWORD   NumberOfSymbols;
+    WORD    SizeOfOptionalHeader;
+    WORD    Characteristics;
+} IMAGE_FILE_HEADER, *PIMAGE_FILE_HEADER;
+
+typedef struct _IMAGE_DATA_DIRECTORY
+{
+    DWORD   VirtualAddress;
+    DWORD   Size;
+} IMAGE_DATA_DIRECTORY, *PIMAGE_DATA_DIRECTORY;
+
+typedef struct _IMAGE_OPTIONAL_HEADER
+{
+    WORD    Magic;
+    BYTE    MajorLinkerVersion;
+    BYTE    MinorLinkerVersion;
+    DWORD   SizeOfCode;
+    DWORD   SizeOfInitializedData;
+    DWORD   SizeOfUninitializedData;
+    DWORD   AddressOfEntryPoint;
+    DWORD   BaseOfCode;
+    DWORD   BaseOfData;
+    DWORD   ImageBase;
+    DWORD   SectionAlignment;
+    DWORD   FileAlignment;
+    WORD    MajorOperatingSystemVersion;
+    WORD    MinorOperatingSystemVersion;
+    WORD    MajorImageVersion;
+    WORD    MinorImageVersion;
+    WORD    MajorSubsystemVersion;
+    WORD    MinorSubsystemVersion;
+    DWORD   Win32VersionValue;
+    DWORD   SizeOfImage;
+    DWORD   SizeOfHeaders;
+    DWORD   CheckSum;
+    WORD    Subsystem;
+    WORD    DllCharacteristics;
+    DWORD   SizeOfStackReserve;
+    DWORD   SizeOfStackCommit;
+    DWORD   SizeOfHeapReserve;
+    DWORD   SizeOfHeapCommit;
+    DWORD   LoaderFlags;
+    DWORD   NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER32, *PIMAGE_OPTIONAL_HEADER32;
+
+typedef struct _IMAGE_OPTIONAL_HEADER64
+{
+    WORD        Magic;
+    BYTE        MajorLinkerVersion;
+    BYTE        MinorLinkerVersion;
+    DWORD       SizeOfCode;
+    DWORD       SizeOfInitializedData;
+    DWORD       SizeOfUninitializedData;
+    DWORD       AddressOfEntryPoint;
+    DWORD       BaseOfCode;
+    ULONGLONG   ImageBase;
+    DWORD       SectionAlignment;
+    DWORD       FileAlignment;
+    WORD        MajorOperatingSystemVersion;
+    WORD        MinorOperatingSystemVersion;
+    WORD        MajorImageVersion;
+    WORD        MinorImageVersion;
+    WORD        MajorSubsystemVersion;
+    WORD        MinorSubsystemVersion;
+    DWORD       Win32VersionValue;
+    DWORD       SizeOfImage;
+    DWORD       SizeOfHeaders;
+    DWORD       CheckSum;
+    WORD        Subsystem;
+    WORD        DllCharacteristics;
+    ULONGLONG   SizeOfStackReserve;
+    ULONGLONG   SizeOfStackCommit;
+    ULONGLONG   SizeOfHeapReserve;
+    ULONGLONG   SizeOfHeapCommit;
+    DWORD       LoaderFlags;
+    DWORD       NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+} IMAGE_OPTIONAL_HEADER64, *PIMAGE_OPTIONAL_HEADER64;
+
+typedef struct _IMAGE_NT_HEADERS
+{
+    DWORD Signature;
+    IMAGE_FILE_HEADER FileHeader;
+    IMAGE_OPTIONAL_HEADER32 OptionalHeader;
+} IMAGE_NT_HEADERS32, *PIMAGE_NT_HEADERS32;
+
+typedef struct _IMAGE_NT_HEADERS64
+{
+    DWORD Signature;
+    IMAGE_FILE_HEADER FileHeader;
+    IMAGE_OPTIONAL_HEADER64 OptionalHeader;
+} IMAGE_NT_HEADERS64, *PIMAGE_NT_HEADERS64;
+
+typedef struct _IMAGE_SECTION_HEADER
+{
+    BYTE    Name[IMAGE_SIZEOF_SHORT_NAME];
+    union
+    {
+        DWORD   PhysicalAddress;
+        DWORD   VirtualSize;
+    } Misc;
+    DWORD   VirtualAddress;
+    DWORD   SizeOfRawData;
+    DWORD   PointerToRawData;
+    DWORD   PointerToRelocations;
+    DWORD   PointerToLinenumbers;
+    WORD    NumberOfRelocations;
+    WORD    NumberOfLinenumbers;
+    DWORD   Characteristics;
+} IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
+
+typedef struct _IMAGE_EXPORT_DIRECTORY
+{
+    DWORD   Characteristics;
+    DWORD   TimeDateStamp;
+    WORD    MajorVersion;
+    WORD    MinorVersion;
+    DWORD   Name;
+    DWORD   Base;
+    DWORD   NumberOfFunctions;
+    DWORD   NumberOfNames;
+    DWORD   AddressOfFunctions;
+    DWORD   AddressOfNames;
+    DWORD   AddressOfNameOrdinals;
+} IMAGE_EXPORT_DIRECTORY, *PIMAGE_EXPORT_DIRECTORY;
+
+typedef struct _IMAGE_IMPORT_DESCRIPTOR
+{
+    union
+    {
+        DWORD   Characteristics;
+        DWORD   OriginalFirstThunk;
+    };
+    DWORD   TimeDateStamp;
+    DWORD   ForwarderChain;
+    DWORD   Name;
+    DWORD   FirstThunk;
+} IMAGE_IMPORT_DESCRIPTOR, *PIMAGE_IMPORT_DESCRIPTOR;
+
+typedef struct _IMAGE_DELAYLOAD_DESCRIPTOR
+{
+    DWORD   Attributes;
+    DWORD   DllNameRVA;
+    DWORD   ModuleHandleRVA;
+    DWORD   ImportAddressTableRVA;
+    DWORD   ImportNameTableRVA;
+    DWORD   BoundImportAddressTableRVA;
+    DWORD   UnloadInformationTableRVA;
+    DWORD   TimeDateStamp;
+} IMAGE_DELAYLOAD_DESCRIPTOR, *PIMAGE_DELAYLOAD_DESCRIPTOR;
+
+typedef struct _IMAGE_THUNK_DATA32
+{
+    union
+    {
+        DWORD ForwarderString;
+        DWORD Function;
+        DWORD Ordinal;
+        DWORD AddressOfData;
+    } u1;
+} IMAGE_THUNK_DATA32, *PIMAGE_THUNK_DATA32;
+
+typedef struct _IMAGE_TLS_DIRECTORY32
+{
+    DWORD   StartAddressOfRawData;
+    DWORD   EndAddressOfRawData;
+    DWORD   AddressOfIndex;
+    DWORD   AddressOfCallBacks;
+    DWORD   SizeOfZeroFill;
+    DWORD   Characteristics;
+} IMAGE_TLS_DIRECTORY32, *PIMAGE_TLS_DIRECTORY32;
+
+typedef struct _IMAGE_BASE_RELOCATION
+{
+    DWORD   VirtualAddress;
+    DWORD   SizeOfBlock;
+} IMAGE_BASE_RELOCATION, *PIMAGE_BASE_RELOCATION;
+
+typedef struct _IMAGE_COR20_HEADER
+{
+    DWORD   cb;
+    WORD    MajorRuntimeVersion;
+    WORD    MinorRuntimeVersion;
+    IMAGE_DATA_DIRECTORY MetaData;
+    DWORD   Flags;
+    union
+    {
+        DWORD   EntryPointToken;
+        DWORD   EntryPointRVA;
+    };
+    IMAGE_DATA_DIRECTORY Resources;
+    IMAGE_DATA_DIRECTORY StrongNameSignature;
+    IMAGE_DATA_DIRECTORY CodeManagerTable;
+    IMAGE_DATA_DIRECTORY VTableFixups;
+    IMAGE_DATA_DIRECTORY ExportAddressTableJumps;
+    IMAGE_DATA_DIRECTORY ManagedNativeHeader;
+} IMAGE_COR20_HEADER, *PIMAGE_COR20_HEADER;
+
+#pragma pack(pop)
+
+#pragma pack(push, 8)
+
+typedef struct _IMAGE_THUNK_DATA64
+{
+    union
+    {
+        ULONGLONG ForwarderString;
+        ULONGLONG Function;
+        ULONGLONG Ordinal;
+        ULONGLONG AddressOfData;
+    } u1;
+} IMAGE_THUNK_DATA64, *PIMAGE_THUNK_DATA64;
+
+typedef struct _IMAGE_TLS_DIRECTORY64
+{
+    ULONGLONG   StartAddressOfRawData;
+    ULONGLONG   EndAddressOfRawData;
+    ULONGLONG   AddressOfIndex;
+    ULONGLONG   AddressOfCallBacks;
+    DWORD       SizeOfZeroFill;
+    DWORD       Characteristics;
+} IMAGE_TLS_DIRECTORY64, *PIMAGE_TLS_DIRECTORY64;
+
+typedef struct _MEMORY_BASIC_INFORMATION64
+{
+    ULONGLONG   BaseAddress;
+    ULONGLONG   AllocationBase;
+    DWORD       AllocationProtect;
+    DWORD       __alignment1;
+    ULONGLONG   RegionSize;
+    DWORD       State;
+    DWORD       Protect;
+    DWORD       Type;
+    DWORD       __alignment2;
+} MEMORY_BASIC_INFORMATION64, *PMEMORY_BASIC_INFORMATION64;
+
+#pragma pack(pop)
+
+static_assert(sizeof(IMAGE_DOS_HEADER) == 64, "IMAGE_DOS_HEADER size mismatch");
+static_assert(sizeof(IMAGE_FILE_HEADER) == 20, "IMAGE_FILE_HEADER size mismatch");
+static_assert(sizeof(IMAGE_OPTIONAL_HEADER32) == 224, "IMAGE_OPTIONAL_HEADER32 size mismatch");
+static_assert(sizeof(IMAGE_OPTIONAL_HEADER64) == 240, "IMAGE_OPTIONAL_HEADER64 size mismatch");
+static_assert(sizeof(IMAGE_NT_HEADERS32) == 248, "IMAGE_NT_HEADERS32 size mismatch");
+static_assert(sizeof(IMAGE_NT_HEADERS64) == 264, "IMAGE_NT_HEADERS64 size mismatch");
+static_assert(sizeof(IMAGE_SECTION_HEADER) == 40, "IMAGE_SECTION_HEADER size mismatch");
+static_assert(sizeof(IMAGE_EXPORT_DIRECTORY) == 40, "IMAGE_EXPORT_DIRECTORY size mismatch");
+static_assert(sizeof(IMAGE_IMPORT_DESCRIPTOR) == 20, "IMAGE_IMPORT_DESCRIPTOR size mismatch");
+static_assert(sizeof(IMAGE_DELAYLOAD_DESCRIPTOR) == 32, "IMAGE_DELAYLOAD_DESCRIPTOR size mismatch");
+static_assert(sizeof(IMAGE_TLS_DIRECTORY32) == 24, "IMAGE_TLS_DIRECTORY32 size mismatch");
+static_assert(sizeof(IMAGE_TLS_DIRECTORY64) == 40, "IMAGE_TLS_DIRECTORY64 size mismatch");
+static_assert(sizeof(IMAGE_COR20_HEADER) == 72, "IMAGE_COR20_HEADER size mismatch");
+static_assert(sizeof(MEMORY_BASIC_INFORMATION64) == 48, "MEMORY_BASIC_INFORMATION64 size mismatch");
@@ -0,0 +1,531 @@
+#include "PEView.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace blackbone
+{
+
+namespace pe
+{
+
+ViewImportIterator::ViewImportIterator( const PEView* view, uint32_t thunkRVA, uint32_t iatRVA )
+    : _view( view )
+    , _thunk( thunkRVA )
+    , _iat( iatRVA )
+{
+    Load();
+}
+
+ViewImportIterator& ViewImportIterator::operator ++()
+{
+    uint32_t width = _view->is64() ? sizeof(uint64_t) : sizeof(uint32_t);
+
+    if (_thunk > 0xFFFFFFFF - width || _iat > 0xFFFFFFFF - width)
+    {
+        *this = ViewImportIterator();
+        return *this;
+    }
+
+    _thunk += width;
+    _iat += width;
+
+    Load();
+    return *this;
+}
+
+/// <summary>
+/// Read current thunk, become end iterator if thunk is null or invalid
+/// </summary>
+void ViewImportIterator::Load()
+{
+    uint64_t data = 0;
+    bool ok = false;
+
+    if (_view->is64())
+    {
+        ok = _view->Read( _thunk, data );
+    }
+    else
+    {
+        uint32_t data32 = 0;
+        ok = _view->Read( _thunk, data32 );
+        data = data32;
+    }
+
+    if (!ok || data == 0)
+    {
+        *this = ViewImportIterator();
+        return;
+    }
+
+    _value = ViewImport();
+    _value.iatRVA = _iat;
+
+    // Import by ordinal
+    if (data & (_view->is64() ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32))
+    {
+        _value.byOrdinal = true;
+        _value.ordinal = static_cast<WORD>(data & 0xFFFF);
+        return;
+    }
+
+    // Import by name, IMAGE_IMPORT_BY_NAME
+    if (data > 0xFFFFFFFF - sizeof(WORD) ||
+        !_view->Read( static_cast<uint32_t>(data), _value.hint ) ||
+        (_value.name = _view->ReadString( static_cast<uint32_t>(data) + sizeof(WORD) )) == nullptr)
+    {
+        *this = ViewImportIterator();
+    }
+}
+
+ViewImportModuleIterator::ViewImportModuleIterator( const PEView* view, uint32_t rva, bool delayed )
+    : _view( view )
+    , _rva( rva )
+    , _delayed( delayed )
+{
+    Load();
+}
+
+ViewImportModuleIterator& ViewImportModuleIterator::operator ++()
+{
+    uint32_t width = _delayed ? sizeof(IMAGE_DELAYLOAD_DESCRIPTOR) : sizeof(IMAGE_IMPORT_DESCRIPTOR);
+
+    if (_rva > 0xFFFFFFFF - width)
+    {
+        *this = ViewImportModuleIterator();
+        return *this;
+    }
+
+    _rva += width;
+
+    Load();
+    return *this;
+}
+
+/// <summary>
+/// Read current descriptor, become end iterator if descriptor is null or invalid
+/// </summary>
+void ViewImportModuleIterator::Load()
+{
+    uint32_t nameRVA = 0;
+
+    _value = ViewImportModule();
+    _value.view = _view;
+
+    if (_delayed)
+    {
+        IMAGE_DELAYLOAD_DESCRIPTOR desc = { 0 };
+        if (_view->Read( _rva, desc ))
+        {
+            nameRVA = desc.DllNameRVA;
+            _value.thunkRVA = desc.ImportNameTableRVA;
+            _value.iatRVA = desc.ImportAddressTableRVA;
+        }
+    }
+    else
+    {
+        IMAGE_IMPORT_DESCRIPTOR desc = { 0 };
+        if (_view->Read( _rva, desc ))
+        {
+            nameRVA = desc.Name;
+            _value.thunkRVA = desc.OriginalFirstThunk ? desc.OriginalFirstThunk : desc.FirstThunk;
+            _value.iatRVA = desc.FirstThunk;
+        }
+    }
+
+    if (nameRVA == 0 || (_value.name = _view->ReadString( nameRVA )) == nullptr)
+        *this = ViewImportModuleIterator();
+}
+
+ViewExportIterator::ViewExportIterator( const PEView* view, uint32_t index )
+    : _view( view )
+    , _index( index )
+{
+    Load();
+}
+
+ViewExportIterator& ViewExportIterator::operator ++()
+{
+    _index++;
+
+    Load();
+    return *this;
+}
+
+/// <summary>
+/// Read current name entry, become end iterator if entry is invalid
+/// </summary>
+void ViewExportIterator::Load()
+{
+    auto& exp = _view->_exports;
+    uint32_t nameRVA = 0;
+    WORD index = 0;
+
+    if (_index >= exp.NumberOfNames ||
+        exp.AddressOfNames + uint64_t( _index ) * sizeof(DWORD) > 0xFFFFFFFF ||
+        exp.AddressOfNameOrdinals + uint64_t( _index ) * sizeof(WORD) > 0xFFFFFFFF ||
+        !_view->Read( exp.AddressOfNames + _index * sizeof(DWORD), nameRVA ) ||
+        !_view->Read( exp.AddressOfNameOrdinals + _index * sizeof(WORD), index ) ||
+        !_view->ExportByOrdinal( static_cast<WORD>(exp.Base + index), _value ) ||
+        (_value.name = _view->ReadString( nameRVA )) == nullptr)
+    {
+        *this = ViewExportIterator();
+    }
+}
+
+ViewTlsIterator::ViewTlsIterator( const PEView* view, uint32_t rva )
+    : _view( view )
+    , _rva( rva )
+{
+    Load();
+}
+
+ViewTlsIterator& ViewTlsIterator::operator ++()
+{
+    uint32_t width = _view->is64() ? sizeof(uint64_t) : sizeof(uint32_t);
+
+    if (_rva > 0xFFFFFFFF - width)
+    {
+        *this = ViewTlsIterator();
+        return *this;
+    }
+
+    _rva += width;
+
+    Load();
+    return *this;
+}
+
+/// <summary>
+/// Read current callback pointer, become end iterator if it is null or invalid
+/// </summary>
+void ViewTlsIterator::Load()
+{
+    bool ok = false;
+
+    if (_view->is64())
+    {
+        uint64_t value = 0;
+        ok = _view->Read( _rva, value );
+        _value = value;
+    }
+    else
+    {
+        uint32_t value = 0;
+        ok = _view->Read( _rva, value );
+        _value = value;
+    }
+
+    if (!ok || _value == 0)
+        *this = ViewTlsIterator();
+}
+
+PEView::PEView()
+{
+}
+
+PEView::~PEView()
+{
+}
+
+/// <summary>
+/// Attach view to buffer and validate headers
+/// </summary>
+/// <param name="data">Image data</param>
+/// <param name="size">Buffer size</param>
+/// <param name="isPlainData">Buffer holds raw file, not image laid out by RVA</param>
+/// <returns>Status code</returns>
+NTSTATUS PEView::Attach( const void* data, size_t size, bool isPlainData /*= true*/ )
+{
+    const uint8_t* base = reinterpret_cast<const uint8_t*>(data);
+    IMAGE_DOS_HEADER hdrDos = { 0 };
+    IMAGE_FILE_HEADER hdrFile = { 0 };
+    DWORD signature = 0;
+    WORD magic = 0;
+    size_t fixedSize = 0, dirCount = 0;
+
+    Reset();
+
+    if (base == nullptr || size < sizeof(hdrDos))
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    memcpy( &hdrDos, base, sizeof(hdrDos) );
+    if (hdrDos.e_magic != IMAGE_DOS_SIGNATURE || hdrDos.e_lfanew < 0)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    // Signature, file header and optional header magic
+    uint64_t ntOfs = static_cast<uint64_t>(hdrDos.e_lfanew);
+    uint64_t optOfs = ntOfs + sizeof(signature) + sizeof(hdrFile);
+    if (optOfs + sizeof(magic) > size)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    memcpy( &signature, base + ntOfs, sizeof(signature) );
+    memcpy( &hdrFile, base + ntOfs + sizeof(signature), sizeof(hdrFile) );
+    memcpy( &magic, base + optOfs, sizeof(magic) );
+
+    if (signature != IMAGE_NT_SIGNATURE)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    // Optional header may be shorter than structure, if image has less data directories
+    if (magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+    {
+        IMAGE_OPTIONAL_HEADER64 hdrOpt = { 0 };
+        fixedSize = FIELD_OFFSET( IMAGE_OPTIONAL_HEADER64, DataDirectory );
+        if (hdrFile.SizeOfOptionalHeader < fixedSize || optOfs + fixedSize > size)
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        memcpy( &hdrOpt, base + optOfs, fixedSize );
+
+        _is64 = true;
+        _imgBase = hdrOpt.ImageBase;
+        _imgSize = hdrOpt.SizeOfImage;
+        _hdrSize = hdrOpt.SizeOfHeaders;
+        _epRVA = hdrOpt.AddressOfEntryPoint;
+        dirCount = hdrOpt.NumberOfRvaAndSizes;
+    }
+    else if (magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+    {
+        IMAGE_OPTIONAL_HEADER32 hdrOpt = { 0 };
+        fixedSize = FIELD_OFFSET( IMAGE_OPTIONAL_HEADER32, DataDirectory );
+        if (hdrFile.SizeOfOptionalHeader < fixedSize || optOfs + fixedSize > size)
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        memcpy( &hdrOpt, base + optOfs, fixedSize );
+
+        _is64 = false;
+        _imgBase = hdrOpt.ImageBase;
+        _imgSize = hdrOpt.SizeOfImage;
+        _hdrSize = hdrOpt.SizeOfHeaders;
+        _epRVA = hdrOpt.AddressOfEntryPoint;
+        dirCount = hdrOpt.NumberOfRvaAndSizes;
+    }
+    else
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    // Section table follows optional header
+    uint64_t secOfs = optOfs + hdrFile.SizeOfOptionalHeader;
+    if (secOfs + uint64_t( hdrFile.NumberOfSections ) * sizeof(IMAGE_SECTION_HEADER) > size)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    // Directories that are both declared and present
+    dirCount = std::min<size_t>( dirCount, IMAGE_NUMBEROF_DIRECTORY_ENTRIES );
+    dirCount = std::min<size_t>( dirCount, (hdrFile.SizeOfOptionalHeader - fixedSize) / sizeof(IMAGE_DATA_DIRECTORY) );
+    dirCount = std::min<size_t>( dirCount, static_cast<size_t>(size - optOfs - fixedSize) / sizeof(IMAGE_DATA_DIRECTORY) );
+
+    _data = base;
+    _size = size;
+    _isPlainData = isPlainData;
+    _dirs = base + optOfs + fixedSize;
+    _dirCount = static_cast<uint32_t>(dirCount);
+    _sections = reinterpret_cast<const IMAGE_SECTION_HEADER*>(base + secOfs);
+    _sectionCount = hdrFile.NumberOfSections;
+    _fileHdr = reinterpret_cast<const IMAGE_FILE_HEADER*>(base + ntOfs + sizeof(signature));
+    _characteristics = hdrFile.Characteristics;
+
+    // Export directory is used by every export lookup
+    _exportDir = Directory( IMAGE_DIRECTORY_ENTRY_EXPORT );
+    if (_exportDir.VirtualAddress == 0 || !Read( _exportDir.VirtualAddress, _exports ))
+        memset( &_exports, 0, sizeof(_exports) );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Detach from buffer
+/// </summary>
+void PEView::Reset()
+{
+    *this = PEView();
+}
+
+/// <summary>
+/// Get pointer to image data
+/// </summary>
+/// <param name="rva">Data RVA</param>
+/// <param name="size">Data size</param>
+/// <returns>Data pointer, nullptr if data isn't entirely inside the buffer</returns>
+const uint8_t* PEView::ResolveRVA( uint32_t rva, size_t size ) const
+{
+    size_t available = 0;
+    auto ptr = Locate( rva, available );
+
+    return (ptr != nullptr && available >= size) ? ptr : nullptr;
+}
+
+/// <summary>
+/// Get null-terminated string from image
+/// </summary>
+/// <param name="rva">String RVA</param>
+/// <returns>String, nullptr if terminator isn't inside the buffer</returns>
+const char* PEView::ReadString( uint32_t rva ) const
+{
+    size_t available = 0;
+    auto ptr = Locate( rva, available );
+
+    if (ptr == nullptr || memchr( ptr, 0, available ) == nullptr)
+        return nullptr;
+
+    return reinterpret_cast<const char*>(ptr);
+}
+
+/// <summary>
+/// Translate RVA into buffer pointer
+/// </summary>
+/// <param name="rva">Data RVA</param>
+/// <param name="available">Number of contiguous bytes available at returned pointer</param>
+/// <returns>Data pointer, nullptr if RVA is outside of the buffer</returns>
+const uint8_t* PEView::Locate( uint32_t rva, size_t& available ) const
+{
+    uint64_t offset = rva;
+    uint64_t limit = _size;
+
+    available = 0;
+    if (!valid())
+        return nullptr;
+
+    if (_isPlainData)
+    {
+        bool found = false;
+
+        for (uint32_t i = 0; i < _sectionCount; i++)
+        {
+            IMAGE_SECTION_HEADER sec = { 0 };
+            memcpy( &sec, _sections + i, sizeof(sec) );
+            uint32_t extent = sec.Misc.VirtualSize ? sec.Misc.VirtualSize : sec.SizeOfRawData;
+
+            if (rva >= sec.VirtualAddress && rva - sec.VirtualAddress < extent)
+            {
+                // Uninitialized part of section isn't present in file
+                if (rva - sec.VirtualAddress >= sec.SizeOfRawData)
+                    return nullptr;
+
+                offset = uint64_t( sec.PointerToRawData ) + (rva - sec.VirtualAddress);
+                limit = std::min<uint64_t>( limit, uint64_t( sec.PointerToRawData ) + std::min<uint32_t>( sec.SizeOfRawData, extent ) );
+                found = true;
+                break;
+            }
+        }
+
+        // Headers aren't a part of any section
+        if (!found)
+        {
+            if (rva >= _hdrSize)
+                return nullptr;
+
+            limit = std::min<uint64_t>( limit, _hdrSize );
+        }
+    }
+
+    if (offset >= limit)
+        return nullptr;
+
+    available = static_cast<size_t>(limit - offset);
+    return _data + offset;
+}
+
+/// <summary>
+/// Get data directory
+/// </summary>
+/// <param name="index">Directory index</param>
+/// <returns>Directory, zeroed if absent</returns>
+IMAGE_DATA_DIRECTORY PEView::Directory( int index ) const
+{
+    IMAGE_DATA_DIRECTORY dir = { 0 };
+
+    if (index >= 0 && static_cast<uint32_t>(index) < _dirCount)
+        memcpy( &dir, _dirs + index * sizeof(dir), sizeof(dir) );
+
+    return dir;
+}
+
+/// <summary>
+/// Find export by ordinal
+/// </summary>
+/// <param name="ordinal">Function ordinal, including ordinal base</param>
+/// <param name="result">Found export, without name</param>
+/// <returns>true if found</returns>
+bool PEView::ExportByOrdinal( WORD ordinal, ViewExport& result ) const
+{
+    uint32_t index = static_cast<uint32_t>(ordinal - _exports.Base);
+    uint32_t rva = 0;
+
+    if (ordinal < _exports.Base || index >= _exports.NumberOfFunctions ||
+        _exports.AddressOfFunctions + uint64_t( index ) * sizeof(DWORD) > 0xFFFFFFFF ||
+        !Read( _exports.AddressOfFunctions + index * sizeof(DWORD), rva ) || rva == 0)
+    {
+        return false;
+    }
+
+    result = ViewExport();
+    result.rva = rva;
+    result.ordinal = ordinal;
+
+    // Forwarded export points to 'module.function' string inside export directory
+    if (rva >= _exportDir.VirtualAddress && rva - _exportDir.VirtualAddress < _exportDir.Size)
+        result.forwarder = ReadString( rva );
+
+    return true;
+}
+
+/// <summary>
+/// Get imported modules
+/// </summary>
+/// <param name="useDelayed">Get delayed import instead</param>
+/// <returns>Import module range</returns>
+ViewRange<ViewImportModuleIterator> PEView::imports( bool useDelayed /*= false*/ ) const
+{
+    auto dir = Directory( useDelayed ? IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT : IMAGE_DIRECTORY_ENTRY_IMPORT );
+    if (dir.VirtualAddress == 0)
+        return ViewRange<ViewImportModuleIterator>( ViewImportModuleIterator(), ViewImportModuleIterator() );
+
+    return ViewRange<ViewImportModuleIterator>( ViewImportModuleIterator( this, dir.VirtualAddress, useDelayed ), ViewImportModuleIterator() );
+}
+
+/// <summary>
+/// Get named exports
+/// </summary>
+/// <returns>Export range</returns>
+ViewRange<ViewExportIterator> PEView::exports() const
+{
+    if (_exports.NumberOfNames == 0)
+        return ViewRange<ViewExportIterator>( ViewExportIterator(), ViewExportIterator() );
+
+    return ViewRange<ViewExportIterator>( ViewExportIterator( this, 0 ), ViewExportIterator() );
+}
+
+/// <summary>
+/// Get TLS callbacks
+/// </summary>
+/// <returns>Callback range</returns>
+ViewRange<ViewTlsIterator> PEView::tlsCallbacks() const
+{
+    auto dir = Directory( IMAGE_DIRECTORY_ENTRY_TLS );
+    ptr_t callbacks = 0;
+
+    if (dir.VirtualAddress != 0)
+    {
+        if (_is64)
+        {
+            IMAGE_TLS_DIRECTORY64 tls = { 0 };
+            if (Read( dir.VirtualAddress, tls ))
+                callbacks = tls.AddressOfCallBacks;
+        }
+        else
+        {
+            IMAGE_TLS_DIRECTORY32 tls = { 0 };
+            if (Read( dir.VirtualAddress, tls ))
+                callbacks = tls.AddressOfCallBacks;
+        }
+    }
+
+    // Callback array address is a VA
+    if (callbacks <= _imgBase || callbacks - _imgBase > 0xFFFFFFFF)
+        return ViewRange<ViewTlsIterator>( ViewTlsIterator(), ViewTlsIterator() );
+
+    return ViewRange<ViewTlsIterator>( ViewTlsIterator( this, static_cast<uint32_t>(callbacks - _imgBase) ), ViewTlsIterator() );
+}
+
+}
+
+}
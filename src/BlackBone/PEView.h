@@ -0,0 +1,321 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+
+#include <cstring>
+
+namespace blackbone
+{
+
+namespace pe
+{
+
+class PEView;
+
+/// <summary>
+/// Pair of iterators, usable in range-based for
+/// </summary>
+template<typename It>
+class ViewRange
+{
+public:
+    ViewRange( It first, It last )
+        : _first( first )
+        , _last( last ) { }
+
+    inline It begin() const { return _first; }
+    inline It end() const { return _last; }
+    inline bool empty() const { return !(_first != _last); }
+
+private:
+    It _first, _last;
+};
+
+// Imported function
+struct ViewImport
+{
+    const char* name = nullptr; // Function name, nullptr if imported by ordinal
+    WORD hint = 0;              // Export name table hint
+    WORD ordinal = 0;           // Function ordinal
+    bool byOrdinal = false;     // Function is imported by ordinal
+    uint32_t iatRVA = 0;        // IAT slot RVA
+};
+
+/// <summary>
+/// Import thunk iterator. Stops at null thunk or at first thunk outside of the buffer
+/// </summary>
+class ViewImportIterator
+{
+public:
+    ViewImportIterator() { }
+    ViewImportIterator( const PEView* view, uint32_t thunkRVA, uint32_t iatRVA );
+
+    inline const ViewImport& operator *() const { return _value; }
+    inline const ViewImport* operator ->() const { return &_value; }
+
+    ViewImportIterator& operator ++();
+
+    inline bool operator ==( const ViewImportIterator& other ) const { return _view == other._view && _thunk == other._thunk; }
+    inline bool operator !=( const ViewImportIterator& other ) const { return !(*this == other); }
+
+private:
+    void Load();
+
+    const PEView* _view = nullptr;  // nullptr for end iterator
+    uint32_t _thunk = 0;            // Current thunk RVA
+    uint32_t _iat = 0;              // Current IAT slot RVA
+    ViewImport _value;
+};
+
+// Imported module
+struct ViewImportModule
+{
+    const char* name = nullptr; // Module name
+    uint32_t thunkRVA = 0;      // Name table RVA
+    uint32_t iatRVA = 0;        // Import address table RVA
+
+    /// <summary>
+    /// Get imported functions
+    /// </summary>
+    /// <returns>Function range</returns>
+    inline ViewRange<ViewImportIterator> functions() const
+    {
+        return ViewRange<ViewImportIterator>( ViewImportIterator( view, thunkRVA, iatRVA ), ViewImportIterator() );
+    }
+
+    const PEView* view = nullptr;
+};
+
+/// <summary>
+/// Import descriptor iterator. Stops at null descriptor or at first descriptor outside of the buffer
+/// </summary>
+class ViewImportModuleIterator
+{
+public:
+    ViewImportModuleIterator() { }
+    ViewImportModuleIterator( const PEView* view, uint32_t rva, bool delayed );
+
+    inline const ViewImportModule& operator *() const { return _value; }
+    inline const ViewImportModule* operator ->() const { return &_value; }
+
+    ViewImportModuleIterator& operator ++();
+
+    inline bool operator ==( const ViewImportModuleIterator& other ) const { return _view == other._view && _rva == other._rva; }
+    inline bool operator !=( const ViewImportModuleIterator& other ) const { return !(*this == other); }
+
+private:
+    void Load();
+
+    const PEView* _view = nullptr;  // nullptr for end iterator
+    uint32_t _rva = 0;              // Current descriptor RVA
+    bool _delayed = false;          // Delayed import descriptors
+    ViewImportModule _value;
+};
+
+// Exported function
+struct ViewExport
+{
+    const char* name = nullptr;         // Function name, nullptr if exported by ordinal only
+    const char* forwarder = nullptr;    // Forwarder string, nullptr if export isn't forwarded
+    uint32_t rva = 0;                   // Function RVA
+    WORD ordinal = 0;                   // Function ordinal, including ordinal base
+};
+
+/// <summary>
+/// Named export iterator, in name table order
+/// </summary>
+class ViewExportIterator
+{
+public:
+    ViewExportIterator() { }
+    ViewExportIterator( const PEView* view, uint32_t index );
+
+    inline const ViewExport& operator *() const { return _value; }
+    inline const ViewExport* operator ->() const { return &_value; }
+
+    ViewExportIterator& operator ++();
+
+    inline bool operator ==( const ViewExportIterator& other ) const { return _view == other._view && _index == other._index; }
+    inline bool operator !=( const ViewExportIterator& other ) const { return !(*this == other); }
+
+private:
+    void Load();
+
+    const PEView* _view = nullptr;  // nullptr for end iterator
+    uint32_t _index = 0;            // Name index
+    ViewExport _value;
+};
+
+/// <summary>
+/// TLS callback iterator, yields callback addresses as stored in image
+/// </summary>
+class ViewTlsIterator
+{
+public:
+    ViewTlsIterator() { }
+    ViewTlsIterator( const PEView* view, uint32_t rva );
+
+    inline ptr_t operator *() const { return _value; }
+
+    ViewTlsIterator& operator ++();
+
+    inline bool operator ==( const ViewTlsIterator& other ) const { return _view == other._view && _rva == other._rva; }
+    inline bool operator !=( const ViewTlsIterator& other ) const { return !(*this == other); }
+
+private:
+    void Load();
+
+    const PEView* _view = nullptr;  // nullptr for end iterator
+    uint32_t _rva = 0;              // Current callback pointer RVA
+    ptr_t _value = 0;
+};
+
+/// <summary>
+/// Non-owning PE image view over a memory buffer.
+/// Every access is checked against buffer bounds, malformed or truncated data ends iteration
+/// instead of being read. Nothing is copied or allocated.
+/// Header pointers returned by view may be unaligned if image is malformed.
+/// </summary>
+class PEView
+{
+public:
+    PEView();
+    ~PEView();
+
+    /// <summary>
+    /// Attach view to buffer and validate headers
+    /// </summary>
+    /// <param name="data">Image data</param>
+    /// <param name="size">Buffer size</param>
+    /// <param name="isPlainData">Buffer holds raw file, not image laid out by RVA</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Attach( const void* data, size_t size, bool isPlainData = true );
+
+    /// <summary>
+    /// Detach from buffer
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Get pointer to image data
+    /// </summary>
+    /// <param name="rva">Data RVA</param>
+    /// <param name="size">Data size</param>
+    /// <returns>Data pointer, nullptr if data isn't entirely inside the buffer</returns>
+    const uint8_t* ResolveRVA( uint32_t rva, size_t size ) const;
+
+    /// <summary>
+    /// Read value from image
+    /// </summary>
+    /// <param name="rva">Value RVA</param>
+    /// <param name="value">Read value</param>
+    /// <returns>true if value is inside the buffer</returns>
+    template<typename T>
+    inline bool Read( uint32_t rva, T& value ) const
+    {
+        auto ptr = ResolveRVA( rva, sizeof(T) );
+        if (ptr == nullptr)
+            return false;
+
+        memcpy( &value, ptr, sizeof(T) );
+        return true;
+    }
+
+    /// <summary>
+    /// Get null-terminated string from image
+    /// </summary>
+    /// <param name="rva">String RVA</param>
+    /// <returns>String, nullptr if terminator isn't inside the buffer</returns>
+    const char* ReadString( uint32_t rva ) const;
+
+    /// <summary>
+    /// Get data directory
+    /// </summary>
+    /// <param name="index">Directory index</param>
+    /// <returns>Directory, zeroed if absent</returns>
+    IMAGE_DATA_DIRECTORY Directory( int index ) const;
+
+    /// <summary>
+    /// Find export by ordinal
+    /// </summary>
+    /// <param name="ordinal">Function ordinal, including ordinal base</param>
+    /// <param name="result">Found export, without name</param>
+    /// <returns>true if found</returns>
+    bool ExportByOrdinal( WORD ordinal, ViewExport& result ) const;
+
+    /// <summary>
+    /// Get section headers
+    /// </summary>
+    /// <returns>Section range</returns>
+    inline ViewRange<const IMAGE_SECTION_HEADER*> sections() const
+    {
+        return ViewRange<const IMAGE_SECTION_HEADER*>( _sections, _sections + _sectionCount );
+    }
+
+    /// <summary>
+    /// Get imported modules
+    /// </summary>
+    /// <param name="useDelayed">Get delayed import instead</param>
+    /// <returns>Import module range</returns>
+    ViewRange<ViewImportModuleIterator> imports( bool useDelayed = false ) const;
+
+    /// <summary>
+    /// Get named exports
+    /// </summary>
+    /// <returns>Export range</returns>
+    ViewRange<ViewExportIterator> exports() const;
+
+    /// <summary>
+    /// Get TLS callbacks
+    /// </summary>
+    /// <returns>Callback range</returns>
+    ViewRange<ViewTlsIterator> tlsCallbacks() const;
+
+    inline bool valid() const { return _fileHdr != nullptr; }
+    inline bool is64() const { return _is64; }
+    inline bool isPlainData() const { return _isPlainData; }
+    inline eModType mType() const { return _is64 ? mt_mod64 : mt_mod32; }
+    inline const IMAGE_FILE_HEADER* fileHeader() const { return _fileHdr; }
+    inline const uint8_t* data() const { return _data; }
+    inline size_t size() const { return _size; }
+    inline module_t imageBase() const { return _imgBase; }
+    inline uint32_t imageSize() const { return _imgSize; }
+    inline uint32_t headersSize() const { return _hdrSize; }
+    inline uint32_t entryPointRVA() const { return _epRVA; }
+    inline bool IsExe() const { return valid() && !(_characteristics & IMAGE_FILE_DLL); }
+
+private:
+    friend class ViewExportIterator;
+
+    /// <summary>
+    /// Translate RVA into buffer pointer
+    /// </summary>
+    /// <param name="rva">Data RVA</param>
+    /// <param name="available">Number of contiguous bytes available at returned pointer</param>
+    /// <returns>Data pointer, nullptr if RVA is outside of the buffer</returns>
+    const uint8_t* Locate( uint32_t rva, size_t& available ) const;
+
+private:
+
+    const uint8_t* _data = nullptr;                 // Buffer
+    size_t _size = 0;                               // Buffer size
+    bool _isPlainData = true;                       // Buffer holds raw file
+    bool _is64 = false;                             // PE32+ image
+    const IMAGE_FILE_HEADER* _fileHdr = nullptr;    // File header, nullptr if view is invalid
+    WORD _characteristics = 0;                      // Image characteristics
+    const uint8_t* _dirs = nullptr;                 // Data directories
+    uint32_t _dirCount = 0;                         // Number of data directories inside buffer
+    const IMAGE_SECTION_HEADER* _sections = nullptr;// Section table
+    uint32_t _sectionCount = 0;                     // Number of sections
+    module_t _imgBase = 0;                          // Image base
+    uint32_t _imgSize = 0;                          // Image size
+    uint32_t _hdrSize = 0;                          // Size of headers
+    uint32_t _epRVA = 0;                            // Entry point RVA
+    IMAGE_DATA_DIRECTORY _exportDir = { 0 };        // Export directory location
+    IMAGE_EXPORT_DIRECTORY _exports = { 0 };        // Export directory, zeroed if absent
+};
+
+}
+
+}
@@ -0,0 +1,258 @@
+#include "PageCache.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace blackbone
+{
+
+PageCache::PageCache( size_t capacity /*= 0*/ )
+    : _capacity( capacity )
+{
+}
+
+PageCache::~PageCache()
+{
+}
+
+/// <summary>
+/// Set maximum number of cached pages
+/// </summary>
+/// <param name="pages">Page count, 0 to disable the cache</param>
+void PageCache::SetCapacity( size_t pages )
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    _capacity = pages;
+    Trim();
+}
+
+/// <summary>
+/// Read memory through the cache
+/// </summary>
+/// <param name="address">Address to read from</param>
+/// <param name="size">Number of bytes to read</param>
+/// <param name="buffer">Output buffer</param>
+/// <param name="fetch">Page loader for missing pages</param>
+/// <returns>Status of the first failed page fetch, STATUS_SUCCESS otherwise</returns>
+NTSTATUS PageCache::Read( ptr_t address, size_t size, void* buffer, const fnFetch& fetch )
+{
+    auto pOut = reinterpret_cast<uint8_t*>(buffer);
+    std::vector<uint8_t> fetched;
+
+    for (ptr_t page = address & ~static_cast<ptr_t>(PageSize - 1); page < address + size; page += PageSize)
+    {
+        // Part of the page covered by read
+        ptr_t from = std::max<ptr_t>( page, address );
+        size_t length = static_cast<size_t>(std::min<ptr_t>( page + PageSize, address + size ) - from);
+        size_t pageOfs = static_cast<size_t>(from - page);
+        auto pDst = pOut + (from - address);
+
+        uint64_t epoch = 0, generation = 0;
+        {
+            std::lock_guard<std::mutex> lg( _lock );
+
+            auto iter = _index.find( page );
+            if (iter != _index.end() && iter->second->epoch == _epoch)
+            {
+                _pages.splice( _pages.begin(), _pages, iter->second );
+                memcpy( pDst, iter->second->data.data() + pageOfs, length );
+                _stats.hits++;
+                continue;
+            }
+
+            _stats.misses++;
+            epoch = _epoch;
+            generation = _generation;
+        }
+
+        // Target is read without holding the lock
+        fetched.resize( PageSize );
+        NTSTATUS status = fetch( page, fetched.data() );
+        if (status != STATUS_SUCCESS)
+            return status;
+
+        memcpy( pDst, fetched.data() + pageOfs, length );
+
+        std::lock_guard<std::mutex> lg( _lock );
+
+        // Page may be already stale if something was invalidated during the read
+        if (generation != _generation || (_capacity == 0 && _snapshots == 0))
+            continue;
+
+        auto iter = _index.find( page );
+        if (iter != _index.end())
+        {
+            iter->second->epoch = epoch;
+            iter->second->data.swap( fetched );
+            _pages.splice( _pages.begin(), _pages, iter->second );
+        }
+        else
+        {
+            Page entry = { page, epoch, std::vector<uint8_t>() };
+            entry.data.swap( fetched );
+            _pages.emplace_front( std::move( entry ) );
+            _index.emplace( page, _pages.begin() );
+            Trim();
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Drop cached pages overlapping memory range
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size</param>
+void PageCache::Invalidate( ptr_t address, size_t size )
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    _generation++;
+
+    ptr_t first = address & ~static_cast<ptr_t>(PageSize - 1);
+    ptr_t last = address + std::max<size_t>( size, 1 );
+
+    // Walk whichever is shorter, page range or cache contents
+    if ((last - first) / PageSize > _index.size())
+    {
+        for (auto iter = _pages.begin(); iter != _pages.end();)
+        {
+            if (iter->address >= first && iter->address < last)
+            {
+                _index.erase( iter->address );
+                iter = _pages.erase( iter );
+            }
+            else
+                ++iter;
+        }
+    }
+    else
+    {
+        for (ptr_t page = first; page < last; page += PageSize)
+        {
+            auto iter = _index.find( page );
+            if (iter != _index.end())
+            {
+                _pages.erase( iter->second );
+                _index.erase( iter );
+            }
+        }
+    }
+}
+
+/// <summary>
+/// Advance epoch, making every cached page stale.
+/// Inside snapshot takes effect when the last snapshot ends
+/// </summary>
+void PageCache::BumpEpoch()
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    if (_snapshots != 0)
+    {
+        _pendingBump = true;
+        return;
+    }
+
+    _epoch++;
+    _generation++;
+}
+
+/// <summary>
+/// Drop cached pages and reset counters
+/// </summary>
+void PageCache::Reset()
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    _pages.clear();
+    _index.clear();
+    _stats = Stats();
+    _generation++;
+}
+
+/// <summary>
+/// Get usage counters
+/// </summary>
+/// <returns>Counters</returns>
+PageCache::Stats PageCache::stats() const
+{
+    std::lock_guard<std::mutex> lg( _lock );
+    return _stats;
+}
+
+/// <summary>
+/// Check if reads should go through the cache
+/// </summary>
+/// <param name="size">Read size</param>
+/// <returns>true if cache is enabled or snapshot is active</returns>
+bool PageCache::active( size_t size ) const
+{
+    std::lock_guard<std::mutex> lg( _lock );
+    return (_capacity != 0 || _snapshots != 0) && size <= MaxCachedRead;
+}
+
+/// <summary>
+/// Get current epoch
+/// </summary>
+/// <returns>Epoch</returns>
+uint64_t PageCache::epoch() const
+{
+    std::lock_guard<std::mutex> lg( _lock );
+    return _epoch;
+}
+
+/// <summary>
+/// Enter snapshot. Outermost snapshot starts new epoch, so it doesn't see older pages
+/// </summary>
+void PageCache::BeginSnapshot()
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    if (_snapshots++ == 0)
+    {
+        _epoch++;
+        _generation++;
+    }
+}
+
+/// <summary>
+/// Leave snapshot, apply deferred epoch bump and trim cache to capacity
+/// </summary>
+void PageCache::EndSnapshot()
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    if (--_snapshots != 0)
+        return;
+
+    if (_pendingBump)
+    {
+        _pendingBump = false;
+        _epoch++;
+        _generation++;
+    }
+
+    Trim();
+}
+
+/// <summary>
+/// Drop least recently used pages above capacity
+/// </summary>
+void PageCache::Trim()
+{
+    // Snapshot keeps everything it has read
+    if (_snapshots != 0)
+        return;
+
+    while (_pages.size() > _capacity)
+    {
+        _index.erase( _pages.back().address );
+        _pages.pop_back();
+        _stats.evictions++;
+    }
+}
+
+}
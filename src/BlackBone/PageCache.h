@@ -0,0 +1,159 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// LRU cache of remote memory pages.
+/// Cached pages are dropped by range invalidation, or all at once by advancing epoch
+/// </summary>
+class PageCache
+{
+public:
+    // Reads pages of this size only
+    static const size_t PageSize = 0x1000;
+
+    // Larger reads bypass the cache, so bulk scans don't evict everything
+    static const size_t MaxCachedRead = 0x4000;
+
+    // Loads single page from target memory
+    typedef std::function<NTSTATUS( ptr_t page, void* buffer )> fnFetch;
+
+    // Usage counters
+    struct Stats
+    {
+        uint64_t hits = 0;          // Pages served from cache
+        uint64_t misses = 0;        // Pages read from target
+        uint64_t evictions = 0;     // Pages dropped to stay within capacity
+    };
+
+    /// <summary>
+    /// Keeps every page read during its lifetime and defers epoch changes until it ends.
+    /// Repeated reads inside snapshot see the same data, even if cache is disabled.
+    /// Own writes are still visible, they invalidate affected pages
+    /// </summary>
+    class Snapshot
+    {
+    public:
+        Snapshot( PageCache& cache ) : _cache( cache ) { _cache.BeginSnapshot(); }
+        ~Snapshot() { _cache.EndSnapshot(); }
+
+    private:
+        Snapshot( const Snapshot& ) = delete;
+        Snapshot& operator =(const Snapshot&) = delete;
+
+    private:
+        PageCache& _cache;
+    };
+
+public:
+    PageCache( size_t capacity = 0 );
+    ~PageCache();
+
+    /// <summary>
+    /// Set maximum number of cached pages
+    /// </summary>
+    /// <param name="pages">Page count, 0 to disable the cache</param>
+    void SetCapacity( size_t pages );
+
+    /// <summary>
+    /// Read memory through the cache
+    /// </summary>
+    /// <param name="address">Address to read from</param>
+    /// <param name="size">Number of bytes to read</param>
+    /// <param name="buffer">Output buffer</param>
+    /// <param name="fetch">Page loader for missing pages</param>
+    /// <returns>Status of the first failed page fetch, STATUS_SUCCESS otherwise</returns>
+    NTSTATUS Read( ptr_t address, size_t size, void* buffer, const fnFetch& fetch );
+
+    /// <summary>
+    /// Drop cached pages overlapping memory range
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size</param>
+    void Invalidate( ptr_t address, size_t size );
+
+    /// <summary>
+    /// Advance epoch, making every cached page stale.
+    /// Inside snapshot takes effect when the last snapshot ends
+    /// </summary>
+    void BumpEpoch();
+
+    /// <summary>
+    /// Drop cached pages and reset counters
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Get usage counters
+    /// </summary>
+    /// <returns>Counters</returns>
+    Stats stats() const;
+
+    /// <summary>
+    /// Check if reads should go through the cache
+    /// </summary>
+    /// <param name="size">Read size</param>
+    /// <returns>true if cache is enabled or snapshot is active</returns>
+    bool active( size_t size ) const;
+
+    /// <summary>
+    /// Get current epoch
+    /// </summary>
+    /// <returns>Epoch</returns>
+    uint64_t epoch() const;
+
+    inline size_t capacity() const { return _capacity; }
+
+private:
+    // Cached page
+    struct Page
+    {
+        ptr_t address;              // Page address
+        uint64_t epoch;             // Epoch page was read in
+        std::vector<uint8_t> data;  // Page contents
+    };
+
+    typedef std::list<Page> listPages;
+
+    /// <summary>
+    /// Enter snapshot. Outermost snapshot starts new epoch, so it doesn't see older pages
+    /// </summary>
+    void BeginSnapshot();
+
+    /// <summary>
+    /// Leave snapshot, apply deferred epoch bump and trim cache to capacity
+    /// </summary>
+    void EndSnapshot();
+
+    /// <summary>
+    /// Drop least recently used pages above capacity
+    /// </summary>
+    void Trim();
+
+private:
+    PageCache( const PageCache& ) = delete;
+    PageCache& operator =(const PageCache&) = delete;
+
+private:
+    mutable std::mutex _lock;                   // Protects everything below
+    listPages _pages;                           // Pages, most recently used first
+    std::unordered_map<ptr_t, listPages::iterator> _index;  // Page address -> page
+    size_t _capacity = 0;                       // Max number of pages
+    uint64_t _epoch = 0;                        // Current epoch
+    uint64_t _generation = 0;                   // Incremented on every invalidation
+    int _snapshots = 0;                         // Active snapshot count
+    bool _pendingBump = false;                  // Epoch bump requested inside snapshot
+    Stats _stats;                               // Usage counters
+};
+
+}
@@ -1,154 +1,1664 @@
 #include "PatternSearch.h"
 #include "Macro.h"
 #include "Winheaders.h"
+#include "PEParser.h"
+
+#ifndef BLACKBONE_PORTABLE
 #include "Process.h"
+#endif
+
+#include <algorithm>
+#include <memory>
+#include <climits>
+#include <cctype>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <future>
+
+#if defined(_M_IX86) || defined(_M_AMD64) || defined(__i386__) || defined(__x86_64__)
+#define PS_X86_SIMD
+#ifdef _MSC_VER
+#include <intrin.h>
+#include <immintrin.h>
+#define PS_TARGET_SSE2
+#define PS_TARGET_AVX2
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define PS_TARGET_SSE2 __attribute__((target("sse2")))
+#define PS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace blackbone
+{
+
+namespace
+{
+
+// Byte frequency rank in typical x86/x64 images. 0 - rarest, 255 - most common
+const uint8_t g_byteRank[256] = 
+{
+    255, 250, 239, 224, 237, 231, 208, 199, 230, 192, 203, 190, 186, 191, 220, 248,
+    228, 165, 174, 131, 133, 127,  77, 108, 195,  87,  73,  61, 106,  45,  64, 209,
+    251, 144, 104,  48, 245, 142,  47,  97, 197, 173,  84,  81, 137, 157, 181, 116,
+    229, 222, 188, 113, 150, 152, 120, 118, 205, 201, 141, 146, 134, 153,  80,  65,
+    202, 242, 196, 187, 227, 233, 160, 163, 253, 235,  85, 138, 244, 200, 193, 145,
+    207,  62, 167, 206, 185, 175, 111, 101, 129,  43, 130, 128, 139, 171,  90, 219,
+    184, 243, 177, 213, 211, 247, 215, 182, 189, 236,  82, 154, 223, 194, 238, 234,
+    216,  46, 241, 225, 246, 214, 183, 123, 162, 164,  58, 121, 158, 159,  54,  79,
+    212, 103,  42, 217, 221, 226, 114,  53, 125, 252,  27, 249, 109, 232,  75,  60,
+    176,  23,  29,  21,  66,  74,  18,  17,  88,   6,   4,  15,  34,  24,   0,  16,
+    117,   7,  26,   1,  32,  11,  13,   3,  93,  10,  92,  14,  37,  12,   2,  20,
+    122,   9,   5,   8,  41,  51, 105,  44, 148,  70, 136,  36,  96,  98, 143,  99,
+    218, 179, 107, 180, 140,  94, 166, 198, 126,  95,  35,  19, 110,  39,  52,  22,
+    149,  38, 119,  25,  30,  31,  33,  28, 178,  50,  40,  76,  63, 115,  71, 132,
+    155,  56,  68,  55,  72,  69,  67, 112, 240, 204,  59, 147, 102,  86, 100, 170,
+    161,  57,  83,  91,  78,  49, 156, 124, 169,  89, 135, 151, 172, 168, 210, 254,
+};
+
+// Pattern in value/mask form. Byte matches if (data & mask) == value
+struct MaskedPattern
+{
+    const uint8_t* value;
+    const uint8_t* mask;
+    size_t len;
+    size_t anchor1;     // Rarest non-wildcard byte
+    size_t anchor2;     // Second rarest non-wildcard byte
+};
+
+/// <summary>
+/// Select two rarest non-wildcard bytes to filter candidates with
+/// </summary>
+/// <param name="pat">Pattern. Anchors are updated</param>
+/// <returns>false if pattern consists of wildcards only</returns>
+bool SelectAnchors( MaskedPattern& pat )
+{
+    // Partially masked bytes are less selective than full ones
+    auto weight = [&pat]( size_t i ) -> int
+    {
+        if (pat.mask[i] == 0xFF)
+            return g_byteRank[pat.value[i]];
+
+        int unknown = 8;
+        for (uint8_t m = pat.mask[i]; m != 0; m &= m - 1)
+            --unknown;
+
+        return 0x100 + unknown * 0x20;
+    };
+
+    size_t best = pat.len, second = pat.len;
+
+    for (size_t i = 0; i < pat.len; ++i)
+    {
+        if (pat.mask[i] == 0)
+            continue;
+
+        if (best == pat.len || weight( i ) < weight( best ))
+        {
+            second = best;
+            best = i;
+        }
+        else if (second == pat.len || weight( i ) < weight( second ))
+        {
+            second = i;
+        }
+    }
+
+    if (best == pat.len)
+        return false;
+
+    pat.anchor1 = best;
+    pat.anchor2 = (second != pat.len) ? second : best;
+    return true;
+}
+
+/// <summary>
+/// Compare data against masked pattern
+/// </summary>
+inline bool MatchMasked( const uint8_t* data, const MaskedPattern& pat )
+{
+    for (size_t i = 0; i < pat.len; ++i)
+        if ((data[i] & pat.mask[i]) != pat.value[i])
+            return false;
+
+    return true;
+}
+
+#ifdef PS_X86_SIMD
+
+inline uint32_t LowestBit( uint32_t val )
+{
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward( &idx, val );
+    return idx;
+#else
+    return __builtin_ctz( val );
+#endif
+}
+
+/// <summary>
+/// Find first pattern occurrence, 16 candidates per iteration
+/// </summary>
+/// <param name="cstart">Scan start</param>
+/// <param name="cend">Scan end</param>
+/// <param name="pat">Pattern</param>
+/// <returns>Found address, cend if nothing found</returns>
+PS_TARGET_SSE2 const uint8_t* FindMaskedSSE2( const uint8_t* cstart, const uint8_t* cend, const MaskedPattern& pat )
+{
+    const __m128i v1 = _mm_set1_epi8( static_cast<char>(pat.value[pat.anchor1]) );
+    const __m128i m1 = _mm_set1_epi8( static_cast<char>(pat.mask[pat.anchor1]) );
+    const __m128i v2 = _mm_set1_epi8( static_cast<char>(pat.value[pat.anchor2]) );
+    const __m128i m2 = _mm_set1_epi8( static_cast<char>(pat.mask[pat.anchor2]) );
+
+    for (; static_cast<size_t>(cend - cstart) >= pat.len + 15; cstart += 16)
+    {
+        __m128i d1 = _mm_loadu_si128( reinterpret_cast<const __m128i*>(cstart + pat.anchor1) );
+        __m128i d2 = _mm_loadu_si128( reinterpret_cast<const __m128i*>(cstart + pat.anchor2) );
+
+        __m128i eq = _mm_and_si128( _mm_cmpeq_epi8( _mm_and_si128( d1, m1 ), v1 ),
+                                    _mm_cmpeq_epi8( _mm_and_si128( d2, m2 ), v2 ) );
+
+        for (uint32_t bits = _mm_movemask_epi8( eq ); bits != 0; bits &= bits - 1)
+        {
+            const uint8_t* candidate = cstart + LowestBit( bits );
+            if (MatchMasked( candidate, pat ))
+                return candidate;
+        }
+    }
+
+    // Tail
+    for (; static_cast<size_t>(cend - cstart) >= pat.len; ++cstart)
+        if (MatchMasked( cstart, pat ))
+            return cstart;
+
+    return cend;
+}
+
+/// <summary>
+/// Find first pattern occurrence, 32 candidates per iteration
+/// </summary>
+/// <param name="cstart">Scan start</param>
+/// <param name="cend">Scan end</param>
+/// <param name="pat">Pattern</param>
+/// <returns>Found address, cend if nothing found</returns>
+PS_TARGET_AVX2 const uint8_t* FindMaskedAVX2( const uint8_t* cstart, const uint8_t* cend, const MaskedPattern& pat )
+{
+    const __m256i v1 = _mm256_set1_epi8( static_cast<char>(pat.value[pat.anchor1]) );
+    const __m256i m1 = _mm256_set1_epi8( static_cast<char>(pat.mask[pat.anchor1]) );
+    const __m256i v2 = _mm256_set1_epi8( static_cast<char>(pat.value[pat.anchor2]) );
+    const __m256i m2 = _mm256_set1_epi8( static_cast<char>(pat.mask[pat.anchor2]) );
+
+    for (; static_cast<size_t>(cend - cstart) >= pat.len + 31; cstart += 32)
+    {
+        __m256i d1 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(cstart + pat.anchor1) );
+        __m256i d2 = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(cstart + pat.anchor2) );
+
+        __m256i eq = _mm256_and_si256( _mm256_cmpeq_epi8( _mm256_and_si256( d1, m1 ), v1 ),
+                                       _mm256_cmpeq_epi8( _mm256_and_si256( d2, m2 ), v2 ) );
+
+        for (uint32_t bits = static_cast<uint32_t>(_mm256_movemask_epi8( eq )); bits != 0; bits &= bits - 1)
+        {
+            const uint8_t* candidate = cstart + LowestBit( bits );
+            if (MatchMasked( candidate, pat ))
+                return candidate;
+        }
+    }
+
+    // Avoid AVX-SSE transition penalty in the caller
+    _mm256_zeroupper();
+
+    return FindMaskedSSE2( cstart, cend, pat );
+}
+
+/// <summary>
+/// Detect supported instruction set
+/// </summary>
+/// <returns>SIMD level</returns>
+eSimdLevel DetectSimd()
+{
+    uint32_t regs1[4] = { 0 }, regs7[4] = { 0 };
+    uint64_t xcr0 = 0;
+
+#ifdef _MSC_VER
+    int maxLeaf[4] = { 0 };
+    __cpuid( maxLeaf, 0 );
+    __cpuid( reinterpret_cast<int*>(regs1), 1 );
+
+    if (maxLeaf[0] >= 7)
+        __cpuidex( reinterpret_cast<int*>(regs7), 7, 0 );
+
+    if (regs1[2] & (1 << 27))
+        xcr0 = _xgetbv( 0 );
+#else
+    __get_cpuid( 1, &regs1[0], &regs1[1], &regs1[2], &regs1[3] );
+    __get_cpuid_count( 7, 0, &regs7[0], &regs7[1], &regs7[2], &regs7[3] );
+
+    if (regs1[2] & (1 << 27))
+    {
+        uint32_t lo = 0, hi = 0;
+        __asm__ __volatile__( "xgetbv" : "=a"(lo), "=d"(hi) : "c"(0) );
+        xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+#endif
+
+    // AVX2 + OS support for YMM state
+    if ((regs7[1] & (1 << 5)) && (regs1[2] & (1 << 28)) && (xcr0 & 6) == 6)
+        return simd_avx2;
+
+    if (regs1[3] & (1 << 26))
+        return simd_sse2;
+
+    return simd_none;
+}
+
+#else
+
+eSimdLevel DetectSimd()
+{
+    return simd_none;
+}
+
+#endif
+
+}
+
+/// <summary>
+/// Parse IDA-style signature, e.g. "48 8B ?? ?? E8 ?? ?? ?? ?? 8? 05".
+/// '?' or '??' is a wildcard byte, '8?' and '?5' match half a byte.
+/// </summary>
+/// <param name="text">Signature text</param>
+/// <returns>false if signature is empty or malformed</returns>
+bool Signature::Parse( const std::string& text )
+{
+    // Nibble value, -1 for wildcard, -2 for invalid character
+    auto nibble = []( char c ) -> int
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c == '?')
+            return -1;
+
+        return -2;
+    };
+
+    value.clear();
+    mask.clear();
+
+    for (size_t i = 0; i < text.length(); )
+    {
+        if (isspace( static_cast<uint8_t>(text[i]) ))
+        {
+            ++i;
+            continue;
+        }
+
+        size_t end = text.find_first_of( " \t\r\n", i );
+        if (end == std::string::npos)
+            end = text.length();
+
+        int hi = nibble( text[i] );
+        int lo = (end - i == 2) ? nibble( text[i + 1] ) : -1;
+
+        // Only wildcard may be a single character
+        if (end - i > 2 || hi == -2 || lo == -2 || (end - i == 1 && hi != -1))
+        {
+            value.clear();
+            mask.clear();
+            return false;
+        }
+
+        value.emplace_back( static_cast<uint8_t>(((hi >= 0 ? hi : 0) << 4) | (lo >= 0 ? lo : 0)) );
+        mask.emplace_back( static_cast<uint8_t>((hi >= 0 ? 0xF0 : 0) | (lo >= 0 ? 0x0F : 0)) );
+        i = end;
+    }
+
+    return !value.empty();
+}
+
+/// <summary>
+/// Executable sections
+/// </summary>
+/// <returns>Section filter</returns>
+SectionFilter SectionFilter::Code()
+{
+    SectionFilter filter;
+    filter.flags = IMAGE_SCN_MEM_EXECUTE;
+
+    return filter;
+}
+
+/// <summary>
+/// Readable non-executable sections with initialized data
+/// </summary>
+/// <returns>Section filter</returns>
+SectionFilter SectionFilter::Data()
+{
+    SectionFilter filter;
+    filter.flags = IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ;
+    filter.exclude = IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_DISCARDABLE;
+
+    return filter;
+}
+
+/// <summary>
+/// Section with given name, e.g. ".rdata"
+/// </summary>
+/// <param name="name">Section name</param>
+/// <returns>Section filter</returns>
+SectionFilter SectionFilter::Named( const std::string& name )
+{
+    SectionFilter filter;
+    filter.name = name;
+
+    return filter;
+}
+
+/// <summary>
+/// Check if section passes filter
+/// </summary>
+/// <param name="section">Section header</param>
+/// <returns>true if section should be searched</returns>
+bool SectionFilter::Match( const IMAGE_SECTION_HEADER& section ) const
+{
+    if ((section.Characteristics & flags) != flags || (section.Characteristics & exclude) != 0)
+        return false;
+
+    // Section name isn't null-terminated if it takes all 8 bytes
+    if (!name.empty())
+        return name.length() <= IMAGE_SIZEOF_SHORT_NAME &&
+               strncmp( name.c_str(), reinterpret_cast<const char*>(section.Name), IMAGE_SIZEOF_SHORT_NAME ) == 0;
+
+    return true;
+}
+
+PatternSearch::PatternSearch( const std::vector<uint8_t>& pattern )
+    : _pattern( pattern )
+{
+}
+
+PatternSearch::PatternSearch( const std::string& pattern )
+    : _pattern( pattern.begin(), pattern.end() )
+{
+}
+
+PatternSearch::PatternSearch( const char* pattern, size_t len /*= 0*/ )
+    : _pattern( pattern, pattern + (len ? len : strlen( pattern )) )
+{
+}
+
+PatternSearch::PatternSearch( const uint8_t* pattern, size_t len /*= 0*/ )
+    : _pattern( pattern, pattern + (len ? len : strlen( (const char*)pattern )) )
+{ 
+}
+
+PatternSearch::PatternSearch( const Signature& signature )
+    : _pattern( signature.value )
+    , _mask( signature.mask )
+{
+}
+
+PatternSearch::~PatternSearch()
+{
+}
+
+/// <summary>
+/// Prepared search state
+/// </summary>
+struct PatternSearch::State
+{
+    enum eMode
+    {
+        mode_none,      // Empty pattern, nothing can be found
+        mode_scalar,    // std::search with wildcard
+        mode_masked,    // Scalar value/mask comparison
+        mode_simd,      // Value/mask comparison filtered by anchors
+        mode_bmh,       // Boyer-Moore-Horspool, full match
+    };
+
+    eMode mode;
+    eSimdLevel simd;
+    uint8_t wildcard;
+    size_t step;                    // Advance after match
+    std::vector<uint8_t> pattern;
+    std::vector<uint8_t> value;
+    std::vector<uint8_t> mask;
+    MaskedPattern masked;           // Points into value and mask, so state is never copied
+    size_t skip[UCHAR_MAX + 1];     // BMH bad character table
+};
+
+/// <summary>
+/// Find first match in range
+/// </summary>
+/// <param name="state">Search state</param>
+/// <param name="cstart">Scan start</param>
+/// <param name="cend">Scan end</param>
+/// <returns>Found address, cend if nothing found</returns>
+const uint8_t* PatternSearch::FindNext( const State& state, const uint8_t* cstart, const uint8_t* cend )
+{
+    const size_t len = state.pattern.size();
+
+    if (cstart >= cend || static_cast<size_t>(cend - cstart) < len)
+        return cend;
+
+    switch (state.mode)
+    {
+        case State::mode_scalar:
+        {
+            uint8_t wildcard = state.wildcard;
+            return std::search( cstart, cend, state.pattern.begin(), state.pattern.end(),
+                                [wildcard]( uint8_t val1, uint8_t val2 ){ return (val1 == val2 || val2 == wildcard); } );
+        }
+
+        case State::mode_masked:
+            for (; static_cast<size_t>(cend - cstart) >= len; ++cstart)
+                if (MatchMasked( cstart, state.masked ))
+                    return cstart;
+
+            return cend;
+
+#ifdef PS_X86_SIMD
+        case State::mode_simd:
+            if (state.simd == simd_avx2)
+                return FindMaskedAVX2( cstart, cend, state.masked );
+            else
+                return FindMaskedSSE2( cstart, cend, state.masked );
+#endif
+
+        case State::mode_bmh:
+        {
+            const uint8_t* needle = state.pattern.data();
+            const size_t last = len - 1;
+
+            for (; static_cast<size_t>(cend - cstart) >= len; cstart += state.skip[cstart[last]])
+            {
+                for (size_t scan = last; cstart[scan] == needle[scan]; --scan)
+                    if (scan == 0)
+                        return cstart;
+            }
+
+            return cend;
+        }
+
+        default:
+            return cend;
+    }
+}
+
+/// <summary>
+/// Prepare search state
+/// </summary>
+/// <param name="useWildcard">True if pattern contains wildcards</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="overlapped">Report overlapping matches</param>
+/// <returns>Search state</returns>
+std::shared_ptr<const PatternSearch::State> PatternSearch::Prepare( bool useWildcard, uint8_t wildcard, bool overlapped ) const
+{
+    auto state = std::make_shared<State>();
+
+    state->simd = _simd;
+    state->wildcard = wildcard;
+    state->pattern = _pattern;
+    state->step = overlapped ? 1 : std::max<size_t>( _pattern.size(), 1 );
+
+    if (_pattern.empty())
+    {
+        state->mode = State::mode_none;
+        return state;
+    }
+
+    // Plain byte pattern
+    if (!useWildcard && _mask.empty())
+    {
+        const size_t last = _pattern.size() - 1;
+
+        state->mode = State::mode_bmh;
+
+        for (size_t i = 0; i <= UCHAR_MAX; ++i)
+            state->skip[i] = _pattern.size();
+
+        for (size_t i = 0; i < last; ++i)
+            state->skip[_pattern[i]] = last - i;
+
+        return state;
+    }
+
+    // Wildcard byte pattern, no SIMD
+    if (_mask.empty() && _simd == simd_none)
+    {
+        state->mode = State::mode_scalar;
+        return state;
+    }
+
+    // Convert pattern into value/mask form.
+    // Signature already has explicit mask, so wildcard value doesn't apply to it
+    state->value.resize( _pattern.size() );
+    state->mask.resize( _pattern.size() );
+
+    for (size_t i = 0; i < _pattern.size(); ++i)
+    {
+        uint8_t mask = _mask.empty() ? 0xFF : _mask[i];
+        if (useWildcard && _mask.empty() && _pattern[i] == wildcard)
+            mask = 0;
+
+        state->mask[i]  = mask;
+        state->value[i] = _pattern[i] & mask;
+    }
+
+    MaskedPattern pat = { state->value.data(), state->mask.data(), _pattern.size(), 0, 0 };
+    state->masked = pat;
+    state->mode = State::mode_masked;
+
+#ifdef PS_X86_SIMD
+    if (_simd != simd_none && SelectAnchors( state->masked ))
+        state->mode = State::mode_simd;
+#endif
+
+    return state;
+}
+
+/// <summary>
+/// Report all matches in buffer
+/// </summary>
+/// <param name="state">Search state</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <param name="callback">Match callback. Return false to stop</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::Enumerate( const State& state, void* scanStart, size_t scanSize, ptr_t value_offset, const fnMatch& callback )
+{
+    const uint8_t* cstart = reinterpret_cast<const uint8_t*>(scanStart);
+    const uint8_t* cend   = cstart + scanSize;
+    size_t count = 0;
+
+    for (const uint8_t* res = FindNext( state, cstart, cend ); res < cend; res = FindNext( state, res + state.step, cend ))
+    {
+        ++count;
+
+        ptr_t address = (value_offset != 0) ? REBASE( res, scanStart, value_offset ) : reinterpret_cast<ptr_t>(res);
+        if (!callback( address ))
+            break;
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Default pattern matching with wildcards.
+/// Candidates are filtered a vector at a time by two rarest non-wildcard bytes,
+/// falls back to std::search if no SIMD is available.
+/// </summary>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="out">Found results</param>
+/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::Search( uint8_t wildcard, void* scanStart, size_t scanSize, std::vector<ptr_t>& out, ptr_t value_offset /*= 0*/ )
+{
+    Enumerate( *Prepare( true, wildcard, false ), scanStart, scanSize, value_offset, 
+               [&out]( ptr_t address ) { out.emplace_back( address ); return true; } );
+
+    return out.size();
+}
+
+/// <summary>
+/// Full pattern match, no wildcards.
+/// Uses BoyerMooreHorspool algorithm, signature patterns use masked search.
+/// </summary>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="out">Found results</param>
+/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::Search( void* scanStart, size_t scanSize, std::vector<ptr_t>& out, ptr_t value_offset /*= 0*/ )
+{
+    Enumerate( *Prepare( false, 0, true ), scanStart, scanSize, value_offset, 
+               [&out]( ptr_t address ) { out.emplace_back( address ); return true; } );
+
+    return out.size();
+}
+
+/// <summary>
+/// Pattern matching with wildcards, each match is passed to callback
+/// </summary>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="callback">Match callback. Return false to stop search</param>
+/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::Search( uint8_t wildcard, void* scanStart, size_t scanSize, const fnMatch& callback, ptr_t value_offset /*= 0*/ )
+{
+    return Enumerate( *Prepare( true, wildcard, false ), scanStart, scanSize, value_offset, callback );
+}
+
+/// <summary>
+/// Full pattern match, each match is passed to callback
+/// </summary>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="callback">Match callback. Return false to stop search</param>
+/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::Search( void* scanStart, size_t scanSize, const fnMatch& callback, ptr_t value_offset /*= 0*/ )
+{
+    return Enumerate( *Prepare( false, 0, true ), scanStart, scanSize, value_offset, callback );
+}
+
+/// <summary>
+/// Find first match, pattern with wildcards
+/// </summary>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="value_offset">Value that will be added to resulting address</param>
+/// <returns>Found address, 0 if not found</returns>
+ptr_t PatternSearch::FindFirst( uint8_t wildcard, void* scanStart, size_t scanSize, ptr_t value_offset /*= 0*/ )
+{
+    return FindNth( 0, wildcard, scanStart, scanSize, value_offset );
+}
+
+/// <summary>
+/// Find first match, full pattern
+/// </summary>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="value_offset">Value that will be added to resulting address</param>
+/// <returns>Found address, 0 if not found</returns>
+ptr_t PatternSearch::FindFirst( void* scanStart, size_t scanSize, ptr_t value_offset /*= 0*/ )
+{
+    return FindNth( 0, scanStart, scanSize, value_offset );
+}
+
+/// <summary>
+/// Find n-th match, pattern with wildcards
+/// </summary>
+/// <param name="n">Zero-based match index</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="value_offset">Value that will be added to resulting address</param>
+/// <returns>Found address, 0 if not found</returns>
+ptr_t PatternSearch::FindNth( size_t n, uint8_t wildcard, void* scanStart, size_t scanSize, ptr_t value_offset /*= 0*/ )
+{
+    ptr_t result = 0;
+
+    Search( wildcard, scanStart, scanSize, [&]( ptr_t address ) 
+    { 
+        if (n-- != 0)
+            return true;
+
+        result = address;
+        return false;
+    }, value_offset );
+
+    return result;
+}
+
+/// <summary>
+/// Find n-th match, full pattern
+/// </summary>
+/// <param name="n">Zero-based match index</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="value_offset">Value that will be added to resulting address</param>
+/// <returns>Found address, 0 if not found</returns>
+ptr_t PatternSearch::FindNth( size_t n, void* scanStart, size_t scanSize, ptr_t value_offset /*= 0*/ )
+{
+    ptr_t result = 0;
+
+    Search( scanStart, scanSize, [&]( ptr_t address ) 
+    { 
+        if (n-- != 0)
+            return true;
+
+        result = address;
+        return false;
+    }, value_offset );
+
+    return result;
+}
+
+/// <summary>
+/// Lazy pattern matching with wildcards. Matches are searched during iteration
+/// </summary>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <returns>Match range</returns>
+PatternSearch::MatchRange PatternSearch::Matches( uint8_t wildcard, void* scanStart, size_t scanSize, ptr_t value_offset /*= 0*/ )
+{
+    return MatchRange( Prepare( true, wildcard, false ), scanStart, scanSize, value_offset );
+}
+
+/// <summary>
+/// Lazy full pattern matching. Matches are searched during iteration
+/// </summary>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <returns>Match range</returns>
+PatternSearch::MatchRange PatternSearch::Matches( void* scanStart, size_t scanSize, ptr_t value_offset /*= 0*/ )
+{
+    return MatchRange( Prepare( false, 0, true ), scanStart, scanSize, value_offset );
+}
+
+PatternSearch::MatchRange::MatchRange( std::shared_ptr<const State> state, void* scanStart, size_t scanSize, ptr_t value_offset )
+    : _state( state )
+    , _start( reinterpret_cast<const uint8_t*>(scanStart) )
+    , _end( reinterpret_cast<const uint8_t*>(scanStart) + scanSize )
+    , _offset( value_offset )
+{
+}
+
+PatternSearch::MatchRange::iterator PatternSearch::MatchRange::begin() const
+{
+    return iterator( this, FindNext( *_state, _start, _end ) );
+}
+
+PatternSearch::MatchRange::iterator PatternSearch::MatchRange::end() const
+{
+    return iterator( this, _end );
+}
+
+ptr_t PatternSearch::MatchRange::iterator::operator *() const
+{
+    if (_range->_offset != 0)
+        return REBASE( _pos, _range->_start, _range->_offset );
+
+    return reinterpret_cast<ptr_t>(_pos);
+}
+
+PatternSearch::MatchRange::iterator& PatternSearch::MatchRange::iterator::operator ++()
+{
+    _pos = FindNext( *_range->_state, _pos + _range->_state->step, _range->_end );
+    return *this;
+}
+
+#ifndef BLACKBONE_PORTABLE
+
+/// <summary>
+/// Search pattern in remote process.
+/// Memory is read by fixed size windows, next window is read while current one is searched.
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="out">Found results</param>
+/// <param name="window">Read window size. 0 - read whole region at once</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::SearchRemote( Process& remote, uint8_t wildcard, ptr_t scanStart, size_t scanSize, 
+                                    std::vector<ptr_t>& out, size_t window /*= DefaultWindow*/ )
+{
+    SearchRemoteStream( remote, true, wildcard, scanStart, scanSize, 
+                        [&out]( ptr_t address ) { out.emplace_back( address ); return true; }, window );
+
+    return out.size();
+}
+
+/// <summary>
+/// Search pattern in remote process, each match is passed to callback.
+/// Matching stops once callback returns false, read of the next window may be already in flight by then.
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="callback">Match callback. Return false to stop search</param>
+/// <param name="window">Read window size. 0 - read whole region at once</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::SearchRemote( Process& remote, uint8_t wildcard, ptr_t scanStart, size_t scanSize, 
+                                    const fnMatch& callback, size_t window /*= DefaultWindow*/ )
+{
+    return SearchRemoteStream( remote, true, wildcard, scanStart, scanSize, callback, window );
+}
+
+/// <summary>
+/// Search pattern in remote process.
+/// Memory is read by fixed size windows, next window is read while current one is searched.
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="out">Found results</param>
+/// <param name="window">Read window size. 0 - read whole region at once</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::SearchRemote( Process& remote, ptr_t scanStart, size_t scanSize, 
+                                    std::vector<ptr_t>& out, size_t window /*= DefaultWindow*/ )
+{
+    SearchRemoteStream( remote, false, 0, scanStart, scanSize, 
+                        [&out]( ptr_t address ) { out.emplace_back( address ); return true; }, window );
+
+    return out.size();
+}
+
+/// <summary>
+/// Search pattern in remote process, each match is passed to callback.
+/// Matching stops once callback returns false, read of the next window may be already in flight by then.
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="callback">Match callback. Return false to stop search</param>
+/// <param name="window">Read window size. 0 - read whole region at once</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::SearchRemote( Process& remote, ptr_t scanStart, size_t scanSize, 
+                                    const fnMatch& callback, size_t window /*= DefaultWindow*/ )
+{
+    return SearchRemoteStream( remote, false, 0, scanStart, scanSize, callback, window );
+}
+
+/// <summary>
+/// Search pattern in sections of remote module.
+/// Section headers are read from target once per call.
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="module">Target module</param>
+/// <param name="filter">Sections to search</param>
+/// <param name="out">Found results</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::SearchModule( Process& remote, uint8_t wildcard, const ModuleData& module, 
+                                    const SectionFilter& filter, std::vector<ptr_t>& out )
+{
+    SearchModuleSections( remote, true, wildcard, module, filter, 
+                          [&out]( ptr_t address ) { out.emplace_back( address ); return true; } );
+
+    return out.size();
+}
+
+/// <summary>
+/// Search pattern in sections of remote module, each match is passed to callback
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="module">Target module</param>
+/// <param name="filter">Sections to search</param>
+/// <param name="callback">Match callback. Return false to stop search</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::SearchModule( Process& remote, uint8_t wildcard, const ModuleData& module, 
+                                    const SectionFilter& filter, const fnMatch& callback )
+{
+    return SearchModuleSections( remote, true, wildcard, module, filter, callback );
+}
+
+/// <summary>
+/// Search pattern in sections of remote module.
+/// Section headers are read from target once per call.
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="module">Target module</param>
+/// <param name="filter">Sections to search</param>
+/// <param name="out">Found results</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::SearchModule( Process& remote, const ModuleData& module, 
+                                    const SectionFilter& filter, std::vector<ptr_t>& out )
+{
+    SearchModuleSections( remote, false, 0, module, filter, 
+                          [&out]( ptr_t address ) { out.emplace_back( address ); return true; } );
+
+    return out.size();
+}
+
+/// <summary>
+/// Search pattern in sections of remote module, each match is passed to callback
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="module">Target module</param>
+/// <param name="filter">Sections to search</param>
+/// <param name="callback">Match callback. Return false to stop search</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::SearchModule( Process& remote, const ModuleData& module, 
+                                    const SectionFilter& filter, const fnMatch& callback )
+{
+    return SearchModuleSections( remote, false, 0, module, filter, callback );
+}
+
+#endif
+
+/// <summary>
+/// Search pattern in sections of local image.
+/// Plain data files are searched by raw section data.
+/// </summary>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="image">Parsed image</param>
+/// <param name="dataSize">Size of image data, e.g. file projection size. Sections are clipped to it</param>
+/// <param name="filter">Sections to search</param>
+/// <param name="out">Found results</param>
+/// <param name="value_offset">Image base for resulting addresses. 0 - report local addresses</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::SearchImage( uint8_t wildcard, const pe::PEParser& image, size_t dataSize, const SectionFilter& filter, 
+                                   std::vector<ptr_t>& out, ptr_t value_offset /*= 0*/ )
+{
+    return SearchImageSections( true, wildcard, image, dataSize, filter, out, value_offset );
+}
+
+/// <summary>
+/// Search pattern in sections of local image.
+/// Plain data files are searched by raw section data.
+/// </summary>
+/// <param name="image">Parsed image</param>
+/// <param name="dataSize">Size of image data, e.g. file projection size. Sections are clipped to it</param>
+/// <param name="filter">Sections to search</param>
+/// <param name="out">Found results</param>
+/// <param name="value_offset">Image base for resulting addresses. 0 - report local addresses</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::SearchImage( const pe::PEParser& image, size_t dataSize, const SectionFilter& filter, 
+                                   std::vector<ptr_t>& out, ptr_t value_offset /*= 0*/ )
+{
+    return SearchImageSections( false, 0, image, dataSize, filter, out, value_offset );
+}
+
+#ifndef BLACKBONE_PORTABLE
+
+/// <summary>
+/// Read section headers of remote module
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="module">Target module</param>
+/// <param name="sections">Section headers</param>
+/// <returns>Status code</returns>
+NTSTATUS PatternSearch::ModuleSections( Process& remote, const ModuleData& module, std::vector<IMAGE_SECTION_HEADER>& sections )
+{
+    sections.clear();
+
+    // Section table usually fits into the first page
+    std::vector<uint8_t> hdr( std::min<size_t>( module.size, 0x1000 ) );
+    if (hdr.size() < sizeof( IMAGE_DOS_HEADER ))
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    NTSTATUS status = remote.memory().Read( module.baseAddress, hdr.size(), hdr.data() );
+    if (!NT_SUCCESS( status ))
+        return status;
+
+    auto pDosHdr = reinterpret_cast<const IMAGE_DOS_HEADER*>(hdr.data());
+    if (pDosHdr->e_magic != IMAGE_DOS_SIGNATURE || pDosHdr->e_lfanew < 0 ||
+         static_cast<size_t>(pDosHdr->e_lfanew) + sizeof( IMAGE_NT_HEADERS32 ) > hdr.size())
+    {
+        return STATUS_INVALID_IMAGE_FORMAT;
+    }
+
+    // File header is same for 32 and 64 bit images
+    auto pNtHdr = reinterpret_cast<const IMAGE_NT_HEADERS32*>(hdr.data() + pDosHdr->e_lfanew);
+    if (pNtHdr->Signature != IMAGE_NT_SIGNATURE)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    size_t secOffset = pDosHdr->e_lfanew + FIELD_OFFSET( IMAGE_NT_HEADERS32, OptionalHeader ) + 
+                       pNtHdr->FileHeader.SizeOfOptionalHeader;
+    size_t secCount = pNtHdr->FileHeader.NumberOfSections;
+    size_t secEnd = secOffset + secCount * sizeof( IMAGE_SECTION_HEADER );
+
+    // Read rest of the headers
+    if (secEnd > hdr.size())
+    {
+        if (secEnd > module.size)
+            return STATUS_INVALID_IMAGE_FORMAT;
+
+        size_t done = hdr.size();
+        hdr.resize( secEnd );
+
+        status = remote.memory().Read( module.baseAddress + done, secEnd - done, hdr.data() + done );
+        if (!NT_SUCCESS( status ))
+            return status;
+    }
+
+    auto pSection = reinterpret_cast<const IMAGE_SECTION_HEADER*>(hdr.data() + secOffset);
+    sections.assign( pSection, pSection + secCount );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Search pattern in remote memory using double-buffered read window.
+/// Windows overlap by pattern length, so no match is lost on window border.
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="useWildcard">True if pattern contains wildcards</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="scanStart">Starting address</param>
+/// <param name="scanSize">Size of region to scan</param>
+/// <param name="callback">Match callback. Return false to stop search</param>
+/// <param name="window">Read window size</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::SearchRemoteStream( Process& remote, bool useWildcard, uint8_t wildcard, ptr_t scanStart, 
+                                          size_t scanSize, const fnMatch& callback, size_t window )
+{
+    if (_pattern.empty() || scanSize < _pattern.size())
+        return 0;
+
+    const size_t overlap = _pattern.size() - 1;
+
+    if (window == 0 || window > scanSize)
+        window = scanSize;
+
+    auto state = Prepare( useWildcard, wildcard, !useWildcard );
+    size_t count = 0;
+    bool stop = false;
+
+    std::vector<uint8_t> buf[2];
+    std::future<NTSTATUS> pending;
+
+    // Wildcard matches don't overlap, so next window starts after the last match
+    ptr_t nextAllowed = scanStart;
+
+    auto read = [&remote]( ptr_t address, std::vector<uint8_t>& dst ) -> NTSTATUS
+    {
+        return remote.memory().Read( address, dst.size(), dst.data() );
+    };
+
+    buf[0].resize( std::min<size_t>( window + overlap, scanSize ) );
+    pending = std::async( std::launch::async, read, scanStart, std::ref( buf[0] ) );
+
+    for (size_t ofst = 0, idx = 0; ofst < scanSize && !stop; ofst += window, idx ^= 1)
+    {
+        ptr_t  address = scanStart + ofst;
+        size_t size    = std::min<size_t>( window, scanSize - ofst );
+        size_t readEnd = std::min<size_t>( window + overlap, scanSize - ofst );
+
+        NTSTATUS status = pending.get();
+
+        // Start reading next window
+        if (ofst + window < scanSize)
+        {
+            auto& next = buf[idx ^ 1];
+            next.resize( std::min<size_t>( window + overlap, scanSize - ofst - window ) );
+            pending = std::async( std::launch::async, read, address + window, std::ref( next ) );
+        }
+
+        // Window is too short to contain pattern or unreadable
+        if (status != STATUS_SUCCESS || readEnd < _pattern.size())
+            continue;
+
+        size_t skip = nextAllowed > address ? static_cast<size_t>(nextAllowed - address) : 0;
+        if (skip >= readEnd)
+            continue;
+
+        Enumerate( *state, buf[idx].data() + skip, readEnd - skip, address + skip, [&]( ptr_t ptr )
+        {
+            // Matches starting in the overlap belong to next window
+            if (ptr >= address + size)
+                return false;
+
+            ++count;
+            if (useWildcard)
+                nextAllowed = ptr + _pattern.size();
+
+            stop = !callback( ptr );
+            return !stop;
+        } );
+    }
+
+    return count;
+}
+
+/// <summary>
+/// Search pattern in filtered sections of remote module
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="useWildcard">True if pattern contains wildcards</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="module">Target module</param>
+/// <param name="filter">Sections to search</param>
+/// <param name="callback">Match callback. Return false to stop search</param>
+/// <returns>Number of reported matches</returns>
+size_t PatternSearch::SearchModuleSections( Process& remote, bool useWildcard, uint8_t wildcard, const ModuleData& module, 
+                                            const SectionFilter& filter, const fnMatch& callback )
+{
+    std::vector<IMAGE_SECTION_HEADER> sections;
+    if (!NT_SUCCESS( ModuleSections( remote, module, sections ) ))
+        return 0;
+
+    size_t count = 0;
+    bool stop = false;
+
+    auto report = [&callback, &stop]( ptr_t address )
+    {
+        stop = !callback( address );
+        return !stop;
+    };
 
-#include <algorithm>
-#include <memory>
+    for (auto& section : sections)
+    {
+        if (stop)
+            break;
 
-namespace blackbone
-{
+        if (!filter.Match( section ) || section.VirtualAddress >= module.size)
+            continue;
 
-PatternSearch::PatternSearch( const std::vector<uint8_t>& pattern )
-    : _pattern( pattern )
-{
-}
+        size_t size = section.Misc.VirtualSize != 0 ? section.Misc.VirtualSize : section.SizeOfRawData;
+        size = std::min<size_t>( size, module.size - section.VirtualAddress );
 
-PatternSearch::PatternSearch( const std::string& pattern )
-    : _pattern( pattern.begin(), pattern.end() )
-{
+        count += SearchRemoteStream( remote, useWildcard, wildcard, module.baseAddress + section.VirtualAddress, 
+                                     size, report, DefaultWindow );
+    }
+
+    return count;
 }
 
-PatternSearch::PatternSearch( const char* pattern, size_t len /*= 0*/ )
-    : _pattern( pattern, pattern + (len ? len : strlen( pattern )) )
+#endif
+
+/// <summary>
+/// Search pattern in filtered sections of local image
+/// </summary>
+/// <param name="useWildcard">True if pattern contains wildcards</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="image">Parsed image</param>
+/// <param name="dataSize">Size of image data, e.g. file projection size. Sections are clipped to it</param>
+/// <param name="filter">Sections to search</param>
+/// <param name="out">Found results</param>
+/// <param name="value_offset">Image base for resulting addresses</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::SearchImageSections( bool useWildcard, uint8_t wildcard, const pe::PEParser& image, size_t dataSize, 
+                                           const SectionFilter& filter, std::vector<ptr_t>& out, ptr_t value_offset )
 {
-}
+    auto base = reinterpret_cast<const uint8_t*>(image.fileBase());
+    if (base == nullptr || _pattern.empty())
+        return out.size();
 
-PatternSearch::PatternSearch( const uint8_t* pattern, size_t len /*= 0*/ )
-    : _pattern( pattern, pattern + (len ? len : strlen( (const char*)pattern )) )
-{ 
+    auto state = Prepare( useWildcard, wildcard, !useWildcard );
+    auto report = [&out]( ptr_t address ) { out.emplace_back( address ); return true; };
+
+    for (auto& section : image.sections())
+    {
+        if (!filter.Match( section ))
+            continue;
+
+        size_t offset = section.VirtualAddress;
+        size_t size = section.Misc.VirtualSize != 0 ? section.Misc.VirtualSize : section.SizeOfRawData;
+        size_t limit = std::min( dataSize, image.imageSize() );
+
+        // Raw section data
+        if (image.isPlainData())
+        {
+            offset = section.PointerToRawData;
+            size = section.SizeOfRawData;
+            limit = dataSize;
+        }
+
+        // Header values aren't trusted
+        if (offset >= limit)
+            continue;
+
+        size = std::min( size, limit - offset );
+
+        Enumerate( *state, const_cast<uint8_t*>(base + offset), size, 
+                   value_offset != 0 ? value_offset + section.VirtualAddress : 0, report );
+    }
+
+    return out.size();
 }
 
-PatternSearch::~PatternSearch()
+#ifndef BLACKBONE_PORTABLE
+
+/// <summary>
+/// Search pattern in whole address space of remote process.
+/// Address space layout is swept again on every call
+/// </summary>
+/// <param name="remote">Remote process</param>
+/// <param name="useWildcard">True if pattern contains wildcards</param>
+/// <param name="wildcard">Pattern wildcard</param>
+/// <param name="out">Found results</param>
+/// <param name="threads">Number of worker threads. 0 - one per CPU core, 1 - scan sequentially</param>
+/// <returns>Number of found addresses</returns>
+size_t PatternSearch::SearchRemoteWhole( Process& remote, bool useWildcard, uint8_t wildcard, std::vector<ptr_t>& out, size_t threads /*= 1*/ )
 {
+    auto native = remote.core().native();
+    auto read = [&remote]( ptr_t address, size_t size, void* buffer ) { return remote.memory().Read( address, size, buffer ); };
+
+    // Layout is swept again, target may have changed it since last walk
+    native->regions().Reset();
+
+    return SearchRegions( native->regions(), native->minAddr(), native->maxAddr(), read, useWildcard, wildcard, out, threads );
 }
 
+#endif
+
 /// <summary>
-/// Default pattern matching with wildcards.
-/// std::search is approximately 2x faster than naive approach.
+/// Search pattern in committed regions of address space.
+/// Backend of SearchRemoteWhole, so any memory source can be searched the same way
 /// </summary>
+/// <param name="map">Address space layout</param>
+/// <param name="from">Range start</param>
+/// <param name="to">Range end</param>
+/// <param name="read">Memory read routine. Regions that can't be read entirely are skipped</param>
+/// <param name="useWildcard">True if pattern contains wildcards</param>
 /// <param name="wildcard">Pattern wildcard</param>
-/// <param name="scanStart">Starting address</param>
-/// <param name="scanSize">Size of region to scan</param>
 /// <param name="out">Found results</param>
-/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <param name="threads">Number of worker threads. 0 - one per CPU core, 1 - scan sequentially</param>
 /// <returns>Number of found addresses</returns>
-size_t PatternSearch::Search( uint8_t wildcard, void* scanStart, size_t scanSize, std::vector<ptr_t>& out, ptr_t value_offset /*= 0*/ )
+size_t PatternSearch::SearchRegions( RegionMap& map, ptr_t from, ptr_t to, const fnRead& read, bool useWildcard, uint8_t wildcard, 
+                                     std::vector<ptr_t>& out, size_t threads /*= 1*/ )
 {
-    const uint8_t* cstart = (const uint8_t*)scanStart;
-    const uint8_t* cend   = cstart + scanSize;
+    RegionMap::vecRegions regions;
 
-    for (;;)
+    out.clear();
+    map.Enum( from, to, regions );
+
+    if (threads != 1)
+        return SearchRegionsParallel( regions, read, useWildcard, wildcard, out, threads );
+
+    std::vector<uint8_t> buf( 1 * 1024 * 1024 );    // 1 MB
+
+    for (auto& mbi : regions)
     {
-        const uint8_t* res = std::search( cstart, cend, _pattern.begin(), _pattern.end(),
-                                          [&wildcard]( uint8_t val1, uint8_t val2 ){ return (val1 == val2 || val2 == wildcard); } );
+        ptr_t memptr = mbi.BaseAddress;
+        size_t size = static_cast<size_t>(mbi.RegionSize);
 
-        if (res >= cend)
-            break;
+        // Filter regions
+        if (mbi.State != MEM_COMMIT || mbi.Protect == PAGE_NOACCESS/*|| !(mbi.Protect & PAGE_READWRITE)*/)
+            continue;
 
-        if (value_offset != 0)
-            out.emplace_back( REBASE( res, scanStart, value_offset ) );
-        else
-            out.emplace_back( reinterpret_cast<ptr_t>(res) );
+        if (size > buf.size())
+            buf.resize( size );
+
+        if (read( memptr, size, buf.data() ) != STATUS_SUCCESS)
+            continue;
 
-        cstart = res + _pattern.size();
+        if (useWildcard)
+            Search( wildcard, buf.data(), size, out, memptr );
+        else
+            Search( buf.data(), size, out, memptr );
     }
 
     return out.size();
 }
 
 /// <summary>
-/// Full pattern match, no wildcards.
-/// Uses BoyerMooreHorspool algorithm.
+/// Search pattern in committed regions using worker pool.
+/// Regions are split into chunks overlapping by pattern length.
 /// </summary>
-/// <param name="scanStart">Starting address</param>
-/// <param name="scanSize">Size of region to scan</param>
+/// <param name="regions">Regions to search</param>
+/// <param name="read">Memory read routine</param>
+/// <param name="useWildcard">True if pattern contains wildcards</param>
+/// <param name="wildcard">Pattern wildcard</param>
 /// <param name="out">Found results</param>
-/// <param name="value_offset">Value that will be added to resulting addresses</param>
+/// <param name="threads">Number of worker threads</param>
 /// <returns>Number of found addresses</returns>
-size_t PatternSearch::Search( void* scanStart, size_t scanSize, std::vector<ptr_t>& out, ptr_t value_offset /*= 0*/ )
+size_t PatternSearch::SearchRegionsParallel( const RegionMap::vecRegions& regions, const fnRead& read, bool useWildcard, uint8_t wildcard, 
+                                             std::vector<ptr_t>& out, size_t threads )
 {
-    size_t bad_char_skip[UCHAR_MAX + 1];
+    // Part of memory region searched by single worker
+    struct Chunk
+    {
+        ptr_t  address;     // Chunk start
+        size_t size;        // Matches must start inside this range
+        size_t readSize;    // Size including overlap with next chunk
+        ptr_t  region;      // Base of region chunk belongs to
+    };
+
+    const size_t chunkSize = 4 * 1024 * 1024;   // 4 MB
+    const size_t overlap = _pattern.empty() ? 0 : _pattern.size() - 1;
+
+    std::vector<Chunk> chunks;
+
+    for (auto& mbi : regions)
+    {
+        // Filter regions
+        if (mbi.State != MEM_COMMIT || mbi.Protect == PAGE_NOACCESS)
+            continue;
+
+        for (ptr_t ofst = 0; ofst < mbi.RegionSize; ofst += chunkSize)
+        {
+            Chunk chunk = { 0 };
+            chunk.address  = mbi.BaseAddress + ofst;
+            chunk.size     = static_cast<size_t>(std::min<ptr_t>( chunkSize, mbi.RegionSize - ofst ));
+            chunk.readSize = static_cast<size_t>(std::min<ptr_t>( chunkSize + overlap, mbi.RegionSize - ofst ));
+            chunk.region   = mbi.BaseAddress;
+
+            chunks.emplace_back( chunk );
+        }
+    }
 
-    const uint8_t* haystack = reinterpret_cast<const uint8_t*>(scanStart);
-    const uint8_t* needle   = &_pattern[0];
-    intptr_t       nlen     = _pattern.size();
-    intptr_t       scan     = 0;
-    intptr_t       last     = nlen - 1;
+    if (threads == 0)
+        threads = std::max<unsigned int>( std::thread::hardware_concurrency(), 1 );
+
+    threads = std::min<size_t>( threads, chunks.size() );
 
     //
-    // Preprocess
+    // Wildcard matches are collected with overlaps, so chunks
+    // can be searched independently of each other
     //
-    for (scan = 0; scan <= UCHAR_MAX; ++scan)
-        bad_char_skip[scan] = nlen;
+    std::vector<std::vector<ptr_t>> results( chunks.size() );
+    std::atomic<size_t> next( 0 );
+    auto state = Prepare( useWildcard, wildcard, true );
+
+    auto worker = [&]()
+    {
+        std::vector<uint8_t> buf( chunkSize + overlap );
+
+        for (size_t i = next++; i < chunks.size(); i = next++)
+        {
+            auto& chunk = chunks[i];
+            auto& found = results[i];
+
+            if (read( chunk.address, chunk.readSize, buf.data() ) != STATUS_SUCCESS)
+                continue;
+
+            // Matches starting in overlap belong to next chunk
+            Enumerate( *state, buf.data(), chunk.readSize, chunk.address, [&]( ptr_t address )
+            {
+                if (address >= chunk.address + chunk.size)
+                    return false;
 
-    for (scan = 0; scan < last; ++scan)
-        bad_char_skip[needle[scan]] = last - scan;
+                found.emplace_back( address );
+                return true;
+            } );
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++)
+        pool.emplace_back( worker );
+
+    worker();
+
+    for (auto& thd : pool)
+        thd.join();
 
     //
-    // Search
+    // Merge in address order. 
+    // Wildcard search doesn't report overlapping matches inside one region
     //
-    while (scanSize >= static_cast<size_t>(nlen))
+    ptr_t nextAllowed = 0;
+    ptr_t region = 0;
+
+    for (size_t i = 0; i < chunks.size(); i++)
     {
-        for (scan = last; haystack[scan] == needle[scan]; --scan)
+        if (chunks[i].region != region)
+        {
+            region = chunks[i].region;
+            nextAllowed = 0;
+        }
+
+        for (auto addr : results[i])
         {
-            if (scan == 0)
+            if (useWildcard)
             {
-                if (value_offset != 0)
-                    out.emplace_back( REBASE( haystack, scanStart, value_offset ) );
-                else
-                    out.emplace_back( reinterpret_cast<ptr_t>(haystack) );
+                if (addr < nextAllowed)
+                    continue;
+
+                nextAllowed = addr + _pattern.size();
             }
-        }
 
-        scanSize -= bad_char_skip[haystack[last]];
-        haystack += bad_char_skip[haystack[last]];
+            out.emplace_back( addr );
+        }
     }
 
     return out.size();
 }
 
+
+PatternSet::PatternSet()
+{
+}
+
+PatternSet::~PatternSet()
+{
+}
+
 /// <summary>
-/// Search pattern in remote process
+/// Add pattern without wildcards
 /// </summary>
-/// <param name="remote">Remote process</param>
+/// <param name="pattern">Pattern bytes</param>
+/// <returns>Pattern index</returns>
+size_t PatternSet::Add( const std::vector<uint8_t>& pattern )
+{
+    _value.emplace_back( pattern );
+    _mask.emplace_back( std::vector<uint8_t>( pattern.size(), 0xFF ) );
+    _compiled = false;
+
+    return _value.size() - 1;
+}
+
+/// <summary>
+/// Add pattern without wildcards
+/// </summary>
+/// <param name="pattern">Pattern bytes</param>
+/// <param name="len">Pattern length. If 0 - pattern is treated as null-terminated string</param>
+/// <returns>Pattern index</returns>
+size_t PatternSet::Add( const char* pattern, size_t len /*= 0*/ )
+{
+    return Add( std::vector<uint8_t>( pattern, pattern + (len ? len : strlen( pattern )) ) );
+}
+
+/// <summary>
+/// Add pattern with wildcards
+/// </summary>
+/// <param name="pattern">Pattern bytes</param>
 /// <param name="wildcard">Pattern wildcard</param>
+/// <returns>Pattern index</returns>
+size_t PatternSet::Add( const std::vector<uint8_t>& pattern, uint8_t wildcard )
+{
+    std::vector<uint8_t> value( pattern.size() ), mask( pattern.size() );
+
+    for (size_t i = 0; i < pattern.size(); ++i)
+    {
+        mask[i]  = (pattern[i] == wildcard) ? 0 : 0xFF;
+        value[i] = pattern[i] & mask[i];
+    }
+
+    _value.emplace_back( std::move( value ) );
+    _mask.emplace_back( std::move( mask ) );
+    _compiled = false;
+
+    return _value.size() - 1;
+}
+
+/// <summary>
+/// Add signature pattern
+/// </summary>
+/// <param name="signature">Pattern value and mask</param>
+/// <returns>Pattern index</returns>
+size_t PatternSet::Add( const Signature& signature )
+{
+    _value.emplace_back( signature.value );
+    _mask.emplace_back( signature.mask );
+    _compiled = false;
+
+    return _value.size() - 1;
+}
+
+/// <summary>
+/// Build anchor lookup tables
+/// </summary>
+void PatternSet::Compile()
+{
+    std::vector<uint32_t> keys( _value.size() );
+    std::vector<int> kinds( _value.size() );
+
+    _anchor.assign( _value.size(), 0 );
+    _pairStart.assign( 0x10001, 0 );
+    _pairFilter.assign( 0x10000 / 8, 0 );
+    _byteStart.assign( 0x101, 0 );
+    _pairItems.clear();
+    _byteItems.clear();
+    _anyItems.clear();
+
+    //
+    // Choose anchors and count bucket sizes
+    //
+    for (size_t i = 0; i < _value.size(); ++i)
+    {
+        auto& value = _value[i];
+        auto& mask = _mask[i];
+        MaskedPattern pat = { value.data(), mask.data(), value.size(), 0, 0 };
+        int bestRank = INT_MAX;
+
+        // Empty pattern never matches, same as single PatternSearch
+        if (value.empty())
+        {
+            kinds[i] = -1;
+            continue;
+        }
+
+        // Rarest pair of adjacent non-wildcard bytes
+        for (size_t j = 0; j + 1 < value.size(); ++j)
+        {
+            if (mask[j] != 0xFF || mask[j + 1] != 0xFF)
+                continue;
+
+            int rank = g_byteRank[value[j]] + g_byteRank[value[j + 1]];
+            if (rank < bestRank)
+            {
+                bestRank = rank;
+                _anchor[i] = j;
+            }
+        }
+
+        if (bestRank != INT_MAX)
+        {
+            kinds[i] = 2;
+            keys[i] = value[_anchor[i]] | (static_cast<uint32_t>(value[_anchor[i] + 1]) << 8);
+            _pairStart[keys[i] + 1]++;
+        }
+        // Rarest single byte, every byte value matching the mask gets an entry
+        else if (SelectAnchors( pat ))
+        {
+            kinds[i] = 1;
+            _anchor[i] = pat.anchor1;
+
+            for (uint32_t b = 0; b < 0x100; ++b)
+                if ((b & mask[pat.anchor1]) == value[pat.anchor1])
+                    _byteStart[b + 1]++;
+        }
+        // Wildcards only, checked at every position
+        else
+        {
+            kinds[i] = 0;
+            _anyItems.push_back( static_cast<uint32_t>(i) );
+        }
+    }
+
+    for (size_t k = 1; k < _pairStart.size(); ++k)
+        _pairStart[k] += _pairStart[k - 1];
+
+    for (size_t k = 1; k < _byteStart.size(); ++k)
+        _byteStart[k] += _byteStart[k - 1];
+
+    //
+    // Fill buckets
+    //
+    std::vector<uint32_t> pairPos( _pairStart.begin(), _pairStart.end() - 1 );
+    std::vector<uint32_t> bytePos( _byteStart.begin(), _byteStart.end() - 1 );
+
+    _pairItems.resize( _pairStart.back() );
+    _byteItems.resize( _byteStart.back() );
+
+    for (size_t i = 0; i < _value.size(); ++i)
+    {
+        if (kinds[i] == 2)
+        {
+            _pairItems[pairPos[keys[i]]++] = static_cast<uint32_t>(i);
+            _pairFilter[keys[i] >> 3] |= 1 << (keys[i] & 7);
+        }
+        else if (kinds[i] == 1)
+        {
+            uint8_t value = _value[i][_anchor[i]];
+            uint8_t mask = _mask[i][_anchor[i]];
+
+            for (uint32_t b = 0; b < 0x100; ++b)
+                if ((b & mask) == value)
+                    _byteItems[bytePos[b]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    _compiled = true;
+}
+
+/// <summary>
+/// Search all patterns at once. Overlapping matches are reported.
+/// </summary>
 /// <param name="scanStart">Starting address</param>
 /// <param name="scanSize">Size of region to scan</param>
-/// <param name="out">Found results</param>
+/// <param name="out">Found results, sorted by address</param>
+/// <param name="value_offset">Value that will be added to resulting addresses</param>
 /// <returns>Number of found addresses</returns>
-size_t PatternSearch::SearchRemote( Process& remote, uint8_t wildcard, ptr_t scanStart, size_t scanSize, std::vector<ptr_t>& out )
+size_t PatternSet::Search( void* scanStart, size_t scanSize, std::vector<Match>& out, ptr_t value_offset /*= 0*/ )
 {
-    uint8_t *pBuffer = reinterpret_cast<uint8_t*>(VirtualAlloc( NULL, scanSize, MEM_COMMIT, PAGE_READWRITE ));
+    if (!_compiled)
+        Compile();
 
-    if (pBuffer && remote.memory().Read( scanStart, scanSize, pBuffer ) == STATUS_SUCCESS)
-        Search( wildcard, pBuffer, scanSize, out );
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(scanStart);
+    size_t first = out.size();
 
-    if (pBuffer)
-        VirtualFree( pBuffer, 0, MEM_RELEASE );
+    // Verify pattern anchored at particular position
+    auto tryMatch = [&]( uint32_t idx, size_t pos )
+    {
+        auto& value = _value[idx];
+        size_t anchor = _anchor[idx];
+
+        if (pos < anchor || scanSize - (pos - anchor) < value.size())
+            return;
+
+        MaskedPattern pat = { value.data(), _mask[idx].data(), value.size(), 0, 0 };
+        const uint8_t* res = data + pos - anchor;
+
+        if (MatchMasked( res, pat ))
+        {
+            Match match = { idx, (value_offset != 0) ? REBASE( res, scanStart, value_offset ) : reinterpret_cast<ptr_t>(res) };
+            out.emplace_back( match );
+        }
+    };
+
+    // Patterns anchored on byte pair
+    if (!_pairItems.empty() && scanSize > 1)
+    {
+        const uint8_t* filter = _pairFilter.data();
+        uint32_t key = static_cast<uint32_t>(data[0]) << 8;
+
+        for (size_t i = 0; i < scanSize - 1; ++i)
+        {
+            key = (key >> 8) | (static_cast<uint32_t>(data[i + 1]) << 8);
+
+            if (filter[key >> 3] & (1 << (key & 7)))
+                for (uint32_t j = _pairStart[key]; j < _pairStart[key + 1]; ++j)
+                    tryMatch( _pairItems[j], i );
+        }
+    }
+
+    // Patterns anchored on single byte
+    if (!_byteItems.empty())
+    {
+        for (size_t i = 0; i < scanSize; ++i)
+            for (uint32_t j = _byteStart[data[i]]; j < _byteStart[data[i] + 1]; ++j)
+                tryMatch( _byteItems[j], i );
+    }
+
+    // Wildcard-only patterns
+    for (auto idx : _anyItems)
+        for (size_t i = 0; i < scanSize; ++i)
+            tryMatch( idx, i );
+
+    // Anchors are at different offsets, so results must be reordered
+    std::sort( out.begin() + first, out.end(), []( const Match& a, const Match& b )
+    {
+        return a.address < b.address || (a.address == b.address && a.index < b.index);
+    } );
 
     return out.size();
 }
 
+#ifndef BLACKBONE_PORTABLE
+
 /// <summary>
-/// Search pattern in remote process
+/// Search all patterns in remote process
 /// </summary>
 /// <param name="remote">Remote process</param>
 /// <param name="scanStart">Starting address</param>
 /// <param name="scanSize">Size of region to scan</param>
-/// <param name="out">Found results</param>
+/// <param name="out">Found results, sorted by address</param>
 /// <returns>Number of found addresses</returns>
-size_t PatternSearch::SearchRemote( Process& remote, ptr_t scanStart, size_t scanSize, std::vector<ptr_t>& out )
+size_t PatternSet::SearchRemote( Process& remote, ptr_t scanStart, size_t scanSize, std::vector<Match>& out )
 {
     uint8_t *pBuffer = reinterpret_cast<uint8_t*>(VirtualAlloc( NULL, scanSize, MEM_COMMIT, PAGE_READWRITE ));
 
@@ -161,53 +1671,40 @@ size_t PatternSearch::SearchRemote( Process& remote, ptr_t scanStart, size_t sca
     return out.size();
 }
 
+#endif
+
 /// <summary>
-/// Search pattern in whole address space of remote process
+/// Get first match of particular pattern
 /// </summary>
-/// <param name="remote">Remote process</param>
-/// <param name="useWildcard">True if pattern contains wildcards</param>
-/// <param name="wildcard">Pattern wildcard</param>
-/// <param name="out">Found results</param>
-/// <returns>Number of found addresses</returns>
-size_t PatternSearch::SearchRemoteWhole( Process& remote, bool useWildcard, uint8_t wildcard, std::vector<ptr_t>& out )
+/// <param name="matches">Search results</param>
+/// <param name="index">Pattern index</param>
+/// <returns>Match address, 0 if pattern wasn't found</returns>
+ptr_t PatternSet::First( const std::vector<Match>& matches, size_t index )
 {
-    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
-    size_t  bufsize = 1 * 1024 * 1024;  // 1 MB
-    uint8_t *buf = reinterpret_cast<uint8_t*>(VirtualAlloc( 0, bufsize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ));
-
-    out.clear();
-
-    auto native = remote.core().native();
-
-    for (ptr_t memptr = native->minAddr(); memptr < native->maxAddr(); memptr = mbi.BaseAddress + mbi.RegionSize)
-    {
-        if (remote.core().native()->VirtualQueryExT( memptr, &mbi ) != STATUS_SUCCESS)
-            continue;
-
-        // Filter regions
-        if (mbi.State != MEM_COMMIT || mbi.Protect == PAGE_NOACCESS/*|| !(mbi.Protect & PAGE_READWRITE)*/)
-            continue;
-
-        // Reallocate buffer
-        if (mbi.RegionSize > bufsize)
-        {
-            bufsize = static_cast<size_t>(mbi.RegionSize);
-            VirtualFree( buf, 0, MEM_RELEASE );
-            buf = reinterpret_cast<uint8_t*>(VirtualAlloc( 0, bufsize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ));
-        }
-
-        if (remote.memory().Read( memptr, static_cast<size_t>(mbi.RegionSize), buf ) != STATUS_SUCCESS)
-            continue;
+    for (auto& match : matches)
+        if (match.index == index)
+            return match.address;
 
-        if (useWildcard)
-            Search( buf, static_cast<size_t>(mbi.RegionSize), out, memptr );
-        else
-            Search( wildcard, buf, static_cast<size_t>(mbi.RegionSize), out, memptr );
-    }
+    return 0;
+}
 
-    VirtualFree( buf, 0, MEM_RELEASE );
+/// <summary>
+/// Get best instruction set supported by current CPU
+/// </summary>
+/// <returns>SIMD level</returns>
+eSimdLevel PatternSearch::SupportedSimd()
+{
+    static const eSimdLevel level = DetectSimd();
+    return level;
+}
 
-    return out.size();
+/// <summary>
+/// Set instruction set used by wildcard search. Clamped to CPU capabilities
+/// </summary>
+/// <param name="level">SIMD level, simd_none forces scalar search</param>
+void PatternSearch::simd( eSimdLevel level )
+{
+    _simd = std::min<eSimdLevel>( level, SupportedSimd() );
 }
 
 
@@ -1,27 +1,167 @@
 #pragma once
 
 #include "Types.h"
+#include "RegionMap.h"
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <iterator>
+#include <functional>
 #include <initializer_list>
 
 namespace blackbone
 {
 
+// Instruction set used by wildcard search
+enum eSimdLevel
+{
+    simd_none = 0,  // Scalar std::search
+    simd_sse2,      // 16 bytes per iteration
+    simd_avx2,      // 32 bytes per iteration
+};
+
+/// <summary>
+/// Pattern in value/mask form. Data byte matches if (data & mask) == value
+/// </summary>
+struct Signature
+{
+    std::vector<uint8_t> value;     // Known bits
+    std::vector<uint8_t> mask;      // 0xFF - exact byte, 0 - wildcard, 0xF0/0x0F - known high/low nibble
+
+    Signature() { }
+
+    /// <summary>
+    /// Parse IDA-style signature, e.g. "48 8B ?? ?? E8 ?? ?? ?? ?? 8? 05".
+    /// '?' or '??' is a wildcard byte, '8?' and '?5' match half a byte.
+    /// </summary>
+    /// <param name="text">Signature text</param>
+    /// <returns>false if signature is empty or malformed</returns>
+    bool Parse( const std::string& text );
+
+    inline size_t size() const { return value.size(); }
+    inline bool empty() const { return value.empty(); }
+};
+
+namespace pe { class PEParser; }
+
+/// <summary>
+/// Selects image sections for module-scoped search
+/// </summary>
+struct SectionFilter
+{
+    uint32_t flags = 0;         // IMAGE_SCN_* flags section must have
+    uint32_t exclude = 0;       // IMAGE_SCN_* flags section must not have
+    std::string name;           // Section name, empty - any name
+
+    SectionFilter() { }
+
+    /// <summary>
+    /// Executable sections
+    /// </summary>
+    /// <returns>Section filter</returns>
+    static SectionFilter Code();
+
+    /// <summary>
+    /// Readable non-executable sections with initialized data
+    /// </summary>
+    /// <returns>Section filter</returns>
+    static SectionFilter Data();
+
+    /// <summary>
+    /// Section with given name, e.g. ".rdata"
+    /// </summary>
+    /// <param name="name">Section name</param>
+    /// <returns>Section filter</returns>
+    static SectionFilter Named( const std::string& name );
+
+    /// <summary>
+    /// Check if section passes filter
+    /// </summary>
+    /// <param name="section">Section header</param>
+    /// <returns>true if section should be searched</returns>
+    bool Match( const IMAGE_SECTION_HEADER& section ) const;
+};
+
 class PatternSearch
 {
+private:
+    // Prepared search state
+    struct State;
+
+public:
+    // Default SearchRemote read window
+    static const size_t DefaultWindow = 4 * 1024 * 1024;
+
+    // Match callback. Return false to stop search
+    typedef std::function<bool( ptr_t )> fnMatch;
+
+    // Target memory read, same contract as ProcessMemory::Read
+    typedef std::function<NTSTATUS( ptr_t address, size_t size, void* buffer )> fnRead;
+
+    /// <summary>
+    /// Lazy sequence of matches. Next match is searched when iterator is advanced
+    /// </summary>
+    class MatchRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef ptr_t value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const ptr_t* pointer;
+            typedef ptr_t reference;
+
+        public:
+            iterator( const MatchRange* range, const uint8_t* pos )
+                : _range( range ), _pos( pos ) { }
+
+            ptr_t operator *() const;
+            iterator& operator ++();
+
+            inline iterator operator ++(int)
+            {
+                iterator tmp( *this );
+                ++*this;
+                return tmp;
+            }
+
+            inline bool operator ==(const iterator& other) const { return _pos == other._pos; }
+            inline bool operator !=(const iterator& other) const { return _pos != other._pos; }
+
+        private:
+            const MatchRange* _range;   // Owning range
+            const uint8_t* _pos;        // Current match, range end if none
+        };
+
+    public:
+        MatchRange( std::shared_ptr<const State> state, void* scanStart, size_t scanSize, ptr_t value_offset );
+
+        iterator begin() const;
+        iterator end() const;
+
+    private:
+        std::shared_ptr<const State> _state;    // Search state
+        const uint8_t* _start;                  // Scan start
+        const uint8_t* _end;                    // Scan end
+        ptr_t _offset;                          // Value that will be added to resulting addresses
+    };
+
 public:
     PatternSearch(const std::vector<uint8_t>& pattern);
     PatternSearch(const std::string& pattern);
     PatternSearch(const char* pattern, size_t len = 0);
     PatternSearch(const uint8_t* pattern, size_t len = 0);
+    PatternSearch(const Signature& signature);
 
     ~PatternSearch();
 
     /// <summary>
     /// Default pattern matching with wildcards.
-    /// std::search is approximately 2x faster than naive approach.
+    /// Candidates are filtered a vector at a time by two rarest non-wildcard bytes,
+    /// falls back to std::search if no SIMD is available.
     /// </summary>
     /// <param name="wildcard">Pattern wildcard</param>
     /// <param name="scanStart">Starting address</param>
@@ -33,7 +173,7 @@ public:
 
     /// <summary>
     /// Full pattern match, no wildcards.
-    /// Uses BoyerMooreHorspool algorithm.
+    /// Uses BoyerMooreHorspool algorithm, signature patterns use masked search.
     /// </summary>
     /// <param name="scanStart">Starting address</param>
     /// <param name="scanSize">Size of region to scan</param>
@@ -43,38 +183,478 @@ public:
     size_t Search( void* scanStart, size_t scanSize, std::vector<ptr_t>& out, ptr_t value_offset = 0 );
 
     /// <summary>
-    /// Search pattern in remote process
+    /// Pattern matching with wildcards, each match is passed to callback
+    /// </summary>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="callback">Match callback. Return false to stop search</param>
+    /// <param name="value_offset">Value that will be added to resulting addresses</param>
+    /// <returns>Number of reported matches</returns>
+    size_t Search( uint8_t wildcard, void* scanStart, size_t scanSize, const fnMatch& callback, ptr_t value_offset = 0 );
+
+    /// <summary>
+    /// Full pattern match, each match is passed to callback
+    /// </summary>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="callback">Match callback. Return false to stop search</param>
+    /// <param name="value_offset">Value that will be added to resulting addresses</param>
+    /// <returns>Number of reported matches</returns>
+    size_t Search( void* scanStart, size_t scanSize, const fnMatch& callback, ptr_t value_offset = 0 );
+
+    /// <summary>
+    /// Find first match, pattern with wildcards
+    /// </summary>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="value_offset">Value that will be added to resulting address</param>
+    /// <returns>Found address, 0 if not found</returns>
+    ptr_t FindFirst( uint8_t wildcard, void* scanStart, size_t scanSize, ptr_t value_offset = 0 );
+
+    /// <summary>
+    /// Find first match, full pattern
+    /// </summary>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="value_offset">Value that will be added to resulting address</param>
+    /// <returns>Found address, 0 if not found</returns>
+    ptr_t FindFirst( void* scanStart, size_t scanSize, ptr_t value_offset = 0 );
+
+    /// <summary>
+    /// Find n-th match, pattern with wildcards
+    /// </summary>
+    /// <param name="n">Zero-based match index</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="value_offset">Value that will be added to resulting address</param>
+    /// <returns>Found address, 0 if not found</returns>
+    ptr_t FindNth( size_t n, uint8_t wildcard, void* scanStart, size_t scanSize, ptr_t value_offset = 0 );
+
+    /// <summary>
+    /// Find n-th match, full pattern
+    /// </summary>
+    /// <param name="n">Zero-based match index</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="value_offset">Value that will be added to resulting address</param>
+    /// <returns>Found address, 0 if not found</returns>
+    ptr_t FindNth( size_t n, void* scanStart, size_t scanSize, ptr_t value_offset = 0 );
+
+    /// <summary>
+    /// Lazy pattern matching with wildcards. Matches are searched during iteration
+    /// </summary>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="value_offset">Value that will be added to resulting addresses</param>
+    /// <returns>Match range</returns>
+    MatchRange Matches( uint8_t wildcard, void* scanStart, size_t scanSize, ptr_t value_offset = 0 );
+
+    /// <summary>
+    /// Lazy full pattern matching. Matches are searched during iteration
+    /// </summary>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="value_offset">Value that will be added to resulting addresses</param>
+    /// <returns>Match range</returns>
+    MatchRange Matches( void* scanStart, size_t scanSize, ptr_t value_offset = 0 );
+
+#ifndef BLACKBONE_PORTABLE
+
+    /// <summary>
+    /// Search pattern in remote process.
+    /// Memory is read by fixed size windows, next window is read while current one is searched.
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="out">Found results</param>
+    /// <param name="window">Read window size. 0 - read whole region at once</param>
+    /// <returns>Number of found addresses</returns>
+    size_t SearchRemote( class Process& remote, uint8_t wildcard, ptr_t scanStart, size_t scanSize, 
+                         std::vector<ptr_t>& out, size_t window = DefaultWindow );
+
+    /// <summary>
+    /// Search pattern in remote process, each match is passed to callback.
+    /// Matching stops once callback returns false, read of the next window may be already in flight by then.
     /// </summary>
     /// <param name="remote">Remote process</param>
     /// <param name="wildcard">Pattern wildcard</param>
     /// <param name="scanStart">Starting address</param>
     /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="callback">Match callback. Return false to stop search</param>
+    /// <param name="window">Read window size. 0 - read whole region at once</param>
+    /// <returns>Number of reported matches</returns>
+    size_t SearchRemote( class Process& remote, uint8_t wildcard, ptr_t scanStart, size_t scanSize, 
+                         const fnMatch& callback, size_t window = DefaultWindow );
+
+    /// <summary>
+    /// Search pattern in remote process.
+    /// Memory is read by fixed size windows, next window is read while current one is searched.
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="out">Found results</param>
+    /// <param name="window">Read window size. 0 - read whole region at once</param>
+    /// <returns>Number of found addresses</returns>
+    size_t SearchRemote( class Process& remote, ptr_t scanStart, size_t scanSize, 
+                         std::vector<ptr_t>& out, size_t window = DefaultWindow );
+
+    /// <summary>
+    /// Search pattern in remote process, each match is passed to callback.
+    /// Matching stops once callback returns false, read of the next window may be already in flight by then.
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="callback">Match callback. Return false to stop search</param>
+    /// <param name="window">Read window size. 0 - read whole region at once</param>
+    /// <returns>Number of reported matches</returns>
+    size_t SearchRemote( class Process& remote, ptr_t scanStart, size_t scanSize, 
+                         const fnMatch& callback, size_t window = DefaultWindow );
+
+    /// <summary>
+    /// Search pattern in sections of remote module.
+    /// Section headers are read from target once per call.
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="module">Target module</param>
+    /// <param name="filter">Sections to search</param>
+    /// <param name="out">Found results</param>
+    /// <returns>Number of found addresses</returns>
+    size_t SearchModule( class Process& remote, uint8_t wildcard, const ModuleData& module, 
+                         const SectionFilter& filter, std::vector<ptr_t>& out );
+
+    /// <summary>
+    /// Search pattern in sections of remote module, each match is passed to callback
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="module">Target module</param>
+    /// <param name="filter">Sections to search</param>
+    /// <param name="callback">Match callback. Return false to stop search</param>
+    /// <returns>Number of reported matches</returns>
+    size_t SearchModule( class Process& remote, uint8_t wildcard, const ModuleData& module, 
+                         const SectionFilter& filter, const fnMatch& callback );
+
+    /// <summary>
+    /// Search pattern in sections of remote module.
+    /// Section headers are read from target once per call.
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="module">Target module</param>
+    /// <param name="filter">Sections to search</param>
+    /// <param name="out">Found results</param>
+    /// <returns>Number of found addresses</returns>
+    size_t SearchModule( class Process& remote, const ModuleData& module, 
+                         const SectionFilter& filter, std::vector<ptr_t>& out );
+
+    /// <summary>
+    /// Search pattern in sections of remote module, each match is passed to callback
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="module">Target module</param>
+    /// <param name="filter">Sections to search</param>
+    /// <param name="callback">Match callback. Return false to stop search</param>
+    /// <returns>Number of reported matches</returns>
+    size_t SearchModule( class Process& remote, const ModuleData& module, 
+                         const SectionFilter& filter, const fnMatch& callback );
+
+#endif
+
+    /// <summary>
+    /// Search pattern in sections of local image.
+    /// Plain data files are searched by raw section data.
+    /// </summary>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="image">Parsed image</param>
+    /// <param name="dataSize">Size of image data, e.g. file projection size. Sections are clipped to it</param>
+    /// <param name="filter">Sections to search</param>
     /// <param name="out">Found results</param>
+    /// <param name="value_offset">Image base for resulting addresses. 0 - report local addresses</param>
     /// <returns>Number of found addresses</returns>
-    size_t SearchRemote( class Process& remote, uint8_t wildcard, ptr_t scanStart, size_t scanSize, std::vector<ptr_t>& out );
+    size_t SearchImage( uint8_t wildcard, const pe::PEParser& image, size_t dataSize, const SectionFilter& filter, 
+                        std::vector<ptr_t>& out, ptr_t value_offset = 0 );
 
     /// <summary>
-    /// Search pattern in remote process
+    /// Search pattern in sections of local image.
+    /// Plain data files are searched by raw section data.
+    /// </summary>
+    /// <param name="image">Parsed image</param>
+    /// <param name="dataSize">Size of image data, e.g. file projection size. Sections are clipped to it</param>
+    /// <param name="filter">Sections to search</param>
+    /// <param name="out">Found results</param>
+    /// <param name="value_offset">Image base for resulting addresses. 0 - report local addresses</param>
+    /// <returns>Number of found addresses</returns>
+    size_t SearchImage( const pe::PEParser& image, size_t dataSize, const SectionFilter& filter, 
+                        std::vector<ptr_t>& out, ptr_t value_offset = 0 );
+
+#ifndef BLACKBONE_PORTABLE
+
+    /// <summary>
+    /// Read section headers of remote module
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="module">Target module</param>
+    /// <param name="sections">Section headers</param>
+    /// <returns>Status code</returns>
+    static NTSTATUS ModuleSections( class Process& remote, const ModuleData& module, std::vector<IMAGE_SECTION_HEADER>& sections );
+
+    /// <summary>
+    /// Search pattern in whole address space of remote process.
+    /// Address space layout is swept again on every call
     /// </summary>
     /// <param name="remote">Remote process</param>
+    /// <param name="useWildcard">True if pattern contains wildcards</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="out">Found results</param>
+    /// <param name="threads">Number of worker threads. 0 - one per CPU core, 1 - scan sequentially</param>
+    /// <returns>Number of found addresses</returns>
+    size_t SearchRemoteWhole( class Process& remote, bool useWildcard, uint8_t wildcard, std::vector<ptr_t>& out, size_t threads = 1 );
+
+#endif
+
+    /// <summary>
+    /// Search pattern in committed regions of address space.
+    /// Backend of SearchRemoteWhole, so any memory source can be searched the same way
+    /// </summary>
+    /// <param name="map">Address space layout</param>
+    /// <param name="from">Range start</param>
+    /// <param name="to">Range end</param>
+    /// <param name="read">Memory read routine. Regions that can't be read entirely are skipped</param>
+    /// <param name="useWildcard">True if pattern contains wildcards</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="out">Found results</param>
+    /// <param name="threads">Number of worker threads. 0 - one per CPU core, 1 - scan sequentially</param>
+    /// <returns>Number of found addresses</returns>
+    size_t SearchRegions( RegionMap& map, ptr_t from, ptr_t to, const fnRead& read, bool useWildcard, uint8_t wildcard, 
+                          std::vector<ptr_t>& out, size_t threads = 1 );
+
+    /// <summary>
+    /// Get best instruction set supported by current CPU
+    /// </summary>
+    /// <returns>SIMD level</returns>
+    static eSimdLevel SupportedSimd();
+
+    /// <summary>
+    /// Set instruction set used by wildcard search. Clamped to CPU capabilities
+    /// </summary>
+    /// <param name="level">SIMD level, simd_none forces scalar search</param>
+    void simd( eSimdLevel level );
+
+    /// <summary>
+    /// Get instruction set used by wildcard search
+    /// </summary>
+    /// <returns>SIMD level</returns>
+    inline eSimdLevel simd() const { return _simd; }
+
+private:
+    /// <summary>
+    /// Prepare search state
+    /// </summary>
+    /// <param name="useWildcard">True if pattern contains wildcards</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="overlapped">Report overlapping matches</param>
+    /// <returns>Search state</returns>
+    std::shared_ptr<const State> Prepare( bool useWildcard, uint8_t wildcard, bool overlapped ) const;
+
+    /// <summary>
+    /// Find first match in range
+    /// </summary>
+    /// <param name="state">Search state</param>
+    /// <param name="cstart">Scan start</param>
+    /// <param name="cend">Scan end</param>
+    /// <returns>Found address, cend if nothing found</returns>
+    static const uint8_t* FindNext( const State& state, const uint8_t* cstart, const uint8_t* cend );
+
+    /// <summary>
+    /// Report all matches in buffer
+    /// </summary>
+    /// <param name="state">Search state</param>
     /// <param name="scanStart">Starting address</param>
     /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="value_offset">Value that will be added to resulting addresses</param>
+    /// <param name="callback">Match callback. Return false to stop</param>
+    /// <returns>Number of reported matches</returns>
+    static size_t Enumerate( const State& state, void* scanStart, size_t scanSize, ptr_t value_offset, const fnMatch& callback );
+
+    /// <summary>
+    /// Search pattern in committed regions using worker pool.
+    /// Regions are split into chunks overlapping by pattern length.
+    /// </summary>
+    /// <param name="regions">Regions to search</param>
+    /// <param name="read">Memory read routine</param>
+    /// <param name="useWildcard">True if pattern contains wildcards</param>
+    /// <param name="wildcard">Pattern wildcard</param>
     /// <param name="out">Found results</param>
+    /// <param name="threads">Number of worker threads</param>
     /// <returns>Number of found addresses</returns>
-    size_t SearchRemote( class Process& remote, ptr_t scanStart, size_t scanSize, std::vector<ptr_t>& out );
+    size_t SearchRegionsParallel( const RegionMap::vecRegions& regions, const fnRead& read, bool useWildcard, uint8_t wildcard, 
+                                  std::vector<ptr_t>& out, size_t threads );
+
+#ifndef BLACKBONE_PORTABLE
+
+    /// <summary>
+    /// Search pattern in remote memory using double-buffered read window.
+    /// Windows overlap by pattern length, so no match is lost on window border.
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="useWildcard">True if pattern contains wildcards</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="callback">Match callback. Return false to stop search</param>
+    /// <param name="window">Read window size</param>
+    /// <returns>Number of reported matches</returns>
+    size_t SearchRemoteStream( class Process& remote, bool useWildcard, uint8_t wildcard, ptr_t scanStart, 
+                               size_t scanSize, const fnMatch& callback, size_t window );
 
     /// <summary>
-    /// Search pattern in whole address space of remote process
+    /// Search pattern in filtered sections of remote module
     /// </summary>
     /// <param name="remote">Remote process</param>
     /// <param name="useWildcard">True if pattern contains wildcards</param>
     /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="module">Target module</param>
+    /// <param name="filter">Sections to search</param>
+    /// <param name="callback">Match callback. Return false to stop search</param>
+    /// <returns>Number of reported matches</returns>
+    size_t SearchModuleSections( class Process& remote, bool useWildcard, uint8_t wildcard, const ModuleData& module, 
+                                 const SectionFilter& filter, const fnMatch& callback );
+
+#endif
+
+    /// <summary>
+    /// Search pattern in filtered sections of local image
+    /// </summary>
+    /// <param name="useWildcard">True if pattern contains wildcards</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <param name="image">Parsed image</param>
+    /// <param name="dataSize">Size of image data, e.g. file projection size. Sections are clipped to it</param>
+    /// <param name="filter">Sections to search</param>
     /// <param name="out">Found results</param>
+    /// <param name="value_offset">Image base for resulting addresses</param>
     /// <returns>Number of found addresses</returns>
-    size_t SearchRemoteWhole( class Process& remote, bool useWildcard, uint8_t wildcard, std::vector<ptr_t>& out );
+    size_t SearchImageSections( bool useWildcard, uint8_t wildcard, const pe::PEParser& image, size_t dataSize, 
+                                const SectionFilter& filter, std::vector<ptr_t>& out, ptr_t value_offset );
 
 private:
     std::vector<uint8_t> _pattern;      // Pattern to search
+    std::vector<uint8_t> _mask;         // Pattern mask, empty if all bytes are significant
+    eSimdLevel _simd = SupportedSimd(); // Wildcard search instruction set
+};
+
+/// <summary>
+/// Set of patterns searched in a single pass over the buffer.
+/// Each pattern is indexed by its rarest byte pair, so scan cost depends on buffer size only.
+/// Empty pattern keeps its index but never matches.
+/// </summary>
+class PatternSet
+{
+public:
+    // Found pattern
+    struct Match
+    {
+        size_t index;       // Pattern index, as returned by Add
+        ptr_t address;      // Match address
+    };
+
+public:
+    PatternSet();
+    ~PatternSet();
+
+    /// <summary>
+    /// Add pattern without wildcards
+    /// </summary>
+    /// <param name="pattern">Pattern bytes</param>
+    /// <returns>Pattern index</returns>
+    size_t Add( const std::vector<uint8_t>& pattern );
+
+    /// <summary>
+    /// Add pattern without wildcards
+    /// </summary>
+    /// <param name="pattern">Pattern bytes</param>
+    /// <param name="len">Pattern length. If 0 - pattern is treated as null-terminated string</param>
+    /// <returns>Pattern index</returns>
+    size_t Add( const char* pattern, size_t len = 0 );
+
+    /// <summary>
+    /// Add pattern with wildcards
+    /// </summary>
+    /// <param name="pattern">Pattern bytes</param>
+    /// <param name="wildcard">Pattern wildcard</param>
+    /// <returns>Pattern index</returns>
+    size_t Add( const std::vector<uint8_t>& pattern, uint8_t wildcard );
+
+    /// <summary>
+    /// Add signature pattern
+    /// </summary>
+    /// <param name="signature">Pattern value and mask</param>
+    /// <returns>Pattern index</returns>
+    size_t Add( const Signature& signature );
+
+    /// <summary>
+    /// Search all patterns at once. Overlapping matches are reported.
+    /// </summary>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="out">Found results, sorted by address</param>
+    /// <param name="value_offset">Value that will be added to resulting addresses</param>
+    /// <returns>Number of found addresses</returns>
+    size_t Search( void* scanStart, size_t scanSize, std::vector<Match>& out, ptr_t value_offset = 0 );
+
+#ifndef BLACKBONE_PORTABLE
+
+    /// <summary>
+    /// Search all patterns in remote process
+    /// </summary>
+    /// <param name="remote">Remote process</param>
+    /// <param name="scanStart">Starting address</param>
+    /// <param name="scanSize">Size of region to scan</param>
+    /// <param name="out">Found results, sorted by address</param>
+    /// <returns>Number of found addresses</returns>
+    size_t SearchRemote( class Process& remote, ptr_t scanStart, size_t scanSize, std::vector<Match>& out );
+
+#endif
+
+    /// <summary>
+    /// Get first match of particular pattern
+    /// </summary>
+    /// <param name="matches">Search results</param>
+    /// <param name="index">Pattern index</param>
+    /// <returns>Match address, 0 if pattern wasn't found</returns>
+    static ptr_t First( const std::vector<Match>& matches, size_t index );
+
+    /// <summary>
+    /// Number of patterns in set
+    /// </summary>
+    /// <returns>Pattern count</returns>
+    inline size_t size() const { return _value.size(); }
+
+private:
+    /// <summary>
+    /// Build anchor lookup tables
+    /// </summary>
+    void Compile();
+
+private:
+    std::vector<std::vector<uint8_t>> _value;   // Pattern bytes, wildcards zeroed
+    std::vector<std::vector<uint8_t>> _mask;    // Pattern masks
+
+    std::vector<size_t>   _anchor;      // Anchor offset inside each pattern
+    std::vector<uint32_t> _pairStart;   // Byte pair -> first entry in _pairItems
+    std::vector<uint32_t> _pairItems;   // Patterns anchored on byte pair
+    std::vector<uint8_t>  _pairFilter;  // Bitmap of used byte pairs
+    std::vector<uint32_t> _byteStart;   // Byte -> first entry in _byteItems
+    std::vector<uint32_t> _byteItems;   // Patterns anchored on single byte
+    std::vector<uint32_t> _anyItems;    // Patterns without anchor (wildcards only)
+    bool _compiled = false;             // Lookup tables are up to date
 };
 
 }
\ No newline at end of file
@@ -0,0 +1,421 @@
+#include "PointerMap.h"
+#include "Process.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace blackbone
+{
+
+namespace
+{
+
+// Remote memory is read by windows of this size
+const size_t ScanWindow = 4 * 1024 * 1024;
+
+// File format
+const uint32_t MapMagic   = 0x4D504242;   // 'BBPM'
+const uint32_t MapVersion = 1;
+
+// Committed memory range
+struct MemRange
+{
+    ptr_t begin;
+    ptr_t end;
+};
+
+/// <summary>
+/// Collect aligned values pointing into committed memory
+/// </summary>
+/// <param name="data">Data to scan</param>
+/// <param name="size">Data size</param>
+/// <param name="address">Data address in target process</param>
+/// <param name="ranges">Committed memory, sorted</param>
+/// <param name="out">Found pointers</param>
+template<typename T>
+void CollectPointers( const uint8_t* data, size_t size, ptr_t address,
+                      const std::vector<MemRange>& ranges, std::vector<PointerMap::Entry>& out )
+{
+    const ptr_t lowest  = ranges.front().begin;
+    const ptr_t highest = ranges.back().end;
+
+    // Pointers tend to point into the same region as previous one
+    const MemRange* last = &ranges.front();
+
+    for (size_t i = 0; i + sizeof( T ) <= size; i += sizeof( T ))
+    {
+        ptr_t val = *reinterpret_cast<const T*>(data + i);
+        if (val < lowest || val >= highest)
+            continue;
+
+        if (val < last->begin || val >= last->end)
+        {
+            auto iter = std::upper_bound( ranges.begin(), ranges.end(), val,
+                                          []( ptr_t v, const MemRange& r ) { return v < r.begin; } );
+
+            if (iter == ranges.begin() || val >= (--iter)->end)
+                continue;
+
+            last = &*iter;
+        }
+
+        PointerMap::Entry entry = { val, address + i };
+        out.emplace_back( entry );
+    }
+}
+
+template<typename T>
+inline void Put( std::ofstream& file, const T& val )
+{
+    file.write( reinterpret_cast<const char*>(&val), sizeof( val ) );
+}
+
+template<typename T>
+inline bool Get( std::ifstream& file, T& val )
+{
+    return file.read( reinterpret_cast<char*>(&val), sizeof( val ) ).good();
+}
+
+}
+
+PointerMap::PointerMap()
+{
+}
+
+PointerMap::~PointerMap()
+{
+}
+
+/// <summary>
+/// Scan committed memory of the process and build pointer index.
+/// Address space layout is swept again
+/// </summary>
+/// <param name="process">Target process</param>
+/// <returns>Status code</returns>
+NTSTATUS PointerMap::Build( Process& process )
+{
+    RegionMap::vecRegions regions;
+    std::vector<MemRange> ranges;
+
+    Reset();
+
+    _ptrSize = process.core().isWow64() ? sizeof( uint32_t ) : sizeof( uint64_t );
+
+    for (auto& mod : process.modules().GetAllModules())
+    {
+        ModuleRange range = { mod.second.baseAddress, mod.second.size, mod.second.name };
+        _modules.emplace_back( range );
+    }
+
+    std::sort( _modules.begin(), _modules.end(), []( const ModuleRange& l, const ModuleRange& r ) { return l.base < r.base; } );
+
+    //
+    // Gather committed memory, adjacent regions are merged
+    //
+    auto native = process.core().native();
+    native->regions().Reset();
+    native->regions().Enum( native->minAddr(), native->maxAddr(), regions );
+
+    for (auto& mbi : regions)
+    {
+        if (mbi.State != MEM_COMMIT || mbi.Protect == PAGE_NOACCESS || (mbi.Protect & PAGE_GUARD))
+            continue;
+
+        if (!ranges.empty() && ranges.back().end == mbi.BaseAddress)
+        {
+            ranges.back().end += mbi.RegionSize;
+        }
+        else
+        {
+            MemRange range = { mbi.BaseAddress, mbi.BaseAddress + mbi.RegionSize };
+            ranges.emplace_back( range );
+        }
+    }
+
+    if (ranges.empty())
+        return STATUS_NOT_FOUND;
+
+    //
+    // Collect pointers
+    //
+    std::vector<uint8_t> buf( ScanWindow );
+
+    for (auto& range : ranges)
+    {
+        for (ptr_t address = range.begin; address < range.end; address += ScanWindow)
+        {
+            size_t size = static_cast<size_t>(std::min<ptr_t>( ScanWindow, range.end - address ));
+
+            if (process.memory().Read( address, size, buf.data() ) != STATUS_SUCCESS)
+                continue;
+
+            if (_ptrSize == sizeof( uint32_t ))
+                CollectPointers<uint32_t>( buf.data(), size, address, ranges, _entries );
+            else
+                CollectPointers<uint64_t>( buf.data(), size, address, ranges, _entries );
+        }
+    }
+
+    std::sort( _entries.begin(), _entries.end(), []( const Entry& l, const Entry& r )
+    {
+        return l.value < r.value || (l.value == r.value && l.address < r.address);
+    } );
+
+    _entries.shrink_to_fit();
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Find static pointer paths leading to the target address
+/// </summary>
+/// <param name="target">Target address</param>
+/// <param name="maxDepth">Max number of dereferences</param>
+/// <param name="maxOffset">Max offset added to pointer on each level</param>
+/// <param name="out">Found paths</param>
+/// <param name="maxResults">Stop after this number of paths. 0 - find all</param>
+/// <returns>Number of found paths</returns>
+size_t PointerMap::FindPaths( ptr_t target, size_t maxDepth, size_t maxOffset,
+                              std::vector<PointerPath>& out, size_t maxResults /*= 0*/ ) const
+{
+    std::vector<ptr_t> offsets;
+
+    Walk( target, maxDepth, maxOffset, offsets, out, maxResults ? out.size() + maxResults : SIZE_MAX );
+    return out.size();
+}
+
+/// <summary>
+/// Get all pointers to the [address - maxOffset, address] range
+/// </summary>
+/// <param name="address">Highest pointed address</param>
+/// <param name="maxOffset">Range size</param>
+/// <param name="out">Found pointers</param>
+/// <returns>Number of found pointers</returns>
+size_t PointerMap::FindPointersTo( ptr_t address, size_t maxOffset, std::vector<Entry>& out ) const
+{
+    ptr_t low = (address > maxOffset) ? address - maxOffset : 0;
+
+    auto first = std::lower_bound( _entries.begin(), _entries.end(), low,
+                                   []( const Entry& e, ptr_t v ) { return e.value < v; } );
+
+    for (; first != _entries.end() && first->value <= address; ++first)
+        out.emplace_back( *first );
+
+    return out.size();
+}
+
+/// <summary>
+/// Get final address of pointer path in live process
+/// </summary>
+/// <param name="process">Target process</param>
+/// <param name="path">Pointer path</param>
+/// <param name="result">Resolved address</param>
+/// <returns>Status code</returns>
+NTSTATUS PointerMap::Resolve( Process& process, const PointerPath& path, ptr_t& result )
+{
+    auto mod = process.modules().GetModule( path.module );
+    if (mod == nullptr)
+        return STATUS_NOT_FOUND;
+
+    const size_t ptrSize = process.core().isWow64() ? sizeof( uint32_t ) : sizeof( uint64_t );
+    ptr_t address = mod->baseAddress + path.moduleOffset;
+
+    for (auto offset : path.offsets)
+    {
+        ptr_t val = 0;
+
+        NTSTATUS status = process.memory().Read( address, ptrSize, &val );
+        if (status != STATUS_SUCCESS)
+            return status;
+
+        address = val + offset;
+    }
+
+    result = address;
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Save pointer map to file
+/// </summary>
+/// <param name="path">File path</param>
+/// <returns>Status code</returns>
+NTSTATUS PointerMap::Save( const std::wstring& path ) const
+{
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    if (!file)
+        return STATUS_OBJECT_NAME_INVALID;
+
+    Put( file, MapMagic );
+    Put( file, MapVersion );
+    Put( file, _ptrSize );
+    Put( file, static_cast<uint32_t>(_modules.size()) );
+
+    for (auto& mod : _modules)
+    {
+        Put( file, mod.base );
+        Put( file, mod.size );
+        Put( file, static_cast<uint32_t>(mod.name.length()) );
+
+        // Names are stored as UTF-16
+        for (auto ch : mod.name)
+            Put( file, static_cast<uint16_t>(ch) );
+    }
+
+    Put( file, static_cast<uint64_t>(_entries.size()) );
+    if (!_entries.empty())
+        file.write( reinterpret_cast<const char*>(_entries.data()), _entries.size() * sizeof( Entry ) );
+
+    return file.good() ? STATUS_SUCCESS : STATUS_DISK_FULL;
+}
+
+/// <summary>
+/// Load pointer map saved by Save
+/// </summary>
+/// <param name="path">File path</param>
+/// <returns>Status code</returns>
+NTSTATUS PointerMap::Load( const std::wstring& path )
+{
+    uint32_t magic = 0, version = 0, modCount = 0;
+    uint64_t entryCount = 0;
+
+    Reset();
+
+    std::ifstream file( path, std::ios::binary );
+    if (!file)
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+
+    if (!Get( file, magic ) || !Get( file, version ) || magic != MapMagic || version != MapVersion)
+        return STATUS_FILE_CORRUPT_ERROR;
+
+    if (!Get( file, _ptrSize ) || !Get( file, modCount ) || (_ptrSize != sizeof( uint32_t ) && _ptrSize != sizeof( uint64_t )))
+    {
+        Reset();
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    for (uint32_t i = 0; i < modCount; i++)
+    {
+        ModuleRange mod;
+        uint32_t len = 0;
+
+        if (!Get( file, mod.base ) || !Get( file, mod.size ) || !Get( file, len ))
+        {
+            Reset();
+            return STATUS_FILE_CORRUPT_ERROR;
+        }
+
+        for (uint32_t j = 0; j < len; j++)
+        {
+            uint16_t ch = 0;
+            if (!Get( file, ch ))
+            {
+                Reset();
+                return STATUS_FILE_CORRUPT_ERROR;
+            }
+
+            mod.name.push_back( static_cast<wchar_t>(ch) );
+        }
+
+        _modules.emplace_back( mod );
+    }
+
+    if (!Get( file, entryCount ))
+    {
+        Reset();
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    // Entries must fit into the rest of the file, otherwise count is garbage
+    auto pos = file.tellg();
+    file.seekg( 0, std::ios::end );
+    uint64_t remaining = static_cast<uint64_t>(file.tellg() - pos);
+    file.seekg( pos );
+
+    if (entryCount > remaining / sizeof( Entry ))
+    {
+        Reset();
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    _entries.resize( static_cast<size_t>(entryCount) );
+    if (!_entries.empty() && !file.read( reinterpret_cast<char*>(_entries.data()), _entries.size() * sizeof( Entry ) ))
+    {
+        Reset();
+        return STATUS_FILE_CORRUPT_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Discard pointer map
+/// </summary>
+void PointerMap::Reset()
+{
+    _entries.clear();
+    _modules.clear();
+    _ptrSize = sizeof( ptr_t );
+}
+
+/// <summary>
+/// Get module containing address
+/// </summary>
+/// <param name="address">Address</param>
+/// <returns>Module range, nullptr if address doesn't belong to any module</returns>
+const PointerMap::ModuleRange* PointerMap::FindModule( ptr_t address ) const
+{
+    auto iter = std::upper_bound( _modules.begin(), _modules.end(), address,
+                                  []( ptr_t v, const ModuleRange& m ) { return v < m.base; } );
+
+    if (iter == _modules.begin())
+        return nullptr;
+
+    --iter;
+    return (address < iter->base + iter->size) ? &*iter : nullptr;
+}
+
+/// <summary>
+/// Walk pointer chains backward from address
+/// </summary>
+/// <param name="address">Current address</param>
+/// <param name="depth">Remaining number of dereferences</param>
+/// <param name="maxOffset">Max offset added to pointer on each level</param>
+/// <param name="offsets">Offsets collected so far, last level first</param>
+/// <param name="out">Found paths</param>
+/// <param name="maxResults">Max number of paths</param>
+void PointerMap::Walk( ptr_t address, size_t depth, size_t maxOffset, std::vector<ptr_t>& offsets,
+                       std::vector<PointerPath>& out, size_t maxResults ) const
+{
+    if (depth == 0)
+        return;
+
+    ptr_t low = (address > maxOffset) ? address - maxOffset : 0;
+
+    auto iter = std::lower_bound( _entries.begin(), _entries.end(), low,
+                                  []( const Entry& e, ptr_t v ) { return e.value < v; } );
+
+    for (; iter != _entries.end() && iter->value <= address && out.size() < maxResults; ++iter)
+    {
+        offsets.emplace_back( address - iter->value );
+
+        // Pointer is stored inside module image - path is static
+        if (auto mod = FindModule( iter->address ))
+        {
+            PointerPath path;
+            path.module = mod->name;
+            path.moduleOffset = iter->address - mod->base;
+            path.offsets.assign( offsets.rbegin(), offsets.rend() );
+
+            out.emplace_back( path );
+        }
+        else
+        {
+            Walk( iter->address, depth - 1, maxOffset, offsets, out, maxResults );
+        }
+
+        offsets.pop_back();
+    }
+}
+
+}
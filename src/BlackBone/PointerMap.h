@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+
+#include <string>
+#include <vector>
+
+namespace blackbone
+{
+
+// Static pointer path: [[[module + moduleOffset] + offsets[0]] + ...] + offsets[n-1]
+struct PointerPath
+{
+    std::wstring module;            // Module name
+    ptr_t moduleOffset;             // Offset of the first pointer inside module
+    std::vector<ptr_t> offsets;     // Offsets applied after each dereference
+};
+
+/// <summary>
+/// Reverse pointer index of a process.
+/// Holds every aligned value that points into committed memory, sorted by pointed address.
+/// </summary>
+class PointerMap
+{
+public:
+    // Pointer found in memory
+    struct Entry
+    {
+        ptr_t value;        // Address pointed to
+        ptr_t address;      // Where pointer is stored
+    };
+
+    // Module address range
+    struct ModuleRange
+    {
+        ptr_t base;
+        ptr_t size;
+        std::wstring name;
+    };
+
+public:
+    PointerMap();
+    ~PointerMap();
+
+    /// <summary>
+    /// Scan committed memory of the process and build pointer index.
+    /// Address space layout is swept again
+    /// </summary>
+    /// <param name="process">Target process</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Build( class Process& process );
+
+    /// <summary>
+    /// Find static pointer paths leading to the target address
+    /// </summary>
+    /// <param name="target">Target address</param>
+    /// <param name="maxDepth">Max number of dereferences</param>
+    /// <param name="maxOffset">Max offset added to pointer on each level</param>
+    /// <param name="out">Found paths</param>
+    /// <param name="maxResults">Stop after this number of paths. 0 - find all</param>
+    /// <returns>Number of found paths</returns>
+    size_t FindPaths( ptr_t target, size_t maxDepth, size_t maxOffset,
+                      std::vector<PointerPath>& out, size_t maxResults = 0 ) const;
+
+    /// <summary>
+    /// Get all pointers to the [address - maxOffset, address] range
+    /// </summary>
+    /// <param name="address">Highest pointed address</param>
+    /// <param name="maxOffset">Range size</param>
+    /// <param name="out">Found pointers</param>
+    /// <returns>Number of found pointers</returns>
+    size_t FindPointersTo( ptr_t address, size_t maxOffset, std::vector<Entry>& out ) const;
+
+    /// <summary>
+    /// Get final address of pointer path in live process
+    /// </summary>
+    /// <param name="process">Target process</param>
+    /// <param name="path">Pointer path</param>
+    /// <param name="result">Resolved address</param>
+    /// <returns>Status code</returns>
+    static NTSTATUS Resolve( class Process& process, const PointerPath& path, ptr_t& result );
+
+    /// <summary>
+    /// Save pointer map to file
+    /// </summary>
+    /// <param name="path">File path</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Save( const std::wstring& path ) const;
+
+    /// <summary>
+    /// Load pointer map saved by Save
+    /// </summary>
+    /// <param name="path">File path</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Load( const std::wstring& path );
+
+    /// <summary>
+    /// Discard pointer map
+    /// </summary>
+    void Reset();
+
+    inline size_t size() const { return _entries.size(); }
+    inline uint32_t ptrSize() const { return _ptrSize; }
+    inline const std::vector<ModuleRange>& modules() const { return _modules; }
+
+private:
+    /// <summary>
+    /// Get module containing address
+    /// </summary>
+    /// <param name="address">Address</param>
+    /// <returns>Module range, nullptr if address doesn't belong to any module</returns>
+    const ModuleRange* FindModule( ptr_t address ) const;
+
+    /// <summary>
+    /// Walk pointer chains backward from address
+    /// </summary>
+    /// <param name="address">Current address</param>
+    /// <param name="depth">Remaining number of dereferences</param>
+    /// <param name="maxOffset">Max offset added to pointer on each level</param>
+    /// <param name="offsets">Offsets collected so far, last level first</param>
+    /// <param name="out">Found paths</param>
+    /// <param name="maxResults">Max number of paths</param>
+    void Walk( ptr_t address, size_t depth, size_t maxOffset, std::vector<ptr_t>& offsets,
+               std::vector<PointerPath>& out, size_t maxResults ) const;
+
+private:
+    uint32_t _ptrSize = sizeof( ptr_t );    // Pointer size in target process
+    std::vector<Entry> _entries;            // Pointers, sorted by value
+    std::vector<ModuleRange> _modules;      // Loaded modules, sorted by base
+};
+
+}
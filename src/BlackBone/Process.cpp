@@ -52,6 +52,29 @@ NTSTATUS Process::Attach( DWORD pid, DWORD access /*= DEFAULT_ACCESS_P*/ )
     return res;
 }
 
+/// <summary>
+/// Attach to custom api wrapper, e.g. MinidumpNative.
+/// No process handle is opened and no code is executed in target
+/// </summary>
+/// <param name="backend">Api wrapper</param>
+/// <returns>Status</returns>
+NTSTATUS Process::Attach( std::unique_ptr<Native> backend )
+{
+    // Reset data
+    _modules.reset();
+    _remote.reset();
+    _mmap.reset();
+    _hooks.reset();
+
+    auto res = _core.Open( std::move( backend ) );
+
+    // Backend could have been used before attach
+    if (res == STATUS_SUCCESS)
+        _core.native()->regions().Reset();
+
+    return res;
+}
+
 /// <summary>
 /// Checks if process still exists
 /// </summary>
@@ -39,6 +39,14 @@ public:
     /// <returns>Status</returns>
     NTSTATUS Attach( DWORD pid, DWORD access = DEFAULT_ACCESS_P );
 
+    /// <summary>
+    /// Attach to custom api wrapper, e.g. MinidumpNative.
+    /// No process handle is opened and no code is executed in target
+    /// </summary>
+    /// <param name="backend">Api wrapper</param>
+    /// <returns>Status</returns>
+    NTSTATUS Attach( std::unique_ptr<Native> backend );
+
     /// <summary>
     /// Get process ID
     /// </summary>
@@ -73,6 +73,24 @@ NTSTATUS ProcessCore::Open( DWORD pid, DWORD access )
     return LastNtStatus();
 }
 
+/// <summary>
+/// Use custom api wrapper instead of live process
+/// </summary>
+/// <param name="native">Api wrapper</param>
+/// <returns>Status</returns>
+NTSTATUS ProcessCore::Open( ptrNative native )
+{
+    Close();
+
+    if (!native)
+        return STATUS_INVALID_PARAMETER;
+
+    _native = std::move( native );
+    _dep = !_native->GetWow64Barrier().targetWow64;
+
+    return STATUS_SUCCESS;
+}
+
 /// <summary>
 /// Close current process handle
 /// </summary>
@@ -84,8 +102,9 @@ void ProcessCore::Close()
 
         _hProcess = NULL;
         _pid = 0;
-        _native.reset( nullptr );
     }
+
+    _native.reset( nullptr );
 }
 
 }
\ No newline at end of file
@@ -83,6 +83,13 @@ private:
     /// <returns>Status</returns>
     NTSTATUS Open( DWORD pid, DWORD access );
 
+    /// <summary>
+    /// Use custom api wrapper instead of live process
+    /// </summary>
+    /// <param name="native">Api wrapper</param>
+    /// <returns>Status</returns>
+    NTSTATUS Open( ptrNative native );
+
     /// <summary>
     /// Close current process handle
     /// </summary>
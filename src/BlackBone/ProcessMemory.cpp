@@ -1,9 +1,30 @@
 #include "ProcessMemory.h"
 #include "ProcessCore.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
 namespace blackbone
 {
 
+namespace
+{
+
+// Granularity of merged reads
+const ptr_t PageSize = 0x1000;
+
+// Adjacent requests aren't merged past this size and overlapping ones are read
+// by pieces of this size, so one unreadable page doesn't turn large span into separate reads
+const size_t MaxSpanSize = 0x10000;
+
+// Number of merged spans per worker thread.
+// Small batches are read in calling thread, thread startup costs more than a few reads
+const size_t SpansPerThread = 64;
+
+}
+
 ProcessMemory::ProcessMemory( class ProcessCore& core )
     : _core( core )
 {
@@ -34,7 +55,15 @@ MemBlock ProcessMemory::Allocate( size_t size, DWORD protection /*= PAGE_EXECUTE
 /// <returns>Status</returns>
 NTSTATUS ProcessMemory::Free( ptr_t pAddr, size_t size /*= 0*/, DWORD freeType /*= MEM_RELEASE*/ )
 {
-    return _core.native()->VirualFreeExT( pAddr, size, freeType );
+    NTSTATUS status = _core.native()->VirualFreeExT( pAddr, size, freeType );
+
+    // Size of released region is unknown
+    if (size == 0)
+        _cache.BumpEpoch();
+    else
+        _cache.Invalidate( pAddr, size );
+
+    return status;
 }
 
 /// <summary>
@@ -62,7 +91,10 @@ NTSTATUS ProcessMemory::Protect( ptr_t pAddr, size_t size, DWORD flProtect, DWOR
     if (pOld == nullptr)
         pOld = &junk;
 
-    return _core.native()->VirtualProtectExT( pAddr, size, CastProtection( flProtect, _core.DEP() ), pOld );
+    NTSTATUS status = _core.native()->VirtualProtectExT( pAddr, size, CastProtection( flProtect, _core.DEP() ), pOld );
+    _cache.Invalidate( pAddr, size );
+
+    return status;
 }
 
 /// <summary>
@@ -74,6 +106,7 @@ NTSTATUS ProcessMemory::Protect( ptr_t pAddr, size_t size, DWORD flProtect, DWOR
 /// <param name="handleHoles">
 /// If true, function will try to read all committed pages in range ignoring uncommitted ones.
 /// Otherwise function will fail if there is at least one non-committed page in region.
+/// Layout of the range is queried again, so pages committed by target since last walk are read.
 /// </param>
 /// <returns>Status</returns>
 NTSTATUS ProcessMemory::Read( ptr_t dwAddress, size_t dwSize, PVOID pResult, bool handleHoles /*= false*/ )
@@ -88,23 +121,35 @@ NTSTATUS ProcessMemory::Read( ptr_t dwAddress, size_t dwSize, PVOID pResult, boo
     // Simple read
     if (!handleHoles)
     {
+        // Pages that can't be read are left to direct read, so it sets the status
+        if (_cache.active( dwSize ))
+        {
+            auto fetch = [this]( ptr_t page, void* buffer )
+            {
+                return _core.native()->ReadProcessMemoryT( page, buffer, PageCache::PageSize );
+            };
+
+            if (_cache.Read( dwAddress, dwSize, pResult, fetch ) == STATUS_SUCCESS)
+                return STATUS_SUCCESS;
+        }
+
         return _core.native()->ReadProcessMemoryT( dwAddress, pResult, dwSize, &dwRead );
     }
     // Read all committed memory regions
     else
     {
-        MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+        RegionMap::vecRegions regions;
+        _core.native()->regions().Invalidate( dwAddress, dwSize );
+        _core.native()->regions().Enum( dwAddress, dwAddress + dwSize, regions );
 
-        for (ptr_t memptr = dwAddress; memptr < dwAddress + dwSize; memptr = mbi.BaseAddress + mbi.RegionSize)
+        // Regions are clipped to requested range
+        for (auto& mbi : regions)
         {
-            if (_core.native()->VirtualQueryExT( memptr, &mbi ) != STATUS_SUCCESS)
-                continue;
-
             // Filter empty regions
             if (mbi.State != MEM_COMMIT || mbi.Protect == PAGE_NOACCESS)
                 continue;
 
-            uint64_t region_ptr = memptr - dwAddress;
+            uint64_t region_ptr = mbi.BaseAddress - dwAddress;
 
             if (_core.native()->ReadProcessMemoryT( mbi.BaseAddress,
                 reinterpret_cast<uint8_t*>(pResult) + region_ptr,
@@ -119,6 +164,143 @@ NTSTATUS ProcessMemory::Read( ptr_t dwAddress, size_t dwSize, PVOID pResult, boo
     return STATUS_SUCCESS;
 }
 
+/// <summary>
+/// Read multiple memory ranges.
+/// Requests touching the same or adjacent pages are merged into native reads of at most 64 KB,
+/// small reads go through page cache
+/// </summary>
+/// <param name="requests">Ranges to read, status of every request is updated</param>
+/// <returns>STATUS_SUCCESS if all requests succeeded, otherwise status of the first failed one</returns>
+NTSTATUS ProcessMemory::ReadBatch( std::vector<ReadRequest>& requests )
+{
+    // Page aligned range covering one or more requests
+    struct Span
+    {
+        ptr_t address;      // Span start
+        size_t size;        // Span size
+        size_t offset;      // Span offset in read buffer
+        size_t first;       // First request, index in sorted order
+        size_t count;       // Number of requests
+    };
+
+    std::vector<size_t> order;
+    order.reserve( requests.size() );
+
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        auto& req = requests[i];
+        req.status = (req.address == 0) ? STATUS_INVALID_ADDRESS : STATUS_SUCCESS;
+
+        if (req.address != 0 && req.size != 0)
+            order.emplace_back( i );
+    }
+
+    std::sort( order.begin(), order.end(), [&requests]( size_t l, size_t r ) { return requests[l].address < requests[r].address; } );
+
+    // Merge requests in address order
+    std::vector<Span> spans;
+    size_t total = 0;
+
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        auto& req = requests[order[i]];
+        ptr_t start = req.address & ~(PageSize - 1);
+        ptr_t end = (req.address + req.size + PageSize - 1) & ~(PageSize - 1);
+
+        // Requests sharing a page always go to the same span
+        ptr_t spanEnd = spans.empty() ? 0 : spans.back().address + spans.back().size;
+        if (!spans.empty() && (start < spanEnd || (start == spanEnd && spans.back().size < MaxSpanSize)))
+        {
+            auto& span = spans.back();
+            span.size = std::max<size_t>( span.size, static_cast<size_t>(end - span.address) );
+            span.count++;
+        }
+        else
+        {
+            Span span = { start, static_cast<size_t>(end - start), 0, i, 1 };
+            spans.emplace_back( span );
+        }
+    }
+
+    for (auto& span : spans)
+    {
+        span.offset = total;
+        total += span.size;
+    }
+
+    std::vector<uint8_t> buf( total );
+    std::atomic<size_t> next( 0 );
+
+    // Small pieces go through page cache, same as Read
+    auto readPiece = [this]( ptr_t address, size_t size, uint8_t* buffer ) -> NTSTATUS
+    {
+        if (_cache.active( size ))
+        {
+            auto fetch = [this]( ptr_t page, void* pageBuf )
+            {
+                return _core.native()->ReadProcessMemoryT( page, pageBuf, PageCache::PageSize );
+            };
+
+            if (_cache.Read( address, size, buffer, fetch ) == STATUS_SUCCESS)
+                return STATUS_SUCCESS;
+        }
+
+        return _core.native()->ReadProcessMemoryT( address, buffer, size );
+    };
+
+    auto worker = [&]()
+    {
+        std::vector<uint8_t> failed;
+
+        for (size_t i = next++; i < spans.size(); i = next++)
+        {
+            auto& span = spans[i];
+
+            // Overlapping requests can grow span past the limit
+            failed.assign( (span.size + MaxSpanSize - 1) / MaxSpanSize, 0 );
+            for (size_t piece = 0; piece < failed.size(); piece++)
+            {
+                size_t offset = piece * MaxSpanSize;
+                size_t size = std::min( MaxSpanSize, span.size - offset );
+
+                failed[piece] = readPiece( span.address + offset, size, buf.data() + span.offset + offset ) != STATUS_SUCCESS;
+            }
+
+            for (size_t j = span.first; j < span.first + span.count; j++)
+            {
+                auto& req = requests[order[j]];
+                size_t offset = static_cast<size_t>(req.address - span.address);
+
+                auto first = failed.begin() + offset / MaxSpanSize;
+                auto last = failed.begin() + (offset + req.size - 1) / MaxSpanSize + 1;
+
+                if (std::find( first, last, 1 ) == last)
+                    memcpy( req.buffer, buf.data() + span.offset + offset, req.size );
+                // Some page of the request isn't readable, read it separately
+                else
+                    req.status = Read( req.address, req.size, req.buffer );
+            }
+        }
+    };
+
+    size_t threads = std::min<size_t>( std::max<unsigned int>( std::thread::hardware_concurrency(), 1 ), spans.size() / SpansPerThread );
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++)
+        pool.emplace_back( worker );
+
+    worker();
+
+    for (auto& thd : pool)
+        thd.join();
+
+    for (auto& req : requests)
+        if (req.status != STATUS_SUCCESS)
+            return LastNtStatus( req.status );
+
+    return STATUS_SUCCESS;
+}
+
 /// <summary>
 /// Write data
 /// </summary>
@@ -128,7 +310,11 @@ NTSTATUS ProcessMemory::Read( ptr_t dwAddress, size_t dwSize, PVOID pResult, boo
 /// <returns>Status</returns>
 NTSTATUS ProcessMemory::Write( ptr_t pAddress, size_t dwSize, const void* pData )
 {
-    return _core.native()->WriteProcessMemoryT( pAddress, pData, dwSize );
+    // Invalidated after write, so concurrent reads can't cache old data
+    NTSTATUS status = _core.native()->WriteProcessMemoryT( pAddress, pData, dwSize );
+    _cache.Invalidate( pAddress, dwSize );
+
+    return status;
 }
 
 }
\ No newline at end of file
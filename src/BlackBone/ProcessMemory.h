@@ -2,12 +2,26 @@
 
 #include "Winheaders.h"
 #include "MemBlock.h"
+#include "PageCache.h"
 
 #include <vector>
 
 namespace blackbone
 {
 
+// Single range of batched read
+struct ReadRequest
+{
+    ptr_t address = 0;                  // Address to read from
+    size_t size = 0;                    // Number of bytes to read
+    void* buffer = nullptr;             // Output buffer
+    NTSTATUS status = STATUS_SUCCESS;   // Read status
+
+    ReadRequest() { }
+    ReadRequest( ptr_t address_, size_t size_, void* buffer_ )
+        : address( address_ ), size( size_ ), buffer( buffer_ ) { }
+};
+
 class ProcessMemory
 {
 public:
@@ -59,10 +73,20 @@ public:
     /// <param name="handleHoles">
     /// If true, function will try to read all committed pages in range ignoring uncommitted ones.
     /// Otherwise function will fail if there is at least one non-committed page in region.
+    /// Layout of the range is queried again, so pages committed by target since last walk are read.
     /// </param>
     /// <returns>Status</returns>
     NTSTATUS Read( ptr_t dwAddress, size_t dwSize, PVOID pResult, bool handleHoles = false );
 
+    /// <summary>
+    /// Read multiple memory ranges.
+    /// Requests touching the same or adjacent pages are merged into native reads of at most 64 KB,
+    /// small reads go through page cache
+    /// </summary>
+    /// <param name="requests">Ranges to read, status of every request is updated</param>
+    /// <returns>STATUS_SUCCESS if all requests succeeded, otherwise status of the first failed one</returns>
+    NTSTATUS ReadBatch( std::vector<ReadRequest>& requests );
+
     /// <summary>
     /// Write data
     /// </summary>
@@ -97,6 +121,13 @@ public:
         return Write( dwAddress, sizeof(T), &data );
     }
 
+    /// <summary>
+    /// Cache of remote pages used by Read, disabled by default.
+    /// Own Write, Protect and Free invalidate it, changes made by target require BumpEpoch
+    /// </summary>
+    /// <returns>Page cache</returns>
+    inline PageCache& cache() { return _cache; }
+
     inline class ProcessCore& core() { return _core; }
 
 private:
@@ -105,6 +136,7 @@ private:
 
 private:
     class ProcessCore& _core;   // Core routines
+    PageCache _cache;           // Remote page cache
 };
 
 }
\ No newline at end of file
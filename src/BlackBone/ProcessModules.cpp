@@ -201,6 +201,7 @@ void ProcessModules::GetManualModules( ProcessModules::mapModules& mods )
 
 /// <summary>
 /// Get export address. Forwarded exports will be automatically resolved if forward module is present
+/// Export table is read once and cached until module is unloaded
 /// </summary>
 /// <param name="hMod">Module to search in</param>
 /// <param name="name_ord">Function name or ordinal</param>
@@ -216,120 +217,81 @@ exportData ProcessModules::GetExport( const ModuleData* hMod, const char* name_o
         LastNtStatus( STATUS_INVALID_PARAMETER_1 );
         return data;
     }
-    
-    std::unique_ptr<IMAGE_EXPORT_DIRECTORY, decltype(&free)> expData( nullptr, &free );
-
-    IMAGE_DOS_HEADER hdrDos = { 0 };
-    uint8_t hdrNt32[sizeof(IMAGE_NT_HEADERS64)] = { 0 };
-    auto phdrNt32 = reinterpret_cast<PIMAGE_NT_HEADERS32>(hdrNt32);
-    auto phdrNt64 = reinterpret_cast<PIMAGE_NT_HEADERS64>(hdrNt32);
-    DWORD expSize = 0;
-    size_t expBase = 0;
-
-    _memory.Read( hMod->baseAddress, sizeof(hdrDos), &hdrDos );
 
-    if (hdrDos.e_magic != IMAGE_DOS_SIGNATURE)
+    auto index = GetExportIndex( hMod );
+    if (!index)
         return data;
 
-    _memory.Read( hMod->baseAddress + hdrDos.e_lfanew, sizeof(IMAGE_NT_HEADERS64), &hdrNt32 );
+    const ExportIndex::Entry* pEntry = nullptr;
+
+    // Find by ordinal or by name
+    if (reinterpret_cast<size_t>(name_ord) <= 0xFFFF)
+        pEntry = index->Find( static_cast<WORD>(reinterpret_cast<size_t>(name_ord)) );
+    else
+        pEntry = index->Find( name_ord );
 
-    if (phdrNt32->Signature != IMAGE_NT_SIGNATURE)
+    if (pEntry == nullptr)
         return data;
 
-    if (phdrNt32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
-        expBase = phdrNt32->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress;
-    else
-        expBase = phdrNt64->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress;
+    data.procAddress = pEntry->rva + hMod->baseAddress;
 
-    // Exports are present
-    if (expBase)
+    // Check forwarded export
+    if (pEntry->forward >= 0)
     {
-        if (phdrNt32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
-            expSize = phdrNt32->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].Size;
+        auto& fwd = index->forward( *pEntry );
+        std::wstring wDll( fwd.module );
+
+        // Fill export data info
+        data.isForwarded = true;
+        data.forwardModule = fwd.module;
+        data.forwardByOrd = fwd.byOrdinal;
+        data.forwardOrdinal = fwd.ordinal;
+        data.forwardName = fwd.name;
+
+        auto hChainMod = GetModule( wDll, LdrList, index->imageType(), baseModule );
+        if (hChainMod == nullptr)
+            return data;
+
+        // Import by ordinal
+        if (data.forwardByOrd)
+            return GetExport( hChainMod, reinterpret_cast<const char*>(data.forwardOrdinal), wDll.c_str() );
+        // Import by name
         else
-            expSize = phdrNt64->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].Size;
-
-        expData.reset( reinterpret_cast<IMAGE_EXPORT_DIRECTORY*>(malloc( expSize )) );
-        IMAGE_EXPORT_DIRECTORY* pExpData = expData.get();
-
-        _memory.Read( hMod->baseAddress + expBase, expSize, pExpData );
-
-        WORD  *pAddressOfOrds  = reinterpret_cast<WORD*> (
-            pExpData->AddressOfNameOrdinals + reinterpret_cast<size_t>(pExpData) - expBase);
+            return GetExport( hChainMod, data.forwardName.c_str(), wDll.c_str() );
+    }
 
-        DWORD *pAddressOfNames = reinterpret_cast<DWORD*>(
-            pExpData->AddressOfNames + reinterpret_cast<size_t>(pExpData) - expBase);
+    return data;
+}
 
-        DWORD *pAddressOfFuncs = reinterpret_cast<DWORD*>(
-            pExpData->AddressOfFunctions + reinterpret_cast<size_t>(pExpData) - expBase);
+/// <summary>
+/// Get export index of module. Index is built on first use
+/// </summary>
+/// <param name="hMod">Module</param>
+/// <returns>Export index, nullptr if failed</returns>
+std::shared_ptr<const ExportIndex> ProcessModules::GetExportIndex( const ModuleData* hMod )
+{
+    {
+        std::lock_guard<std::mutex> lg( _modGuard );
 
-        for (DWORD i = 0; i < pExpData->NumberOfFunctions; ++i)
-        {
-            WORD OrdIndex = 0xFFFF;
-            char *pName = nullptr;
+        auto iter = _exports.find( hMod->baseAddress );
+        if (iter != _exports.end() && iter->second->valid( *hMod ))
+            return iter->second;
+    }
 
-            // Find by index
-            if (reinterpret_cast<size_t>(name_ord) <= 0xFFFF)
-            {
-                OrdIndex = static_cast<WORD>(i);
-            }
-            // Find by name
-            else if (reinterpret_cast<size_t>(name_ord) > 0xFFFF && i < pExpData->NumberOfNames)
-            {
-                pName = (char*)(pAddressOfNames[i] + reinterpret_cast<size_t>(pExpData) - expBase);
-                OrdIndex = static_cast<WORD>(pAddressOfOrds[i]);
-            }
-            else
-                return data;
+    // Build outside of lock, it reads remote memory
+    auto index = std::make_shared<ExportIndex>();
 
-            if ((reinterpret_cast<size_t>(name_ord) <= 0xFFFF && reinterpret_cast<WORD>(name_ord) == (OrdIndex + pExpData->Base)) ||
-                 (reinterpret_cast<size_t>(name_ord) > 0xFFFF && strcmp( pName, name_ord ) == 0))
-            {
-                data.procAddress = pAddressOfFuncs[OrdIndex] + hMod->baseAddress;
-
-                // Check forwarded export
-                if (data.procAddress >= hMod->baseAddress + expBase && 
-                    data.procAddress <= hMod->baseAddress + expBase + expSize)
-                {
-                    char forwardStr[255] = { 0 };
-
-                    _memory.Read( data.procAddress, sizeof(forwardStr), forwardStr );
-
-                    std::string chainExp( forwardStr );
-
-                    std::string strDll = chainExp.substr( 0, chainExp.find( "." ) ) + ".dll";
-                    std::string strName = chainExp.substr( chainExp.find( "." ) + 1, strName.npos );
-                    std::wstring wDll( Utils::AnsiToWstring( strDll ) );
-
-                    // Fill export data info
-                    data.isForwarded = true;
-                    data.forwardModule = wDll;
-                    data.forwardByOrd = (strName.find( "#" ) == 0);
-
-                    if (data.forwardByOrd)
-                        data.forwardOrdinal = static_cast<WORD>(atoi( strName.c_str() + 1 ));
-                    else
-                        data.forwardName = strName;
-
-                    auto mt = (phdrNt32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC) ? mt_mod32 : mt_mod64;
-                    auto hChainMod = GetModule( wDll, LdrList, mt, baseModule );
-                    if (hChainMod == nullptr)
-                        return data;
-
-                    // Import by ordinal
-                    if (data.forwardByOrd)
-                        return GetExport( hChainMod, reinterpret_cast<const char*>(data.forwardOrdinal), wDll.c_str() );
-                    // Import by name
-                    else
-                        return GetExport( hChainMod, strName.c_str(), wDll.c_str() );
-                }
-
-                break;
-            }
-        }
+    NTSTATUS status = index->Build( _memory, *hMod );
+    if (!NT_SUCCESS( status ))
+    {
+        LastNtStatus( status );
+        return nullptr;
     }
 
-    return data;
+    std::lock_guard<std::mutex> lg( _modGuard );
+    _exports[hMod->baseAddress] = index;
+
+    return index;
 }
 
 /// <summary>
@@ -446,6 +408,8 @@ bool ProcessModules::Unload( const ModuleData* hMod )
         _proc.remote().ExecDirect( pUnload.procAddress, hMod->baseAddress );
 
     // Remove module from cache
+    std::lock_guard<std::mutex> lg( _modGuard );
+    _exports.erase( hMod->baseAddress );
     _modules.erase( std::make_pair( hMod->name, hMod->type ) );
 
     return true;
@@ -513,10 +477,15 @@ const ModuleData* ProcessModules::AddManualModule( const std::wstring& FilePath,
 /// <param name="mt">Module type. 32 bit or 64 bit</param>
 void ProcessModules::RemoveManualModule( const std::wstring& filename, eModType mt )
 {
-    auto key = std::make_pair( filename, mt );
+    std::lock_guard<std::mutex> lg( _modGuard );
 
-    if (_modules.count( key ))
-        _modules.erase( key );
+    auto iter = _modules.find( std::make_pair( filename, mt ) );
+
+    if (iter != _modules.end())
+    {
+        _exports.erase( iter->second.baseAddress );
+        _modules.erase( iter );
+    }
 }
 
 // DWORD alignment
@@ -832,7 +801,12 @@ void ProcessModules::reset()
 {
     std::lock_guard<std::mutex> lg( _modGuard ); 
     _modules.clear(); 
+    _exports.clear();
     _ldrPatched = false;
+
+    // Module list is rebuilt from scratch, so is address space layout
+    if (_core.native())
+        _core.native()->regions().Reset();
 }
 
 }
\ No newline at end of file
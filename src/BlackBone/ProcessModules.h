@@ -2,12 +2,14 @@
 
 #include "Winheaders.h"
 #include "PEParser.h"
+#include "ExportIndex.h"
 
 #include <string>
 #include <map>
 #include <unordered_map>
 #include <algorithm>
 #include <mutex>
+#include <memory>
 
 template <>
 struct std::hash< std::pair<std::wstring, blackbone::eModType> >
@@ -102,6 +104,7 @@ public:
 
     /// <summary>
     /// Get export address. Forwarded exports will be automatically resolved if forward module is present
+    /// Export table is read once and cached until module is unloaded
     /// </summary>
     /// <param name="hMod">Module to search in</param>
     /// <param name="name_ord">Function name or ordinal</param>
@@ -178,12 +181,20 @@ private:
     ProcessModules( const ProcessModules& ) = delete;
     ProcessModules operator =(const ProcessModules&) = delete;
 
+    /// <summary>
+    /// Get export index of module. Index is built on first use
+    /// </summary>
+    /// <param name="hMod">Module</param>
+    /// <returns>Export index, nullptr if failed</returns>
+    std::shared_ptr<const ExportIndex> GetExportIndex( const ModuleData* hMod );
+
 private:
     class Process&       _proc;
     class ProcessMemory& _memory;
     class ProcessCore&   _core;
 
     mapModules _modules;    // Fast lookup cache
+    std::unordered_map<module_t, std::shared_ptr<const ExportIndex>> _exports;  // Export tables, by module base
     std::mutex _modGuard;   // Module guard        
     bool _ldrPatched;       // Win7 loader patch flag
 };
@@ -0,0 +1,287 @@
+#include "RegionMap.h"
+
+#include <algorithm>
+
+namespace blackbone
+{
+
+RegionMap::RegionMap( ptr_t minAddr, ptr_t maxAddr, fnQuery query )
+    : _minAddr( minAddr )
+    , _maxAddr( maxAddr )
+    , _query( query )
+{
+}
+
+RegionMap::~RegionMap()
+{
+}
+
+/// <summary>
+/// Get region containing address
+/// </summary>
+/// <param name="address">Address to query</param>
+/// <param name="mbi">Region info, BaseAddress is page containing address</param>
+/// <returns>Status code</returns>
+NTSTATUS RegionMap::Query( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi )
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    if (address >= _minAddr && address < _maxAddr)
+    {
+        Refresh();
+
+        size_t idx = Find( address );
+        if (idx < _regions.size())
+        {
+            ptr_t page = address & ~(PageSize - 1);
+
+            mbi = _regions[idx];
+            mbi.RegionSize -= page - mbi.BaseAddress;
+            mbi.BaseAddress = page;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    // Not covered by snapshot
+    return _query( address, mbi );
+}
+
+/// <summary>
+/// Get regions overlapping address range
+/// </summary>
+/// <param name="from">Range start</param>
+/// <param name="to">Range end</param>
+/// <param name="result">Found regions, first and last one are clipped to range</param>
+/// <returns>Status code</returns>
+NTSTATUS RegionMap::Enum( ptr_t from, ptr_t to, vecRegions& result )
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    result.clear();
+
+    NTSTATUS status = Refresh();
+
+    auto iter = std::upper_bound( _regions.begin(), _regions.end(), from,
+        []( ptr_t address, const MEMORY_BASIC_INFORMATION64& region ) { return address < region.BaseAddress; } );
+
+    if (iter != _regions.begin() && (iter - 1)->BaseAddress + (iter - 1)->RegionSize > from)
+        --iter;
+
+    for (; iter != _regions.end() && iter->BaseAddress < to; ++iter)
+    {
+        MEMORY_BASIC_INFORMATION64 region = *iter;
+        ptr_t start = std::max<ptr_t>( region.BaseAddress, from );
+        ptr_t end = std::min<ptr_t>( region.BaseAddress + region.RegionSize, to );
+
+        region.BaseAddress = start;
+        region.RegionSize = end - start;
+        result.emplace_back( region );
+    }
+
+    return status;
+}
+
+/// <summary>
+/// Mark range as changed, it is queried again on next access
+/// </summary>
+/// <param name="address">Range start</param>
+/// <param name="size">Range size. 0 - whole allocation containing address</param>
+void RegionMap::Invalidate( ptr_t address, size_t size )
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    // Nothing to update yet
+    if (!_valid)
+        return;
+
+    ptr_t start = address & ~(PageSize - 1);
+    ptr_t end = (address + std::max<size_t>( size, 1 ) + PageSize - 1) & ~(PageSize - 1);
+
+    // Allocation bounds are taken from snapshot, it still has old layout
+    size_t idx = (size == 0) ? Find( address ) : _regions.size();
+    if (idx < _regions.size() && _regions[idx].State != MEM_FREE)
+    {
+        size_t first = idx, last = idx;
+        ptr_t base = _regions[idx].AllocationBase;
+
+        while (first > 0 && _regions[first - 1].AllocationBase == base && _regions[first - 1].State != MEM_FREE)
+            first--;
+
+        while (last + 1 < _regions.size() && _regions[last + 1].AllocationBase == base && _regions[last + 1].State != MEM_FREE)
+            last++;
+
+        start = _regions[first].BaseAddress;
+        end = _regions[last].BaseAddress + _regions[last].RegionSize;
+    }
+
+    start = std::max<ptr_t>( start, _minAddr );
+    end = std::min<ptr_t>( end, _maxAddr );
+
+    if (start < end)
+        _dirty.emplace_back( start, end );
+}
+
+/// <summary>
+/// Drop snapshot, next access sweeps whole address space again
+/// </summary>
+void RegionMap::Reset()
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    _valid = false;
+    _regions.clear();
+    _dirty.clear();
+}
+
+/// <summary>
+/// Build snapshot or query invalidated ranges again
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS RegionMap::Refresh()
+{
+    ptr_t end = 0;
+
+    if (!_valid)
+    {
+        _regions.clear();
+        _dirty.clear();
+
+        // Partial snapshot is kept for lookups, but next access starts over
+        NTSTATUS status = Sweep( _minAddr, _maxAddr, _regions, end );
+        _valid = (status == STATUS_SUCCESS);
+        return status;
+    }
+
+    if (_dirty.empty())
+        return STATUS_SUCCESS;
+
+    std::sort( _dirty.begin(), _dirty.end() );
+
+    //
+    // Query every dirty range. Swept range ends on region boundary,
+    // so it may cover beginning of the next dirty range
+    //
+    vecRegions merged;
+    std::vector<Range> swept;
+    ptr_t done = 0;
+
+    for (auto& range : _dirty)
+    {
+        ptr_t from = std::max<ptr_t>( range.first, done );
+        if (from >= range.second)
+            continue;
+
+        NTSTATUS status = Sweep( from, range.second, merged, end );
+        if (status != STATUS_SUCCESS)
+        {
+            _valid = false;
+            return status;
+        }
+
+        swept.emplace_back( from, end );
+        done = end;
+    }
+
+    _dirty.clear();
+
+    //
+    // Keep parts of old regions outside swept ranges.
+    // Attributes of such part are unchanged, even if its region was split
+    //
+    size_t first = 0;
+    for (auto& region : _regions)
+    {
+        ptr_t start = region.BaseAddress;
+        ptr_t regionEnd = region.BaseAddress + region.RegionSize;
+
+        while (first < swept.size() && swept[first].second <= start)
+            first++;
+
+        for (size_t i = first; i < swept.size() && swept[i].first < regionEnd; i++)
+        {
+            if (swept[i].first > start)
+            {
+                MEMORY_BASIC_INFORMATION64 part = region;
+                part.BaseAddress = start;
+                part.RegionSize = swept[i].first - start;
+                merged.emplace_back( part );
+            }
+
+            start = std::max<ptr_t>( start, swept[i].second );
+        }
+
+        if (start < regionEnd)
+        {
+            MEMORY_BASIC_INFORMATION64 part = region;
+            part.BaseAddress = start;
+            part.RegionSize = regionEnd - start;
+            merged.emplace_back( part );
+        }
+    }
+
+    std::sort( merged.begin(), merged.end(), []( const MEMORY_BASIC_INFORMATION64& l, const MEMORY_BASIC_INFORMATION64& r )
+    {
+        return l.BaseAddress < r.BaseAddress;
+    } );
+
+    _regions.swap( merged );
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Query regions starting at address until range end is reached
+/// </summary>
+/// <param name="from">Range start</param>
+/// <param name="to">Range end</param>
+/// <param name="result">Found regions</param>
+/// <param name="end">End of queried range, not less than 'to' on success</param>
+/// <returns>Status of failed query, STATUS_SUCCESS otherwise</returns>
+NTSTATUS RegionMap::Sweep( ptr_t from, ptr_t to, vecRegions& result, ptr_t& end )
+{
+    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+
+    for (end = from; end < to;)
+    {
+        NTSTATUS status = _query( end, mbi );
+
+        // Beyond user space
+        if (status == STATUS_INVALID_PARAMETER)
+        {
+            end = _maxAddr;
+            break;
+        }
+        else if (status != STATUS_SUCCESS)
+            return status;
+
+        // Region must contain queried address, otherwise sweep won't advance
+        ptr_t regionEnd = std::min<ptr_t>( mbi.BaseAddress + mbi.RegionSize, _maxAddr );
+        if (regionEnd <= end)
+            return STATUS_UNSUCCESSFUL;
+
+        mbi.RegionSize = regionEnd - end;
+        mbi.BaseAddress = end;
+        result.emplace_back( mbi );
+
+        end = regionEnd;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Find region containing address
+/// </summary>
+/// <param name="address">Address</param>
+/// <returns>Region index, number of regions if not found</returns>
+size_t RegionMap::Find( ptr_t address ) const
+{
+    auto iter = std::upper_bound( _regions.begin(), _regions.end(), address,
+        []( ptr_t value, const MEMORY_BASIC_INFORMATION64& region ) { return value < region.BaseAddress; } );
+
+    if (iter == _regions.begin() || address >= (iter - 1)->BaseAddress + (iter - 1)->RegionSize)
+        return _regions.size();
+
+    return static_cast<size_t>(iter - _regions.begin()) - 1;
+}
+
+}
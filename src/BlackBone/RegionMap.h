@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace blackbone
+{
+
+/// <summary>
+/// Snapshot of target address space layout, sorted by region address.
+/// Built by single sweep on first use, afterwards only invalidated ranges are queried again
+/// </summary>
+class RegionMap
+{
+public:
+    // Region granularity
+    static const ptr_t PageSize = 0x1000;
+
+    // Queries single region, same contract as VirtualQueryEx
+    typedef std::function<NTSTATUS( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi )> fnQuery;
+
+    typedef std::vector<MEMORY_BASIC_INFORMATION64> vecRegions;
+
+public:
+    RegionMap( ptr_t minAddr, ptr_t maxAddr, fnQuery query );
+    ~RegionMap();
+
+    /// <summary>
+    /// Get region containing address
+    /// </summary>
+    /// <param name="address">Address to query</param>
+    /// <param name="mbi">Region info, BaseAddress is page containing address</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Query( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi );
+
+    /// <summary>
+    /// Get regions overlapping address range
+    /// </summary>
+    /// <param name="from">Range start</param>
+    /// <param name="to">Range end</param>
+    /// <param name="result">Found regions, first and last one are clipped to range</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Enum( ptr_t from, ptr_t to, vecRegions& result );
+
+    /// <summary>
+    /// Mark range as changed, it is queried again on next access
+    /// </summary>
+    /// <param name="address">Range start</param>
+    /// <param name="size">Range size. 0 - whole allocation containing address</param>
+    void Invalidate( ptr_t address, size_t size );
+
+    /// <summary>
+    /// Drop snapshot, next access sweeps whole address space again
+    /// </summary>
+    void Reset();
+
+private:
+    typedef std::pair<ptr_t, ptr_t> Range;
+
+    /// <summary>
+    /// Build snapshot or query invalidated ranges again
+    /// </summary>
+    /// <returns>Status code</returns>
+    NTSTATUS Refresh();
+
+    /// <summary>
+    /// Query regions starting at address until range end is reached
+    /// </summary>
+    /// <param name="from">Range start</param>
+    /// <param name="to">Range end</param>
+    /// <param name="result">Found regions</param>
+    /// <param name="end">End of queried range, not less than 'to' on success</param>
+    /// <returns>Status of failed query, STATUS_SUCCESS otherwise</returns>
+    NTSTATUS Sweep( ptr_t from, ptr_t to, vecRegions& result, ptr_t& end );
+
+    /// <summary>
+    /// Find region containing address
+    /// </summary>
+    /// <param name="address">Address</param>
+    /// <returns>Region index, number of regions if not found</returns>
+    size_t Find( ptr_t address ) const;
+
+private:
+    RegionMap( const RegionMap& ) = delete;
+    RegionMap& operator =(const RegionMap&) = delete;
+
+private:
+    std::mutex _lock;               // Protects everything below
+    ptr_t _minAddr;                 // Lowest address to sweep
+    ptr_t _maxAddr;                 // Highest address to sweep
+    fnQuery _query;                 // Region query routine
+    vecRegions _regions;            // Regions sorted by base address
+    std::vector<Range> _dirty;      // Ranges to query again
+    bool _valid = false;            // Snapshot was built
+};
+
+}
@@ -0,0 +1,315 @@
+#include "RelocationPlan.h"
+#include "PEParser.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace blackbone
+{
+
+namespace pe
+{
+
+namespace
+{
+
+// Number of bytes modified by fixup, 0 for unsupported types
+size_t FixupSize( uint16_t type )
+{
+    switch (type)
+    {
+        case reloc_high:
+        case reloc_low:
+        case reloc_highadj:
+            return sizeof(uint16_t);
+
+        case reloc_highlow:
+            return sizeof(uint32_t);
+
+        case reloc_arm_mov32:
+        case reloc_thumb_mov32:
+        case reloc_dir64:
+            return sizeof(uint64_t);
+
+        default:
+            return 0;
+    }
+}
+
+// Fixups are not guaranteed to be aligned
+template<typename T>
+inline T Load( const uint8_t* ptr )
+{
+    T value;
+    memcpy( &value, ptr, sizeof(value) );
+    return value;
+}
+
+template<typename T>
+inline void Store( uint8_t* ptr, T value )
+{
+    memcpy( ptr, &value, sizeof(value) );
+}
+
+// ARM MOVW/MOVT immediate: imm4 in bits 19:16, imm12 in bits 11:0
+inline uint16_t ArmGetImm16( uint32_t instr )
+{
+    return static_cast<uint16_t>(((instr >> 4) & 0xF000) | (instr & 0x0FFF));
+}
+
+inline uint32_t ArmSetImm16( uint32_t instr, uint16_t imm )
+{
+    return (instr & 0xFFF0F000) | ((imm & 0xF000) << 4) | (imm & 0x0FFF);
+}
+
+// Thumb-2 MOVW/MOVT immediate: imm4 and i in first halfword, imm3 and imm8 in second one
+inline uint16_t ThumbGetImm16( const uint8_t* ptr )
+{
+    uint16_t hw1 = Load<uint16_t>( ptr ), hw2 = Load<uint16_t>( ptr + 2 );
+    return static_cast<uint16_t>(((hw1 & 0x000F) << 12) | ((hw1 & 0x0400) << 1) | ((hw2 & 0x7000) >> 4) | (hw2 & 0x00FF));
+}
+
+inline void ThumbSetImm16( uint8_t* ptr, uint16_t imm )
+{
+    uint16_t hw1 = Load<uint16_t>( ptr ), hw2 = Load<uint16_t>( ptr + 2 );
+
+    hw1 = static_cast<uint16_t>((hw1 & 0xFBF0) | ((imm >> 12) & 0x000F) | ((imm >> 1) & 0x0400));
+    hw2 = static_cast<uint16_t>((hw2 & 0x8F00) | ((imm << 4) & 0x7000) | (imm & 0x00FF));
+
+    Store( ptr, hw1 );
+    Store( ptr + 2, hw2 );
+}
+
+}
+
+RelocationPlan::RelocationPlan()
+{
+}
+
+RelocationPlan::~RelocationPlan()
+{
+}
+
+/// <summary>
+/// Parse relocation directory of the image. Works for both mapped and plain data images
+/// </summary>
+/// <param name="image">Parsed image</param>
+/// <returns>Status code, STATUS_NOT_FOUND if image has no relocation directory</returns>
+NTSTATUS RelocationPlan::Build( const PEParser& image )
+{
+    auto start = image.DirectoryAddress( IMAGE_DIRECTORY_ENTRY_BASERELOC );
+    if (start == 0)
+    {
+        Reset();
+        return STATUS_NOT_FOUND;
+    }
+
+    return Build( reinterpret_cast<const void*>(start), image.DirectorySize( IMAGE_DIRECTORY_ENTRY_BASERELOC ) );
+}
+
+/// <summary>
+/// Parse raw relocation blocks
+/// </summary>
+/// <param name="relocs">Relocation directory data</param>
+/// <param name="size">Relocation directory size</param>
+/// <returns>Status code</returns>
+NTSTATUS RelocationPlan::Build( const void* relocs, size_t size )
+{
+    const size_t hdrSize = 2 * sizeof(uint32_t);
+    const uint8_t* ptr = reinterpret_cast<const uint8_t*>(relocs);
+    const uint8_t* end = ptr + size;
+
+    Reset();
+
+    // Block: page RVA, block size, 16 bit entries
+    while (static_cast<size_t>(end - ptr) >= hdrSize)
+    {
+        uint32_t pageRVA = Load<uint32_t>( ptr );
+        uint32_t blockSize = Load<uint32_t>( ptr + sizeof(uint32_t) );
+
+        // Directory can be padded with zeros
+        if (blockSize == 0)
+            break;
+
+        if (blockSize < hdrSize || blockSize > static_cast<size_t>(end - ptr))
+        {
+            Reset();
+            return STATUS_INVALID_IMAGE_FORMAT;
+        }
+
+        size_t count = (blockSize - hdrSize) / sizeof(uint16_t);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint16_t item = Load<uint16_t>( ptr + hdrSize + i * sizeof(uint16_t) );
+            Record rec = { pageRVA + (item & 0x0FFF), static_cast<uint16_t>(item >> 12), 0 };
+
+            if (rec.type == reloc_absolute)
+                continue;
+
+            // Low part of adjusted value is stored as a separate entry
+            if (rec.type == reloc_highadj)
+            {
+                if (++i >= count)
+                {
+                    Reset();
+                    return STATUS_INVALID_IMAGE_FORMAT;
+                }
+
+                rec.param = Load<uint16_t>( ptr + hdrSize + i * sizeof(uint16_t) );
+            }
+
+            _records.emplace_back( rec );
+        }
+
+        ptr += blockSize;
+    }
+
+    return Finalize();
+}
+
+/// <summary>
+/// Use previously parsed records
+/// </summary>
+/// <param name="records">Relocation records</param>
+/// <returns>Status code</returns>
+NTSTATUS RelocationPlan::Assign( const std::vector<Record>& records )
+{
+    _records = records;
+    return Finalize();
+}
+
+/// <summary>
+/// Rebase image
+/// </summary>
+/// <param name="imageBase">Local image, laid out by RVA</param>
+/// <param name="imageSize">Image size</param>
+/// <param name="delta">New image base - old image base</param>
+/// <returns>Status code</returns>
+NTSTATUS RelocationPlan::Apply( void* imageBase, size_t imageSize, uint64_t delta ) const
+{
+    uint8_t* base = reinterpret_cast<uint8_t*>(imageBase);
+    const Record* recs = _records.data();
+    const size_t count = _records.size();
+
+    // Records are sorted by RVA inside each type, so checking the last one of each type is enough
+    for (size_t i = 0; i < count; i++)
+    {
+        if ((i + 1 == count || recs[i + 1].type != recs[i].type) &&
+             (recs[i].rva > imageSize || imageSize - recs[i].rva < FixupSize( recs[i].type )))
+        {
+            return STATUS_INVALID_IMAGE_FORMAT;
+        }
+    }
+
+    if (delta == 0)
+        return STATUS_SUCCESS;
+
+    const uint32_t delta32 = static_cast<uint32_t>(delta);
+    const uint16_t deltaLow = static_cast<uint16_t>(delta32);
+    const uint16_t deltaHigh = static_cast<uint16_t>(delta32 >> 16);
+
+    for (size_t i = 0; i < count; )
+    {
+        size_t last = i;
+        while (last < count && recs[last].type == recs[i].type)
+            last++;
+
+        switch (recs[i].type)
+        {
+            case reloc_dir64:
+                for (; i < last; i++)
+                    Store( base + recs[i].rva, static_cast<uint64_t>(Load<uint64_t>( base + recs[i].rva ) + delta) );
+                break;
+
+            case reloc_highlow:
+                for (; i < last; i++)
+                    Store( base + recs[i].rva, static_cast<uint32_t>(Load<uint32_t>( base + recs[i].rva ) + delta32) );
+                break;
+
+            case reloc_high:
+                for (; i < last; i++)
+                    Store( base + recs[i].rva, static_cast<uint16_t>(Load<uint16_t>( base + recs[i].rva ) + deltaHigh) );
+                break;
+
+            case reloc_low:
+                for (; i < last; i++)
+                    Store( base + recs[i].rva, static_cast<uint16_t>(Load<uint16_t>( base + recs[i].rva ) + deltaLow) );
+                break;
+
+            case reloc_highadj:
+                for (; i < last; i++)
+                {
+                    uint32_t value = static_cast<uint32_t>(Load<uint16_t>( base + recs[i].rva )) << 16;
+                    value += static_cast<uint32_t>(static_cast<int32_t>(static_cast<int16_t>(recs[i].param)));
+                    value += delta32 + 0x8000;
+
+                    Store( base + recs[i].rva, static_cast<uint16_t>(value >> 16) );
+                }
+                break;
+
+            case reloc_arm_mov32:
+                for (; i < last; i++)
+                {
+                    uint8_t* ptr = base + recs[i].rva;
+                    uint32_t movw = Load<uint32_t>( ptr ), movt = Load<uint32_t>( ptr + 4 );
+                    uint32_t value = ((static_cast<uint32_t>(ArmGetImm16( movt )) << 16) | ArmGetImm16( movw )) + delta32;
+
+                    Store( ptr, ArmSetImm16( movw, static_cast<uint16_t>(value) ) );
+                    Store( ptr + 4, ArmSetImm16( movt, static_cast<uint16_t>(value >> 16) ) );
+                }
+                break;
+
+            case reloc_thumb_mov32:
+                for (; i < last; i++)
+                {
+                    uint8_t* ptr = base + recs[i].rva;
+                    uint32_t value = ((static_cast<uint32_t>(ThumbGetImm16( ptr + 4 )) << 16) | ThumbGetImm16( ptr )) + delta32;
+
+                    ThumbSetImm16( ptr, static_cast<uint16_t>(value) );
+                    ThumbSetImm16( ptr + 4, static_cast<uint16_t>(value >> 16) );
+                }
+                break;
+
+            default:
+                i = last;
+                break;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Discard records
+/// </summary>
+void RelocationPlan::Reset()
+{
+    _records.clear();
+}
+
+/// <summary>
+/// Validate record types and sort records
+/// </summary>
+/// <returns>Status code</returns>
+NTSTATUS RelocationPlan::Finalize()
+{
+    for (auto& rec : _records)
+    {
+        if (FixupSize( rec.type ) == 0)
+        {
+            Reset();
+            return STATUS_INVALID_IMAGE_FORMAT;
+        }
+    }
+
+    std::sort( _records.begin(), _records.end(), []( const Record& l, const Record& r )
+    {
+        return l.type != r.type ? l.type < r.type : l.rva < r.rva;
+    } );
+
+    return STATUS_SUCCESS;
+}
+
+}
+
+}
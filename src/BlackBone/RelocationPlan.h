@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+
+#include <vector>
+
+namespace blackbone
+{
+
+namespace pe
+{
+
+class PEParser;
+
+// Base relocation types, same values as IMAGE_REL_BASED_*
+enum eRelocType
+{
+    reloc_absolute    = 0,      // No fixup
+    reloc_high        = 1,      // High 16 bits of delta added to 16 bit field
+    reloc_low         = 2,      // Low 16 bits of delta added to 16 bit field
+    reloc_highlow     = 3,      // 32 bit field
+    reloc_highadj     = 4,      // High 16 bits of 32 bit value, low 16 bits are in the next record
+    reloc_arm_mov32   = 5,      // ARM MOVW/MOVT pair
+    reloc_thumb_mov32 = 7,      // Thumb-2 MOVW/MOVT pair
+    reloc_dir64       = 10,     // 64 bit field
+};
+
+/// <summary>
+/// Base relocations parsed into a flat record array.
+/// Records are grouped by type and sorted by RVA, so rebasing is a simple loop per type.
+/// </summary>
+class RelocationPlan
+{
+public:
+    // Single fixup
+    struct Record
+    {
+        uint32_t rva;       // Fixup RVA
+        uint16_t type;      // Relocation type, see eRelocType
+        uint16_t param;     // Low 16 bits of target value for reloc_highadj
+    };
+
+public:
+    RelocationPlan();
+    ~RelocationPlan();
+
+    /// <summary>
+    /// Parse relocation directory of the image. Works for both mapped and plain data images
+    /// </summary>
+    /// <param name="image">Parsed image</param>
+    /// <returns>Status code, STATUS_NOT_FOUND if image has no relocation directory</returns>
+    NTSTATUS Build( const PEParser& image );
+
+    /// <summary>
+    /// Parse raw relocation blocks
+    /// </summary>
+    /// <param name="relocs">Relocation directory data</param>
+    /// <param name="size">Relocation directory size</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Build( const void* relocs, size_t size );
+
+    /// <summary>
+    /// Use previously parsed records
+    /// </summary>
+    /// <param name="records">Relocation records</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Assign( const std::vector<Record>& records );
+
+    /// <summary>
+    /// Rebase image
+    /// </summary>
+    /// <param name="imageBase">Local image, laid out by RVA</param>
+    /// <param name="imageSize">Image size</param>
+    /// <param name="delta">New image base - old image base</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Apply( void* imageBase, size_t imageSize, uint64_t delta ) const;
+
+    /// <summary>
+    /// Discard records
+    /// </summary>
+    void Reset();
+
+    inline const std::vector<Record>& records() const { return _records; }
+    inline size_t size() const { return _records.size(); }
+    inline bool empty() const { return _records.empty(); }
+
+private:
+    /// <summary>
+    /// Validate record types and sort records
+    /// </summary>
+    /// <returns>Status code</returns>
+    NTSTATUS Finalize();
+
+private:
+    std::vector<Record> _records;   // Records, sorted by type and RVA
+};
+
+}
+
+}
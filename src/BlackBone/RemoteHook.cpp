@@ -599,8 +599,9 @@ DWORD RemoteHook::StackBacktrace( ptr_t ip, ptr_t sp, Thread& thd, std::vector<s
         if (stack_val < _core.native()->minAddr() || original > _core.native()->maxAddr())
             continue;
 
-        // Check if memory is executable
-        if (_core.native()->VirtualQueryExT( original, &meminfo ) != STATUS_SUCCESS)
+        // Check if memory is executable. Target may have allocated code since map was filled, so query current state
+        _core.native()->regions().Invalidate( original, 1 );
+        if (_core.native()->regions().Query( original, meminfo ) != STATUS_SUCCESS)
             continue;
 
         if ( meminfo.AllocationProtect != PAGE_EXECUTE_READ &&
@@ -0,0 +1,794 @@
+#include "SimulatedMemory.h"
+#include "FileProjection.h"
+#include "PEView.h"
+#include "RelocationPlan.h"
+#include "Macro.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace blackbone
+{
+
+namespace
+{
+
+// Loader structures of simulated process, T is target pointer type.
+// Only fields used by loader list walkers are filled
+template<typename T>
+struct ListEntryT
+{
+    T Flink;
+    T Blink;
+};
+
+template<typename T>
+struct UnicodeStringT
+{
+    WORD Length;
+    WORD MaximumLength;
+    T Buffer;
+};
+
+template<typename T>
+struct PebT
+{
+    T Flags;
+    T Mutant;
+    T ImageBaseAddress;
+    T Ldr;
+};
+
+template<typename T>
+struct TebT
+{
+    T NtTib[7];
+    T EnvironmentPointer;
+    T ClientId[2];
+    T ActiveRpcHandle;
+    T ThreadLocalStoragePointer;
+    T ProcessEnvironmentBlock;
+};
+
+template<typename T>
+struct PebLdrDataT
+{
+    DWORD Length;
+    BYTE Initialized;
+    T SsHandle;
+    ListEntryT<T> InLoadOrderModuleList;
+    ListEntryT<T> InMemoryOrderModuleList;
+    ListEntryT<T> InInitializationOrderModuleList;
+};
+
+template<typename T>
+struct LdrEntryT
+{
+    ListEntryT<T> InLoadOrderLinks;
+    ListEntryT<T> InMemoryOrderLinks;
+    ListEntryT<T> InInitializationOrderLinks;
+    T DllBase;
+    T EntryPoint;
+    DWORD SizeOfImage;
+    UnicodeStringT<T> FullDllName;
+    UnicodeStringT<T> BaseDllName;
+    DWORD Flags;
+    WORD LoadCount;
+    WORD TlsIndex;
+    ListEntryT<T> HashLinks;
+    DWORD TimeDateStamp;
+};
+
+static_assert(offsetof( TebT<DWORD>, ProcessEnvironmentBlock ) == 0x30, "Bad TEB32 layout");
+static_assert(offsetof( TebT<DWORD64>, ProcessEnvironmentBlock ) == 0x60, "Bad TEB64 layout");
+static_assert(offsetof( PebLdrDataT<DWORD64>, InLoadOrderModuleList ) == 0x10, "Bad PEB_LDR_DATA64 layout");
+static_assert(offsetof( LdrEntryT<DWORD>, FullDllName ) == 0x24, "Bad LDR_DATA_TABLE_ENTRY32 layout");
+static_assert(offsetof( LdrEntryT<DWORD64>, FullDllName ) == 0x48, "Bad LDR_DATA_TABLE_ENTRY64 layout");
+
+// Arena block size, bigger allocations get dedicated block
+const size_t ArenaBlockSize = 16 * 1024 * 1024;
+
+inline ptr_t PageDown( ptr_t value ) { return value & ~(SimulatedMemory::PageSize - 1); }
+inline ptr_t PageUp( ptr_t value ) { return PageDown( value + SimulatedMemory::PageSize - 1 ); }
+
+/// <summary>
+/// Check if page contents can be accessed
+/// </summary>
+/// <param name="protect">Page protection, 0 - reserved</param>
+/// <returns>true if accessible</returns>
+inline bool Accessible( DWORD protect )
+{
+    return protect != 0 && (protect & (PAGE_NOACCESS | PAGE_GUARD)) == 0;
+}
+
+/// <summary>
+/// Get page protection of image section
+/// </summary>
+/// <param name="characteristics">Section characteristics</param>
+/// <returns>Page protection</returns>
+DWORD SectionProtection( DWORD characteristics )
+{
+    bool exec = (characteristics & IMAGE_SCN_MEM_EXECUTE) != 0;
+    bool write = (characteristics & IMAGE_SCN_MEM_WRITE) != 0;
+    bool read = (characteristics & IMAGE_SCN_MEM_READ) != 0;
+
+    if (exec)
+        return write ? PAGE_EXECUTE_READWRITE : (read ? PAGE_EXECUTE_READ : PAGE_EXECUTE);
+
+    return write ? PAGE_READWRITE : (read ? PAGE_READONLY : PAGE_NOACCESS);
+}
+
+}
+
+SimulatedMemory::SimulatedMemory( bool is64 )
+    : _is64( is64 )
+{
+    for (int i = 0; i < sim_callCount; i++)
+    {
+        _delay[i].store( 0 );
+        _calls[i].store( 0 );
+    }
+
+    // PEB page followed by PEB_LDR_DATA page
+    AllocateLocked( _peb, 2 * PageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, MEM_PRIVATE );
+    _ldr = _peb + PageSize;
+
+    if (_is64)
+        InitLoaderT<DWORD64>();
+    else
+        InitLoaderT<DWORD>();
+}
+
+SimulatedMemory::~SimulatedMemory()
+{
+}
+
+/// <summary>
+/// Allocate or commit memory
+/// </summary>
+/// <param name="address">Desired address, 0 - any. Receives page-aligned region base</param>
+/// <param name="size">Region size</param>
+/// <param name="allocType">MEM_RESERVE and/or MEM_COMMIT</param>
+/// <param name="protect">Memory protection</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedMemory::Allocate( ptr_t& address, ptr_t size, DWORD allocType, DWORD protect )
+{
+    Delay( sim_alloc );
+
+    std::lock_guard<std::mutex> lg( _lock );
+    return AllocateLocked( address, size, allocType, protect, MEM_PRIVATE );
+}
+
+/// <summary>
+/// Release or decommit memory
+/// </summary>
+/// <param name="address">Region address</param>
+/// <param name="size">Region size, ignored for MEM_RELEASE. 0 - up to the end of allocation</param>
+/// <param name="freeType">MEM_RELEASE or MEM_DECOMMIT</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedMemory::Free( ptr_t address, ptr_t size, DWORD freeType )
+{
+    Delay( sim_free );
+
+    std::lock_guard<std::mutex> lg( _lock );
+
+    auto iter = Find( address );
+    if (iter == _allocations.end())
+        return STATUS_INVALID_ADDRESS;
+
+    if (freeType & MEM_RELEASE)
+    {
+        if (address != iter->first)
+            return STATUS_FREE_VM_NOT_AT_BASE;
+
+        _allocations.erase( iter );
+        return STATUS_SUCCESS;
+    }
+
+    if (!(freeType & MEM_DECOMMIT))
+        return STATUS_INVALID_PARAMETER;
+
+    auto& alloc = iter->second;
+    ptr_t start = PageDown( address ) - iter->first;
+    ptr_t end = size != 0 ? PageUp( address + size ) - iter->first : alloc.size;
+    if (end > alloc.size)
+        return STATUS_INVALID_PARAMETER;
+
+    // Recommitted pages must be zeroed
+    memset( alloc.data + start, 0, static_cast<size_t>(end - start) );
+    std::fill( alloc.pages.begin() + static_cast<size_t>(start / PageSize), alloc.pages.begin() + static_cast<size_t>(end / PageSize), 0 );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Change protection of committed pages
+/// </summary>
+/// <param name="address">Region address</param>
+/// <param name="size">Region size</param>
+/// <param name="protect">New protection</param>
+/// <param name="pOld">Old protection of the first page</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedMemory::Protect( ptr_t address, ptr_t size, DWORD protect, DWORD* pOld /*= nullptr*/ )
+{
+    Delay( sim_protect );
+
+    std::lock_guard<std::mutex> lg( _lock );
+
+    auto iter = Find( address );
+    if (iter == _allocations.end() || protect == 0)
+        return iter == _allocations.end() ? STATUS_NOT_COMMITTED : STATUS_INVALID_PARAMETER;
+
+    auto& alloc = iter->second;
+    size_t first = static_cast<size_t>((PageDown( address ) - iter->first) / PageSize);
+    size_t last = static_cast<size_t>((PageUp( address + std::max<ptr_t>( size, 1 ) ) - iter->first) / PageSize);
+    if (last > alloc.pages.size())
+        return STATUS_NOT_COMMITTED;
+
+    if (std::find( alloc.pages.begin() + first, alloc.pages.begin() + last, 0 ) != alloc.pages.begin() + last)
+        return STATUS_NOT_COMMITTED;
+
+    if (pOld)
+        *pOld = alloc.pages[first];
+
+    std::fill( alloc.pages.begin() + first, alloc.pages.begin() + last, protect );
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Read memory. Stops at first page that isn't committed or is PAGE_NOACCESS/PAGE_GUARD
+/// </summary>
+/// <param name="address">Memory address</param>
+/// <param name="buffer">Output buffer</param>
+/// <param name="size">Number of bytes to read</param>
+/// <param name="pDone">Number of bytes read</param>
+/// <returns>STATUS_SUCCESS if whole range was read, STATUS_PARTIAL_COPY otherwise</returns>
+NTSTATUS SimulatedMemory::Read( ptr_t address, void* buffer, size_t size, size_t* pDone /*= nullptr*/ )
+{
+    Delay( sim_read );
+
+    std::lock_guard<std::mutex> lg( _lock );
+
+    size_t done = CopyLocked( address, reinterpret_cast<uint8_t*>(buffer), size, false );
+    if (pDone)
+        *pDone = done;
+
+    return done == size ? STATUS_SUCCESS : STATUS_PARTIAL_COPY;
+}
+
+/// <summary>
+/// Write memory. Read-only pages are written too, same as debugger write
+/// </summary>
+/// <param name="address">Memory address</param>
+/// <param name="buffer">Data to write</param>
+/// <param name="size">Number of bytes to write</param>
+/// <param name="pDone">Number of bytes written</param>
+/// <returns>STATUS_SUCCESS if whole range was written, STATUS_PARTIAL_COPY otherwise</returns>
+NTSTATUS SimulatedMemory::Write( ptr_t address, const void* buffer, size_t size, size_t* pDone /*= nullptr*/ )
+{
+    Delay( sim_write );
+
+    std::lock_guard<std::mutex> lg( _lock );
+
+    size_t done = CopyLocked( address, const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(buffer)), size, true );
+    if (pDone)
+        *pDone = done;
+
+    return done == size ? STATUS_SUCCESS : STATUS_PARTIAL_COPY;
+}
+
+/// <summary>
+/// Get memory region info
+/// </summary>
+/// <param name="address">Address to query</param>
+/// <param name="mbi">Region info, BaseAddress is page containing address</param>
+/// <returns>Status code, STATUS_INVALID_PARAMETER past the end of address space</returns>
+NTSTATUS SimulatedMemory::Query( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi )
+{
+    Delay( sim_query );
+
+    if (address >= maxAddr())
+        return STATUS_INVALID_PARAMETER;
+
+    std::lock_guard<std::mutex> lg( _lock );
+
+    memset( &mbi, 0, sizeof(mbi) );
+    mbi.BaseAddress = PageDown( address );
+
+    auto iter = Find( address );
+    if (iter == _allocations.end())
+    {
+        auto next = _allocations.upper_bound( address );
+
+        mbi.RegionSize = (next != _allocations.end() ? next->first : maxAddr()) - mbi.BaseAddress;
+        mbi.State = MEM_FREE;
+        mbi.Protect = PAGE_NOACCESS;
+        return STATUS_SUCCESS;
+    }
+
+    // Run of pages with the same protection
+    auto& alloc = iter->second;
+    size_t first = static_cast<size_t>((mbi.BaseAddress - iter->first) / PageSize);
+    size_t last = first;
+    while (last < alloc.pages.size() && alloc.pages[last] == alloc.pages[first])
+        last++;
+
+    mbi.AllocationBase = iter->first;
+    mbi.AllocationProtect = alloc.allocProtect;
+    mbi.RegionSize = (last - first) * PageSize;
+    mbi.State = alloc.pages[first] != 0 ? MEM_COMMIT : MEM_RESERVE;
+    mbi.Protect = alloc.pages[first];
+    mbi.Type = alloc.type;
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Lay out image file at chosen base, apply relocations and section protection.
+/// Image is appended to PEB loader lists
+/// </summary>
+/// <param name="path">Image path</param>
+/// <param name="base">Image base, 0 - preferred base. Receives actual base</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedMemory::LoadImage( const std::wstring& path, ptr_t& base )
+{
+    FileProjection file;
+    if (file.Project( path ) == nullptr)
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+
+    // Projection already laid out sections by RVA
+    pe::PEView view;
+    if (file.isPlainData() || view.Attach( file.base(), file.size(), false ) != STATUS_SUCCESS || view.is64() != _is64)
+        return STATUS_INVALID_IMAGE_FORMAT;
+
+    if (base == 0)
+        base = view.imageBase();
+
+    if (base % AllocationGranularity != 0)
+        return STATUS_INVALID_PARAMETER;
+
+    std::lock_guard<std::mutex> lg( _lock );
+
+    NTSTATUS status = AllocateLocked( base, view.imageSize(), MEM_RESERVE | MEM_COMMIT, PAGE_READONLY, MEM_IMAGE );
+    if (status != STATUS_SUCCESS)
+        return status;
+
+    auto& alloc = _allocations[base];
+    memcpy( alloc.data, file.base(), std::min<size_t>( file.size(), view.imageSize() ) );
+
+    // Rebase
+    if (base != view.imageBase())
+    {
+        auto dir = view.Directory( IMAGE_DIRECTORY_ENTRY_BASERELOC );
+
+        pe::RelocationPlan relocs;
+        if (dir.Size == 0 || view.ResolveRVA( dir.VirtualAddress, dir.Size ) == nullptr
+            || relocs.Build( alloc.data + dir.VirtualAddress, dir.Size ) != STATUS_SUCCESS
+            || relocs.Apply( alloc.data, view.imageSize(), base - view.imageBase() ) != STATUS_SUCCESS)
+        {
+            _allocations.erase( base );
+            return STATUS_CONFLICTING_ADDRESSES;
+        }
+
+        // Loader updates image base in headers
+        DWORD ntOffset = 0;
+        memcpy( &ntOffset, alloc.data + offsetof( IMAGE_DOS_HEADER, e_lfanew ), sizeof(ntOffset) );
+
+        if (_is64)
+            memcpy( alloc.data + ntOffset + offsetof( IMAGE_NT_HEADERS64, OptionalHeader.ImageBase ), &base, sizeof(DWORD64) );
+        else
+            memcpy( alloc.data + ntOffset + offsetof( IMAGE_NT_HEADERS32, OptionalHeader.ImageBase ), &base, sizeof(DWORD) );
+    }
+
+    // Section protection, headers stay read-only
+    for (auto& secRef : view.sections())
+    {
+        IMAGE_SECTION_HEADER sec;
+        memcpy( &sec, &secRef, sizeof(sec) );
+
+        ptr_t end = PageUp( sec.VirtualAddress + std::max<DWORD>( sec.Misc.VirtualSize, sec.SizeOfRawData ) );
+        size_t first = static_cast<size_t>(sec.VirtualAddress / PageSize);
+        size_t last = std::min<size_t>( static_cast<size_t>(end / PageSize), alloc.pages.size() );
+
+        for (size_t i = first; i < last; i++)
+            alloc.pages[i] = SectionProtection( sec.Characteristics );
+    }
+
+    Module mod = { base, view.imageSize(), path, 0 };
+    ptr_t entryPoint = view.entryPointRVA() != 0 ? base + view.entryPointRVA() : 0;
+
+    mod.ldrEntry = _is64 ? CreateEntryT<DWORD64>( mod, entryPoint ) : CreateEntryT<DWORD>( mod, entryPoint );
+    if (mod.ldrEntry == 0)
+    {
+        _allocations.erase( base );
+        return STATUS_NO_MEMORY;
+    }
+
+    // First executable becomes process image
+    if (view.IsExe())
+    {
+        ptr_t imageBase = 0;
+        ptr_t offset = _is64 ? offsetof( PebT<DWORD64>, ImageBaseAddress ) : offsetof( PebT<DWORD>, ImageBaseAddress );
+        size_t ptrSize = _is64 ? sizeof(DWORD64) : sizeof(DWORD);
+
+        CopyLocked( _peb + offset, reinterpret_cast<uint8_t*>(&imageBase), ptrSize, false );
+        if (imageBase == 0)
+            CopyLocked( _peb + offset, reinterpret_cast<uint8_t*>(&base), ptrSize, true );
+    }
+
+    _modules.emplace_back( mod );
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Create thread environment block
+/// </summary>
+/// <param name="id">Thread ID</param>
+/// <param name="teb">Created TEB address</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedMemory::CreateThread( uint32_t id, ptr_t& teb )
+{
+    std::lock_guard<std::mutex> lg( _lock );
+
+    if (FindThread( id ) != nullptr)
+        return STATUS_INVALID_PARAMETER;
+
+    teb = 0;
+    NTSTATUS status = AllocateLocked( teb, 2 * PageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, MEM_PRIVATE );
+    if (status != STATUS_SUCCESS)
+        return status;
+
+    if (_is64)
+    {
+        TebT<DWORD64> data = { { 0 } };
+        data.NtTib[6] = teb;
+        data.ClientId[1] = id;
+        data.ProcessEnvironmentBlock = _peb;
+        CopyLocked( teb, reinterpret_cast<uint8_t*>(&data), sizeof(data), true );
+    }
+    else
+    {
+        TebT<DWORD> data = { { 0 } };
+        data.NtTib[6] = static_cast<DWORD>(teb);
+        data.ClientId[1] = id;
+        data.ProcessEnvironmentBlock = static_cast<DWORD>(_peb);
+        CopyLocked( teb, reinterpret_cast<uint8_t*>(&data), sizeof(data), true );
+    }
+
+    Thread thread = { id, teb };
+    _threads.emplace_back( thread );
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Find thread by ID
+/// </summary>
+/// <param name="id">Thread ID</param>
+/// <returns>Thread, nullptr if not found</returns>
+const SimulatedMemory::Thread* SimulatedMemory::FindThread( uint32_t id ) const
+{
+    for (auto& thread : _threads)
+        if (thread.id == id)
+            return &thread;
+
+    return nullptr;
+}
+
+/// <summary>
+/// Set delay of simulated call
+/// </summary>
+/// <param name="call">Call type</param>
+/// <param name="delayNs">Delay in nanoseconds, 0 - none</param>
+void SimulatedMemory::SetLatency( eSimCall call, uint64_t delayNs )
+{
+    _delay[call].store( delayNs );
+}
+
+/// <summary>
+/// Get number of simulated calls since creation or last ResetCounters
+/// </summary>
+/// <param name="call">Call type</param>
+/// <returns>Call count</returns>
+uint64_t SimulatedMemory::calls( eSimCall call ) const
+{
+    return _calls[call].load();
+}
+
+/// <summary>
+/// Reset call counters
+/// </summary>
+void SimulatedMemory::ResetCounters()
+{
+    for (auto& counter : _calls)
+        counter.store( 0 );
+}
+
+/// <summary>
+/// Get storage from arena
+/// </summary>
+/// <param name="size">Storage size</param>
+/// <returns>Zeroed storage</returns>
+uint8_t* SimulatedMemory::ArenaAlloc( size_t size )
+{
+    if (size > ArenaBlockSize / 4)
+    {
+        _arena.emplace_back( new uint8_t[size]() );
+        return _arena.back().get();
+    }
+
+    if (static_cast<size_t>(_arenaEnd - _arenaPos) < size)
+    {
+        _arena.emplace_back( new uint8_t[ArenaBlockSize]() );
+        _arenaPos = _arena.back().get();
+        _arenaEnd = _arenaPos + ArenaBlockSize;
+    }
+
+    uint8_t* ptr = _arenaPos;
+    _arenaPos += size;
+
+    return ptr;
+}
+
+/// <summary>
+/// Find allocation containing address
+/// </summary>
+/// <param name="address">Target address</param>
+/// <returns>Allocation, _allocations.end() if address is free</returns>
+SimulatedMemory::mapAllocations::iterator SimulatedMemory::Find( ptr_t address )
+{
+    auto iter = _allocations.upper_bound( address );
+    if (iter == _allocations.begin())
+        return _allocations.end();
+
+    --iter;
+    return address < iter->first + iter->second.size ? iter : _allocations.end();
+}
+
+/// <summary>
+/// Allocate memory without delay and call counting
+/// </summary>
+/// <param name="address">Desired address, 0 - any. Receives page-aligned region base</param>
+/// <param name="size">Region size</param>
+/// <param name="allocType">MEM_RESERVE and/or MEM_COMMIT</param>
+/// <param name="protect">Memory protection</param>
+/// <param name="type">MEM_PRIVATE or MEM_IMAGE</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedMemory::AllocateLocked( ptr_t& address, ptr_t size, DWORD allocType, DWORD protect, DWORD type )
+{
+    if (size == 0 || protect == 0 || !(allocType & (MEM_RESERVE | MEM_COMMIT)))
+        return STATUS_INVALID_PARAMETER;
+
+    // Commit inside existing allocation
+    if (!(allocType & MEM_RESERVE) && address != 0)
+    {
+        auto iter = Find( address );
+        if (iter == _allocations.end() || PageUp( address + size ) - iter->first > iter->second.size)
+            return STATUS_INVALID_ADDRESS;
+
+        auto& pages = iter->second.pages;
+        size_t first = static_cast<size_t>((PageDown( address ) - iter->first) / PageSize);
+        size_t last = static_cast<size_t>((PageUp( address + size ) - iter->first) / PageSize);
+
+        for (size_t i = first; i < last; i++)
+            if (pages[i] == 0)
+                pages[i] = protect;
+
+        address = PageDown( address );
+        return STATUS_SUCCESS;
+    }
+
+    ptr_t base = address & ~(AllocationGranularity - 1);
+    if (address != 0)
+    {
+        size = PageUp( address + size ) - base;
+
+        if (base < minAddr() || base + size > maxAddr())
+            return STATUS_INVALID_PARAMETER;
+
+        auto next = _allocations.lower_bound( base );
+        if (Find( base ) != _allocations.end() || (next != _allocations.end() && next->first < base + size))
+            return STATUS_CONFLICTING_ADDRESSES;
+    }
+    else
+    {
+        // First fit from the bottom of address space
+        size = PageUp( size );
+        base = minAddr();
+
+        for (auto& item : _allocations)
+        {
+            if (item.first >= base + size)
+                break;
+
+            base = (item.first + item.second.size + AllocationGranularity - 1) & ~(AllocationGranularity - 1);
+        }
+
+        if (base + size > maxAddr())
+            return STATUS_NO_MEMORY;
+    }
+
+    Allocation alloc;
+    alloc.size = size;
+    alloc.allocProtect = protect;
+    alloc.type = type;
+    alloc.data = ArenaAlloc( static_cast<size_t>(size) );
+    alloc.pages.assign( static_cast<size_t>(size / PageSize), (allocType & MEM_COMMIT) ? protect : 0 );
+
+    _allocations.emplace( base, std::move( alloc ) );
+    address = base;
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Copy memory between buffer and address space
+/// </summary>
+/// <param name="address">Memory address</param>
+/// <param name="buffer">Local buffer</param>
+/// <param name="size">Number of bytes</param>
+/// <param name="write">Copy from buffer into address space</param>
+/// <returns>Number of bytes copied</returns>
+size_t SimulatedMemory::CopyLocked( ptr_t address, uint8_t* buffer, size_t size, bool write )
+{
+    size_t done = 0;
+
+    while (done < size)
+    {
+        ptr_t current = address + done;
+        auto iter = Find( current );
+        if (iter == _allocations.end())
+            break;
+
+        // Accessible pages in a row
+        auto& alloc = iter->second;
+        size_t offset = static_cast<size_t>(current - iter->first);
+        size_t page = offset / PageSize;
+        size_t last = page;
+
+        while (last < alloc.pages.size() && Accessible( alloc.pages[last] ) && last * PageSize < offset + (size - done))
+            last++;
+
+        if (last == page)
+            break;
+
+        size_t chunk = std::min<size_t>( last * PageSize - offset, size - done );
+        if (write)
+            memcpy( alloc.data + offset, buffer + done, chunk );
+        else
+            memcpy( buffer + done, alloc.data + offset, chunk );
+
+        done += chunk;
+    }
+
+    return done;
+}
+
+/// <summary>
+/// Fill PEB_LDR_DATA with empty lists and link it to PEB
+/// </summary>
+template<typename T>
+void SimulatedMemory::InitLoaderT()
+{
+    PebLdrDataT<T> ldr = { 0 };
+    ldr.Length = sizeof(ldr);
+    ldr.Initialized = 1;
+
+    ListEntryT<T>* lists[] = { &ldr.InLoadOrderModuleList, &ldr.InMemoryOrderModuleList, &ldr.InInitializationOrderModuleList };
+    for (auto list : lists)
+        list->Flink = list->Blink = static_cast<T>(_ldr + (reinterpret_cast<uint8_t*>(list) - reinterpret_cast<uint8_t*>(&ldr)));
+
+    T ldrPtr = static_cast<T>(_ldr);
+    CopyLocked( _ldr, reinterpret_cast<uint8_t*>(&ldr), sizeof(ldr), true );
+    CopyLocked( _peb + offsetof( PebT<T>, Ldr ), reinterpret_cast<uint8_t*>(&ldrPtr), sizeof(ldrPtr), true );
+}
+
+/// <summary>
+/// Link loader entry at the tail of PEB_LDR_DATA lists
+/// </summary>
+/// <param name="entry">LDR_DATA_TABLE_ENTRY address</param>
+template<typename T>
+void SimulatedMemory::LinkEntryT( ptr_t entry )
+{
+    const std::pair<size_t, size_t> lists[] =
+    {
+        { offsetof( PebLdrDataT<T>, InLoadOrderModuleList ), offsetof( LdrEntryT<T>, InLoadOrderLinks ) },
+        { offsetof( PebLdrDataT<T>, InMemoryOrderModuleList ), offsetof( LdrEntryT<T>, InMemoryOrderLinks ) },
+        { offsetof( PebLdrDataT<T>, InInitializationOrderModuleList ), offsetof( LdrEntryT<T>, InInitializationOrderLinks ) },
+    };
+
+    for (auto& list : lists)
+    {
+        ListEntryT<T> head = { 0 };
+        ptr_t headPtr = _ldr + list.first;
+        T link = static_cast<T>(entry + list.second);
+
+        CopyLocked( headPtr, reinterpret_cast<uint8_t*>(&head), sizeof(head), false );
+
+        // entry->Blink = tail, entry->Flink = head, tail->Flink = entry, head->Blink = entry
+        ListEntryT<T> links = { static_cast<T>(headPtr), head.Blink };
+        CopyLocked( link, reinterpret_cast<uint8_t*>(&links), sizeof(links), true );
+        CopyLocked( head.Blink + offsetof( ListEntryT<T>, Flink ), reinterpret_cast<uint8_t*>(&link), sizeof(link), true );
+        CopyLocked( headPtr + offsetof( ListEntryT<T>, Blink ), reinterpret_cast<uint8_t*>(&link), sizeof(link), true );
+    }
+}
+
+/// <summary>
+/// Create LDR_DATA_TABLE_ENTRY for loaded image
+/// </summary>
+/// <param name="mod">Loaded image</param>
+/// <param name="entryPoint">Image entry point</param>
+/// <returns>Entry address, 0 if failed</returns>
+template<typename T>
+ptr_t SimulatedMemory::CreateEntryT( const Module& mod, ptr_t entryPoint )
+{
+    // Path is stored as UTF-16 right after the entry
+    std::vector<WORD> path;
+    size_t nameStart = 0;
+
+    for (auto ch : mod.path)
+    {
+        uint32_t code = static_cast<uint32_t>(ch);
+        if (code > 0xFFFF)
+        {
+            code -= 0x10000;
+            path.push_back( static_cast<WORD>(0xD800 + (code >> 10)) );
+            path.push_back( static_cast<WORD>(0xDC00 + (code & 0x3FF)) );
+        }
+        else
+            path.push_back( static_cast<WORD>(code) );
+
+        if (ch == L'\\' || ch == L'/')
+            nameStart = path.size();
+    }
+
+    path.push_back( 0 );
+
+    ptr_t entry = 0;
+    size_t pathBytes = path.size() * sizeof(WORD);
+    if (pathBytes > 0xFFFF || AllocateLocked( entry, sizeof(LdrEntryT<T>) + pathBytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, MEM_PRIVATE ) != STATUS_SUCCESS)
+        return 0;
+
+    LdrEntryT<T> data;
+    memset( &data, 0, sizeof(data) );
+
+    ptr_t pathPtr = entry + sizeof(data);
+
+    data.DllBase = static_cast<T>(mod.base);
+    data.EntryPoint = static_cast<T>(entryPoint);
+    data.SizeOfImage = mod.size;
+    data.FullDllName.Length = static_cast<WORD>(pathBytes - sizeof(WORD));
+    data.FullDllName.MaximumLength = static_cast<WORD>(pathBytes);
+    data.FullDllName.Buffer = static_cast<T>(pathPtr);
+    data.BaseDllName.Length = static_cast<WORD>((path.size() - 1 - nameStart) * sizeof(WORD));
+    data.BaseDllName.MaximumLength = static_cast<WORD>((path.size() - nameStart) * sizeof(WORD));
+    data.BaseDllName.Buffer = static_cast<T>(pathPtr + nameStart * sizeof(WORD));
+    data.LoadCount = 0xFFFF;
+
+    CopyLocked( entry, reinterpret_cast<uint8_t*>(&data), sizeof(data), true );
+    CopyLocked( pathPtr, reinterpret_cast<uint8_t*>(path.data()), pathBytes, true );
+    LinkEntryT<T>( entry );
+
+    return entry;
+}
+
+/// <summary>
+/// Spin for configured delay
+/// </summary>
+/// <param name="call">Call type</param>
+void SimulatedMemory::Delay( eSimCall call )
+{
+    _calls[call].fetch_add( 1 );
+
+    uint64_t delay = _delay[call].load();
+    if (delay == 0)
+        return;
+
+    // Sleep granularity is too coarse for syscall-sized delays
+    auto until = std::chrono::high_resolution_clock::now() + std::chrono::nanoseconds( delay );
+    while (std::chrono::high_resolution_clock::now() < until)
+        ;
+}
+
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace blackbone
+{
+
+// Simulated call, used to assign latency and count calls
+enum eSimCall
+{
+    sim_read = 0,   // Read
+    sim_write,      // Write
+    sim_query,      // Query
+    sim_alloc,      // Allocate
+    sim_free,       // Free
+    sim_protect,    // Protect
+
+    sim_callCount
+};
+
+/// <summary>
+/// Sparse in-memory address space of fake process.
+/// Allocations follow VirtualAlloc rules and are backed by bump arena,
+/// released storage is returned to the arena only on destruction.
+/// Images are laid out from files and linked into fake PEB loader lists.
+/// Every public call can be delayed to mimic cost of a real system call.
+/// Setup calls (LoadImage, CreateThread) are expected before the space is shared between threads
+/// </summary>
+class SimulatedMemory
+{
+public:
+    // Simulated thread
+    struct Thread
+    {
+        uint32_t id;        // Thread ID
+        ptr_t teb;          // TEB address
+    };
+
+    // Loaded image
+    struct Module
+    {
+        ptr_t base;             // Image base
+        uint32_t size;          // Image size
+        std::wstring path;      // Full image path
+        ptr_t ldrEntry;         // Loader entry address
+    };
+
+    static const ptr_t PageSize = 0x1000;
+    static const ptr_t AllocationGranularity = 0x10000;
+
+public:
+    /// <summary>
+    /// Create address space with PEB and empty loader lists
+    /// </summary>
+    /// <param name="is64">Simulate 64 bit process</param>
+    SimulatedMemory( bool is64 );
+    ~SimulatedMemory();
+
+    /// <summary>
+    /// Allocate or commit memory
+    /// </summary>
+    /// <param name="address">Desired address, 0 - any. Receives page-aligned region base</param>
+    /// <param name="size">Region size</param>
+    /// <param name="allocType">MEM_RESERVE and/or MEM_COMMIT</param>
+    /// <param name="protect">Memory protection</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Allocate( ptr_t& address, ptr_t size, DWORD allocType, DWORD protect );
+
+    /// <summary>
+    /// Release or decommit memory
+    /// </summary>
+    /// <param name="address">Region address</param>
+    /// <param name="size">Region size, ignored for MEM_RELEASE. 0 - up to the end of allocation</param>
+    /// <param name="freeType">MEM_RELEASE or MEM_DECOMMIT</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Free( ptr_t address, ptr_t size, DWORD freeType );
+
+    /// <summary>
+    /// Change protection of committed pages
+    /// </summary>
+    /// <param name="address">Region address</param>
+    /// <param name="size">Region size</param>
+    /// <param name="protect">New protection</param>
+    /// <param name="pOld">Old protection of the first page</param>
+    /// <returns>Status code</returns>
+    NTSTATUS Protect( ptr_t address, ptr_t size, DWORD protect, DWORD* pOld = nullptr );
+
+    /// <summary>
+    /// Read memory. Stops at first page that isn't committed or is PAGE_NOACCESS/PAGE_GUARD
+    /// </summary>
+    /// <param name="address">Memory address</param>
+    /// <param name="buffer">Output buffer</param>
+    /// <param name="size">Number of bytes to read</param>
+    /// <param name="pDone">Number of bytes read</param>
+    /// <returns>STATUS_SUCCESS if whole range was read, STATUS_PARTIAL_COPY otherwise</returns>
+    NTSTATUS Read( ptr_t address, void* buffer, size_t size, size_t* pDone = nullptr );
+
+    /// <summary>
+    /// Write memory. Read-only pages are written too, same as debugger write
+    /// </summary>
+    /// <param name="address">Memory address</param>
+    /// <param name="buffer">Data to write</param>
+    /// <param name="size">Number of bytes to write</param>
+    /// <param name="pDone">Number of bytes written</param>
+    /// <returns>STATUS_SUCCESS if whole range was written, STATUS_PARTIAL_COPY otherwise</returns>
+    NTSTATUS Write( ptr_t address, const void* buffer, size_t size, size_t* pDone = nullptr );
+
+    /// <summary>
+    /// Get memory region info
+    /// </summary>
+    /// <param name="address">Address to query</param>
+    /// <param name="mbi">Region info, BaseAddress is page containing address</param>
+    /// <returns>Status code, STATUS_INVALID_PARAMETER past the end of address space</returns>
+    NTSTATUS Query( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi );
+
+    /// <summary>
+    /// Lay out image file at chosen base, apply relocations and section protection.
+    /// Image is appended to PEB loader lists
+    /// </summary>
+    /// <param name="path">Image path</param>
+    /// <param name="base">Image base, 0 - preferred base. Receives actual base</param>
+    /// <returns>Status code</returns>
+    NTSTATUS LoadImage( const std::wstring& path, ptr_t& base );
+
+    /// <summary>
+    /// Create thread environment block
+    /// </summary>
+    /// <param name="id">Thread ID</param>
+    /// <param name="teb">Created TEB address</param>
+    /// <returns>Status code</returns>
+    NTSTATUS CreateThread( uint32_t id, ptr_t& teb );
+
+    /// <summary>
+    /// Find thread by ID
+    /// </summary>
+    /// <param name="id">Thread ID</param>
+    /// <returns>Thread, nullptr if not found</returns>
+    const Thread* FindThread( uint32_t id ) const;
+
+    /// <summary>
+    /// Set delay of simulated call
+    /// </summary>
+    /// <param name="call">Call type</param>
+    /// <param name="delayNs">Delay in nanoseconds, 0 - none</param>
+    void SetLatency( eSimCall call, uint64_t delayNs );
+
+    /// <summary>
+    /// Get number of simulated calls since creation or last ResetCounters
+    /// </summary>
+    /// <param name="call">Call type</param>
+    /// <returns>Call count</returns>
+    uint64_t calls( eSimCall call ) const;
+
+    /// <summary>
+    /// Reset call counters
+    /// </summary>
+    void ResetCounters();
+
+    inline bool is64() const { return _is64; }
+    inline ptr_t peb() const { return _peb; }
+    inline ptr_t minAddr() const { return 0x10000; }
+    inline ptr_t maxAddr() const { return _is64 ? 0x7FFFFFFF0000 : 0x7FFF0000; }
+    inline const std::vector<Module>& modules() const { return _modules; }
+    inline const std::vector<Thread>& threads() const { return _threads; }
+
+private:
+    // Single allocation
+    struct Allocation
+    {
+        ptr_t size;                 // Reserved size
+        DWORD allocProtect;         // Protection passed on reserve
+        DWORD type;                 // MEM_PRIVATE or MEM_IMAGE
+        uint8_t* data;              // Arena storage
+        std::vector<DWORD> pages;   // Page protection, 0 - reserved page
+    };
+
+    typedef std::map<ptr_t, Allocation> mapAllocations;
+
+    /// <summary>
+    /// Get storage from arena
+    /// </summary>
+    /// <param name="size">Storage size</param>
+    /// <returns>Zeroed storage</returns>
+    uint8_t* ArenaAlloc( size_t size );
+
+    /// <summary>
+    /// Find allocation containing address
+    /// </summary>
+    /// <param name="address">Target address</param>
+    /// <returns>Allocation, _allocations.end() if address is free</returns>
+    mapAllocations::iterator Find( ptr_t address );
+
+    /// <summary>
+    /// Allocate memory without delay and call counting
+    /// </summary>
+    /// <param name="address">Desired address, 0 - any. Receives page-aligned region base</param>
+    /// <param name="size">Region size</param>
+    /// <param name="allocType">MEM_RESERVE and/or MEM_COMMIT</param>
+    /// <param name="protect">Memory protection</param>
+    /// <param name="type">MEM_PRIVATE or MEM_IMAGE</param>
+    /// <returns>Status code</returns>
+    NTSTATUS AllocateLocked( ptr_t& address, ptr_t size, DWORD allocType, DWORD protect, DWORD type );
+
+    /// <summary>
+    /// Copy memory between buffer and address space
+    /// </summary>
+    /// <param name="address">Memory address</param>
+    /// <param name="buffer">Local buffer</param>
+    /// <param name="size">Number of bytes</param>
+    /// <param name="write">Copy from buffer into address space</param>
+    /// <returns>Number of bytes copied</returns>
+    size_t CopyLocked( ptr_t address, uint8_t* buffer, size_t size, bool write );
+
+    /// <summary>
+    /// Fill PEB_LDR_DATA with empty lists and link it to PEB
+    /// </summary>
+    template<typename T>
+    void InitLoaderT();
+
+    /// <summary>
+    /// Link loader entry at the tail of PEB_LDR_DATA lists
+    /// </summary>
+    /// <param name="entry">LDR_DATA_TABLE_ENTRY address</param>
+    template<typename T>
+    void LinkEntryT( ptr_t entry );
+
+    /// <summary>
+    /// Create LDR_DATA_TABLE_ENTRY for loaded image
+    /// </summary>
+    /// <param name="mod">Loaded image</param>
+    /// <param name="entryPoint">Image entry point</param>
+    /// <returns>Entry address, 0 if failed</returns>
+    template<typename T>
+    ptr_t CreateEntryT( const Module& mod, ptr_t entryPoint );
+
+    /// <summary>
+    /// Spin for configured delay
+    /// </summary>
+    /// <param name="call">Call type</param>
+    void Delay( eSimCall call );
+
+private:
+    SimulatedMemory( const SimulatedMemory& ) = delete;
+    SimulatedMemory& operator =(const SimulatedMemory&) = delete;
+
+private:
+    bool _is64;                                         // Pointer size of simulated process
+    ptr_t _peb = 0;                                     // PEB address
+    ptr_t _ldr = 0;                                     // PEB_LDR_DATA address
+    mapAllocations _allocations;                        // Allocations by base address
+    std::vector<std::unique_ptr<uint8_t[]>> _arena;     // Arena blocks
+    uint8_t* _arenaPos = nullptr;                       // Free space of the last block
+    uint8_t* _arenaEnd = nullptr;                       // End of the last block
+    std::vector<Module> _modules;                       // Loaded images
+    std::vector<Thread> _threads;                       // Threads
+    std::mutex _lock;                                   // Address space lock
+    std::atomic<uint64_t> _delay[sim_callCount];        // Call delays, ns
+    std::atomic<uint64_t> _calls[sim_callCount];        // Call counters
+};
+
+}
@@ -0,0 +1,168 @@
+#include "SimulatedNative.h"
+#include "Macro.h"
+
+namespace blackbone
+{
+
+SimulatedNative::SimulatedNative( bool is64 )
+    : OfflineNative(
+        [this]( ptr_t address, std::wstring& path )
+        {
+            for (auto& mod : _memory.modules())
+            {
+                if (address >= mod.base && address < mod.base + mod.size)
+                {
+                    path = mod.path;
+                    return true;
+                }
+            }
+
+            return false;
+        },
+        [this]( uint32_t id )
+        {
+            auto pThread = _memory.FindThread( id );
+            return pThread != nullptr ? pThread->teb : 0;
+        } )
+    , _memory( is64 )
+{
+    // Barrier is defined by simulated process bitness
+    SetTargetBitness( is64 );
+}
+
+SimulatedNative::~SimulatedNative()
+{
+}
+
+/// <summary>
+/// Allocate virtual memory
+/// </summary>
+/// <param name="lpAddress">Allocation address</param>
+/// <param name="dwSize">Region size</param>
+/// <param name="flAllocationType">Allocation type</param>
+/// <param name="flProtect">Memory protection</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedNative::VirualAllocExT( ptr_t& lpAddress, size_t dwSize, DWORD flAllocationType, DWORD flProtect )
+{
+    NTSTATUS status = _memory.Allocate( lpAddress, dwSize, flAllocationType, flProtect );
+    if (status == STATUS_SUCCESS)
+        _regions.Invalidate( lpAddress, dwSize );
+
+    return LastNtStatus( status );
+}
+
+/// <summary>
+/// Free virtual memory
+/// </summary>
+/// <param name="lpAddress">Memory address</param>
+/// <param name="dwSize">Region size</param>
+/// <param name="dwFreeType">Memory release type.</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedNative::VirualFreeExT( ptr_t lpAddress, size_t dwSize, DWORD dwFreeType )
+{
+    NTSTATUS status = _memory.Free( lpAddress, dwSize, dwFreeType );
+    _regions.Invalidate( lpAddress, dwSize );
+
+    return LastNtStatus( status );
+}
+
+/// <summary>
+/// Change memory protection
+/// </summary>
+/// <param name="lpAddress">Memory address.</param>
+/// <param name="dwSize">Region size</param>
+/// <param name="flProtect">New protection.</param>
+/// <param name="flOld">Old protection</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedNative::VirtualProtectExT( ptr_t lpAddress, DWORD64 dwSize, DWORD flProtect, DWORD* flOld )
+{
+    NTSTATUS status = _memory.Protect( lpAddress, dwSize, flProtect, flOld );
+    _regions.Invalidate( lpAddress, static_cast<size_t>(dwSize) );
+
+    return LastNtStatus( status );
+}
+
+/// <summary>
+/// Read virtual memory
+/// </summary>
+/// <param name="lpBaseAddress">Memory address</param>
+/// <param name="lpBuffer">Output buffer</param>
+/// <param name="nSize">Number of bytes to read</param>
+/// <param name="lpBytes">Mumber of bytes read</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedNative::ReadProcessMemoryT( ptr_t lpBaseAddress, LPVOID lpBuffer, size_t nSize, DWORD64 *lpBytes /*= nullptr */ )
+{
+    size_t done = 0;
+    NTSTATUS status = _memory.Read( lpBaseAddress, lpBuffer, nSize, &done );
+
+    if (lpBytes)
+        *lpBytes = done;
+
+    return LastNtStatus( status );
+}
+
+/// <summary>
+/// Write virtual memory
+/// </summary>
+/// <param name="lpBaseAddress">Memory address</param>
+/// <param name="lpBuffer">Buffer to write</param>
+/// <param name="nSize">Number of bytes to read</param>
+/// <param name="lpBytes">Mumber of bytes read</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedNative::WriteProcessMemoryT( ptr_t lpBaseAddress, LPCVOID lpBuffer, size_t nSize, DWORD64 *lpBytes /*= nullptr */ )
+{
+    size_t done = 0;
+    NTSTATUS status = _memory.Write( lpBaseAddress, lpBuffer, nSize, &done );
+
+    if (lpBytes)
+        *lpBytes = done;
+
+    return LastNtStatus( status );
+}
+
+/// <summary>
+/// Query virtual memory
+/// </summary>
+/// <param name="lpAddress">Address to query</param>
+/// <param name="lpBuffer">Retrieved memory info</param>
+/// <returns>Status code</returns>
+NTSTATUS SimulatedNative::VirtualQueryExT( ptr_t lpAddress, PMEMORY_BASIC_INFORMATION64 lpBuffer )
+{
+    return LastNtStatus( _memory.Query( lpAddress, *lpBuffer ) );
+}
+
+/// <summary>
+/// Get PEB of 32 bit process
+/// </summary>
+/// <param name="ppeb">Retrieved PEB</param>
+/// <returns>PEB pointer</returns>
+ptr_t SimulatedNative::getPEB( _PEB32* ppeb )
+{
+    return _memory.is64() ? 0 : getPEBT<DWORD>( ppeb );
+}
+
+/// <summary>
+/// Get PEB of 64 bit process
+/// </summary>
+/// <param name="ppeb">Retrieved PEB</param>
+/// <returns>PEB pointer</returns>
+ptr_t SimulatedNative::getPEB( _PEB64* ppeb )
+{
+    return _memory.is64() ? getPEBT<DWORD64>( ppeb ) : 0;
+}
+
+/// <summary>
+/// Read simulated PEB
+/// </summary>
+/// <param name="ppeb">Retrieved PEB</param>
+/// <returns>PEB pointer</returns>
+template<typename T>
+ptr_t SimulatedNative::getPEBT( typename _PEB_T2<T>::type* ppeb )
+{
+    if (ppeb)
+        _memory.Read( _memory.peb(), ppeb, sizeof(*ppeb) );
+
+    return _memory.peb();
+}
+
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "OfflineNative.h"
+#include "SimulatedMemory.h"
+
+namespace blackbone
+{
+
+/// <summary>
+/// Simulated process subsystem. Memory calls are served by in-memory address space,
+/// so module, memory and search code can be tested and profiled without live target
+/// </summary>
+class SimulatedNative : public OfflineNative
+{
+public:
+    SimulatedNative( bool is64 );
+    ~SimulatedNative();
+
+    /// <summary>
+    /// Allocate virtual memory
+    /// </summary>
+    /// <param name="lpAddress">Allocation address</param>
+    /// <param name="dwSize">Region size</param>
+    /// <param name="flAllocationType">Allocation type</param>
+    /// <param name="flProtect">Memory protection</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS VirualAllocExT( ptr_t& lpAddress, size_t dwSize, DWORD flAllocationType, DWORD flProtect );
+
+    /// <summary>
+    /// Free virtual memory
+    /// </summary>
+    /// <param name="lpAddress">Memory address</param>
+    /// <param name="dwSize">Region size</param>
+    /// <param name="dwFreeType">Memory release type.</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS VirualFreeExT( ptr_t lpAddress, size_t dwSize, DWORD dwFreeType );
+
+    /// <summary>
+    /// Change memory protection
+    /// </summary>
+    /// <param name="lpAddress">Memory address.</param>
+    /// <param name="dwSize">Region size</param>
+    /// <param name="flProtect">New protection.</param>
+    /// <param name="flOld">Old protection</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS VirtualProtectExT( ptr_t lpAddress, DWORD64 dwSize, DWORD flProtect, DWORD* flOld );
+
+    /// <summary>
+    /// Read virtual memory
+    /// </summary>
+    /// <param name="lpBaseAddress">Memory address</param>
+    /// <param name="lpBuffer">Output buffer</param>
+    /// <param name="nSize">Number of bytes to read</param>
+    /// <param name="lpBytes">Mumber of bytes read</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS ReadProcessMemoryT( ptr_t lpBaseAddress, LPVOID lpBuffer, size_t nSize, DWORD64 *lpBytes = nullptr );
+
+    /// <summary>
+    /// Write virtual memory
+    /// </summary>
+    /// <param name="lpBaseAddress">Memory address</param>
+    /// <param name="lpBuffer">Buffer to write</param>
+    /// <param name="nSize">Number of bytes to read</param>
+    /// <param name="lpBytes">Mumber of bytes read</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS WriteProcessMemoryT( ptr_t lpBaseAddress, LPCVOID lpBuffer, size_t nSize, DWORD64 *lpBytes = nullptr );
+
+    /// <summary>
+    /// Query virtual memory
+    /// </summary>
+    /// <param name="lpAddress">Address to query</param>
+    /// <param name="lpBuffer">Retrieved memory info</param>
+    /// <returns>Status code</returns>
+    virtual NTSTATUS VirtualQueryExT( ptr_t lpAddress, PMEMORY_BASIC_INFORMATION64 lpBuffer );
+    using OfflineNative::VirtualQueryExT;
+
+    /// <summary>
+    /// Get PEB of 32 bit process
+    /// </summary>
+    /// <param name="ppeb">Retrieved PEB</param>
+    /// <returns>PEB pointer</returns>
+    virtual ptr_t getPEB( _PEB32* ppeb );
+
+    /// <summary>
+    /// Get PEB of 64 bit process
+    /// </summary>
+    /// <param name="ppeb">Retrieved PEB</param>
+    /// <returns>PEB pointer</returns>
+    virtual ptr_t getPEB( _PEB64* ppeb );
+
+    inline SimulatedMemory& memory() { return _memory; }
+
+private:
+    /// <summary>
+    /// Read simulated PEB
+    /// </summary>
+    /// <param name="ppeb">Retrieved PEB</param>
+    /// <returns>PEB pointer</returns>
+    template<typename T>
+    ptr_t getPEBT( typename _PEB_T2<T>::type* ppeb );
+
+private:
+    SimulatedMemory _memory;    // Address space
+};
+
+}
@@ -32,7 +32,8 @@ Thread ProcessThreads::CreateNew( ptr_t threadProc, ptr_t arg, DWORD flags /*= 0
 }
 
 /// <summary>
-/// Gets all process threads
+/// Gets all process threads.
+/// List is empty for offline targets
 /// </summary>
 /// <param name="dontUpdate">Return already existing thread list</param>
 /// <returns>Threads collection</returns>
@@ -41,10 +42,14 @@ std::vector<Thread>& ProcessThreads::getAll( bool dontUpdate /*= false*/ )
     if (dontUpdate)
         return _threads;
 
-    HANDLE hThreadSnapshot = CreateToolhelp32Snapshot( TH32CS_SNAPTHREAD, 0 );
-
     _threads.clear();
 
+    // Offline targets (e.g. minidump) have no live threads to open
+    if (_core.pid() == 0)
+        return _threads;
+
+    HANDLE hThreadSnapshot = CreateToolhelp32Snapshot( TH32CS_SNAPTHREAD, 0 );
+
     if (hThreadSnapshot != INVALID_HANDLE_VALUE)
     {
         THREADENTRY32 tEntry = { 0 };
@@ -24,7 +24,8 @@ public:
     Thread CreateNew( ptr_t threadProc, ptr_t arg, DWORD flags = 0 );
 
     /// <summary>
-    /// Gets all process threads
+    /// Gets all process threads.
+    /// List is empty for offline targets
     /// </summary>
     /// <param name="dontUpdate">Return already existing thread list</param>
     /// <returns>Threads collection</returns>
@@ -1,10 +1,15 @@
 #pragma once
 
+#include "Winheaders.h"
+
+#ifdef _WIN32
 #include "NativeStructures.h"
 #include "FunctionTypes.h"
+#endif
 
 #include <stdint.h>
 #include <string>
+#include <type_traits>
 
 namespace blackbone
 {
@@ -12,6 +17,8 @@ namespace blackbone
 typedef uint64_t ptr_t;     // Generic pointer in remote process
 typedef ptr_t    module_t;  // Module base pointer
 
+#ifdef _WIN32
+
 // PEB helper
 template<typename T>
 struct _PEB_T2
@@ -19,6 +26,8 @@ struct _PEB_T2
     typedef typename std::conditional<std::is_same<T, DWORD>::value, _PEB32, _PEB64>::type type;
 };
 
+#endif
+
 // Type of barrier
 enum WoW64Type
 {
@@ -1,9 +1,11 @@
 #include "Utils.h"
+
+#ifndef BLACKBONE_PORTABLE
 #include "DynImport.h"
+#endif
 
 #include <codecvt>
 #include <locale>
-#include <filesystem>
 #include <algorithm>
 
 namespace blackbone
@@ -39,9 +41,28 @@ std::string Utils::WstringToUTF8( const std::wstring& str )
 /// <returns>wide char string</returns>
 std::wstring Utils::AnsiToWstring( const std::string& input, DWORD locale /*= CP_ACP*/ )
 {
+#ifdef _WIN32
     wchar_t buf[8192] = { 0 };
     MultiByteToWideChar( locale, 0, input.c_str(), (int)input.length(), buf, ARRAYSIZE( buf ) );
     return buf;
+#else
+    // No code pages outside of Windows, treat input as Latin-1
+    // Malformed UTF-8 is treated the same way instead of throwing
+    if (locale == CP_UTF8)
+    {
+        std::wstring_convert<std::codecvt_utf8<wchar_t>, wchar_t> conv( "", L"" );
+        auto result = conv.from_bytes( input );
+        if (conv.converted() == input.length())
+            return result;
+    }
+
+    std::wstring result;
+    result.reserve( input.length() );
+    for (auto ch : input)
+        result.push_back( static_cast<unsigned char>(ch) );
+
+    return result;
+#endif
 }
 
 /// <summary>
@@ -84,6 +105,8 @@ std::wstring Utils::GetParent( const std::wstring& path )
         return path;
 }
 
+#ifndef BLACKBONE_PORTABLE
+
 /// <summary>
 /// Get current process exe file directory
 /// </summary>
@@ -98,6 +121,8 @@ std::wstring Utils::GetExeDirectory()
     return GetParent( imgName );
 }
 
+#endif
+
 /// <summary>
 /// Cast string characters to lower case
 /// </summary>
@@ -111,6 +136,8 @@ std::wstring Utils::ToLower( const std::wstring& str )
     return str2;
 }
 
+#ifndef BLACKBONE_PORTABLE
+
 /// <summary>
 /// Get system error description
 /// </summary>
@@ -210,4 +237,6 @@ NTSTATUS Utils::LoadDriver( const std::wstring& svcName, const std::wstring& pat
     return GET_IMPORT( NtLoadDriver )(&Ustr);
 }
 
+#endif
+
 }
\ No newline at end of file
@@ -45,12 +45,16 @@ public:
     /// <returns>Parent directory</returns>
     static std::wstring GetParent( const std::wstring& path );
 
+#ifndef BLACKBONE_PORTABLE
+
     /// <summary>
     /// Get current process exe file directory
     /// </summary>
     /// <returns>Exe directory</returns>
     static std::wstring GetExeDirectory();
 
+#endif
+
     /// <summary>
     /// Cast string characters to lower case
     /// </summary>
@@ -58,6 +62,8 @@ public:
     /// <returns>Result string</returns>
     static std::wstring ToLower( const std::wstring& str );
 
+#ifndef BLACKBONE_PORTABLE
+
     /// <summary>
     /// Get system error description
     /// </summary>
@@ -79,6 +85,8 @@ public:
     /// <param name="path">Driver file path</param>
     /// <returns>Status</returns>
     static NTSTATUS LoadDriver( const std::wstring& svcName, const std::wstring& path );
+
+#endif
 };
 
 }
\ No newline at end of file
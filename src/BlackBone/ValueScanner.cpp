@@ -0,0 +1,501 @@
+#include "ValueScanner.h"
+#include "PatternSearch.h"
+#include "Process.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_AMD64) || defined(__SSE2__)
+#define VS_SIMD
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace blackbone
+{
+
+namespace
+{
+
+// Remote memory is read by windows of this size
+const size_t ScanWindow = 4 * 1024 * 1024;
+
+// Unit of retry when window read fails
+const size_t PageSize = 0x1000;
+
+/// <summary>
+/// Append delta to encoded hit list, 7 bits per byte
+/// </summary>
+inline void PutDelta( std::vector<uint8_t>& out, uint64_t delta )
+{
+    for (; delta >= 0x80; delta >>= 7)
+        out.emplace_back( static_cast<uint8_t>(delta | 0x80) );
+
+    out.emplace_back( static_cast<uint8_t>(delta) );
+}
+
+/// <summary>
+/// Read next delta from encoded hit list
+/// </summary>
+inline uint64_t GetDelta( const uint8_t*& ptr )
+{
+    uint64_t delta = 0;
+
+    for (int shift = 0;; shift += 7)
+    {
+        uint8_t val = *ptr++;
+        delta |= static_cast<uint64_t>(val & 0x7F) << shift;
+        if (!(val & 0x80))
+            break;
+    }
+
+    return delta;
+}
+
+template<typename T>
+inline T LoadValue( const uint8_t* ptr )
+{
+    T val;
+    memcpy( &val, ptr, sizeof( val ) );
+    return val;
+}
+
+#ifdef VS_SIMD
+
+inline uint32_t LowestBit( uint32_t val )
+{
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward( &idx, val );
+    return idx;
+#else
+    return __builtin_ctz( val );
+#endif
+}
+
+//
+// Compare 16 bytes of data against [lo, hi] range.
+// Returns one bit per value
+//
+template<typename T>
+struct RangeKernel;
+
+template<>
+struct RangeKernel<int32_t>
+{
+    __m128i lo, hi;
+
+    RangeKernel( int32_t lo_, int32_t hi_ ) : lo( _mm_set1_epi32( lo_ ) ), hi( _mm_set1_epi32( hi_ ) ) { }
+    static bool Supported( int32_t, int32_t ) { return true; }
+
+    inline uint32_t operator()( const uint8_t* ptr ) const
+    {
+        __m128i val = _mm_loadu_si128( reinterpret_cast<const __m128i*>(ptr) );
+        __m128i out = _mm_or_si128( _mm_cmplt_epi32( val, lo ), _mm_cmpgt_epi32( val, hi ) );
+        return ~_mm_movemask_ps( _mm_castsi128_ps( out ) ) & 0xF;
+    }
+};
+
+// SSE2 has no 64 bit comparison, so only exact match is vectorized
+template<>
+struct RangeKernel<int64_t>
+{
+    __m128i value;
+
+    RangeKernel( int64_t lo_, int64_t ) : value( _mm_set_epi32( static_cast<int>(lo_ >> 32), static_cast<int>(lo_),
+                                                                static_cast<int>(lo_ >> 32), static_cast<int>(lo_) ) ) { }
+    static bool Supported( int64_t lo_, int64_t hi_ ) { return lo_ == hi_; }
+
+    inline uint32_t operator()( const uint8_t* ptr ) const
+    {
+        __m128i eq = _mm_cmpeq_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>(ptr) ), value );
+        eq = _mm_and_si128( eq, _mm_shuffle_epi32( eq, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+        return _mm_movemask_pd( _mm_castsi128_pd( eq ) );
+    }
+};
+
+template<>
+struct RangeKernel<float>
+{
+    __m128 lo, hi;
+
+    RangeKernel( float lo_, float hi_ ) : lo( _mm_set1_ps( lo_ ) ), hi( _mm_set1_ps( hi_ ) ) { }
+    static bool Supported( float, float ) { return true; }
+
+    inline uint32_t operator()( const uint8_t* ptr ) const
+    {
+        __m128 val = _mm_loadu_ps( reinterpret_cast<const float*>(ptr) );
+        return _mm_movemask_ps( _mm_and_ps( _mm_cmpge_ps( val, lo ), _mm_cmple_ps( val, hi ) ) );
+    }
+};
+
+template<>
+struct RangeKernel<double>
+{
+    __m128d lo, hi;
+
+    RangeKernel( double lo_, double hi_ ) : lo( _mm_set1_pd( lo_ ) ), hi( _mm_set1_pd( hi_ ) ) { }
+    static bool Supported( double, double ) { return true; }
+
+    inline uint32_t operator()( const uint8_t* ptr ) const
+    {
+        __m128d val = _mm_loadu_pd( reinterpret_cast<const double*>(ptr) );
+        return _mm_movemask_pd( _mm_and_pd( _mm_cmpge_pd( val, lo ), _mm_cmple_pd( val, hi ) ) );
+    }
+};
+
+#endif
+
+/// <summary>
+/// Find all aligned values inside [lo, hi] range
+/// </summary>
+/// <param name="data">Data to scan</param>
+/// <param name="size">Data size</param>
+/// <param name="lo">Lower bound</param>
+/// <param name="hi">Upper bound</param>
+/// <param name="found">Indexes of found values</param>
+template<typename T>
+void FindInRange( const uint8_t* data, size_t size, T lo, T hi, std::vector<uint32_t>& found )
+{
+    size_t i = 0;
+
+#ifdef VS_SIMD
+    if (PatternSearch::SupportedSimd() >= simd_sse2 && RangeKernel<T>::Supported( lo, hi ))
+    {
+        const uint32_t perBlock = 16 / sizeof( T );
+        RangeKernel<T> kernel( lo, hi );
+
+        // 64 bytes per iteration, most blocks have no hits at all
+        for (; i + 64 <= size; i += 64)
+        {
+            uint32_t bits = kernel( data + i )
+                          | kernel( data + i + 16 ) << perBlock
+                          | kernel( data + i + 32 ) << (perBlock * 2)
+                          | kernel( data + i + 48 ) << (perBlock * 3);
+
+            for (; bits != 0; bits &= bits - 1)
+                found.emplace_back( static_cast<uint32_t>(i / sizeof( T ) + LowestBit( bits )) );
+        }
+    }
+#endif
+
+    for (; i + sizeof( T ) <= size; i += sizeof( T ))
+    {
+        T val = LoadValue<T>( data + i );
+        if (val >= lo && val <= hi)
+            found.emplace_back( static_cast<uint32_t>(i / sizeof( T )) );
+    }
+}
+
+}
+
+template<typename T>
+ValueScanner<T>::ValueScanner( Process& process, bool writableOnly /*= true*/ )
+    : _process( process )
+    , _writableOnly( writableOnly )
+{
+}
+
+template<typename T>
+ValueScanner<T>::~ValueScanner()
+{
+}
+
+/// <summary>
+/// Scan whole address space of the process.
+/// Previous results are discarded, address space layout is swept again.
+/// </summary>
+/// <param name="type">scan_exact or scan_range</param>
+/// <param name="value">Value to search for, lower bound for range scan</param>
+/// <param name="value2">Upper bound for range scan</param>
+/// <returns>Status code</returns>
+template<typename T>
+NTSTATUS ValueScanner<T>::FirstScan( eScanType type, T value, T value2 /*= T()*/ )
+{
+    if (type != scan_exact && type != scan_range)
+        return STATUS_INVALID_PARAMETER;
+
+    const DWORD writable = PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+
+    RegionMap::vecRegions regions;
+    std::vector<uint8_t> buf( ScanWindow );
+
+    Reset();
+
+    // Layout is swept again, target may have changed it since last walk
+    auto native = _process.core().native();
+    native->regions().Reset();
+    native->regions().Enum( native->minAddr(), native->maxAddr(), regions );
+
+    for (auto& mbi : regions)
+    {
+        // Filter regions
+        if (mbi.State != MEM_COMMIT || mbi.Protect == PAGE_NOACCESS || (mbi.Protect & PAGE_GUARD))
+            continue;
+
+        if (_writableOnly && !(mbi.Protect & writable))
+            continue;
+
+        _regions.emplace_back();
+
+        auto& hits = _regions.back();
+        hits.base  = mbi.BaseAddress;
+        hits.size  = static_cast<size_t>(mbi.RegionSize);
+        hits.count = 0;
+
+        ScanRegion( hits, value, (type == scan_range) ? value2 : value, buf );
+
+        if (hits.count == 0)
+        {
+            _regions.pop_back();
+            continue;
+        }
+
+        hits.deltas.shrink_to_fit();
+        hits.values.shrink_to_fit();
+        _count += hits.count;
+    }
+
+    _scanned = true;
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Re-check addresses found by previous scan
+/// </summary>
+/// <param name="type">Comparison type</param>
+/// <param name="value">Value for exact and range comparison</param>
+/// <param name="value2">Upper bound for range comparison</param>
+/// <returns>Status code</returns>
+template<typename T>
+NTSTATUS ValueScanner<T>::NextScan( eScanType type, T value /*= T()*/, T value2 /*= T()*/ )
+{
+    if (!_scanned)
+        return STATUS_INVALID_PARAMETER;
+
+    std::vector<uint8_t> buf( ScanWindow );
+
+    _count = 0;
+
+    for (auto iter = _regions.begin(); iter != _regions.end();)
+    {
+        RescanRegion( *iter, type, value, (type == scan_range) ? value2 : value, buf );
+
+        if (iter->count == 0)
+        {
+            iter = _regions.erase( iter );
+        }
+        else
+        {
+            _count += iter->count;
+            ++iter;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+/// <summary>
+/// Get found addresses and values they had during last scan
+/// </summary>
+/// <param name="out">Found results</param>
+/// <param name="maxCount">Max number of results to get. 0 - get all</param>
+/// <returns>Number of results</returns>
+template<typename T>
+size_t ValueScanner<T>::GetResults( std::vector<Result>& out, size_t maxCount /*= 0*/ ) const
+{
+    if (maxCount == 0)
+        maxCount = _count;
+
+    out.reserve( out.size() + std::min<size_t>( maxCount, _count ) );
+
+    for (auto& hits : _regions)
+    {
+        const uint8_t* ptr = hits.deltas.data();
+        uint64_t slot = 0;
+
+        for (size_t i = 0; i < hits.count && out.size() < maxCount; ++i)
+        {
+            slot += GetDelta( ptr );
+            out.emplace_back( hits.base + slot * sizeof( T ), hits.values[i] );
+        }
+    }
+
+    return out.size();
+}
+
+/// <summary>
+/// Discard found results
+/// </summary>
+template<typename T>
+void ValueScanner<T>::Reset()
+{
+    _regions.clear();
+    _count = 0;
+    _scanned = false;
+}
+
+/// <summary>
+/// Memory used by results, in bytes
+/// </summary>
+/// <returns>Size in bytes</returns>
+template<typename T>
+size_t ValueScanner<T>::footprint() const
+{
+    size_t size = 0;
+
+    for (auto& hits : _regions)
+        size += sizeof( hits ) + hits.deltas.capacity() + hits.values.capacity() * sizeof( T );
+
+    return size;
+}
+
+/// <summary>
+/// Scan single memory region
+/// </summary>
+/// <param name="hits">Region descriptor. Hits are appended</param>
+/// <param name="lo">Lower bound</param>
+/// <param name="hi">Upper bound</param>
+/// <param name="buf">Read buffer</param>
+template<typename T>
+void ValueScanner<T>::ScanRegion( RegionHits& hits, T lo, T hi, std::vector<uint8_t>& buf )
+{
+    std::vector<uint32_t> found;
+    uint64_t last = 0;
+
+    for (size_t ofst = 0; ofst < hits.size; ofst += ScanWindow)
+    {
+        size_t size = std::min<size_t>( ScanWindow, hits.size - ofst );
+
+        if (_process.memory().Read( hits.base + ofst, size, buf.data() ) != STATUS_SUCCESS)
+            continue;
+
+        found.clear();
+        FindInRange( buf.data(), size, lo, hi, found );
+
+        for (auto idx : found)
+        {
+            uint64_t slot = ofst / sizeof( T ) + idx;
+
+            PutDelta( hits.deltas, slot - last );
+            hits.values.emplace_back( LoadValue<T>( buf.data() + idx * sizeof( T ) ) );
+            last = slot;
+        }
+
+        hits.count += found.size();
+    }
+}
+
+/// <summary>
+/// Re-check hits in single memory region
+/// </summary>
+/// <param name="hits">Region descriptor. Updated in place</param>
+/// <param name="type">Comparison type</param>
+/// <param name="lo">Lower bound</param>
+/// <param name="hi">Upper bound</param>
+/// <param name="buf">Read buffer</param>
+template<typename T>
+void ValueScanner<T>::RescanRegion( RegionHits& hits, eScanType type, T lo, T hi, std::vector<uint8_t>& buf )
+{
+    std::vector<uint8_t> deltas;
+    std::vector<T> values;
+    std::vector<uint64_t> slots( hits.count );
+
+    const uint8_t* ptr = hits.deltas.data();
+    uint64_t slot = 0, last = 0;
+
+    for (auto& val : slots)
+        val = (slot += GetDelta( ptr ));
+
+    // Compare hit with its previous value, keep it if it still matches
+    auto check = [&]( size_t i, const uint8_t* data )
+    {
+        T val = LoadValue<T>( data );
+        T old = hits.values[i];
+        bool match = false;
+
+        switch (type)
+        {
+            case scan_exact:
+            case scan_range:
+                match = (val >= lo && val <= hi);
+                break;
+
+            case scan_changed:
+                match = (val != old);
+                break;
+
+            case scan_unchanged:
+                match = (val == old);
+                break;
+
+            case scan_increased:
+                match = (val > old);
+                break;
+
+            case scan_decreased:
+                match = (val < old);
+                break;
+
+            default:
+                break;
+        }
+
+        if (match)
+        {
+            PutDelta( deltas, slots[i] - last );
+            values.emplace_back( val );
+            last = slots[i];
+        }
+    };
+
+    auto offset = [&slots]( size_t i ) { return static_cast<size_t>(slots[i] * sizeof( T )); };
+
+    // Each read spans from the first hit to the last one fitting into window, so sparse hits are read alone
+    for (size_t first = 0, end = 0; first < slots.size(); first = end)
+    {
+        for (end = first + 1; end < slots.size() && offset( end ) + sizeof( T ) - offset( first ) <= ScanWindow; ++end)
+            ;
+
+        const size_t winStart = offset( first );
+        const size_t winSize  = offset( end - 1 ) + sizeof( T ) - winStart;
+
+        if (_process.memory().Read( hits.base + winStart, winSize, buf.data() ) == STATUS_SUCCESS)
+        {
+            for (size_t i = first; i < end; i++)
+                check( i, buf.data() + offset( i ) - winStart );
+
+            continue;
+        }
+
+        // Some page is gone, re-read hits page by page and drop only hits on unreadable pages
+        for (size_t i = first, next = first; i < end; i = next)
+        {
+            const size_t page = offset( i ) & ~(PageSize - 1);
+            for (next = i + 1; next < end && (offset( next ) & ~(PageSize - 1)) == page; ++next)
+                ;
+
+            const size_t start = offset( i );
+            const size_t size  = offset( next - 1 ) + sizeof( T ) - start;
+
+            if (_process.memory().Read( hits.base + start, size, buf.data() ) != STATUS_SUCCESS)
+                continue;
+
+            for (size_t j = i; j < next; j++)
+                check( j, buf.data() + offset( j ) - start );
+        }
+    }
+
+    hits.count = values.size();
+    hits.deltas.swap( deltas );
+    hits.values.swap( values );
+}
+
+template class ValueScanner<int32_t>;
+template class ValueScanner<int64_t>;
+template class ValueScanner<float>;
+template class ValueScanner<double>;
+
+}
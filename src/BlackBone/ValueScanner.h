@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Winheaders.h"
+#include "Types.h"
+
+#include <vector>
+#include <list>
+#include <utility>
+
+namespace blackbone
+{
+
+// Value scan comparison
+enum eScanType
+{
+    scan_exact,         // Value is equal to 'value'
+    scan_range,         // Value is inside [value, value2]
+    scan_changed,       // Value differs from the previous scan. Next scan only
+    scan_unchanged,     // Value is same as in the previous scan. Next scan only
+    scan_increased,     // Value is greater than in the previous scan. Next scan only
+    scan_decreased,     // Value is less than in the previous scan. Next scan only
+};
+
+/// <summary>
+/// Remote memory value scanner.
+/// First scan finds all naturally aligned values of type T, next scans narrow results down.
+/// Supported types: int32_t, int64_t, float, double
+/// </summary>
+template<typename T>
+class ValueScanner
+{
+public:
+    // Found value
+    typedef std::pair<ptr_t, T> Result;
+
+public:
+    /// <summary>
+    /// ValueScanner ctor
+    /// </summary>
+    /// <param name="process">Target process</param>
+    /// <param name="writableOnly">Scan only writable memory</param>
+    ValueScanner( class Process& process, bool writableOnly = true );
+    ~ValueScanner();
+
+    /// <summary>
+    /// Scan whole address space of the process.
+    /// Previous results are discarded, address space layout is swept again.
+    /// </summary>
+    /// <param name="type">scan_exact or scan_range</param>
+    /// <param name="value">Value to search for, lower bound for range scan</param>
+    /// <param name="value2">Upper bound for range scan</param>
+    /// <returns>Status code</returns>
+    NTSTATUS FirstScan( eScanType type, T value, T value2 = T() );
+
+    /// <summary>
+    /// Re-check addresses found by previous scan
+    /// </summary>
+    /// <param name="type">Comparison type</param>
+    /// <param name="value">Value for exact and range comparison</param>
+    /// <param name="value2">Upper bound for range comparison</param>
+    /// <returns>Status code</returns>
+    NTSTATUS NextScan( eScanType type, T value = T(), T value2 = T() );
+
+    /// <summary>
+    /// Get found addresses and values they had during last scan
+    /// </summary>
+    /// <param name="out">Found results</param>
+    /// <param name="maxCount">Max number of results to get. 0 - get all</param>
+    /// <returns>Number of results</returns>
+    size_t GetResults( std::vector<Result>& out, size_t maxCount = 0 ) const;
+
+    /// <summary>
+    /// Discard found results
+    /// </summary>
+    void Reset();
+
+    /// <summary>
+    /// Number of found addresses
+    /// </summary>
+    /// <returns>Result count</returns>
+    inline size_t count() const { return _count; }
+
+    /// <summary>
+    /// Memory used by results, in bytes
+    /// </summary>
+    /// <returns>Size in bytes</returns>
+    size_t footprint() const;
+
+private:
+    //
+    // Results are stored per memory region.
+    // Hit offsets are delta-encoded in units of sizeof(T), 7 bits per byte,
+    // so densely packed hits cost 1 byte + value each.
+    //
+    struct RegionHits
+    {
+        ptr_t base;                     // Region base address
+        size_t size;                    // Region size
+        size_t count;                   // Number of hits
+        std::vector<uint8_t> deltas;    // Encoded hit offsets
+        std::vector<T> values;          // Values during last scan
+    };
+
+    /// <summary>
+    /// Scan single memory region
+    /// </summary>
+    /// <param name="hits">Region descriptor. Hits are appended</param>
+    /// <param name="lo">Lower bound</param>
+    /// <param name="hi">Upper bound</param>
+    /// <param name="buf">Read buffer</param>
+    void ScanRegion( RegionHits& hits, T lo, T hi, std::vector<uint8_t>& buf );
+
+    /// <summary>
+    /// Re-check hits in single memory region
+    /// </summary>
+    /// <param name="hits">Region descriptor. Updated in place</param>
+    /// <param name="type">Comparison type</param>
+    /// <param name="lo">Lower bound</param>
+    /// <param name="hi">Upper bound</param>
+    /// <param name="buf">Read buffer</param>
+    void RescanRegion( RegionHits& hits, eScanType type, T lo, T hi, std::vector<uint8_t>& buf );
+
+private:
+    class Process& _process;            // Target process
+    bool _writableOnly;                 // Skip read-only memory
+    bool _scanned = false;              // First scan was made
+    size_t _count = 0;                  // Total number of hits
+    std::list<RegionHits> _regions;     // Found hits
+};
+
+}
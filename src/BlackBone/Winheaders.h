@@ -1,5 +1,12 @@
 #pragma once
 
+// Portable build: only image analysis components, without process and OS interaction
+#if !defined(_WIN32) && !defined(BLACKBONE_PORTABLE)
+#define BLACKBONE_PORTABLE
+#endif
+
+#ifdef _WIN32
+
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
@@ -13,3 +20,9 @@
 #pragma warning(disable : 4005)
 #include <ntstatus.h>
 #pragma warning(default : 4005)
+
+#else
+
+#include "PEStructs.h"
+
+#endif
@@ -36,7 +36,11 @@ NTSTATUS NativeWow64::VirualAllocExT( ptr_t& lpAddress, size_t dwSize, DWORD flA
     if (ntavm == 0)
         return STATUS_ORDINAL_NOT_FOUND;
 
-    return static_cast<NTSTATUS>(_local.X64Call( ntavm, _hProcess, &lpAddress, 0, &size64, flAllocationType, flProtect ));
+    NTSTATUS status = static_cast<NTSTATUS>(_local.X64Call( ntavm, _hProcess, &lpAddress, 0, &size64, flAllocationType, flProtect ));
+    if (NT_SUCCESS( status ))
+        _regions.Invalidate( lpAddress, static_cast<size_t>(size64) );
+
+    return status;
 }
 
 /// <summary>
@@ -55,7 +59,10 @@ NTSTATUS NativeWow64::VirualFreeExT( ptr_t lpAddress, size_t dwSize, DWORD dwFre
     DWORD64 tmpAddr = lpAddress;
     DWORD64 tmpSize = dwSize;
 
-    return static_cast<NTSTATUS>(_local.X64Call( ntfvm, _hProcess, &tmpAddr, &tmpSize, dwFreeType ));
+    NTSTATUS status = static_cast<NTSTATUS>(_local.X64Call( ntfvm, _hProcess, &tmpAddr, &tmpSize, dwFreeType ));
+    _regions.Invalidate( lpAddress, dwSize );
+
+    return status;
 }
 
 /// <summary>
@@ -98,7 +105,10 @@ NTSTATUS NativeWow64::VirtualProtectExT( ptr_t lpAddress, DWORD64 dwSize, DWORD
     if (ntpvm == 0)
         return STATUS_ORDINAL_NOT_FOUND;
 
-    return static_cast<NTSTATUS>(_local.X64Call( ntpvm, _hProcess, &lpAddress, &dwSize, flProtect, flOld ));
+    NTSTATUS status = static_cast<NTSTATUS>(_local.X64Call( ntpvm, _hProcess, &lpAddress, &dwSize, flProtect, flOld ));
+    _regions.Invalidate( lpAddress, static_cast<size_t>(dwSize) );
+
+    return status;
 }
 
 /// <summary>
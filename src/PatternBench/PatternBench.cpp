@@ -0,0 +1,603 @@
+#include "../BlackBone/PatternSearch.h"
+#include "../BlackBone/PEParser.h"
+#include "../BlackBone/PEView.h"
+#include "../BlackBone/RegionMap.h"
+#include "../BlackBone/SimulatedMemory.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+using namespace blackbone;
+
+/*
+    PatternSearch throughput benchmark.
+    Runs exact, wildcard and signature search over random data, adversarial
+    repeated-prefix data and a folder of PE files, using both Search overloads
+    and every SIMD kernel supported by the CPU.
+    PE files are also parsed with PEParser and PEView, counting imports and exports.
+    Whole address space search is run against simulated process with given per-call latency.
+
+    Usage: PatternBench [-size <MB>] [-time <ms>] [-latency <ns>] [-pe <folder>] [-csv]
+*/
+
+namespace
+{
+
+typedef std::vector<uint8_t> vecBytes;
+
+// Command line options
+struct Options
+{
+    size_t size = 64 * 1024 * 1024;     // Synthetic buffer size
+    double minTime = 0.2;               // Min run time of a single case, seconds
+    uint64_t latency = 2000;            // Simulated system call latency, ns
+    std::string peDir;                  // Folder with PE files
+    bool csv = false;                   // Print results as CSV
+};
+
+// Single case timing
+struct Result
+{
+    double seconds = 0.0;   // Total time
+    size_t passes = 0;      // Number of passes over the corpus
+    size_t bytes = 0;       // Total scanned bytes
+    size_t matches = 0;     // Total found matches
+};
+
+// Corpus to search in
+struct Corpus
+{
+    const char* name;
+    std::vector<vecBytes> buffers;
+    size_t bytes = 0;
+};
+
+// Pattern in all three search forms
+struct BenchPattern
+{
+    std::vector<uint8_t> exact;     // Plain pattern
+    std::vector<uint8_t> wild;      // Pattern with wildcard bytes
+    uint8_t wildcard = 0;           // Wildcard value
+    Signature signature;            // Pattern with nibble masks
+};
+
+const char* g_simdNames[] = { "scalar", "sse2", "avx2" };
+const size_t g_lengths[] = { 4, 8, 16, 32, 64, 128 };
+
+// Common x86/x64 code signatures
+const char* g_signatures[] =
+{
+    "E8 ?? ?? ?? ?? 48 8B",
+    "FF 15 ?? ?? ?? ??",
+    "55 8B EC 83 E4 F8",
+    "4? 8B 0D ?? ?? ?? ?? 48 85 C9",
+    "48 89 5C 24 ?? 57 48 83 EC 20",
+    "48 8B 05 ?? ?? ?? ?? 48 85 C0 74 ??",
+    "CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC CC",
+};
+
+/// <summary>
+/// Run search over the whole corpus until min time has passed
+/// </summary>
+/// <param name="corpus">Corpus</param>
+/// <param name="minTime">Min run time</param>
+/// <param name="pass">Search function. Returns number of matches</param>
+/// <returns>Timing</returns>
+template<typename Fn>
+Result Measure( Corpus& corpus, double minTime, Fn pass )
+{
+    typedef std::chrono::high_resolution_clock clock;
+
+    Result res;
+    auto start = clock::now();
+
+    do
+    {
+        for (auto& buf : corpus.buffers)
+            res.matches += pass( buf.data(), buf.size() );
+
+        res.passes++;
+        res.bytes += corpus.bytes;
+        res.seconds = std::chrono::duration<double>( clock::now() - start ).count();
+    } while (res.seconds < minTime);
+
+    return res;
+}
+
+void PrintHeader( const Options& opt )
+{
+    if (opt.csv)
+        printf( "corpus,mode,kernel,sink,length,gbps,matches_per_sec,matches\n" );
+    else
+        printf( "%-12s %-10s %-7s %-9s %6s %10s %14s %10s\n",
+                "corpus", "mode", "kernel", "sink", "len", "GB/s", "matches/s", "matches" );
+}
+
+void PrintResult( const Options& opt, const Corpus& corpus, const char* mode, const char* kernel,
+                  const char* sink, size_t len, const Result& res )
+{
+    double gbps = res.bytes / res.seconds / 1e9;
+    double mps = res.matches / res.seconds;
+    unsigned long long perPass = res.matches / res.passes;
+
+    if (opt.csv)
+        printf( "%s,%s,%s,%s,%u,%.3f,%.0f,%llu\n", corpus.name, mode, kernel, sink,
+                static_cast<unsigned>(len), gbps, mps, perPass );
+    else
+        printf( "%-12s %-10s %-7s %-9s %6u %10.3f %14.0f %10llu\n", corpus.name, mode, kernel, sink,
+                static_cast<unsigned>(len), gbps, mps, perPass );
+
+    fflush( stdout );
+}
+
+/// <summary>
+/// Benchmark both Search overloads with single kernel
+/// </summary>
+void RunOverloads( const Options& opt, Corpus& corpus, const char* mode, const char* kernel,
+                   PatternSearch& ps, bool useWildcard, uint8_t wildcard, size_t len )
+{
+    std::vector<ptr_t> out;
+    out.reserve( 0x10000 );
+
+    auto vec = Measure( corpus, opt.minTime, [&]( uint8_t* data, size_t size ) -> size_t
+    {
+        out.clear();
+        return useWildcard ? ps.Search( wildcard, data, size, out ) : ps.Search( data, size, out );
+    } );
+
+    PrintResult( opt, corpus, mode, kernel, "vector", len, vec );
+
+    size_t found = 0;
+    PatternSearch::fnMatch callback = [&found]( ptr_t ) { found++; return true; };
+
+    auto cb = Measure( corpus, opt.minTime, [&]( uint8_t* data, size_t size ) -> size_t
+    {
+        found = 0;
+        if (useWildcard)
+            ps.Search( wildcard, data, size, callback );
+        else
+            ps.Search( data, size, callback );
+
+        return found;
+    } );
+
+    PrintResult( opt, corpus, mode, kernel, "callback", len, cb );
+}
+
+/// <summary>
+/// Benchmark pattern in all forms and with all supported kernels
+/// </summary>
+void RunPattern( const Options& opt, Corpus& corpus, const BenchPattern& pattern )
+{
+    size_t len = pattern.exact.size();
+
+    // Exact search doesn't depend on SIMD level
+    PatternSearch exact( pattern.exact );
+    RunOverloads( opt, corpus, "exact", "bmh", exact, false, 0, len );
+
+    PatternSearch wild( pattern.wild );
+    PatternSearch sig( pattern.signature );
+
+    for (int level = simd_none; level <= PatternSearch::SupportedSimd(); level++)
+    {
+        wild.simd( static_cast<eSimdLevel>(level) );
+        sig.simd( static_cast<eSimdLevel>(level) );
+
+        RunOverloads( opt, corpus, "wildcard", g_simdNames[level], wild, true, pattern.wildcard, len );
+        RunOverloads( opt, corpus, "signature", g_simdNames[level], sig, false, 0, len );
+    }
+}
+
+/// <summary>
+/// Build all pattern forms from exact bytes.
+/// Every third byte except the last one becomes a wildcard,
+/// same bytes keep high nibble in signature form.
+/// </summary>
+BenchPattern MakePattern( const std::vector<uint8_t>& bytes )
+{
+    BenchPattern pattern;
+    pattern.exact = bytes;
+    pattern.wild = bytes;
+    pattern.signature.value = bytes;
+    pattern.signature.mask.assign( bytes.size(), 0xFF );
+
+    // Wildcard value must not collide with known bytes
+    bool used[256] = { false };
+    for (auto val : bytes)
+        used[val] = true;
+
+    while (used[pattern.wildcard])
+        pattern.wildcard++;
+
+    for (size_t i = 1; i + 1 < bytes.size(); i += 3)
+    {
+        pattern.wild[i] = pattern.wildcard;
+        pattern.signature.value[i] &= 0xF0;
+        pattern.signature.mask[i] = 0xF0;
+    }
+
+    return pattern;
+}
+
+/// <summary>
+/// Take pattern from corpus, so it has at least one match
+/// </summary>
+BenchPattern SamplePattern( const Corpus& corpus, size_t len, std::mt19937& rng )
+{
+    std::vector<const vecBytes*> fit;
+    for (auto& buf : corpus.buffers)
+        if (buf.size() >= len)
+            fit.push_back( &buf );
+
+    if (fit.empty())
+        return MakePattern( std::vector<uint8_t>( len, 0 ) );
+
+    auto& buf = *fit[rng() % fit.size()];
+    size_t pos = rng() % (buf.size() - len + 1);
+
+    return MakePattern( std::vector<uint8_t>( buf.begin() + pos, buf.begin() + pos + len ) );
+}
+
+/// <summary>
+/// Uniformly random bytes
+/// </summary>
+void RunRandom( const Options& opt )
+{
+    Corpus corpus;
+    corpus.name = "random";
+    corpus.bytes = opt.size;
+    corpus.buffers.emplace_back( opt.size );
+
+    std::mt19937 rng( 0 );
+    for (auto& val : corpus.buffers.back())
+        val = static_cast<uint8_t>(rng());
+
+    for (auto len : g_lengths)
+        RunPattern( opt, corpus, SamplePattern( corpus, len, rng ) );
+}
+
+/// <summary>
+/// Data where every position matches all but one pattern byte
+/// </summary>
+void RunAdversarial( const Options& opt )
+{
+    Corpus corpus;
+    corpus.bytes = opt.size;
+    corpus.buffers.emplace_back( opt.size, 'A' );
+
+    // Mismatch is found on the last byte
+    corpus.name = "prefix";
+    for (auto len : g_lengths)
+    {
+        std::vector<uint8_t> bytes( len, 'A' );
+        bytes.back() = 'B';
+        RunPattern( opt, corpus, MakePattern( bytes ) );
+    }
+
+    // Mismatch is found on the first byte
+    corpus.name = "suffix";
+    for (auto len : g_lengths)
+    {
+        std::vector<uint8_t> bytes( len, 'A' );
+        bytes.front() = 'B';
+        RunPattern( opt, corpus, MakePattern( bytes ) );
+    }
+
+    // Periodic data with period-breaking pattern
+    auto& buf = corpus.buffers.back();
+    for (size_t i = 0; i < buf.size(); i++)
+        buf[i] = "ABCD"[i % 4];
+
+    corpus.name = "periodic";
+    for (auto len : g_lengths)
+    {
+        std::vector<uint8_t> bytes( len );
+        for (size_t i = 0; i < len; i++)
+            bytes[i] = "ABCD"[i % 4];
+
+        bytes.back() = 'E';
+        RunPattern( opt, corpus, MakePattern( bytes ) );
+    }
+}
+
+/// <summary>
+/// Search whole address space of simulated process by SearchRegions, backend of SearchRemoteWhole.
+/// Region map is either rebuilt on each pass or kept between passes
+/// </summary>
+void RunRemote( const Options& opt )
+{
+    typedef std::chrono::high_resolution_clock clock;
+
+    SimulatedMemory mem( true );
+    std::mt19937 rng( 0 );
+    vecBytes data;
+
+    // Mix of committed regions, reserved tails and guard pages
+    Corpus corpus;
+    corpus.name = "remote";
+    corpus.bytes = opt.size;
+
+    for (size_t total = 0; total < opt.size; )
+    {
+        size_t size = std::min<size_t>( (1 + rng() % 256) * SimulatedMemory::PageSize, opt.size - total );
+
+        ptr_t address = 0;
+        mem.Allocate( address, size + 0x4000, MEM_RESERVE, PAGE_READWRITE );
+        mem.Allocate( address, size, MEM_COMMIT, PAGE_READWRITE );
+        if (size > SimulatedMemory::PageSize)
+            mem.Protect( address + size - SimulatedMemory::PageSize, SimulatedMemory::PageSize, PAGE_READWRITE | PAGE_GUARD );
+
+        data.resize( size );
+        for (auto& val : data)
+            val = static_cast<uint8_t>(rng());
+
+        mem.Write( address, data.data(), data.size() );
+        total += size;
+    }
+
+    // Last region has at least one readable page
+    std::vector<uint8_t> pattern( data.begin() + 0x100, data.begin() + 0x110 );
+
+    PatternSearch ps( pattern );
+    std::vector<ptr_t> out;
+
+    auto query = [&mem]( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi ) { return mem.Query( address, mbi ); };
+    auto read = [&mem]( ptr_t address, size_t size, void* buffer ) { return mem.Read( address, buffer, size ); };
+    const uint64_t latencies[] = { 0, opt.latency };
+
+    // Bytes searched by one pass
+    RegionMap layout( mem.minAddr(), mem.maxAddr(), query );
+    RegionMap::vecRegions regions;
+    uint64_t committed = 0;
+
+    layout.Enum( mem.minAddr(), mem.maxAddr(), regions );
+    for (auto& mbi : regions)
+        if (mbi.State == MEM_COMMIT && mbi.Protect != PAGE_NOACCESS && !(mbi.Protect & PAGE_GUARD))
+            committed += mbi.RegionSize;
+
+    for (auto latency : latencies)
+    {
+        for (int cached = 0; cached < 2; cached++)
+        {
+            for (int call = 0; call < sim_callCount; call++)
+                mem.SetLatency( static_cast<eSimCall>(call), latency );
+
+            // Same path as PatternSearch::SearchRemoteWhole
+            RegionMap map( mem.minAddr(), mem.maxAddr(), query );
+            Result res;
+            auto start = clock::now();
+
+            do
+            {
+                if (!cached)
+                    map.Reset();
+
+                res.matches += ps.SearchRegions( map, mem.minAddr(), mem.maxAddr(), read, false, 0, out );
+                res.bytes += committed;
+                res.passes++;
+                res.seconds = std::chrono::duration<double>( clock::now() - start ).count();
+            } while (res.seconds < opt.minTime);
+
+            char kernel[32] = { 0 };
+            sprintf( kernel, "%uns", static_cast<unsigned>(latency) );
+            PrintResult( opt, corpus, "whole", kernel, cached ? "cached" : "sweep", pattern.size(), res );
+        }
+    }
+}
+
+/// <summary>
+/// Get names of files in folder
+/// </summary>
+std::vector<std::string> ListFolder( const std::string& path )
+{
+    std::vector<std::string> files;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA fd = { 0 };
+    HANDLE hFind = FindFirstFileA( (path + "\\*").c_str(), &fd );
+    if (hFind == INVALID_HANDLE_VALUE)
+        return files;
+
+    do
+    {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+            files.emplace_back( path + "\\" + fd.cFileName );
+    } while (FindNextFileA( hFind, &fd ));
+
+    FindClose( hFind );
+#else
+    DIR* dir = opendir( path.c_str() );
+    if (dir == nullptr)
+        return files;
+
+    for (dirent* ent = readdir( dir ); ent != nullptr; ent = readdir( dir ))
+        if (ent->d_name[0] != '.')
+            files.emplace_back( path + "/" + ent->d_name );
+
+    closedir( dir );
+#endif
+
+    std::sort( files.begin(), files.end() );
+    return files;
+}
+
+/// <summary>
+/// Read file if it is a PE image
+/// </summary>
+bool LoadImage( const std::string& path, vecBytes& data )
+{
+    FILE* file = fopen( path.c_str(), "rb" );
+    if (file == nullptr)
+        return false;
+
+    data.clear();
+
+    uint8_t chunk[0x10000];
+    for (size_t read = 0; (read = fread( chunk, 1, sizeof( chunk ), file )) != 0; )
+        data.insert( data.end(), chunk, chunk + read );
+
+    fclose( file );
+    return data.size() >= 0x40 && data[0] == 'M' && data[1] == 'Z';
+}
+
+/// <summary>
+/// Parse every image, walking imports and named exports
+/// </summary>
+void RunParse( const Options& opt, Corpus& corpus )
+{
+    // PEParser doesn't check bounds, so it gets only images accepted by PEView
+    Corpus valid;
+    valid.name = "pe-parse";
+
+    for (auto& buf : corpus.buffers)
+    {
+        pe::PEView view;
+        if (view.Attach( buf.data(), buf.size() ) == STATUS_SUCCESS)
+        {
+            valid.buffers.push_back( buf );
+            valid.bytes += buf.size();
+        }
+    }
+
+    if (valid.buffers.empty())
+        return;
+
+    auto parser = Measure( valid, opt.minTime, []( uint8_t* data, size_t ) -> size_t
+    {
+        pe::PEParser image;
+        std::list<std::string> names;
+        size_t items = 0;
+
+        if (!image.Parse( data, true ))
+            return 0;
+
+        for (auto& mod : image.ProcessImports())
+            items += mod.second.size();
+
+        image.GetExportNames( names );
+        return items + names.size();
+    } );
+
+    PrintResult( opt, valid, "parse", "PEParser", "-", 0, parser );
+
+    auto view = Measure( valid, opt.minTime, []( uint8_t* data, size_t size ) -> size_t
+    {
+        pe::PEView image;
+        size_t items = 0;
+
+        if (image.Attach( data, size ) != STATUS_SUCCESS)
+            return 0;
+
+        for (auto& mod : image.imports())
+            for (auto& func : mod.functions())
+                items += (func.byOrdinal || func.name != nullptr);
+
+        for (auto& exp : image.exports())
+            items += (exp.name != nullptr);
+
+        return items;
+    } );
+
+    PrintResult( opt, valid, "parse", "PEView", "-", 0, view );
+}
+
+/// <summary>
+/// Files from PE folder, searched one by one
+/// </summary>
+void RunImages( const Options& opt )
+{
+    Corpus corpus;
+    corpus.name = "pe";
+
+    for (auto& path : ListFolder( opt.peDir ))
+    {
+        corpus.buffers.emplace_back();
+        if (LoadImage( path, corpus.buffers.back() ))
+            corpus.bytes += corpus.buffers.back().size();
+        else
+            corpus.buffers.pop_back();
+    }
+
+    if (corpus.buffers.empty())
+    {
+        fprintf( stderr, "No PE files found in '%s'\n", opt.peDir.c_str() );
+        return;
+    }
+
+    if (!opt.csv)
+        printf( "# %u images, %.1f MB\n", static_cast<unsigned>(corpus.buffers.size()), corpus.bytes / 1048576.0 );
+
+    std::mt19937 rng( 0 );
+    for (auto len : g_lengths)
+        RunPattern( opt, corpus, SamplePattern( corpus, len, rng ) );
+
+    // Real-world signatures
+    corpus.name = "pe-sig";
+    for (auto text : g_signatures)
+    {
+        Signature sig;
+        if (!sig.Parse( text ))
+            continue;
+
+        PatternSearch ps( sig );
+        for (int level = simd_none; level <= PatternSearch::SupportedSimd(); level++)
+        {
+            ps.simd( static_cast<eSimdLevel>(level) );
+            RunOverloads( opt, corpus, "signature", g_simdNames[level], ps, false, 0, sig.size() );
+        }
+    }
+
+    RunParse( opt, corpus );
+}
+
+}
+
+int main( int argc, char* argv[] )
+{
+    Options opt;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "-size" && i + 1 < argc)
+            opt.size = std::max<size_t>( strtoul( argv[++i], nullptr, 10 ), 1 ) * 1024 * 1024;
+        else if (arg == "-time" && i + 1 < argc)
+            opt.minTime = strtoul( argv[++i], nullptr, 10 ) / 1000.0;
+        else if (arg == "-latency" && i + 1 < argc)
+            opt.latency = strtoull( argv[++i], nullptr, 10 );
+        else if (arg == "-pe" && i + 1 < argc)
+            opt.peDir = argv[++i];
+        else if (arg == "-csv")
+            opt.csv = true;
+        else
+        {
+            printf( "Usage: %s [-size <MB>] [-time <ms>] [-latency <ns>] [-pe <folder>] [-csv]\n", argv[0] );
+            return 1;
+        }
+    }
+
+    if (!opt.csv)
+        printf( "# CPU kernel: %s, buffer %u MB\n", g_simdNames[PatternSearch::SupportedSimd()],
+                static_cast<unsigned>(opt.size >> 20) );
+
+    PrintHeader( opt );
+    RunRandom( opt );
+    RunAdversarial( opt );
+    RunRemote( opt );
+
+    if (!opt.peDir.empty())
+        RunImages( opt );
+
+    return 0;
+}
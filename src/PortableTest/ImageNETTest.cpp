@@ -0,0 +1,189 @@
+#include "Tests.h"
+
+#include <cstring>
+#include <string>
+
+namespace
+{
+
+// Metadata blob builder
+struct Blob
+{
+    std::vector<uint8_t> data;
+
+    void u8( uint8_t value ) { data.push_back( value ); }
+    void u16( uint16_t value ) { u8( value & 0xFF ); u8( value >> 8 ); }
+    void u32( uint32_t value ) { u16( value & 0xFFFF ); u16( value >> 16 ); }
+    void str( const char* value, size_t align )
+    {
+        data.insert( data.end(), value, value + strlen( value ) + 1 );
+        while (data.size() % align)
+            u8( 0 );
+    }
+};
+
+/// <summary>
+/// Build metadata with <Module>, Ns.Foo with Bar and Baz methods and Inner with Run method
+/// </summary>
+/// <returns>Metadata root and streams</returns>
+std::vector<uint8_t> BuildMetadata()
+{
+    // #Strings
+    Blob strings;
+    strings.u8( 0 );
+    auto addString = [&strings]( const char* value ) -> uint16_t
+    {
+        auto index = static_cast<uint16_t>(strings.data.size());
+        strings.str( value, 1 );
+        return index;
+    };
+
+    uint16_t sModule = addString( "<Module>" ), sFoo = addString( "Foo" ), sNs = addString( "Ns" );
+    uint16_t sBar = addString( "Bar" ), sBaz = addString( "Baz" ), sInner = addString( "Inner" ), sRun = addString( "Run" );
+    uint16_t sGlobal = addString( "Global" );
+    while (strings.data.size() % 4)
+        strings.u8( 0 );
+
+    // #~: Module, TypeDef and MethodDef tables, all indexes are 2 bytes wide
+    Blob tables;
+    tables.u32( 0 );
+    tables.u8( 2 );
+    tables.u8( 0 );
+    tables.u8( 0 );
+    tables.u8( 1 );
+    tables.u32( (1 << 0x00) | (1 << 0x02) | (1 << 0x06) );
+    tables.u32( 0 );
+    tables.u32( 0 );
+    tables.u32( 0 );
+    tables.u32( 1 );
+    tables.u32( 3 );
+    tables.u32( 4 );
+
+    // Module
+    tables.u16( 0 );
+    tables.u16( sModule );
+    tables.u16( 1 );
+    tables.u16( 0 );
+    tables.u16( 0 );
+
+    // TypeDef: Flags, Name, Namespace, Extends, FieldList, MethodList
+    const uint16_t types[][3] = { { sModule, 0, 1 }, { sFoo, sNs, 2 }, { sInner, 0, 4 } };
+    for (auto& type : types)
+    {
+        tables.u32( 0 );
+        tables.u16( type[0] );
+        tables.u16( type[1] );
+        tables.u16( 0 );
+        tables.u16( 1 );
+        tables.u16( type[2] );
+    }
+
+    // MethodDef: RVA, ImplFlags, Flags, Name, Signature, ParamList
+    const uint16_t methodNames[] = { sGlobal, sBar, sBaz, sRun };
+    const uint32_t methodRVAs[] = { 0x2040, 0x2050, 0, 0x2060 };
+    for (int i = 0; i < 4; i++)
+    {
+        tables.u32( methodRVAs[i] );
+        tables.u16( 0 );
+        tables.u16( 0 );
+        tables.u16( methodNames[i] );
+        tables.u16( 0 );
+        tables.u16( 1 );
+    }
+
+    while (tables.data.size() % 4)
+        tables.u8( 0 );
+
+    // Root with version string and three stream headers
+    Blob root;
+    root.u32( 0x424A5342 );
+    root.u16( 1 );
+    root.u16( 1 );
+    root.u32( 0 );
+    root.u32( 12 );
+    root.str( "v4.0.30319", 4 );
+    root.u16( 0 );
+    root.u16( 3 );
+
+    const uint32_t headersSize = static_cast<uint32_t>(root.data.size()) + 3 * 8 + 4 + 12 + 8;
+    uint32_t offset = headersSize;
+
+    root.u32( offset );
+    root.u32( static_cast<uint32_t>(tables.data.size()) );
+    root.str( "#~", 4 );
+    offset += static_cast<uint32_t>(tables.data.size());
+
+    root.u32( offset );
+    root.u32( static_cast<uint32_t>(strings.data.size()) );
+    root.str( "#Strings", 4 );
+    offset += static_cast<uint32_t>(strings.data.size());
+
+    root.u32( offset );
+    root.u32( 4 );
+    root.str( "#Blob", 4 );
+
+    root.data.insert( root.data.end(), tables.data.begin(), tables.data.end() );
+    root.data.insert( root.data.end(), strings.data.begin(), strings.data.end() );
+    root.u32( 0 );
+
+    return root.data;
+}
+
+}
+
+/*
+    Parse synthetic metadata placed into test image
+*/
+void TestImageNET()
+{
+    std::cout << "ImageNET test\n";
+
+    const uint32_t corRVA = 0x3100, metaRVA = 0x3200;
+
+    auto image = BuildTestImage( true );
+    auto& img = image.mapped;
+    auto meta = BuildMetadata();
+
+    IMAGE_COR20_HEADER cor = { 0 };
+    cor.cb = sizeof(cor);
+    cor.MajorRuntimeVersion = 2;
+    cor.MetaData.VirtualAddress = metaRVA;
+    cor.MetaData.Size = static_cast<DWORD>(meta.size());
+    cor.Flags = COMIMAGE_FLAGS_ILONLY;
+    memcpy( &img[corRVA], &cor, sizeof(cor) );
+    memcpy( &img[metaRVA], meta.data(), meta.size() );
+
+    IMAGE_DATA_DIRECTORY dir = { corRVA, sizeof(cor) };
+    memcpy( &img[0x80 + FIELD_OFFSET( IMAGE_NT_HEADERS64, OptionalHeader.DataDirectory ) + IMAGE_DIRECTORY_ENTRY_COM_DESCRIPTOR * sizeof(dir)], &dir, sizeof(dir) );
+
+    ImageNET net;
+    ImageNET::mapMethodRVA methods;
+    CHECK( net.Init( img.data(), img.size(), false ) );
+    CHECK( net.Parse( methods ) );
+
+    // Global methods of <Module> aren't reported
+    ImageNET::mapMethodRVA expected;
+    expected[std::make_pair( std::wstring( L"Ns.Foo" ), std::wstring( L"Bar" ) )] = 0x2050;
+    expected[std::make_pair( std::wstring( L"Ns.Foo" ), std::wstring( L"Baz" ) )] = 0;
+    expected[std::make_pair( std::wstring( L"Inner" ), std::wstring( L"Run" ) )] = 0x2060;
+    CHECK( methods == expected );
+
+    // Truncated metadata must be rejected or parsed without reading past the end
+    for (uint32_t size = 0; size < meta.size(); size += 5)
+    {
+        cor.MetaData.Size = size;
+        memcpy( &img[corRVA], &cor, sizeof(cor) );
+
+        std::vector<uint8_t> part( img );
+        memset( &part[metaRVA + size], 0xFF, meta.size() - size );
+
+        ImageNET truncated;
+        if (truncated.Init( part.data(), part.size(), false ))
+            truncated.Parse( methods );
+    }
+
+    // Not a managed image
+    auto native = BuildTestImage( false );
+    CHECK( !net.Init( native.file.data(), native.file.size(), true ) );
+    CHECK( !net.Parse( methods ) );
+}
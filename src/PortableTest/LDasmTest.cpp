@@ -0,0 +1,39 @@
+#include "Tests.h"
+
+#include <cstring>
+
+/*
+    Decode several known instructions
+*/
+void TestLDasm()
+{
+    std::cout << "LDasm test\n";
+
+    struct
+    {
+        std::vector<uint8_t> code;
+        uint32_t is64;
+        unsigned int length;
+        uint8_t flags;
+    } tests[] =
+    {
+        { { 0x55 }, 0, 1, 0 },                                              // push ebp
+        { { 0xC3 }, 1, 1, 0 },                                              // ret
+        { { 0xE8, 0x10, 0x00, 0x00, 0x00 }, 1, 5, F_IMM | F_RELATIVE },     // call rel32
+        { { 0x48, 0x8B, 0x05, 0, 0, 0, 0 }, 1, 7, F_REX | F_MODRM | F_DISP | F_RELATIVE },   // mov rax, [rip]
+        { { 0x8B, 0x44, 0x24, 0x08 }, 0, 4, F_MODRM | F_SIB | F_DISP },     // mov eax, [esp+8]
+        { { 0x66, 0xB8, 0x34, 0x12 }, 0, 4, F_PREFIX | F_IMM },             // mov ax, 0x1234
+        { { 0x48, 0xB8, 1, 2, 3, 4, 5, 6, 7, 8 }, 1, 10, F_REX | F_IMM },  // mov rax, imm64
+    };
+
+    for (auto& test : tests)
+    {
+        uint8_t code[32] = { 0 };
+        ldasm_data data = { 0 };
+
+        memcpy( code, test.code.data(), test.code.size() );
+
+        CHECK( ldasm( code, &data, test.is64 ) == test.length );
+        CHECK( (data.flags & test.flags) == test.flags && !(data.flags & F_INVALID) );
+    }
+}
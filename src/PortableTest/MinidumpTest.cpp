@@ -0,0 +1,232 @@
+#include "Tests.h"
+#include "../BlackBone/Minidump.h"
+#include "../BlackBone/RegionMap.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+const ptr_t ImageBase = 0x140000000;
+const ptr_t TebBase = 0x7FF0000;
+const ptr_t PebBase = 0x7FF1000;
+const ptr_t ReservedBase = 0x8000000;
+
+// Dump writer
+struct DumpWriter
+{
+    std::vector<uint8_t> data;
+
+    void u16( uint16_t value ) { data.push_back( value & 0xFF ); data.push_back( value >> 8 ); }
+    void u32( uint32_t value ) { u16( value & 0xFFFF ); u16( value >> 16 ); }
+    void u64( uint64_t value ) { u32( value & 0xFFFFFFFF ); u32( value >> 32 ); }
+    void zero( size_t size ) { data.resize( data.size() + size ); }
+    uint32_t pos() const { return static_cast<uint32_t>(data.size()); }
+
+    void set32( uint32_t offset, uint32_t value ) { memcpy( &data[offset], &value, sizeof(value) ); }
+
+    void region( ptr_t base, ptr_t size, DWORD state, DWORD protect, DWORD type )
+    {
+        u64( base );
+        u64( base );
+        u32( protect );
+        u32( 0 );
+        u64( size );
+        u32( state );
+        u32( protect );
+        u32( type );
+        u32( 0 );
+    }
+};
+
+/// <summary>
+/// Build full memory dump of 64 bit process with single module and thread
+/// </summary>
+/// <param name="image">Module image</param>
+/// <returns>Dump data</returns>
+std::vector<uint8_t> BuildDump( const std::vector<uint8_t>& image )
+{
+    const uint32_t streams = 5;
+    DumpWriter dump;
+
+    // Header and stream directory
+    dump.u32( 0x504D444D );
+    dump.u32( 0xA793 );
+    dump.u32( streams );
+    dump.u32( 32 );
+    dump.zero( 16 );
+
+    uint32_t directory = dump.pos();
+    dump.zero( streams * 12 );
+
+    auto stream = [&]( uint32_t index, uint32_t type, uint32_t rva )
+    {
+        dump.set32( directory + index * 12, type );
+        dump.set32( directory + index * 12 + 4, dump.pos() - rva );
+        dump.set32( directory + index * 12 + 8, rva );
+    };
+
+    // SystemInfo, AMD64
+    uint32_t start = dump.pos();
+    dump.u16( 9 );
+    dump.zero( 54 );
+    stream( 0, 7, start );
+
+    // Module name
+    uint32_t nameRva = dump.pos();
+    const wchar_t name[] = L"C:\\Windows\\Test.dll";
+    dump.u32( static_cast<uint32_t>((ARRAYSIZE( name ) - 1) * 2) );
+    for (auto ch : name)
+        dump.u16( static_cast<uint16_t>(ch) );
+
+    // ModuleList
+    start = dump.pos();
+    dump.u32( 1 );
+    dump.u64( ImageBase );
+    dump.u32( static_cast<uint32_t>(image.size()) );
+    dump.u32( 0 );
+    dump.u32( 0 );
+    dump.u32( nameRva );
+    dump.zero( 52 + 16 + 16 );
+    stream( 1, 4, start );
+
+    // ThreadList, stack points to TEB page for simplicity
+    start = dump.pos();
+    dump.u32( 1 );
+    dump.u32( 0x1234 );
+    dump.zero( 12 );
+    dump.u64( TebBase );
+    dump.u64( TebBase );
+    dump.u32( 0x100 );
+    dump.u32( 0 );
+    dump.u32( 0 );
+    dump.u32( 0 );
+    stream( 2, 3, start );
+
+    // MemoryInfoList
+    start = dump.pos();
+    dump.u32( 16 );
+    dump.u32( 48 );
+    dump.u64( 3 );
+    dump.region( ImageBase, image.size(), MEM_COMMIT, PAGE_READONLY, MEM_IMAGE );
+    dump.region( TebBase, 0x2000, MEM_COMMIT, PAGE_READWRITE, MEM_PRIVATE );
+    dump.region( ReservedBase, 0x10000, MEM_RESERVE, PAGE_NOACCESS, MEM_PRIVATE );
+    stream( 3, 16, start );
+
+    // Memory64List, TEB and PEB are separate ranges
+    start = dump.pos();
+    dump.u64( 3 );
+    uint32_t baseRva = dump.pos();
+    dump.u64( 0 );
+    dump.u64( TebBase );
+    dump.u64( 0x1000 );
+    dump.u64( PebBase );
+    dump.u64( 0x1000 );
+    dump.u64( ImageBase );
+    dump.u64( image.size() );
+    stream( 4, 9, start );
+
+    dump.set32( baseRva, dump.pos() );
+
+    std::vector<uint8_t> teb( 0x1000, 0xAA ), peb( 0x1000, 0xBB );
+    memcpy( &teb[0x60], &PebBase, sizeof(PebBase) );
+    dump.data.insert( dump.data.end(), teb.begin(), teb.end() );
+    dump.data.insert( dump.data.end(), peb.begin(), peb.end() );
+    dump.data.insert( dump.data.end(), image.begin(), image.end() );
+
+    return dump.data;
+}
+
+}
+
+/*
+    Index synthetic full memory dump
+*/
+void TestMinidump()
+{
+    std::cout << "Minidump test\n";
+
+    auto image = BuildTestImage( true ).mapped;
+    auto data = BuildDump( image );
+
+    Minidump dump;
+    CHECK( dump.Open( data.data(), data.size() ) == STATUS_SUCCESS );
+    CHECK( dump.is64() );
+
+    CHECK( dump.modules().size() == 1 && dump.modules()[0].path == L"C:\\Windows\\Test.dll" );
+    CHECK( dump.FindModule( ImageBase + 0x10 ) == &dump.modules()[0] && dump.FindModule( ImageBase - 1 ) == nullptr );
+    CHECK( dump.threads().size() == 1 && dump.FindThread( 0x1234 ) != nullptr && dump.FindThread( 0x1234 )->teb == TebBase );
+
+    // Memory is served from dump data
+    size_t available = 0;
+    auto pImage = dump.Translate( ImageBase, available );
+    CHECK( pImage == &data[data.size() - image.size()] && available == image.size() );
+
+    std::vector<uint8_t> buf( image.size() );
+    CHECK( dump.Read( ImageBase, buf.data(), buf.size() ) == STATUS_SUCCESS && buf == image );
+
+    // PEB pointer from TEB, read spanning two ranges
+    ptr_t peb = 0;
+    CHECK( dump.Read( TebBase + 0x60, &peb, sizeof(peb) ) == STATUS_SUCCESS && peb == PebBase );
+    CHECK( dump.Read( TebBase + 0xFF0, buf.data(), 0x20 ) == STATUS_SUCCESS && buf[0] == 0xAA && buf[0x1F] == 0xBB );
+
+    size_t read = 0;
+    CHECK( dump.Read( PebBase + 0xFF0, buf.data(), 0x20, &read ) == STATUS_PARTIAL_COPY && read == 0x10 );
+    CHECK( dump.Read( ReservedBase, buf.data(), 1 ) == STATUS_PARTIAL_COPY );
+
+    // Regions, including gaps between them
+    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+    CHECK( dump.Query( ImageBase + 0x1010, mbi ) == STATUS_SUCCESS && mbi.BaseAddress == ImageBase + 0x1000 );
+    CHECK( mbi.State == MEM_COMMIT && mbi.Type == MEM_IMAGE && mbi.RegionSize == image.size() - 0x1000 );
+    CHECK( dump.Query( 0x10000, mbi ) == STATUS_SUCCESS && mbi.State == MEM_FREE && mbi.RegionSize == TebBase - 0x10000 );
+    CHECK( dump.Query( ReservedBase + 0x5000, mbi ) == STATUS_SUCCESS && mbi.State == MEM_RESERVE );
+    CHECK( dump.Query( ImageBase + image.size(), mbi ) == STATUS_INVALID_PARAMETER );
+
+    // Whole address space sweep
+    RegionMap map( 0x10000, 0x7FFFFFFF0000, [&dump]( ptr_t address, MEMORY_BASIC_INFORMATION64& info )
+    {
+        return dump.Query( address, info );
+    } );
+
+    RegionMap::vecRegions regions;
+    CHECK( map.Enum( 0, 0x7FFFFFFF0000, regions ) == STATUS_SUCCESS && regions.size() == 6 );
+
+    // Pattern search directly in dump data
+    std::vector<ptr_t> found;
+    PatternSearch ps( "PE\0\0", 4 );
+    ps.Search( const_cast<uint8_t*>(pImage), available, found, ImageBase );
+    CHECK( found.size() == 1 && found[0] == ImageBase + 0x80 );
+
+    // Same dump mapped from file
+    FILE* file = fopen( "PortableTest.tmp.dmp", "wb" );
+    CHECK( file != nullptr );
+    if (file != nullptr)
+    {
+        fwrite( data.data(), 1, data.size(), file );
+        fclose( file );
+
+        Minidump mapped;
+        CHECK( mapped.Open( L"PortableTest.tmp.dmp" ) == STATUS_SUCCESS );
+        CHECK( mapped.Read( ImageBase, buf.data(), buf.size() ) == STATUS_SUCCESS && buf == image );
+        mapped.Close();
+
+        remove( "PortableTest.tmp.dmp" );
+    }
+
+    // Truncated dump must be rejected or indexed without reading past the end
+    for (size_t size = 0; size < data.size(); size += 97)
+    {
+        std::vector<uint8_t> part( data.begin(), data.begin() + size );
+
+        Minidump truncated;
+        if (truncated.Open( part.data(), part.size() ) == STATUS_SUCCESS)
+        {
+            truncated.Read( ImageBase, buf.data(), buf.size() );
+            truncated.Query( TebBase, mbi );
+        }
+    }
+
+    data[0] = 'X';
+    CHECK( dump.Open( data.data(), data.size() ) == STATUS_INVALID_IMAGE_FORMAT && !dump.valid() );
+}
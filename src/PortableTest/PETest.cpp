@@ -0,0 +1,339 @@
+#include "Tests.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+/*
+    Parse test image in both file and memory layout
+*/
+void TestPEParser()
+{
+    std::cout << "PEParser test\n";
+
+    for (int is64 = 0; is64 < 2; is64++)
+    {
+        auto image = BuildTestImage( is64 != 0 );
+
+        for (int plain = 0; plain < 2; plain++)
+        {
+            const void* base = plain ? image.file.data() : image.mapped.data();
+            pe::PEParser parser;
+
+            CHECK( parser.Parse( base, plain != 0 ) );
+            CHECK( parser.mType() == (is64 ? mt_mod64 : mt_mod32) );
+            CHECK( parser.imageBase() == image.imageBase );
+            CHECK( parser.imageSize() == image.mapped.size() );
+            CHECK( parser.sections().size() == 3 );
+            CHECK( !parser.IsExe() );
+            CHECK( !parser.IsPureManaged() );
+
+            // Imports
+            auto& imports = parser.ProcessImports();
+            CHECK( imports.size() == 1 );
+
+            auto iter = imports.find( L"KERNEL32.dll" );
+            CHECK( iter != imports.end() );
+            if (iter != imports.end() && iter->second.size() == 2)
+            {
+                CHECK( !iter->second[0].importByOrd && iter->second[0].importName == "Sleep" );
+                CHECK( iter->second[0].ptrRVA == 0x2140 );
+                CHECK( iter->second[1].importByOrd && iter->second[1].importOrdinal == 17 );
+                CHECK( iter->second[1].ptrRVA == 0x2140 + (is64 ? 8u : 4u) );
+            }
+            else
+                CHECK( !"Wrong import count" );
+
+            CHECK( parser.ProcessImports( true ).empty() );
+
+            // Exports
+            std::list<std::string> names;
+            parser.GetExportNames( names );
+            CHECK( names == std::list<std::string>( { "Alpha", "Beta" } ) );
+
+            // TLS callbacks, rebased to new image base
+            std::vector<ptr_t> callbacks;
+            CHECK( parser.GetTLSCallbacks( 0x40000000, callbacks ) == 2 );
+            CHECK( callbacks.size() == 2 && callbacks[0] == 0x40001000 && callbacks[1] == 0x40001008 );
+        }
+
+        // RVA to file offset, including last byte at VirtualAddress + VirtualSize
+        pe::PEParser parser;
+        CHECK( parser.Parse( image.file.data(), true ) );
+        CHECK( parser.ResolveRVAToVA( 0x1000, true ) == 0x400 );
+        CHECK( parser.ResolveRVAToVA( 0x2140, true ) == 0x740 );
+        CHECK( parser.ResolveRVAToVA( 0x3004, true ) == 0xA04 );
+        CHECK( parser.ResolveRVAToVA( 0x1200, true ) == 0x600 );
+        CHECK( parser.ResolveRVAToVA( 0x2000, true ) == 0x600 );
+        CHECK( parser.ResolveRVAToVA( 0x1201, true ) == 0 );
+        CHECK( parser.ResolveRVAToVA( 0x500, true ) == 0 );
+
+        // Parsing again must not accumulate sections
+        CHECK( parser.Parse( image.file.data(), true ) && parser.sections().size() == 3 );
+    }
+
+    // Not a PE file
+    std::vector<uint8_t> junk( 0x1000, 0x90 );
+    pe::PEParser parser;
+    CHECK( !parser.Parse( junk.data(), true ) );
+}
+
+/*
+    Walk test image with PEView and feed truncated copies to it
+*/
+void TestPEView()
+{
+    std::cout << "PEView test\n";
+
+    for (int is64 = 0; is64 < 2; is64++)
+    {
+        auto image = BuildTestImage( is64 != 0 );
+
+        for (int plain = 0; plain < 2; plain++)
+        {
+            auto& data = plain ? image.file : image.mapped;
+            pe::PEView view;
+
+            CHECK( view.Attach( data.data(), data.size(), plain != 0 ) == STATUS_SUCCESS );
+            CHECK( view.valid() && view.is64() == (is64 != 0) );
+            CHECK( view.imageBase() == image.imageBase );
+            CHECK( view.entryPointRVA() == 0x1000 );
+            CHECK( !view.IsExe() );
+
+            int count = 0;
+            for (auto& sec : view.sections())
+                count += (sec.VirtualAddress != 0);
+
+            CHECK( count == 3 );
+
+            // Imports
+            count = 0;
+            for (auto& mod : view.imports())
+            {
+                CHECK( strcmp( mod.name, "KERNEL32.dll" ) == 0 );
+
+                int index = 0;
+                for (auto& func : mod.functions())
+                {
+                    if (index == 0)
+                        CHECK( !func.byOrdinal && strcmp( func.name, "Sleep" ) == 0 && func.hint == 1 );
+                    else
+                        CHECK( func.byOrdinal && func.ordinal == 17 );
+
+                    index++;
+                }
+
+                CHECK( index == 2 );
+                count++;
+            }
+
+            CHECK( count == 1 );
+            CHECK( view.imports( true ).empty() );
+
+            // Exports
+            std::vector<std::string> names;
+            for (auto& exp : view.exports())
+                names.emplace_back( exp.name );
+
+            CHECK( names.size() == 2 && names[0] == "Alpha" && names[1] == "Beta" );
+
+            pe::ViewExport exp;
+            CHECK( view.ExportByOrdinal( 2, exp ) && exp.rva == 0x1008 && exp.forwarder == nullptr );
+            CHECK( !view.ExportByOrdinal( 3, exp ) );
+
+            // TLS
+            std::vector<ptr_t> callbacks;
+            for (auto cb : view.tlsCallbacks())
+                callbacks.push_back( cb );
+
+            CHECK( callbacks.size() == 2 && callbacks[0] == image.imageBase + 0x1000 );
+        }
+
+        // Every truncated copy must be either rejected or walked without reading past the end
+        for (size_t size = 0; size < image.file.size(); size += 7)
+        {
+            std::vector<uint8_t> part( image.file.begin(), image.file.begin() + size );
+            pe::PEView view;
+
+            if (view.Attach( part.data(), part.size() ) != STATUS_SUCCESS)
+                continue;
+
+            for (auto& mod : view.imports())
+                for (auto& func : mod.functions())
+                    CHECK( func.byOrdinal || func.name != nullptr );
+
+            for (auto& exp : view.exports())
+                CHECK( exp.name != nullptr );
+
+            for (auto cb : view.tlsCallbacks())
+                CHECK( cb != 0 );
+        }
+    }
+
+    pe::PEView view;
+    CHECK( view.Attach( nullptr, 0 ) == STATUS_INVALID_IMAGE_FORMAT );
+    CHECK( !view.valid() );
+}
+
+/*
+    Rebase mapped test image
+*/
+void TestRelocations()
+{
+    std::cout << "RelocationPlan test\n";
+
+    for (int is64 = 0; is64 < 2; is64++)
+    {
+        auto image = BuildTestImage( is64 != 0 );
+        pe::PEParser parser;
+        pe::RelocationPlan plan;
+
+        CHECK( parser.Parse( image.mapped.data() ) );
+        CHECK( plan.Build( parser ) == STATUS_SUCCESS );
+        CHECK( plan.size() == 3 );
+
+        const uint64_t delta = 0x10000;
+        CHECK( plan.Apply( image.mapped.data(), image.mapped.size(), delta ) == STATUS_SUCCESS );
+
+        // Callback pointers are moved by delta
+        pe::PEView view;
+        CHECK( view.Attach( image.mapped.data(), image.mapped.size(), false ) == STATUS_SUCCESS );
+
+        ptr_t value = 0;
+        CHECK( view.Read( 0x2340, value ) );
+        if (!is64)
+            value &= 0xFFFFFFFF;
+
+        CHECK( value == image.imageBase + delta + 0x1000 );
+    }
+
+    std::vector<uint8_t> buf( 0x100 );
+    auto put16 = [&buf]( size_t rva, uint16_t v ) { memcpy( &buf[rva], &v, sizeof(v) ); };
+    auto put32 = [&buf]( size_t rva, uint32_t v ) { memcpy( &buf[rva], &v, sizeof(v) ); };
+    auto get16 = [&buf]( size_t rva ) { uint16_t v; memcpy( &v, &buf[rva], sizeof(v) ); return v; };
+    auto get32 = [&buf]( size_t rva ) { uint32_t v; memcpy( &v, &buf[rva], sizeof(v) ); return v; };
+
+    // Known answers for 16 bit and MOVW/MOVT fixups, target value 0x10000200 is moved to 0x22345878
+    put16( 0x10, 0x1111 );                              // HIGH
+    put16( 0x20, 0x1111 );                              // LOW
+    put16( 0x30, 0x1000 );                              // HIGHADJ, low part 0x3040
+    put16( 0x34, 0x1000 );                              // HIGHADJ, low part 0x8800 is negative
+    put32( 0x40, 0xAAAAAAAA );                          // HIGHADJ second slot must not become HIGHLOW fixup here
+    put32( 0x50, 0xE3000200 );                          // movw r0, #0x0200
+    put32( 0x54, 0xE3411000 );                          // movt r1, #0x1000
+    put16( 0x60, 0xF240 ); put16( 0x62, 0x2000 );       // movw r0, #0x0200
+    put16( 0x64, 0xF2C1 ); put16( 0x66, 0x0100 );       // movt r1, #0x1000
+
+    const uint16_t block[] =
+    {
+        0x0000, 0x0000, 0x0018, 0x0000,                 // Page RVA 0, block size 24
+        0x1010, 0x2020, 0x4030, 0x3040, 0x4034, 0x8800, 0x5050, 0x7060
+    };
+
+    pe::RelocationPlan plan;
+    CHECK( plan.Build( block, sizeof(block) ) == STATUS_SUCCESS );
+    CHECK( plan.size() == 6 );
+    CHECK( plan.Apply( buf.data(), buf.size(), 0x12345678 ) == STATUS_SUCCESS );
+
+    CHECK( get16( 0x10 ) == 0x2345 );
+    CHECK( get16( 0x20 ) == 0x6789 );
+    CHECK( get16( 0x30 ) == 0x2235 );                   // 0x10003040 + delta = 0x223486B8, rounded
+    CHECK( get16( 0x34 ) == 0x2234 );                   // 0x0FFF8800 + delta = 0x2233DE78, rounded
+    CHECK( get32( 0x40 ) == 0xAAAAAAAA );
+    CHECK( get32( 0x50 ) == 0xE3050878 );               // movw r0, #0x5878
+    CHECK( get32( 0x54 ) == 0xE3421234 );               // movt r1, #0x2234
+    CHECK( get16( 0x60 ) == 0xF645 && get16( 0x62 ) == 0x0078 );
+    CHECK( get16( 0x64 ) == 0xF2C2 && get16( 0x66 ) == 0x2134 );
+
+    // HIGHADJ without second slot
+    const uint16_t truncated[] = { 0x0000, 0x0000, 0x000A, 0x0000, 0x4030 };
+    CHECK( plan.Build( truncated, sizeof(truncated) ) == STATUS_INVALID_IMAGE_FORMAT );
+    CHECK( plan.empty() );
+
+    // Fixup crossing image end is rejected for every type, even if other types are in bounds
+    const uint16_t types[] = { pe::reloc_high, pe::reloc_low, pe::reloc_highlow, pe::reloc_highadj,
+                               pe::reloc_arm_mov32, pe::reloc_thumb_mov32, pe::reloc_dir64 };
+
+    for (auto type : types)
+    {
+        size_t fixupSize = (type == pe::reloc_highlow) ? 4 : (type >= pe::reloc_arm_mov32 ? 8 : 2);
+        std::vector<pe::RelocationPlan::Record> records;
+
+        for (auto other : types)
+        {
+            pe::RelocationPlan::Record rec = { 0x10, other, 0 };
+            records.emplace_back( rec );
+        }
+
+        pe::RelocationPlan::Record last = { static_cast<uint32_t>(buf.size() - fixupSize), type, 0 };
+        records.emplace_back( last );
+
+        CHECK( plan.Assign( records ) == STATUS_SUCCESS );
+        CHECK( plan.Apply( buf.data(), buf.size(), 0 ) == STATUS_SUCCESS );
+
+        records.back().rva++;
+        auto copy = buf;
+
+        CHECK( plan.Assign( records ) == STATUS_SUCCESS );
+        CHECK( plan.Apply( buf.data(), buf.size(), 0x10000 ) == STATUS_INVALID_IMAGE_FORMAT );
+        CHECK( buf == copy );
+    }
+}
+
+/*
+    Project test image from disk and compare with expected memory layout
+*/
+void TestFileProjection()
+{
+    std::cout << "FileProjection test\n";
+
+    const char* path = "PortableTest.tmp.dll";
+
+    for (int is64 = 0; is64 < 2; is64++)
+    {
+        for (int aligned = 0; aligned < 2; aligned++)
+        {
+            auto image = BuildTestImage( is64 != 0, aligned != 0 );
+
+            FILE* file = fopen( path, "wb" );
+            CHECK( file != nullptr );
+            if (file == nullptr)
+                return;
+
+            fwrite( image.file.data(), 1, image.file.size(), file );
+            fclose( file );
+
+            FileProjection fp;
+            CHECK( fp.Project( L"PortableTest.tmp.dll" ) != nullptr );
+            CHECK( !fp.isPlainData() );
+
+            // Headers and sections must match, padding must be zero-filled
+            auto pImage = reinterpret_cast<const uint8_t*>(fp.base());
+            if (pImage != nullptr)
+                CHECK( memcmp( pImage, image.mapped.data(), image.mapped.size() ) == 0 );
+
+            pe::PEParser parser;
+            CHECK( parser.Parse( fp, fp.isPlainData() ) );
+            CHECK( parser.ProcessImports().size() == 1 );
+
+            std::list<std::string> names;
+            parser.GetExportNames( names );
+            CHECK( names.size() == 2 );
+        }
+    }
+
+    // Not an image - raw data fallback
+    FILE* file = fopen( path, "wb" );
+    if (file != nullptr)
+    {
+        fputs( "not a PE file", file );
+        fclose( file );
+    }
+
+    FileProjection fp;
+    CHECK( fp.Project( L"PortableTest.tmp.dll" ) != nullptr && fp.isPlainData() );
+    fp.Release();
+
+    remove( path );
+    CHECK( fp.Project( L"PortableTest.tmp.dll" ) == nullptr );
+}
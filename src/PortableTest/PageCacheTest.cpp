@@ -0,0 +1,90 @@
+#include "Tests.h"
+#include "../BlackBone/PageCache.h"
+
+#include <cstring>
+
+/*
+    Read through page cache backed by local buffer acting as target memory
+*/
+void TestPageCache()
+{
+    std::cout << "PageCache test\n";
+
+    const ptr_t base = 0x10000;
+    std::vector<uint8_t> target( 0x10000 );
+    for (size_t i = 0; i < target.size(); i++)
+        target[i] = static_cast<uint8_t>(i * 7);
+
+    int fetches = 0;
+    auto fetch = [&]( ptr_t page, void* buffer ) -> NTSTATUS
+    {
+        fetches++;
+        if (page < base || page + PageCache::PageSize > base + target.size())
+            return STATUS_PARTIAL_COPY;
+
+        memcpy( buffer, &target[static_cast<size_t>(page - base)], PageCache::PageSize );
+        return STATUS_SUCCESS;
+    };
+
+    auto same = [&]( ptr_t address, const std::vector<uint8_t>& data )
+    {
+        return memcmp( &target[static_cast<size_t>(address - base)], data.data(), data.size() ) == 0;
+    };
+
+    PageCache cache( 2 );
+    std::vector<uint8_t> buf( 0x1800 );
+
+    // Read crossing page boundary, then served from cache
+    CHECK( cache.active( buf.size() ) && !cache.active( PageCache::MaxCachedRead + 1 ) );
+    CHECK( cache.Read( base + 0x800, buf.size(), buf.data(), fetch ) == STATUS_SUCCESS );
+    CHECK( same( base + 0x800, buf ) && fetches == 2 );
+    CHECK( cache.Read( base + 0x900, 0x100, buf.data(), fetch ) == STATUS_SUCCESS && fetches == 2 );
+
+    // Target changed, range invalidation drops affected page only
+    target[0x1000] ^= 0xFF;
+    cache.Invalidate( base + 0x1000, 1 );
+    CHECK( cache.Read( base + 0x800, buf.size(), buf.data(), fetch ) == STATUS_SUCCESS );
+    CHECK( same( base + 0x800, buf ) && fetches == 3 );
+
+    // LRU eviction, page 0 is the least recent one
+    CHECK( cache.Read( base + 0x2000, 0x10, buf.data(), fetch ) == STATUS_SUCCESS && fetches == 4 );
+    CHECK( cache.Read( base + 0x1000, 0x10, buf.data(), fetch ) == STATUS_SUCCESS && fetches == 4 );
+    CHECK( cache.Read( base, 0x10, buf.data(), fetch ) == STATUS_SUCCESS && fetches == 5 );
+    CHECK( cache.stats().evictions == 2 );
+
+    // Epoch bump makes everything stale
+    cache.BumpEpoch();
+    CHECK( cache.Read( base, 0x10, buf.data(), fetch ) == STATUS_SUCCESS && fetches == 6 );
+
+    // Failed page is reported and not cached
+    CHECK( cache.Read( base - 0x10, 0x20, buf.data(), fetch ) == STATUS_PARTIAL_COPY );
+    CHECK( cache.Read( base - 0x10, 0x20, buf.data(), fetch ) == STATUS_PARTIAL_COPY );
+
+    // Snapshot keeps every page and defers epoch change, even with cache disabled
+    cache.SetCapacity( 0 );
+    CHECK( !cache.active( 1 ) );
+    {
+        PageCache::Snapshot snapshot( cache );
+        CHECK( cache.active( 1 ) );
+
+        fetches = 0;
+        for (ptr_t page = base; page < base + 0x8000; page += PageCache::PageSize)
+            cache.Read( page, 0x10, buf.data(), fetch );
+
+        target[0] ^= 0xFF;
+        cache.BumpEpoch();
+
+        std::vector<uint8_t> first( 1 );
+        CHECK( cache.Read( base, 1, first.data(), fetch ) == STATUS_SUCCESS );
+        CHECK( fetches == 8 && first[0] != target[0] );
+    }
+
+    CHECK( !cache.active( 1 ) );
+    CHECK( cache.Read( base, 1, buf.data(), fetch ) == STATUS_SUCCESS && buf[0] == target[0] && fetches == 9 );
+
+    auto stats = cache.stats();
+    CHECK( stats.hits > 0 && stats.misses > 0 );
+
+    cache.Reset();
+    CHECK( cache.stats().hits == 0 );
+}
@@ -0,0 +1,234 @@
+#include "Tests.h"
+#include "../BlackBone/SimulatedMemory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+
+namespace
+{
+
+/// <summary>
+/// Reference search, byte by byte
+/// </summary>
+std::vector<ptr_t> NaiveSearch( const std::vector<uint8_t>& data, const Signature& sig, ptr_t base )
+{
+    std::vector<ptr_t> result;
+
+    for (size_t i = 0; i + sig.size() <= data.size(); i++)
+    {
+        size_t j = 0;
+        for (; j < sig.size() && (data[i + j] & sig.mask[j]) == sig.value[j]; j++);
+
+        if (j == sig.size())
+            result.push_back( base + i );
+    }
+
+    return result;
+}
+
+}
+
+/*
+    Compare every search kernel against reference search
+*/
+void TestPatternSearch()
+{
+    std::cout << "PatternSearch test\n";
+
+    std::vector<uint8_t> buf( 1024 * 1024 );
+    std::mt19937 rng( 0 );
+    for (auto& val : buf)
+        val = static_cast<uint8_t>(rng() % 4 == 0 ? 0x48 : rng());
+
+    // 48 8B ?? ?? E8 ?? ?? ?? ?? 8? C0
+    Signature sig;
+    CHECK( sig.Parse( "48 8B ?? ?? E8 ?? ?? ?? ?? 8? C0" ) );
+    CHECK( sig.size() == 11 && sig.mask[9] == 0xF0 );
+    CHECK( !Signature().Parse( "48 XY" ) );
+
+    // Plant matches, including one at the very end
+    for (size_t i = 0; i < 200; i++)
+    {
+        size_t pos = (i == 0) ? buf.size() - sig.size() : rng() % (buf.size() - sig.size());
+        for (size_t j = 0; j < sig.size(); j++)
+            buf[pos + j] = (buf[pos + j] & ~sig.mask[j]) | sig.value[j];
+    }
+
+    const ptr_t base = 0x10000;
+    auto reference = NaiveSearch( buf, sig, base );
+    CHECK( reference.size() >= 200 );
+
+    // Same pattern in wildcard form
+    std::vector<uint8_t> wild( sig.value );
+    for (size_t i = 0; i < wild.size(); i++)
+        if (sig.mask[i] == 0)
+            wild[i] = 0xCC;
+
+    Signature wildSig;
+    wildSig.value = sig.value;
+    wildSig.mask = sig.mask;
+    wildSig.mask[9] = 0xFF;
+    wildSig.value[9] = wild[9];
+
+    auto wildReference = NaiveSearch( buf, wildSig, base );
+
+    PatternSearch ps( sig );
+    PatternSearch psWild( wild );
+
+    for (int level = simd_none; level <= PatternSearch::SupportedSimd(); level++)
+    {
+        std::vector<ptr_t> found;
+        ps.simd( static_cast<eSimdLevel>(level) );
+        ps.Search( buf.data(), buf.size(), found, base );
+        CHECK( found == reference );
+
+        found.clear();
+        psWild.simd( static_cast<eSimdLevel>(level) );
+        psWild.Search( 0xCC, buf.data(), buf.size(), found, base );
+        CHECK( found == wildReference );
+    }
+
+    // Exact byte of signature equal to wildcard value must not become a wildcard
+    Signature ccSig;
+    CHECK( ccSig.Parse( "CC 48 ?? CC" ) );
+
+    for (size_t i = 0; i < 50; i++)
+    {
+        size_t pos = rng() % (buf.size() - ccSig.size());
+        buf[pos] = 0xCC;
+        buf[pos + 1] = 0x48;
+        buf[pos + 3] = 0xCC;
+    }
+
+    auto ccReference = NaiveSearch( buf, ccSig, base );
+    PatternSearch psCC( ccSig );
+
+    for (int level = simd_none; level <= PatternSearch::SupportedSimd(); level++)
+    {
+        std::vector<ptr_t> found;
+        psCC.simd( static_cast<eSimdLevel>(level) );
+        psCC.Search( 0xCC, buf.data(), buf.size(), found, base );
+        CHECK( !ccReference.empty() && found == ccReference );
+    }
+
+    reference = NaiveSearch( buf, sig, base );
+    CHECK( ps.FindFirst( buf.data(), buf.size(), base ) == reference.front() );
+
+    // Lazy iteration must stop at requested match
+    size_t count = 0;
+    for (auto addr : ps.Matches( buf.data(), buf.size(), base ))
+    {
+        CHECK( addr == reference[count] );
+        if (++count == 3)
+            break;
+    }
+
+    CHECK( count == 3 );
+
+    // Exact patterns in a single pass
+    PatternSet set;
+    auto first = set.Add( "\x48\x8B\x05", 3 );
+    auto second = set.Add( "\xE8", 1 );
+
+    std::vector<PatternSet::Match> matches;
+    set.Search( buf.data(), buf.size(), matches, base );
+
+    std::vector<uint8_t> firstBytes = { 0x48, 0x8B, 0x05 };
+    std::vector<ptr_t> firstRef;
+    PatternSearch( firstBytes ).Search( buf.data(), buf.size(), firstRef, base );
+
+    std::vector<ptr_t> firstFound;
+    size_t secondCount = 0;
+    for (auto& match : matches)
+    {
+        if (match.index == first)
+            firstFound.push_back( match.address );
+        else if (match.index == second)
+            secondCount++;
+    }
+
+    CHECK( firstFound == firstRef );
+    CHECK( secondCount == static_cast<size_t>(std::count( buf.begin(), buf.end(), 0xE8 )) );
+
+    // Empty patterns never match, same as single pattern search
+    PatternSet withEmpty;
+    auto empty = withEmpty.Add( std::vector<uint8_t>() );
+    auto emptyWild = withEmpty.Add( std::vector<uint8_t>(), 0xCC );
+    auto call = withEmpty.Add( "\xE8", 1 );
+
+    std::vector<ptr_t> emptyFound;
+    PatternSearch( std::vector<uint8_t>() ).Search( buf.data(), buf.size(), emptyFound, base );
+
+    matches.clear();
+    withEmpty.Search( buf.data(), buf.size(), matches, base );
+
+    CHECK( empty != emptyWild && empty != call && emptyWild != call );
+    CHECK( emptyFound.empty() );
+    CHECK( matches.size() == secondCount );
+    CHECK( std::all_of( matches.begin(), matches.end(), [call]( const PatternSet::Match& m ) { return m.index == call; } ) );
+
+    // Section scoped search in test image
+    auto image = BuildTestImage( true );
+    pe::PEParser parser;
+    CHECK( parser.Parse( image.file.data(), true ) );
+
+    std::vector<uint8_t> code = { 0x48, 0x8B, 0x05 };
+    std::vector<ptr_t> inCode, inData;
+    PatternSearch( code ).SearchImage( parser, image.file.size(), SectionFilter::Code(), inCode, image.imageBase );
+    PatternSearch( code ).SearchImage( parser, image.file.size(), SectionFilter::Data(), inData, image.imageBase );
+
+    CHECK( inCode.size() == 1 && inCode[0] == image.imageBase + 0x1001 );
+    CHECK( inData.empty() );
+
+    // Raw data is clipped to file size
+    size_t rawCode = parser.sections()[0].PointerToRawData;
+    inCode.clear();
+    PatternSearch( code ).SearchImage( parser, rawCode + 3, SectionFilter::Code(), inCode, image.imageBase );
+    CHECK( inCode.empty() );
+
+    PatternSearch( code ).SearchImage( parser, rawCode + 4, SectionFilter::Code(), inCode, image.imageBase );
+    CHECK( inCode.size() == 1 );
+
+    inData.clear();
+    PatternSearch( code ).SearchImage( parser, rawCode, SectionFilter(), inData, image.imageBase );
+    CHECK( inData.empty() );
+
+    // Committed regions of simulated address space, match across parallel chunk border
+    SimulatedMemory mem( true );
+    const uint8_t marker[] = { 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88 };
+    const size_t bigSize = 5 * 1024 * 1024;
+    ptr_t big = 0, small = 0;
+
+    CHECK( mem.Allocate( big, bigSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ) == STATUS_SUCCESS );
+    CHECK( mem.Allocate( small, 0x2000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ) == STATUS_SUCCESS );
+
+    std::vector<ptr_t> expected = { big, big + 4 * 1024 * 1024 - 3, big + bigSize - sizeof(marker), small + 0x10 };
+    for (auto address : expected)
+        mem.Write( address, marker, sizeof(marker) );
+
+    // Unreadable page is skipped
+    mem.Write( small + 0x1010, marker, sizeof(marker) );
+    mem.Protect( small + 0x1000, 0x1000, PAGE_NOACCESS );
+    std::sort( expected.begin(), expected.end() );
+
+    RegionMap map( mem.minAddr(), mem.maxAddr(), [&mem]( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi )
+    {
+        return mem.Query( address, mbi );
+    } );
+
+    auto read = [&mem]( ptr_t address, size_t size, void* buffer ) { return mem.Read( address, buffer, size ); };
+
+    std::vector<uint8_t> wildMarker( marker, marker + sizeof(marker) );
+    wildMarker[3] = 0xCC;
+
+    for (size_t threads : { 1, 0, 3 })
+    {
+        std::vector<ptr_t> found;
+        PatternSearch( marker, sizeof(marker) ).SearchRegions( map, mem.minAddr(), mem.maxAddr(), read, false, 0, found, threads );
+        CHECK( found == expected );
+
+        PatternSearch( wildMarker ).SearchRegions( map, mem.minAddr(), mem.maxAddr(), read, true, 0xCC, found, threads );
+        CHECK( found == expected );
+    }
+}
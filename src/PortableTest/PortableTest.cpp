@@ -0,0 +1,245 @@
+#include "Tests.h"
+
+#include <cstring>
+
+int g_failed = 0;
+
+namespace
+{
+
+// Layout of test image
+const uint32_t HeadersSize = 0x400;
+const uint32_t ImageSize = 0x4000;
+
+struct SectionInfo
+{
+    const char* name;
+    uint32_t rva;
+    uint32_t rawOffset;
+    uint32_t rawSize;
+    uint32_t flags;
+};
+
+const SectionInfo g_sections[] =
+{
+    { ".text",  0x1000, 0x400, 0x200, IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE | IMAGE_SCN_MEM_READ },
+    { ".rdata", 0x2000, 0x600, 0x400, IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ },
+    { ".reloc", 0x3000, 0xA00, 0x200, IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_DISCARDABLE },
+};
+
+template<typename T>
+void Put( std::vector<uint8_t>& img, uint32_t rva, const T& value )
+{
+    memcpy( &img[rva], &value, sizeof(value) );
+}
+
+void PutString( std::vector<uint8_t>& img, uint32_t rva, const char* str )
+{
+    memcpy( &img[rva], str, strlen( str ) + 1 );
+}
+
+/// <summary>
+/// Fill optional header fields common for PE32 and PE32+
+/// </summary>
+template<typename T>
+void FillOptional( T& hdr, WORD magic, ptr_t imageBase, uint32_t fileAlign )
+{
+    hdr.Magic = magic;
+    hdr.AddressOfEntryPoint = 0x1000;
+    hdr.ImageBase = static_cast<decltype(hdr.ImageBase)>(imageBase);
+    hdr.SectionAlignment = 0x1000;
+    hdr.FileAlignment = fileAlign;
+    hdr.SizeOfImage = ImageSize;
+    hdr.SizeOfHeaders = static_cast<DWORD>(Align( HeadersSize, fileAlign ));
+    hdr.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+
+    hdr.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress = 0x2000;
+    hdr.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].Size = 2 * sizeof(IMAGE_IMPORT_DESCRIPTOR);
+    hdr.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress = 0x2200;
+    hdr.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].Size = 0x100;
+    hdr.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress = 0x2300;
+    hdr.DataDirectory[IMAGE_DIRECTORY_ENTRY_TLS].Size = magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC ?
+        sizeof(IMAGE_TLS_DIRECTORY64) : sizeof(IMAGE_TLS_DIRECTORY32);
+    hdr.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress = 0x3000;
+    hdr.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size = 0x10;
+}
+
+}
+
+/// <summary>
+/// Build small dll with imports, exports, TLS callbacks and relocations.
+/// Image is first laid out by RVA, then sections are copied into file layout.
+/// </summary>
+/// <param name="is64">Build PE32+ image</param>
+/// <param name="pageAligned">Use page file alignment, so file offsets match RVAs</param>
+/// <returns>Test image</returns>
+TestImage BuildTestImage( bool is64, bool pageAligned /*= false*/ )
+{
+    TestImage result;
+    auto& img = result.mapped;
+    uint32_t ptrSize = is64 ? sizeof(uint64_t) : sizeof(uint32_t);
+    uint32_t fileAlign = pageAligned ? 0x1000 : 0x200;
+
+    result.imageBase = is64 ? 0x180000000ull : 0x10000000ull;
+    img.resize( ImageSize );
+
+    // Headers
+    IMAGE_DOS_HEADER dos = { 0 };
+    dos.e_magic = IMAGE_DOS_SIGNATURE;
+    dos.e_lfanew = 0x80;
+    Put( img, 0, dos );
+
+    IMAGE_FILE_HEADER file = { 0 };
+    file.Machine = is64 ? IMAGE_FILE_MACHINE_AMD64 : IMAGE_FILE_MACHINE_I386;
+    file.NumberOfSections = ARRAYSIZE( g_sections );
+    file.Characteristics = IMAGE_FILE_DLL | IMAGE_FILE_EXECUTABLE_IMAGE;
+
+    uint32_t secOfs = 0;
+    if (is64)
+    {
+        IMAGE_NT_HEADERS64 nt = { 0 };
+        nt.Signature = IMAGE_NT_SIGNATURE;
+        nt.FileHeader = file;
+        nt.FileHeader.SizeOfOptionalHeader = sizeof(nt.OptionalHeader);
+        FillOptional( nt.OptionalHeader, IMAGE_NT_OPTIONAL_HDR64_MAGIC, result.imageBase, fileAlign );
+        Put( img, 0x80, nt );
+        secOfs = 0x80 + sizeof(nt);
+    }
+    else
+    {
+        IMAGE_NT_HEADERS32 nt = { 0 };
+        nt.Signature = IMAGE_NT_SIGNATURE;
+        nt.FileHeader = file;
+        nt.FileHeader.SizeOfOptionalHeader = sizeof(nt.OptionalHeader);
+        FillOptional( nt.OptionalHeader, IMAGE_NT_OPTIONAL_HDR32_MAGIC, result.imageBase, fileAlign );
+        Put( img, 0x80, nt );
+        secOfs = 0x80 + sizeof(nt);
+    }
+
+    for (auto& info : g_sections)
+    {
+        IMAGE_SECTION_HEADER sec = { 0 };
+        memcpy( sec.Name, info.name, strlen( info.name ) );
+        sec.Misc.VirtualSize = pageAligned ? fileAlign : info.rawSize;
+        sec.VirtualAddress = info.rva;
+        sec.SizeOfRawData = sec.Misc.VirtualSize;
+        sec.PointerToRawData = pageAligned ? info.rva : info.rawOffset;
+        sec.Characteristics = info.flags;
+        Put( img, secOfs, sec );
+        secOfs += sizeof(sec);
+    }
+
+    // Code: push rbp; mov rax, [rip+0]; call rel32; int3 padding
+    const uint8_t code[] = { 0x55, 0x48, 0x8B, 0x05, 0, 0, 0, 0, 0xE8, 0, 0, 0, 0, 0xC3 };
+    memcpy( &img[0x1000], code, sizeof(code) );
+    memset( &img[0x1000 + sizeof(code)], 0xCC, 0x10 );
+
+    // Import from KERNEL32.dll: Sleep by name and #17 by ordinal
+    IMAGE_IMPORT_DESCRIPTOR imp = { 0 };
+    imp.OriginalFirstThunk = 0x2100;
+    imp.FirstThunk = 0x2140;
+    imp.Name = 0x2180;
+    Put( img, 0x2000, imp );
+
+    uint64_t thunks[] = { 0x21A0, (is64 ? IMAGE_ORDINAL_FLAG64 : IMAGE_ORDINAL_FLAG32) | 17 };
+    for (uint32_t i = 0; i < ARRAYSIZE( thunks ); i++)
+    {
+        memcpy( &img[0x2100 + i * ptrSize], &thunks[i], ptrSize );
+        memcpy( &img[0x2140 + i * ptrSize], &thunks[i], ptrSize );
+    }
+
+    PutString( img, 0x2180, "KERNEL32.dll" );
+    Put<WORD>( img, 0x21A0, 1 );
+    PutString( img, 0x21A2, "Sleep" );
+
+    // Export Alpha and Beta, ordinal base 1
+    IMAGE_EXPORT_DIRECTORY exp = { 0 };
+    exp.Name = 0x2280;
+    exp.Base = 1;
+    exp.NumberOfFunctions = 2;
+    exp.NumberOfNames = 2;
+    exp.AddressOfFunctions = 0x2240;
+    exp.AddressOfNames = 0x2250;
+    exp.AddressOfNameOrdinals = 0x2260;
+    Put( img, 0x2200, exp );
+
+    Put<DWORD>( img, 0x2240, 0x1000 );
+    Put<DWORD>( img, 0x2244, 0x1008 );
+    Put<DWORD>( img, 0x2250, 0x2290 );
+    Put<DWORD>( img, 0x2254, 0x22A0 );
+    Put<WORD>( img, 0x2260, 0 );
+    Put<WORD>( img, 0x2262, 1 );
+    PutString( img, 0x2280, "test.dll" );
+    PutString( img, 0x2290, "Alpha" );
+    PutString( img, 0x22A0, "Beta" );
+
+    // Two TLS callbacks
+    uint32_t callbacksOfs = 0;
+    if (is64)
+    {
+        IMAGE_TLS_DIRECTORY64 tls = { 0 };
+        tls.AddressOfCallBacks = result.imageBase + 0x2340;
+        Put( img, 0x2300, tls );
+        callbacksOfs = 0x2300 + FIELD_OFFSET( IMAGE_TLS_DIRECTORY64, AddressOfCallBacks );
+    }
+    else
+    {
+        IMAGE_TLS_DIRECTORY32 tls = { 0 };
+        tls.AddressOfCallBacks = static_cast<DWORD>(result.imageBase + 0x2340);
+        Put( img, 0x2300, tls );
+        callbacksOfs = 0x2300 + FIELD_OFFSET( IMAGE_TLS_DIRECTORY32, AddressOfCallBacks );
+    }
+
+    uint64_t callbacks[] = { result.imageBase + 0x1000, result.imageBase + 0x1008 };
+    for (uint32_t i = 0; i < ARRAYSIZE( callbacks ); i++)
+        memcpy( &img[0x2340 + i * ptrSize], &callbacks[i], ptrSize );
+
+    // Relocations for TLS pointers, padded with absolute entry
+    WORD type = is64 ? IMAGE_REL_BASED_DIR64 : IMAGE_REL_BASED_HIGHLOW;
+    Put<DWORD>( img, 0x3000, 0x2000 );
+    Put<DWORD>( img, 0x3004, 0x10 );
+    Put<WORD>( img, 0x3008, static_cast<WORD>((type << 12) | (callbacksOfs - 0x2000)) );
+    Put<WORD>( img, 0x300A, static_cast<WORD>((type << 12) | 0x340) );
+    Put<WORD>( img, 0x300C, static_cast<WORD>((type << 12) | (0x340 + ptrSize)) );
+    Put<WORD>( img, 0x300E, IMAGE_REL_BASED_ABSOLUTE );
+
+    // File layout
+    if (pageAligned)
+    {
+        result.file = img;
+        return result;
+    }
+
+    result.file.assign( img.begin(), img.begin() + HeadersSize );
+    for (auto& info : g_sections)
+    {
+        result.file.resize( info.rawOffset + info.rawSize );
+        memcpy( &result.file[info.rawOffset], &img[info.rva], info.rawSize );
+    }
+
+    return result;
+}
+
+int main( int /*argc*/, char* /*argv*/[] )
+{
+    TestPEParser();
+    TestPEView();
+    TestRelocations();
+    TestFileProjection();
+    TestImageNET();
+    TestPageCache();
+    TestRegionMap();
+    TestMinidump();
+    TestSimulatedMemory();
+    TestPatternSearch();
+    TestLDasm();
+
+    if (g_failed != 0)
+    {
+        std::cout << g_failed << " checks failed\n";
+        return 1;
+    }
+
+    std::cout << "All tests passed\n";
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "Tests.h"
+#include "../BlackBone/RegionMap.h"
+
+namespace
+{
+
+// Page attributes of fake address space
+struct FakePage
+{
+    DWORD state;
+    DWORD protect;
+    ptr_t allocationBase;
+};
+
+const ptr_t FakeBase = 0x10000;
+const ptr_t PageSize = RegionMap::PageSize;
+
+/// <summary>
+/// Set attributes of page range
+/// </summary>
+void SetPages( std::vector<FakePage>& pages, ptr_t address, size_t count, DWORD state, DWORD protect, ptr_t allocationBase )
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        FakePage page = { state, protect, allocationBase };
+        pages[static_cast<size_t>((address - FakeBase) / PageSize) + i] = page;
+    }
+}
+
+}
+
+/*
+    Region map over fake address space with VirtualQueryEx semantics
+*/
+void TestRegionMap()
+{
+    std::cout << "RegionMap test\n";
+
+    FakePage freePage = { MEM_FREE, PAGE_NOACCESS, 0 };
+    std::vector<FakePage> pages( 64, freePage );
+
+    SetPages( pages, 0x12000, 4, MEM_COMMIT, PAGE_READONLY, 0x12000 );
+    SetPages( pages, 0x16000, 2, MEM_COMMIT, PAGE_EXECUTE_READ, 0x12000 );
+    SetPages( pages, 0x20000, 16, MEM_COMMIT, PAGE_READWRITE, 0x20000 );
+
+    // Pages past the end are outside user space
+    int queries = 0;
+    auto query = [&]( ptr_t address, MEMORY_BASIC_INFORMATION64& mbi ) -> NTSTATUS
+    {
+        queries++;
+
+        size_t idx = static_cast<size_t>((address - FakeBase) / PageSize);
+        if (address < FakeBase || idx >= pages.size())
+            return STATUS_INVALID_PARAMETER;
+
+        size_t last = idx;
+        auto& page = pages[idx];
+        while (last + 1 < pages.size() && pages[last + 1].state == page.state &&
+               pages[last + 1].protect == page.protect && pages[last + 1].allocationBase == page.allocationBase)
+        {
+            last++;
+        }
+
+        mbi.BaseAddress = address & ~(PageSize - 1);
+        mbi.AllocationBase = page.allocationBase;
+        mbi.AllocationProtect = page.protect;
+        mbi.RegionSize = FakeBase + (last + 1) * PageSize - mbi.BaseAddress;
+        mbi.State = page.state;
+        mbi.Protect = page.protect;
+        mbi.Type = MEM_PRIVATE;
+        return STATUS_SUCCESS;
+    };
+
+    // Every page must match fake address space
+    auto consistent = [&]( RegionMap& map )
+    {
+        for (size_t i = 0; i < pages.size(); i++)
+        {
+            MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+            ptr_t address = FakeBase + i * PageSize + 0x10;
+
+            if (map.Query( address, mbi ) != STATUS_SUCCESS || mbi.BaseAddress != address - 0x10)
+                return false;
+            if (mbi.State != pages[i].state || mbi.Protect != pages[i].protect || mbi.AllocationBase != pages[i].allocationBase)
+                return false;
+        }
+
+        return true;
+    };
+
+    RegionMap map( FakeBase, 0x7FFFFFFF0000, query );
+    RegionMap::vecRegions regions;
+
+    // Single sweep, lookups don't query target
+    CHECK( map.Enum( 0, 0x7FFFFFFF0000, regions ) == STATUS_SUCCESS );
+    CHECK( regions.size() == 6 && queries == 7 );
+    CHECK( consistent( map ) && queries == 7 );
+
+    // Range is clipped
+    CHECK( map.Enum( 0x13000, 0x21000, regions ) == STATUS_SUCCESS );
+    CHECK( regions.size() == 4 && regions.front().BaseAddress == 0x13000 && regions.front().RegionSize == 0x3000 );
+    CHECK( regions.back().BaseAddress == 0x20000 && regions.back().RegionSize == 0x1000 );
+
+    // Allocation inside free region, only its range is queried again
+    SetPages( pages, 0x30000, 2, MEM_COMMIT, PAGE_READWRITE, 0x30000 );
+    map.Invalidate( 0x30000, 0x2000 );
+    CHECK( consistent( map ) && queries == 8 );
+
+    // Protection change splits region
+    SetPages( pages, 0x24000, 1, MEM_COMMIT, PAGE_NOACCESS, 0x20000 );
+    map.Invalidate( 0x24000, 0x10 );
+    CHECK( consistent( map ) && queries == 9 );
+
+    // Release without size covers whole allocation, freed range merges with following free region
+    SetPages( pages, 0x12000, 6, MEM_FREE, PAGE_NOACCESS, 0 );
+    map.Invalidate( 0x12000, 0 );
+    CHECK( consistent( map ) && queries == 10 );
+
+    // Changes made by target are visible after reset
+    SetPages( pages, 0x40000, 1, MEM_COMMIT, PAGE_READONLY, 0x40000 );
+    map.Reset();
+    CHECK( consistent( map ) && queries > 10 );
+}
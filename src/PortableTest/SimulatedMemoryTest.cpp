@@ -0,0 +1,164 @@
+#include "Tests.h"
+#include "../BlackBone/SimulatedMemory.h"
+#include "../BlackBone/RegionMap.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+
+/// <summary>
+/// Read target pointer
+/// </summary>
+/// <param name="mem">Address space</param>
+/// <param name="address">Pointer address</param>
+/// <returns>Pointer value, 0 if failed</returns>
+ptr_t ReadPtr( SimulatedMemory& mem, ptr_t address )
+{
+    ptr_t value = 0;
+    mem.Read( address, &value, mem.is64() ? sizeof(DWORD64) : sizeof(DWORD) );
+    return value;
+}
+
+/// <summary>
+/// Load test image at non-preferred base and walk PEB loader list
+/// </summary>
+/// <param name="is64">Image bitness</param>
+void TestSimulatedImage( bool is64 )
+{
+    const ptr_t ptrSize = is64 ? 8 : 4;
+    auto image = BuildTestImage( is64 );
+
+    FILE* file = fopen( "PortableTest.tmp.dll", "wb" );
+    CHECK( file != nullptr );
+    if (file == nullptr)
+        return;
+
+    fwrite( image.file.data(), 1, image.file.size(), file );
+    fclose( file );
+
+    SimulatedMemory mem( is64 );
+    ptr_t base = image.imageBase + 0x100000;
+
+    CHECK( mem.LoadImage( L"C:\\Windows\\PortableTest.tmp.dll", base ) == STATUS_OBJECT_NAME_NOT_FOUND );
+    CHECK( mem.LoadImage( L"PortableTest.tmp.dll", base ) == STATUS_SUCCESS && base == image.imageBase + 0x100000 );
+    CHECK( mem.LoadImage( L"PortableTest.tmp.dll", base ) == STATUS_CONFLICTING_ADDRESSES );
+    CHECK( mem.modules().size() == 1 );
+
+    remove( "PortableTest.tmp.dll" );
+
+    // Code is copied as is, TLS callbacks are rebased
+    std::vector<uint8_t> buf( 0x200 );
+    CHECK( mem.Read( base + 0x1000, buf.data(), buf.size() ) == STATUS_SUCCESS );
+    CHECK( memcmp( buf.data(), &image.mapped[0x1000], buf.size() ) == 0 );
+    CHECK( ReadPtr( mem, base + 0x2340 ) == base + 0x1000 && ReadPtr( mem, base + 0x2340 + ptrSize ) == base + 0x1008 );
+
+    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+    CHECK( mem.Query( base + 0x1010, mbi ) == STATUS_SUCCESS && mbi.BaseAddress == base + 0x1000 && mbi.RegionSize == 0x1000 );
+    CHECK( mbi.AllocationBase == base && mbi.Type == MEM_IMAGE && mbi.Protect == PAGE_EXECUTE_READ );
+    CHECK( mem.Query( base + 0x2000, mbi ) == STATUS_SUCCESS && mbi.RegionSize == 0x2000 && mbi.Protect == PAGE_READONLY );
+
+    // PEB -> PEB_LDR_DATA -> first InLoadOrder entry
+    ptr_t ldr = ReadPtr( mem, mem.peb() + 3 * ptrSize );
+    ptr_t head = ldr + (is64 ? 0x10 : 0xC);
+    ptr_t entry = ReadPtr( mem, head );
+
+    CHECK( entry == mem.modules()[0].ldrEntry && ReadPtr( mem, entry ) == head && ReadPtr( mem, head + ptrSize ) == entry );
+    CHECK( ReadPtr( mem, entry + 6 * ptrSize ) == base );
+
+    WORD length = 0;
+    ptr_t baseName = entry + (is64 ? 0x58 : 0x2C);
+    CHECK( mem.Read( baseName, &length, sizeof(length) ) == STATUS_SUCCESS && length == 20 * sizeof(WORD) );
+
+    std::vector<WORD> name( length / sizeof(WORD) );
+    CHECK( mem.Read( ReadPtr( mem, baseName + ptrSize ), name.data(), length ) == STATUS_SUCCESS );
+    CHECK( std::wstring( name.begin(), name.end() ) == L"PortableTest.tmp.dll" );
+
+    // TEB points to PEB
+    ptr_t teb = 0;
+    CHECK( mem.CreateThread( 7, teb ) == STATUS_SUCCESS && mem.FindThread( 7 )->teb == teb );
+    CHECK( mem.CreateThread( 7, teb ) == STATUS_INVALID_PARAMETER );
+    CHECK( ReadPtr( mem, teb + 12 * ptrSize ) == mem.peb() );
+}
+
+}
+
+/*
+    Allocation rules, image loading and call accounting of simulated address space
+*/
+void TestSimulatedMemory()
+{
+    std::cout << "SimulatedMemory test\n";
+
+    TestSimulatedImage( false );
+    TestSimulatedImage( true );
+
+    SimulatedMemory mem( true );
+    MEMORY_BASIC_INFORMATION64 mbi = { 0 };
+    uint8_t buf[0x20] = { 0 };
+    size_t done = 0;
+
+    // Reserve, then commit the middle page
+    ptr_t address = 0;
+    CHECK( mem.Allocate( address, 0x3000, MEM_RESERVE, PAGE_READWRITE ) == STATUS_SUCCESS );
+    CHECK( address % SimulatedMemory::AllocationGranularity == 0 );
+    CHECK( mem.Read( address, buf, 1, &done ) == STATUS_PARTIAL_COPY && done == 0 );
+
+    ptr_t page = address + 0x1010;
+    CHECK( mem.Allocate( page, 0x10, MEM_COMMIT, PAGE_READWRITE ) == STATUS_SUCCESS && page == address + 0x1000 );
+    CHECK( mem.Query( address, mbi ) == STATUS_SUCCESS && mbi.State == MEM_RESERVE && mbi.RegionSize == 0x1000 );
+    CHECK( mem.Query( page, mbi ) == STATUS_SUCCESS && mbi.State == MEM_COMMIT && mbi.RegionSize == 0x1000 );
+
+    memset( buf, 0x5A, sizeof(buf) );
+    CHECK( mem.Write( page + 0xFF0, buf, sizeof(buf), &done ) == STATUS_PARTIAL_COPY && done == 0x10 );
+    CHECK( mem.Read( page + 0xFE0, buf, sizeof(buf) ) == STATUS_SUCCESS && buf[0] == 0 && buf[0x1F] == 0x5A );
+
+    DWORD old = 0;
+    CHECK( mem.Protect( page, 0x1000, PAGE_NOACCESS, &old ) == STATUS_SUCCESS && old == PAGE_READWRITE );
+    CHECK( mem.Read( page, buf, 1 ) == STATUS_PARTIAL_COPY );
+    CHECK( mem.Protect( address, 0x2000, PAGE_READONLY ) == STATUS_NOT_COMMITTED );
+
+    ptr_t conflict = address + 0x2000;
+    CHECK( mem.Allocate( conflict, 0x1000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE ) == STATUS_CONFLICTING_ADDRESSES );
+
+    // Decommitted page is zeroed
+    CHECK( mem.Free( page, 0x1000, MEM_DECOMMIT ) == STATUS_SUCCESS );
+    CHECK( mem.Allocate( page, 0x1000, MEM_COMMIT, PAGE_READWRITE ) == STATUS_SUCCESS );
+    CHECK( mem.Read( page + 0xFF0, buf, 0x10 ) == STATUS_SUCCESS && buf[0] == 0 );
+
+    CHECK( mem.Free( page, 0, MEM_RELEASE ) == STATUS_FREE_VM_NOT_AT_BASE );
+    CHECK( mem.Free( address, 0, MEM_RELEASE ) == STATUS_SUCCESS );
+    CHECK( mem.Query( address, mbi ) == STATUS_SUCCESS && mbi.State == MEM_FREE );
+
+    // Sweep covers whole address space without gaps
+    RegionMap map( mem.minAddr(), mem.maxAddr(), [&mem]( ptr_t addr, MEMORY_BASIC_INFORMATION64& info )
+    {
+        return mem.Query( addr, info );
+    } );
+
+    RegionMap::vecRegions regions;
+    CHECK( map.Enum( mem.minAddr(), mem.maxAddr(), regions ) == STATUS_SUCCESS && !regions.empty() );
+
+    ptr_t expected = mem.minAddr();
+    for (auto& region : regions)
+    {
+        CHECK( region.BaseAddress == expected );
+        expected = region.BaseAddress + region.RegionSize;
+    }
+
+    CHECK( expected == mem.maxAddr() );
+
+    // Latency and counters
+    mem.ResetCounters();
+    mem.SetLatency( sim_read, 200000 );
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < 5; i++)
+        mem.Read( mem.peb(), buf, sizeof(buf) );
+
+    auto elapsed = std::chrono::high_resolution_clock::now() - start;
+    CHECK( elapsed >= std::chrono::microseconds( 1000 ) );
+    CHECK( mem.calls( sim_read ) == 5 && mem.calls( sim_query ) == 0 );
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "../BlackBone/PEParser.h"
+#include "../BlackBone/PEView.h"
+#include "../BlackBone/FileProjection.h"
+#include "../BlackBone/RelocationPlan.h"
+#include "../BlackBone/PatternSearch.h"
+#include "../BlackBone/LDasm.h"
+#include "../BlackBone/Macro.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace blackbone;
+
+// Number of failed checks
+extern int g_failed;
+
+#define CHECK(expr) \
+    do { if (!(expr)) { std::cout << __FILE__ << "(" << __LINE__ << "): check failed: " #expr "\n"; g_failed++; } } while (0)
+
+// Image built by test, in both file and memory layout
+struct TestImage
+{
+    std::vector<uint8_t> file;      // Raw file
+    std::vector<uint8_t> mapped;    // Image laid out by RVA
+    ptr_t imageBase = 0;            // Preferred image base
+};
+
+TestImage BuildTestImage( bool is64, bool pageAligned = false );
+
+void TestPEParser();
+void TestPEView();
+void TestRelocations();
+void TestFileProjection();
+void TestImageNET();
+void TestPageCache();
+void TestRegionMap();
+void TestMinidump();
+void TestSimulatedMemory();
+void TestPatternSearch();
+void TestLDasm();
@@ -1,5 +1,99 @@
 #include "Tests.h"
 
+/*
+    Change one byte of file, keeping its size and last write time
+*/
+static bool PatchKeepTime( const std::wstring& path, LONG offset )
+{
+    HANDLE hFile = CreateFileW( path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL );
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    FILETIME time = { 0 };
+    uint8_t val = 0;
+    DWORD bytes = 0;
+
+    bool ok = GetFileTime( hFile, NULL, NULL, &time ) != FALSE
+           && SetFilePointer( hFile, offset, NULL, FILE_BEGIN ) != INVALID_SET_FILE_POINTER
+           && ReadFile( hFile, &val, sizeof(val), &bytes, NULL ) && bytes == sizeof(val);
+
+    val ^= 0xFF;
+
+    ok = ok && SetFilePointer( hFile, offset, NULL, FILE_BEGIN ) != INVALID_SET_FILE_POINTER
+            && WriteFile( hFile, &val, sizeof(val), &bytes, NULL ) && bytes == sizeof(val)
+            && SetFileTime( hFile, NULL, NULL, &time );
+
+    CloseHandle( hFile );
+    return ok;
+}
+
+/*
+    Map copy of a system DLL twice with image cache enabled,
+    then check that entry is dropped when file content changes
+*/
+void TestImageCache( Process& proc )
+{
+    wchar_t sysDir[MAX_PATH] = { 0 }, full[MAX_PATH] = { 0 };
+    GetSystemDirectoryW( sysDir, MAX_PATH );
+
+    GetFullPathNameW( L"TestApp.tmp.dll", MAX_PATH, full, NULL );
+    std::wstring dllPath = full;
+
+    GetFullPathNameW( L"TestApp.cache", MAX_PATH, full, NULL );
+    std::wstring cacheDir = full;
+
+    std::wcout << L"Image cache test\n";
+
+    if (!CopyFileW( (std::wstring( sysDir ) + L"\\version.dll").c_str(), dllPath.c_str(), FALSE ))
+    {
+        std::wcout << L"Failed to copy version.dll" << std::endl << std::endl;
+        return;
+    }
+
+    auto& cache = proc.mmap().imageCache();
+    cache.SetDirectory( cacheDir );
+
+    // First mapping creates entry, second one uses it
+    bool mapped = proc.mmap().MapImage( dllPath, NoDelayLoad ) != nullptr;
+    proc.mmap().UnmapAllModules();
+
+    bool stored = cache.Lookup( dllPath ) != nullptr;
+    bool remapped = proc.mmap().MapImage( dllPath, NoDelayLoad ) != nullptr;
+    proc.mmap().UnmapAllModules();
+
+    // Section data is changed, size and write time are the same
+    WIN32_FILE_ATTRIBUTE_DATA info = { 0 };
+    GetFileAttributesExW( dllPath.c_str(), GetFileExInfoStandard, &info );
+    LONG offset = static_cast<LONG>(info.nFileSizeLow / 2);
+
+    bool patched = PatchKeepTime( dllPath, offset );
+    bool invalidated = patched && cache.Lookup( dllPath ) == nullptr;
+
+    // Original content matches entry again
+    bool restored = PatchKeepTime( dllPath, offset ) && cache.Lookup( dllPath ) != nullptr;
+
+    cache.SetDirectory( L"" );
+    DeleteFileW( dllPath.c_str() );
+
+    WIN32_FIND_DATAW fd = { 0 };
+    HANDLE hFind = FindFirstFileW( (cacheDir + L"\\*.bbic").c_str(), &fd );
+    if (hFind != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            DeleteFileW( (cacheDir + L"\\" + fd.cFileName).c_str() );
+        } while (FindNextFileW( hFind, &fd ));
+
+        FindClose( hFind );
+    }
+
+    RemoveDirectoryW( cacheDir.c_str() );
+
+    std::wcout << L"Mapped " << (mapped ? L"OK" : L"FAILED")
+               << L". Cache hit " << (stored && remapped ? L"OK" : L"FAILED")
+               << L". Invalidation " << (invalidated && restored ? L"OK" : L"FAILED") << std::endl << std::endl;
+}
+
 
 /*
     Try to map calc.exe into current process
@@ -23,4 +117,6 @@ void TestMMap()
         std::wcout << L"Successfully mapped, unmapping\n";
 
     thisProc.mmap().UnmapAllModules();
+
+    TestImageCache( thisProc );
 }
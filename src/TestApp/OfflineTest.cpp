@@ -0,0 +1,279 @@
+#include "Tests.h"
+#include "../BlackBone/MinidumpNative.h"
+#include "../BlackBone/SimulatedNative.h"
+#include "../BlackBone/PointerMap.h"
+
+#include <memory>
+#include <fstream>
+#include <iterator>
+#include <DbgHelp.h>
+
+/*
+    Dump current process and resolve export from the dump
+*/
+void TestMinidump()
+{
+    const wchar_t* path = L"TestApp.tmp.dmp";
+
+    std::wcout << L"Minidump test\n";
+
+    auto pWrite = reinterpret_cast<decltype(&MiniDumpWriteDump)>(
+        GetProcAddress( LoadLibraryW( L"dbghelp.dll" ), "MiniDumpWriteDump" ));
+
+    HANDLE hFile = CreateFileW( path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+    if (pWrite == nullptr || hFile == INVALID_HANDLE_VALUE)
+    {
+        std::wcout << L"Failed to create dump file" << std::endl << std::endl;
+        return;
+    }
+
+    BOOL written = pWrite( GetCurrentProcess(), GetCurrentProcessId(), hFile, MiniDumpWithFullMemory, NULL, NULL, NULL );
+    CloseHandle( hFile );
+
+    std::unique_ptr<MinidumpNative> dump( new MinidumpNative() );
+    if (!written || dump->Open( path ) != STATUS_SUCCESS)
+    {
+        std::wcout << L"Failed to open dump file" << std::endl << std::endl;
+        DeleteFileW( path );
+        return;
+    }
+
+    {
+        Process offline;
+        offline.Attach( std::move( dump ) );
+
+        exportData exp;
+        auto expected = reinterpret_cast<ptr_t>(GetProcAddress( GetModuleHandleW( L"kernel32.dll" ), "LoadLibraryW" ));
+        auto pMod = offline.modules().GetModule( L"kernel32.dll" );
+        if (pMod != nullptr)
+            exp = offline.modules().GetExport( pMod, "LoadLibraryW" );
+
+        std::wcout << L"kernel32.dll " << (pMod != nullptr ? L"found" : L"NOT FOUND")
+                   << L". LoadLibraryW 0x" << std::hex << exp.procAddress
+                   << (exp.procAddress == expected ? L"" : L". ADDRESS MISMATCH")
+                   << L". Threads " << std::dec << offline.threads().getAll().size() << std::endl << std::endl;
+    }
+
+    DeleteFileW( path );
+}
+
+/*
+    Load kernel32 into simulated process, resolve export and search planted data
+*/
+void TestSimulatedProcess()
+{
+    wchar_t path[MAX_PATH] = { 0 };
+    HMODULE hKernel32 = GetModuleHandleW( L"kernel32.dll" );
+    GetModuleFileNameW( hKernel32, path, MAX_PATH );
+
+    std::wcout << L"Simulated process test\n";
+
+    std::unique_ptr<SimulatedNative> sim( new SimulatedNative( sizeof(void*) == sizeof(uint64_t) ) );
+    ptr_t base = 0;
+
+    if (sim->memory().LoadImage( path, base ) != STATUS_SUCCESS)
+    {
+        std::wcout << L"Failed to load " << path << std::endl << std::endl;
+        return;
+    }
+
+    const uint8_t marker[] = { 0xDE, 0xC0, 0xAD, 0x0B, 0x5E, 0xA5, 0x1D, 0xE0 };
+    ptr_t data = 0;
+    sim->memory().Allocate( data, 0x10000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+    sim->memory().Write( data + 0x1234, marker, sizeof(marker) );
+
+    Process proc;
+    proc.Attach( std::move( sim ) );
+
+    exportData exp;
+    auto pMod = proc.modules().GetModule( L"kernel32.dll" );
+    if (pMod != nullptr)
+        exp = proc.modules().GetExport( pMod, "LoadLibraryW" );
+
+    auto expected = reinterpret_cast<ptr_t>(GetProcAddress( hKernel32, "LoadLibraryW" )) - reinterpret_cast<ptr_t>(hKernel32) + base;
+
+    std::vector<ptr_t> found;
+    PatternSearch( marker, sizeof(marker) ).SearchRemoteWhole( proc, false, 0, found );
+
+    std::wcout << L"kernel32.dll " << (pMod != nullptr && pMod->baseAddress == base ? L"found" : L"NOT FOUND")
+               << L". LoadLibraryW 0x" << std::hex << exp.procAddress
+               << (exp.procAddress == expected ? L"" : L". ADDRESS MISMATCH")
+               << L". Marker " << ((found.size() == 1 && found[0] == data + 0x1234) ? L"found" : L"NOT FOUND")
+               << std::endl << std::endl;
+}
+
+/*
+    Span merging, 64 KB cap, unreadable pages, worker threads and page cache of batched read
+*/
+void TestReadBatch()
+{
+    const size_t pageSize = 0x1000;
+    const size_t regionSize = 0x400000;
+
+    std::wcout << L"Batched read test\n";
+
+    std::unique_ptr<SimulatedNative> sim( new SimulatedNative( sizeof(void*) == sizeof(uint64_t) ) );
+    auto& mem = sim->memory();
+
+    std::vector<uint8_t> data( regionSize );
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = static_cast<uint8_t>(i * 7 + i / pageSize);
+
+    ptr_t base = 0;
+    mem.Allocate( base, regionSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+    mem.Write( base, data.data(), data.size() );
+    mem.Protect( base + 0x21000, pageSize, PAGE_NOACCESS );
+
+    Process proc;
+    proc.Attach( std::move( sim ) );
+
+    std::vector<std::vector<uint8_t>> buffers;
+    std::vector<ReadRequest> requests;
+    bool ok = true;
+
+    // Read batch and compare every readable request with source data
+    auto run = [&]( std::vector<std::pair<size_t, size_t>> ranges, uint64_t expectedReads, const wchar_t* name )
+    {
+        buffers.assign( ranges.size(), std::vector<uint8_t>() );
+        requests.clear();
+
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            buffers[i].resize( ranges[i].second );
+            requests.emplace_back( base + ranges[i].first, ranges[i].second, buffers[i].data() );
+        }
+
+        mem.ResetCounters();
+        proc.memory().ReadBatch( requests );
+
+        bool valid = true;
+        for (size_t i = 0; i < ranges.size(); i++)
+        {
+            bool readable = ranges[i].first + ranges[i].second <= 0x21000 || ranges[i].first >= 0x22000;
+            if (readable != (requests[i].status == STATUS_SUCCESS))
+                valid = false;
+            else if (readable && memcmp( buffers[i].data(), &data[ranges[i].first], ranges[i].second ) != 0)
+                valid = false;
+        }
+
+        if (mem.calls( sim_read ) != expectedReads)
+            valid = false;
+
+        std::wcout << name << L": " << std::dec << mem.calls( sim_read ) << L" reads" << (valid ? L"" : L". FAILED") << std::endl;
+        ok = ok && valid;
+    };
+
+    // Requests sharing or touching pages are read at once
+    run( { { 0x10, 0x20 }, { 0x1010, 0x10 }, { 0x1FF0, 0x20 } }, 1, L"Adjacent" );
+
+    // Adjacent pages are merged up to 64 KB
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t i = 0; i < 20; i++)
+        ranges.emplace_back( i * pageSize, 1 );
+
+    run( ranges, 2, L"Capped" );
+
+    // Overlapping requests grow span past the cap, it is still read by 64 KB pieces
+    run( { { 0x300000, 0x30000 - 0x100 }, { 0x300100, 0x30000 } }, 4, L"Overlapped" );
+
+    // Span fails, then only requests touching unreadable page fail
+    run( { { 0x20F00, 0x100 }, { 0x20FF0, 0x20 }, { 0x22000, 0x10 } }, 4, L"Unreadable" );
+
+    // Enough spans for worker threads
+    ranges.clear();
+    for (size_t i = 0; i < 256; i++)
+        ranges.emplace_back( 0x40000 + i * 2 * pageSize + i, 0x100 );
+
+    run( ranges, 256, L"Threaded" );
+
+    // Cached pages aren't read again
+    proc.memory().cache().SetCapacity( 1024 );
+    run( { { 0x10, 0x20 }, { 0x3010, 0x10 } }, 2, L"Cache cold" );
+    run( { { 0x10, 0x20 }, { 0x3010, 0x10 } }, 0, L"Cache warm" );
+    proc.memory().cache().SetCapacity( 0 );
+
+    std::wcout << (ok ? L"Batched read OK" : L"Batched read FAILED") << std::endl << std::endl;
+}
+
+/*
+    Build pointer map of simulated process, save it, load it back and find planted pointer path
+*/
+void TestPointerMap()
+{
+    const wchar_t* mapPath = L"TestApp.tmp.pmap";
+    wchar_t path[MAX_PATH] = { 0 };
+    GetModuleFileNameW( GetModuleHandleW( L"kernel32.dll" ), path, MAX_PATH );
+
+    std::wcout << L"Pointer map test\n";
+
+    std::unique_ptr<SimulatedNative> sim( new SimulatedNative( sizeof(void*) == sizeof(uint64_t) ) );
+    auto& mem = sim->memory();
+    ptr_t base = 0, heap = 0;
+
+    if (mem.LoadImage( path, base ) != STATUS_SUCCESS)
+    {
+        std::wcout << L"Failed to load " << path << std::endl << std::endl;
+        return;
+    }
+
+    // [[kernel32 + 0x800] + 0x10] + 0x20 -> target
+    mem.Allocate( heap, 0x10000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+    ptr_t first = heap, second = heap + 0x8000;
+    ptr_t target = second + 0x20;
+
+    mem.Write( base + 0x800, &first, sizeof(void*) );
+    mem.Write( heap + 0x10, &second, sizeof(void*) );
+
+    Process proc;
+    proc.Attach( std::move( sim ) );
+
+    // Find planted path and resolve it in the process
+    auto check = [&]( const PointerMap& map )
+    {
+        std::vector<PointerPath> paths;
+        map.FindPaths( target, 2, 0x100, paths );
+
+        for (auto& p : paths)
+        {
+            ptr_t resolved = 0;
+            if (_wcsicmp( p.module.c_str(), L"kernel32.dll" ) == 0 && p.moduleOffset == 0x800 &&
+                 p.offsets.size() == 2 && p.offsets[0] == 0x10 && p.offsets[1] == 0x20)
+            {
+                return PointerMap::Resolve( proc, p, resolved ) == STATUS_SUCCESS && resolved == target;
+            }
+        }
+
+        return false;
+    };
+
+    PointerMap built, loaded;
+    bool ok = built.Build( proc ) == STATUS_SUCCESS && check( built );
+    ok = ok && built.Save( mapPath ) == STATUS_SUCCESS;
+    ok = ok && loaded.Load( mapPath ) == STATUS_SUCCESS && check( loaded );
+    ok = ok && loaded.size() == built.size() && loaded.ptrSize() == built.ptrSize() &&
+         loaded.modules().size() == built.modules().size();
+
+    // Entry count past the end of file must be rejected before allocation
+    std::vector<char> bytes;
+    {
+        std::ifstream in( mapPath, std::ios::binary );
+        bytes.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() );
+    }
+
+    size_t countOffset = bytes.size() - built.size() * sizeof(PointerMap::Entry) - sizeof(uint64_t);
+    uint64_t badCount = built.size() + 1;
+    memcpy( &bytes[countOffset], &badCount, sizeof(badCount) );
+    std::ofstream( mapPath, std::ios::binary | std::ios::trunc ).write( bytes.data(), bytes.size() );
+
+    ok = ok && loaded.Load( mapPath ) == STATUS_FILE_CORRUPT_ERROR && loaded.size() == 0;
+
+    badCount = 1ull << 60;
+    memcpy( &bytes[countOffset], &badCount, sizeof(badCount) );
+    std::ofstream( mapPath, std::ios::binary | std::ios::trunc ).write( bytes.data(), bytes.size() );
+
+    ok = ok && loaded.Load( mapPath ) == STATUS_FILE_CORRUPT_ERROR && loaded.size() == 0;
+
+    DeleteFileW( mapPath );
+
+    std::wcout << L"Pointers " << std::dec << built.size() << (ok ? L". Pointer map OK" : L". Pointer map FAILED") << std::endl << std::endl;
+}
@@ -0,0 +1,45 @@
+#include "Tests.h"
+
+#include <random>
+
+/*
+    Compare wildcard search kernels on random data.
+    Throughput is measured by PatternBench
+*/
+void TestPatternSearch()
+{
+    const size_t bufSize = 4 * 1024 * 1024;
+    const wchar_t* names[] = { L"Scalar", L"SSE2", L"AVX2" };
+
+    // 48 8B ?? ?? E8 ?? ?? ?? ?? 85 C0
+    uint8_t pattern[] = { 0x48, 0x8B, 0xCC, 0xCC, 0xE8, 0xCC, 0xCC, 0xCC, 0xCC, 0x85, 0xC0 };
+
+    std::wcout << L"Pattern search test\n";
+
+    std::vector<uint8_t> buf( bufSize );
+    std::mt19937 rng( 0 );
+    for (auto& val : buf)
+        val = static_cast<uint8_t>(rng());
+
+    // Plant some matches
+    for (size_t i = 0; i < 1000; i++)
+        memcpy( &buf[rng() % (bufSize - sizeof(pattern))], pattern, sizeof(pattern) );
+
+    PatternSearch ps( pattern, sizeof(pattern) );
+    std::vector<ptr_t> reference;
+
+    for (int level = simd_none; level <= PatternSearch::SupportedSimd(); level++)
+    {
+        std::vector<ptr_t> found;
+        ps.simd( static_cast<eSimdLevel>(level) );
+        ps.Search( 0xCC, buf.data(), buf.size(), found );
+
+        if (level == simd_none)
+            reference = found;
+
+        std::wcout << names[level] << L": " << found.size() << L" matches"
+                   << (found == reference ? L"" : L". RESULT MISMATCH") << std::endl;
+    }
+
+    std::wcout << std::endl;
+}
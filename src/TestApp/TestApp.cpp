@@ -47,6 +47,12 @@ int wmain( int /*argc*/, wchar_t* /*argv*/[] )
     TestRemoteCall();
     //TestRemoteHook();
     TestMMap();
+    TestPatternSearch();
+    TestValueScanner();
+    TestMinidump();
+    TestSimulatedProcess();
+    TestReadBatch();
+    TestPointerMap();
 
 	return 0;
 }
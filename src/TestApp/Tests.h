@@ -2,6 +2,7 @@
 
 #include "../BlackBone/Process.h"
 #include "../BlackBone/PatternSearch.h"
+#include "../BlackBone/ValueScanner.h"
 #include "../BlackBone/PEParser.h"
 #include "../BlackBone/RemoteFunction.hpp"
 #include "../BlackBone/Utils.h"
@@ -14,4 +15,10 @@ using namespace blackbone;
 void TestLocalHook();
 void TestRemoteHook();
 void TestMMap();
-void TestRemoteCall();
\ No newline at end of file
+void TestRemoteCall();
+void TestPatternSearch();
+void TestValueScanner();
+void TestMinidump();
+void TestSimulatedProcess();
+void TestReadBatch();
+void TestPointerMap();
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "Tests.h"
+#include "../BlackBone/SimulatedNative.h"
+
+#include <memory>
+
+/*
+    Sparse hits are re-read one by one, unreadable page drops only its own hits
+*/
+void TestValueScannerSparse()
+{
+    const int32_t marker = 0x1F2E3D4C;
+    const size_t offsets[] = { 0x1000, 0x50000, 0x90000 };
+
+    std::unique_ptr<SimulatedNative> sim( new SimulatedNative( sizeof(void*) == sizeof(uint64_t) ) );
+    auto& mem = sim->memory();
+
+    ptr_t base = 0;
+    mem.Allocate( base, 0x100000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+    for (auto ofst : offsets)
+        mem.Write( base + ofst, &marker, sizeof(marker) );
+
+    Process proc;
+    proc.Attach( std::move( sim ) );
+
+    ValueScanner<int32_t> scanner( proc );
+    scanner.FirstScan( scan_exact, marker );
+    size_t first = scanner.count();
+
+    // Window read fails, then each page with hits is read separately
+    mem.Protect( base + offsets[1], 0x1000, PAGE_NOACCESS );
+    mem.ResetCounters();
+    scanner.NextScan( scan_unchanged );
+
+    std::vector<ValueScanner<int32_t>::Result> results;
+    scanner.GetResults( results );
+
+    bool valid = first == 3 && results.size() == 2 && mem.calls( sim_read ) == 4 &&
+                 results[0].first == base + offsets[0] && results[1].first == base + offsets[2];
+
+    std::wcout << L"Sparse rescan: " << std::dec << mem.calls( sim_read ) << L" reads, "
+               << results.size() << L" results" << (valid ? L"" : L". FAILED") << std::endl << std::endl;
+}
+
+/*
+    Narrow down address of a heap variable in current process
+*/
+void TestValueScanner()
+{
+    Process thisProc;
+    thisProc.Attach( GetCurrentProcessId() );
+
+    std::wcout << L"Value scanner test\n";
+
+    std::unique_ptr<int32_t> value( new int32_t( 0x1F2E3D4C ) );
+    ValueScanner<int32_t> scanner( thisProc );
+
+    scanner.FirstScan( scan_exact, *value );
+    std::wcout << L"First scan: " << std::dec << scanner.count() << L" results" << std::endl;
+
+    *value += 5;
+    scanner.NextScan( scan_increased );
+    std::wcout << L"Increased: " << scanner.count() << L" results" << std::endl;
+
+    scanner.NextScan( scan_unchanged );
+
+    std::vector<ValueScanner<int32_t>::Result> results;
+    scanner.GetResults( results );
+
+    bool found = false;
+    for (auto& res : results)
+        if (res.first == reinterpret_cast<ptr_t>(value.get()))
+            found = true;
+
+    std::wcout << L"Unchanged: " << scanner.count() << L" results. Variable "
+               << (found ? L"found" : L"NOT FOUND") << std::endl << std::endl;
+
+    TestValueScannerSparse();
+}